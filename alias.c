@@ -23,98 +23,1019 @@
  */
 
 #include "alias.h"
+#include "hide.h"
+#include "shard.h"
 
-static pool *alias_pool = NULL;
-static pr_table_t *alias_tab = NULL;
+/* Aliases with configured attributes; there are expected to be few of these,
+ * hence the simple list, kept in the context.
+ */
+struct alias_attrs_entry {
+  const char *dst_path;
+  const char *src_path;
+  size_t src_pathlen;
+  struct vroot_alias_attrs *attrs;
+};
 
-unsigned int vroot_alias_count(void) {
+/* Aliases whose destination name is a pattern, using "*" and "?" wildcards,
+ * grouped by destination directory.  The patterns of a directory are also
+ * compiled into a single matcher, so that names matching none of them are
+ * rejected in one pass.
+ */
+struct alias_pattern {
+  const char *name_pattern;
+  const char *src_template;
+  unsigned int ncaptures;
+};
+
+struct alias_pattern_dir {
+  const char *dir_path;
+  size_t dir_pathlen;
+  array_header *patterns;
+  struct vroot_hide *matcher;
+};
+
+/* Maximum number of wildcards, i.e. "$N" references, per pattern. */
+#define VROOT_ALIAS_MAX_CAPTURES		9
+
+#define VROOT_ALIAS_MAX_PREFETCH_THREADS	32
+#define VROOT_ALIAS_MAX_PREFETCH_WINDOW		65536
+#define VROOT_ALIAS_DEFAULT_PREFETCH_WINDOW	256
+#define VROOT_ALIAS_MAX_READAHEAD_FILES		256
+#define VROOT_ALIAS_DEFAULT_READAHEAD_BYTES	(64 * 1024 * 1024)
+#define VROOT_ALIAS_MAX_METADATA_RATE		1000000
+
+static const char *trace_channel = "vroot.alias";
+
+unsigned int vroot_alias_ctx_count(const struct vroot_ctx *ctx) {
   int count;
 
-  count = pr_table_count(alias_tab);
-  if (count < 0) {
+  if (ctx == NULL) {
     return 0;
   }
 
-  return count;
+  count = pr_table_count(ctx->alias_tab);
+  if (count < 0) {
+    return ctx->alias_pattern_count;
+  }
+
+  return count + ctx->alias_pattern_count;
 }
 
-int vroot_alias_do(int cb(const void *key_data, size_t key_datasz,
-    const void *value_data, size_t value_datasz, void *user_data),
-    void *user_data) {
+unsigned int vroot_alias_count(void) {
+  return vroot_alias_ctx_count(vroot_ctx_get_default());
+}
+
+int vroot_alias_ctx_do(const struct vroot_ctx *ctx,
+    int cb(const void *key_data, size_t key_datasz, const void *value_data,
+    size_t value_datasz, void *user_data), void *user_data) {
   int res;
 
-  if (cb == NULL) {
+  if (ctx == NULL ||
+      cb == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  res = pr_table_do(alias_tab, cb, user_data, PR_TABLE_DO_FL_ALL);
+  res = pr_table_do(ctx->alias_tab, cb, user_data, PR_TABLE_DO_FL_ALL);
   return res;
 }
 
-int vroot_alias_exists(const char *path) {
+int vroot_alias_do(int cb(const void *key_data, size_t key_datasz,
+    const void *value_data, size_t value_datasz, void *user_data),
+    void *user_data) {
+  return vroot_alias_ctx_do(vroot_ctx_get_default(), cb, user_data);
+}
+
+int vroot_alias_ctx_exists(const struct vroot_ctx *ctx, const char *path) {
   const void *v;
 
-  if (path == NULL) {
+  if (ctx == NULL ||
+      path == NULL) {
     return FALSE;
   }
 
-  v = pr_table_get(alias_tab, path, 0);
+  v = pr_table_get(ctx->alias_tab, path, 0);
   if (v != NULL) {
     return TRUE;
   }
 
+  if (ctx->alias_pattern_count > 0) {
+    char src_path[PR_TUNABLE_PATH_MAX + 1];
+
+    if (vroot_alias_ctx_match(ctx, path, src_path, sizeof(src_path)) == 0) {
+      return TRUE;
+    }
+  }
+
   return FALSE;
 }
 
-const char *vroot_alias_get(const char *path) {
+int vroot_alias_exists(const char *path) {
+  return vroot_alias_ctx_exists(vroot_ctx_get_default(), path);
+}
+
+const char *vroot_alias_ctx_get(const struct vroot_ctx *ctx,
+    const char *path) {
   const void *v;
 
-  if (path == NULL) {
+  if (ctx == NULL ||
+      path == NULL) {
     errno = EINVAL;
     return NULL;
   }
 
-  v = pr_table_get(alias_tab, path, NULL);
+  v = pr_table_get(ctx->alias_tab, path, NULL);
   return v;
 }
 
-int vroot_alias_add(const char *dst_path, const char *src_path) {
+const char *vroot_alias_get(const char *path) {
+  return vroot_alias_ctx_get(vroot_ctx_get_default(), path);
+}
+
+/* Matches the given name against the given pattern, noting the text matched
+ * by each wildcard.  Stars match as much as possible.
+ */
+static int pattern_match(const char *pattern, const char *name,
+    const char **caps, size_t *caplens) {
+  while (*pattern != '\0') {
+    if (*pattern == '*') {
+      size_t len;
+
+      len = strlen(name);
+      while (TRUE) {
+        caps[0] = name;
+        caplens[0] = len;
+
+        if (pattern_match(pattern + 1, name + len, caps + 1,
+            caplens + 1) == TRUE) {
+          return TRUE;
+        }
+
+        if (len == 0) {
+          return FALSE;
+        }
+
+        len--;
+      }
+    }
+
+    if (*name == '\0') {
+      return FALSE;
+    }
+
+    if (*pattern == '?') {
+      caps[0] = name;
+      caplens[0] = 1;
+      caps++;
+      caplens++;
+
+    } else if (*pattern != *name) {
+      return FALSE;
+    }
+
+    pattern++;
+    name++;
+  }
+
+  return (*name == '\0');
+}
+
+/* Expands the "$N" references of the given source template. */
+static int pattern_expand(const char *src_template, const char **caps,
+    const size_t *caplens, char *src_path, size_t src_pathsz) {
+  const char *ptr;
+  size_t len = 0;
+
+  for (ptr = src_template; *ptr != '\0'; ptr++) {
+    const char *text = ptr;
+    size_t textlen = 1;
+
+    if (ptr[0] == '$' &&
+        ptr[1] >= '1' &&
+        ptr[1] <= '9') {
+      unsigned int idx;
+
+      idx = ptr[1] - '1';
+      text = caps[idx];
+      textlen = caplens[idx];
+      ptr++;
+    }
+
+    if (len + textlen >= src_pathsz) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+
+    memcpy(src_path + len, text, textlen);
+    len += textlen;
+  }
+
+  src_path[len] = '\0';
+  return 0;
+}
+
+/* Checks that the text matched by each wildcard is a usable name part: not
+ * empty, ".", or "..", and without any '/'.
+ */
+static int pattern_check_captures(const char **caps, const size_t *caplens,
+    unsigned int ncaptures) {
+  register unsigned int i;
+
+  for (i = 0; i < ncaptures; i++) {
+    if (caplens[i] == 0 ||
+        (caplens[i] == 1 && caps[i][0] == '.') ||
+        (caplens[i] == 2 && caps[i][0] == '.' && caps[i][1] == '.') ||
+        memchr(caps[i], '/', caplens[i]) != NULL) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Checks that the given expanded source path has no "." or ".."
+ * components, e.g. from several wildcards expanded next to each other.
+ */
+static int pattern_check_path(const char *path) {
+  const char *ptr;
+
+  for (ptr = path; *ptr != '\0'; ptr++) {
+    if (ptr[0] == '/' &&
+        ptr[1] == '.' &&
+        (ptr[2] == '/' || ptr[2] == '\0' ||
+         (ptr[2] == '.' && (ptr[3] == '/' || ptr[3] == '\0')))) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static struct alias_pattern_dir *pattern_dir_get(const struct vroot_ctx *ctx,
+    const char *dir_path, size_t dir_pathlen) {
+  register unsigned int i;
+  struct alias_pattern_dir **dirs;
+
+  if (ctx->alias_pattern_dirs == NULL) {
+    return NULL;
+  }
+
+  dirs = ctx->alias_pattern_dirs->elts;
+  for (i = 0; i < ctx->alias_pattern_dirs->nelts; i++) {
+    if (dirs[i]->dir_pathlen == dir_pathlen &&
+        strncmp(dirs[i]->dir_path, dir_path, dir_pathlen) == 0) {
+      return dirs[i];
+    }
+  }
+
+  return NULL;
+}
+
+static int alias_is_pattern(const char *dst_path) {
+  const char *name;
+
+  name = strrchr(dst_path, '/');
+  if (name == NULL) {
+    name = dst_path;
+  }
+
+  return (strpbrk(name, "*?") != NULL);
+}
+
+static int alias_pattern_add(struct vroot_ctx *ctx, const char *dst_path,
+    const char *src_path) {
+  register unsigned int i;
+  const char *name, *ptr;
+  struct alias_pattern_dir *dir;
+  struct alias_pattern *pattern;
+  array_header *matcher_patterns;
+  struct vroot_hide *matcher;
+  unsigned int ncaptures = 0;
+  size_t dir_pathlen;
+
+  name = strrchr(dst_path, '/');
+  if (name == NULL ||
+      *src_path != '/') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  dir_pathlen = name - dst_path;
+  name++;
+
+  for (ptr = name; *ptr != '\0'; ptr++) {
+    if (*ptr == '*' ||
+        *ptr == '?') {
+      ncaptures++;
+    }
+  }
+
+  /* The source may only refer to the wildcards of the pattern. */
+  for (ptr = src_path; *ptr != '\0'; ptr++) {
+    if (ptr[0] == '$' &&
+        ptr[1] >= '1' &&
+        ptr[1] <= '9' &&
+        (unsigned int) (ptr[1] - '0') > ncaptures) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  if (ncaptures > VROOT_ALIAS_MAX_CAPTURES) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  dir = pattern_dir_get(ctx, dst_path, dir_pathlen);
+  if (dir == NULL) {
+    if (ctx->alias_pattern_dirs == NULL) {
+      ctx->alias_pattern_dirs = make_array(ctx->ctx_pool, 1,
+        sizeof(struct alias_pattern_dir *));
+    }
+
+    dir = pcalloc(ctx->ctx_pool, sizeof(struct alias_pattern_dir));
+    dir->dir_path = pstrndup(ctx->ctx_pool, dst_path, dir_pathlen);
+    dir->dir_pathlen = dir_pathlen;
+    dir->patterns = make_array(ctx->ctx_pool, 1,
+      sizeof(struct alias_pattern));
+
+    *((struct alias_pattern_dir **) push_array(ctx->alias_pattern_dirs)) = dir;
+
+  } else {
+    struct alias_pattern *patterns;
+
+    patterns = dir->patterns->elts;
+    for (i = 0; i < dir->patterns->nelts; i++) {
+      if (strcmp(patterns[i].name_pattern, name) == 0) {
+        errno = EEXIST;
+        return -1;
+      }
+    }
+  }
+
+  /* The matcher treats brackets and backslashes specially; these are
+   * literal in alias patterns.
+   */
+  matcher_patterns = make_array(ctx->ctx_pool, dir->patterns->nelts + 1,
+    sizeof(char *));
+  for (i = 0; i <= dir->patterns->nelts; i++) {
+    const char *text;
+    char *escaped, *dst;
+
+    text = (i < dir->patterns->nelts ?
+      ((struct alias_pattern *) dir->patterns->elts)[i].name_pattern : name);
+
+    escaped = dst = palloc(ctx->ctx_pool, (strlen(text) * 2) + 1);
+    for (ptr = text; *ptr != '\0'; ptr++) {
+      if (*ptr == '[' ||
+          *ptr == '\\') {
+        *dst++ = '\\';
+      }
+
+      *dst++ = *ptr;
+    }
+    *dst = '\0';
+
+    *((char **) push_array(matcher_patterns)) = escaped;
+  }
+
+  matcher = vroot_hide_compile(ctx->ctx_pool, matcher_patterns, 0);
+  if (matcher == NULL) {
+    return -1;
+  }
+
+  pattern = push_array(dir->patterns);
+  pattern->name_pattern = pstrdup(ctx->ctx_pool, name);
+  pattern->src_template = pstrdup(ctx->ctx_pool, src_path);
+  pattern->ncaptures = ncaptures;
+
+  dir->matcher = matcher;
+  ctx->alias_pattern_count++;
+
+  pr_trace_msg(trace_channel, 15,
+    "added pattern alias '%s' (%u %s) in '%s' for '%s'", name, ncaptures,
+    ncaptures != 1 ? "wildcards" : "wildcard", dir->dir_path, src_path);
+
+  return 0;
+}
+
+int vroot_alias_ctx_match(const struct vroot_ctx *ctx, const char *dst_path,
+    char *src_path, size_t src_pathsz) {
+  register unsigned int i;
+  const char *name;
+  struct alias_pattern_dir *dir;
+  struct alias_pattern *patterns;
+
+  if (ctx == NULL ||
+      dst_path == NULL ||
+      src_path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (ctx->alias_pattern_count == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  name = strrchr(dst_path, '/');
+  if (name == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  dir = pattern_dir_get(ctx, dst_path, name - dst_path);
+  name++;
+
+  if (dir == NULL ||
+      *name == '\0' ||
+      strcmp(name, ".") == 0 ||
+      strcmp(name, "..") == 0 ||
+      vroot_hide_match(dir->matcher, name) != TRUE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* The first configured pattern matching the name wins. */
+  patterns = dir->patterns->elts;
+  for (i = 0; i < dir->patterns->nelts; i++) {
+    const char *caps[VROOT_ALIAS_MAX_CAPTURES];
+    size_t caplens[VROOT_ALIAS_MAX_CAPTURES];
+
+    if (pattern_match(patterns[i].name_pattern, name, caps,
+        caplens) != TRUE) {
+      continue;
+    }
+
+    /* Wildcards must not lead out of the configured source. */
+    if (pattern_check_captures(caps, caplens, patterns[i].ncaptures) < 0) {
+      pr_trace_msg(trace_channel, 9,
+        "ignoring pattern alias '%s' for '%s': bad wildcard text",
+        patterns[i].name_pattern, name);
+      continue;
+    }
+
+    if (pattern_expand(patterns[i].src_template, caps, caplens,
+        src_path, src_pathsz) < 0) {
+      return -1;
+    }
+
+    if (pattern_check_path(src_path) < 0) {
+      pr_trace_msg(trace_channel, 9,
+        "ignoring pattern alias '%s' for '%s': bad source path '%s'",
+        patterns[i].name_pattern, name, src_path);
+      errno = ENOENT;
+      return -1;
+    }
+
+    return 0;
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+int vroot_alias_match(const char *dst_path, char *src_path,
+    size_t src_pathsz) {
+  return vroot_alias_ctx_match(vroot_ctx_get_default(), dst_path, src_path,
+    src_pathsz);
+}
+
+/* Adds the names provided by the given pattern alias, by listing its source
+ * directory.
+ */
+static void pattern_scan(pool *p, const struct alias_pattern *pattern,
+    array_header *names) {
+  const char *src_template, *wildcard;
+  char *src_dir;
+  size_t src_dirlen, prefixlen;
+  DIR *dirh;
+  struct dirent *dent;
+
+  src_template = pattern->src_template;
+  src_dirlen = strlen(src_template);
+
+  if (pattern->ncaptures != 1 ||
+      src_dirlen < 3 ||
+      strcmp(src_template + src_dirlen - 3, "/$1") != 0 ||
+      strchr(src_template, '$') != src_template + src_dirlen - 2) {
+    return;
+  }
+
+  src_dirlen -= 3;
+  src_dir = pstrndup(p, src_template, src_dirlen > 0 ? src_dirlen : 1);
+
+  dirh = opendir(src_dir);
+  if (dirh == NULL) {
+    return;
+  }
+
+  wildcard = strpbrk(pattern->name_pattern, "*?");
+  prefixlen = wildcard - pattern->name_pattern;
+
+  while ((dent = readdir(dirh)) != NULL) {
+    const char *caps[VROOT_ALIAS_MAX_CAPTURES];
+    size_t caplens[VROOT_ALIAS_MAX_CAPTURES];
+    char *name;
+
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+    name = pstrcat(p, pstrndup(p, pattern->name_pattern, prefixlen),
+      dent->d_name, wildcard + 1, NULL);
+
+    /* Only names which map back to this source entry are listed. */
+    if (pattern_match(pattern->name_pattern, name, caps, caplens) == TRUE &&
+        caplens[0] == strlen(dent->d_name)) {
+      *((char **) push_array(names)) = name;
+    }
+  }
+
+  (void) closedir(dirh);
+}
+
+int vroot_alias_ctx_scan_patterns(const struct vroot_ctx *ctx, pool *p,
+    const char *dir_path, array_header *names) {
+  register unsigned int i;
+  struct alias_pattern_dir **dirs;
+  size_t dir_pathlen;
+
+  if (ctx == NULL ||
+      p == NULL ||
+      dir_path == NULL ||
+      names == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (ctx->alias_pattern_dirs == NULL) {
+    return 0;
+  }
+
+  dir_pathlen = strlen(dir_path);
+  if (dir_pathlen > 0 &&
+      dir_path[dir_pathlen-1] == '/') {
+    dir_pathlen--;
+  }
+
+  dirs = ctx->alias_pattern_dirs->elts;
+  for (i = 0; i < ctx->alias_pattern_dirs->nelts; i++) {
+    const char *rel_path, *ptr;
+    register unsigned int j;
+    char *name;
+    int found = FALSE;
+
+    if (dirs[i]->dir_pathlen == dir_pathlen &&
+        strncmp(dirs[i]->dir_path, dir_path, dir_pathlen) == 0) {
+      struct alias_pattern *patterns;
+
+      patterns = dirs[i]->patterns->elts;
+      for (j = 0; j < dirs[i]->patterns->nelts; j++) {
+        pattern_scan(p, &(patterns[j]), names);
+      }
+
+      continue;
+    }
+
+    /* The patterns of a subdirectory still need an entry for that
+     * subdirectory here.
+     */
+    if (dirs[i]->dir_pathlen <= dir_pathlen ||
+        strncmp(dirs[i]->dir_path, dir_path, dir_pathlen) != 0 ||
+        dirs[i]->dir_path[dir_pathlen] != '/') {
+      continue;
+    }
+
+    rel_path = dirs[i]->dir_path + dir_pathlen + 1;
+    ptr = strchr(rel_path, '/');
+    name = (ptr != NULL ? pstrndup(p, rel_path, ptr - rel_path) :
+      pstrdup(p, rel_path));
+
+    for (j = 0; j < names->nelts; j++) {
+      if (strcmp(((char **) names->elts)[j], name) == 0) {
+        found = TRUE;
+        break;
+      }
+    }
+
+    if (found == FALSE) {
+      *((char **) push_array(names)) = name;
+    }
+  }
+
+  return 0;
+}
+
+int vroot_alias_scan_patterns(pool *p, const char *dir_path,
+    array_header *names) {
+  return vroot_alias_ctx_scan_patterns(vroot_ctx_get_default(), p, dir_path,
+    names);
+}
+
+int vroot_alias_ctx_add(struct vroot_ctx *ctx, const char *dst_path,
+    const char *src_path) {
   int res;
 
-  if (dst_path == NULL ||
+  if (ctx == NULL ||
+      dst_path == NULL ||
       src_path == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  res = pr_table_add(alias_tab, pstrdup(alias_pool, dst_path),
-    pstrdup(alias_pool, src_path), 0);
+  if (alias_is_pattern(dst_path)) {
+    return alias_pattern_add(ctx, dst_path, src_path);
+  }
+
+  res = pr_table_add(ctx->alias_tab, pstrdup(ctx->ctx_pool, dst_path),
+    pstrdup(ctx->ctx_pool, src_path), 0);
   return res;
 }
 
+int vroot_alias_add(const char *dst_path, const char *src_path) {
+  return vroot_alias_ctx_add(vroot_ctx_get_default(), dst_path, src_path);
+}
+
+static int parse_uint(const char *text, unsigned int min, unsigned int max,
+    unsigned int *res) {
+  char *endp = NULL;
+  unsigned long val;
+
+  if (*text == '\0' ||
+      *text == '-') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  val = strtoul(text, &endp, 10);
+  if (endp == NULL ||
+      *endp != '\0' ||
+      val < min ||
+      val > max) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *res = (unsigned int) val;
+  return 0;
+}
+
+static int parse_bool(const char *text, int *res) {
+  int b;
+
+  b = pr_str_is_boolean(text);
+  if (b < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *res = b;
+  return 0;
+}
+
+int vroot_alias_attrs_parse(pool *p, struct vroot_alias_attrs *attrs,
+    const char *text) {
+  const char *ptr;
+  char *name, *value;
+
+  if (p == NULL ||
+      attrs == NULL ||
+      text == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ptr = strchr(text, '=');
+  if (ptr == NULL ||
+      ptr == text) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  name = pstrndup(p, text, ptr - text);
+  value = pstrdup(p, ptr + 1);
+
+  if (strcasecmp(name, "prefetch-threads") == 0) {
+    if (parse_uint(value, 0, VROOT_ALIAS_MAX_PREFETCH_THREADS,
+        &(attrs->prefetch_threads)) < 0) {
+      return -1;
+    }
+
+    if (attrs->prefetch_threads > 0 &&
+        attrs->prefetch_window == 0) {
+      attrs->prefetch_window = VROOT_ALIAS_DEFAULT_PREFETCH_WINDOW;
+    }
+
+  } else if (strcasecmp(name, "prefetch-window") == 0) {
+    if (parse_uint(value, 1, VROOT_ALIAS_MAX_PREFETCH_WINDOW,
+        &(attrs->prefetch_window)) < 0) {
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "read-advice") == 0) {
+    if (strcasecmp(value, "normal") == 0) {
+      attrs->read_advice = VROOT_ALIAS_ADVICE_NORMAL;
+
+    } else if (strcasecmp(value, "sequential") == 0) {
+      attrs->read_advice = VROOT_ALIAS_ADVICE_SEQUENTIAL;
+
+    } else if (strcasecmp(value, "random") == 0) {
+      attrs->read_advice = VROOT_ALIAS_ADVICE_RANDOM;
+
+    } else if (strcasecmp(value, "noreuse") == 0) {
+      attrs->read_advice = VROOT_ALIAS_ADVICE_NOREUSE;
+
+    } else {
+      errno = EINVAL;
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "readahead") == 0) {
+    if (pr_str_get_nbytes(value, NULL, &(attrs->readahead)) < 0) {
+      errno = EINVAL;
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "readahead-files") == 0) {
+    if (parse_uint(value, 0, VROOT_ALIAS_MAX_READAHEAD_FILES,
+        &(attrs->readahead_files)) < 0) {
+      return -1;
+    }
+
+    if (attrs->readahead_files > 0 &&
+        attrs->readahead_bytes == 0) {
+      attrs->readahead_bytes = VROOT_ALIAS_DEFAULT_READAHEAD_BYTES;
+    }
+
+  } else if (strcasecmp(name, "readahead-bytes") == 0) {
+    if (pr_str_get_nbytes(value, NULL, &(attrs->readahead_bytes)) < 0 ||
+        attrs->readahead_bytes == 0) {
+      errno = EINVAL;
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "noatime") == 0) {
+    if (parse_bool(value, &(attrs->noatime)) < 0) {
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "dontneed") == 0) {
+    if (parse_bool(value, &(attrs->dontneed)) < 0) {
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "ioprio") == 0) {
+    char *level;
+    unsigned int n = 0;
+
+    level = strchr(value, ':');
+    if (level != NULL) {
+      *level++ = '\0';
+    }
+
+    if (strcasecmp(value, "realtime") == 0) {
+      attrs->ioprio_class = VROOT_ALIAS_IOPRIO_REALTIME;
+
+    } else if (strcasecmp(value, "best-effort") == 0) {
+      attrs->ioprio_class = VROOT_ALIAS_IOPRIO_BEST_EFFORT;
+
+    } else if (strcasecmp(value, "idle") == 0) {
+      attrs->ioprio_class = VROOT_ALIAS_IOPRIO_IDLE;
+
+    } else {
+      errno = EINVAL;
+      return -1;
+    }
+
+    /* The idle class has no levels. */
+    if (level != NULL) {
+      if (attrs->ioprio_class == VROOT_ALIAS_IOPRIO_IDLE ||
+          parse_uint(level, 0, 7, &n) < 0) {
+        errno = EINVAL;
+        return -1;
+      }
+
+    } else if (attrs->ioprio_class != VROOT_ALIAS_IOPRIO_IDLE) {
+      /* The kernel's default level. */
+      n = 4;
+    }
+
+    attrs->ioprio_level = (int) n;
+
+  } else if (strcasecmp(name, "write-behind") == 0) {
+    if (pr_str_get_nbytes(value, NULL, &(attrs->write_behind)) < 0) {
+      errno = EINVAL;
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "fsync") == 0) {
+    if (strcasecmp(value, "data") == 0) {
+      attrs->fsync_mode = VROOT_ALIAS_FSYNC_DATA;
+
+    } else if (strcasecmp(value, "full") == 0) {
+      attrs->fsync_mode = VROOT_ALIAS_FSYNC_FULL;
+
+    } else {
+      int b;
+
+      if (parse_bool(value, &b) < 0) {
+        return -1;
+      }
+
+      attrs->fsync_mode = (b == TRUE ? VROOT_ALIAS_FSYNC_FULL :
+        VROOT_ALIAS_FSYNC_NONE);
+    }
+
+  } else if (strcasecmp(name, "preallocate") == 0) {
+    if (parse_bool(value, &(attrs->preallocate)) < 0) {
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "metadata-rate") == 0) {
+    if (parse_uint(value, 0, VROOT_ALIAS_MAX_METADATA_RATE,
+        &(attrs->metadata_rate)) < 0) {
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "metadata-burst") == 0) {
+    if (parse_uint(value, 1, VROOT_ALIAS_MAX_METADATA_RATE,
+        &(attrs->metadata_burst)) < 0) {
+      return -1;
+    }
+
+  } else if (strcasecmp(name, "shard-levels") == 0) {
+    if (parse_uint(value, 0, VROOT_SHARD_MAX_LEVELS,
+        &(attrs->shard_levels)) < 0) {
+      return -1;
+    }
+
+  } else {
+    errno = ENOENT;
+    return -1;
+  }
+
+  return 0;
+}
+
+int vroot_alias_ctx_set_attrs(struct vroot_ctx *ctx, const char *dst_path,
+    const struct vroot_alias_attrs *attrs) {
+  const char *src_path;
+  struct alias_attrs_entry *entry;
+
+  if (ctx == NULL ||
+      dst_path == NULL ||
+      attrs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  src_path = vroot_alias_ctx_get(ctx, dst_path);
+  if (src_path == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (ctx->alias_attrs == NULL) {
+    ctx->alias_attrs = make_array(ctx->ctx_pool, 1,
+      sizeof(struct alias_attrs_entry));
+  }
+
+  entry = push_array(ctx->alias_attrs);
+  entry->dst_path = pstrdup(ctx->ctx_pool, dst_path);
+  entry->src_path = src_path;
+  entry->src_pathlen = strlen(src_path);
+  entry->attrs = palloc(ctx->ctx_pool, sizeof(struct vroot_alias_attrs));
+  memcpy(entry->attrs, attrs, sizeof(struct vroot_alias_attrs));
+
+  pr_trace_msg(trace_channel, 15, "set attributes for alias '%s'",
+    dst_path);
+
+  return 0;
+}
+
+int vroot_alias_set_attrs(const char *dst_path,
+    const struct vroot_alias_attrs *attrs) {
+  return vroot_alias_ctx_set_attrs(vroot_ctx_get_default(), dst_path, attrs);
+}
+
+const struct vroot_alias_attrs *vroot_alias_ctx_get_attrs(
+    const struct vroot_ctx *ctx, const char *dst_path) {
+  register unsigned int i;
+  struct alias_attrs_entry *entries;
+
+  if (ctx == NULL ||
+      dst_path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (ctx->alias_attrs != NULL) {
+    entries = ctx->alias_attrs->elts;
+    for (i = 0; i < ctx->alias_attrs->nelts; i++) {
+      if (strcmp(entries[i].dst_path, dst_path) == 0) {
+        return entries[i].attrs;
+      }
+    }
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
+const struct vroot_alias_attrs *vroot_alias_get_attrs(const char *dst_path) {
+  return vroot_alias_ctx_get_attrs(vroot_ctx_get_default(), dst_path);
+}
+
+const struct vroot_alias_attrs *vroot_alias_ctx_find_attrs(
+    const struct vroot_ctx *ctx, const char *real_path, const char **rel_path) {
+  register unsigned int i;
+  struct alias_attrs_entry *entries, *best = NULL;
+
+  if (ctx == NULL ||
+      real_path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (ctx->alias_attrs == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  /* Find the longest alias source path containing the given path; aliases
+   * may be nested.
+   */
+  entries = ctx->alias_attrs->elts;
+  for (i = 0; i < ctx->alias_attrs->nelts; i++) {
+    size_t len;
+
+    len = entries[i].src_pathlen;
+    if (strncmp(real_path, entries[i].src_path, len) != 0) {
+      continue;
+    }
+
+    if (real_path[len] != '\0' &&
+        real_path[len] != '/') {
+      continue;
+    }
+
+    if (best == NULL ||
+        len > best->src_pathlen) {
+      best = &(entries[i]);
+    }
+  }
+
+  if (best == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if (rel_path != NULL) {
+    *rel_path = real_path + best->src_pathlen;
+  }
+
+  return best->attrs;
+}
+
+const struct vroot_alias_attrs *vroot_alias_find_attrs(const char *real_path,
+    const char **rel_path) {
+  return vroot_alias_ctx_find_attrs(vroot_ctx_get_default(), real_path,
+    rel_path);
+}
+
 int vroot_alias_init(pool *p) {
+  struct vroot_ctx *ctx;
+
   if (p == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  if (alias_pool == NULL) {
-    alias_pool = make_sub_pool(p);
-    pr_pool_tag(alias_pool, "VRoot Alias Pool");
+  ctx = vroot_ctx_get_default();
+  if (ctx->ctx_pool == NULL) {
+    ctx->ctx_pool = make_sub_pool(p);
+    pr_pool_tag(ctx->ctx_pool, "VRoot Alias Pool");
 
-    alias_tab = pr_table_alloc(alias_pool, 0);
+    ctx->alias_tab = pr_table_alloc(ctx->ctx_pool, 0);
   }
 
   return 0;
 }
 
 int vroot_alias_free(void) {
-  if (alias_pool != NULL) {
-    pr_table_empty(alias_tab);
-    destroy_pool(alias_pool);
-    alias_pool = NULL;
-    alias_tab = NULL;
+  struct vroot_ctx *ctx;
+
+  ctx = vroot_ctx_get_default();
+  if (ctx->ctx_pool != NULL) {
+    pr_table_empty(ctx->alias_tab);
+    destroy_pool(ctx->ctx_pool);
+    ctx->ctx_pool = NULL;
+    ctx->alias_tab = NULL;
+    ctx->alias_attrs = NULL;
+    ctx->alias_pattern_dirs = NULL;
+    ctx->alias_pattern_count = 0;
   }
 
   return 0;
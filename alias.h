@@ -26,6 +26,7 @@
 #define MOD_VROOT_ALIAS_H
 
 #include "mod_vroot.h"
+#include "ctx.h"
 
 unsigned int vroot_alias_count(void);
 
@@ -37,8 +38,129 @@ int vroot_alias_exists(const char *path);
 
 const char *vroot_alias_get(const char *dst_path);
 
+/* Adds an alias.  If the last component of the destination path contains
+ * "*" or "?" wildcards, the alias is a pattern alias, matching any name in
+ * that directory; the source path may then refer to the text matched by the
+ * Nth wildcard as "$N".
+ */
 int vroot_alias_add(const char *dst_path, const char *src_path);
 
+/* Resolves the given path, which matched no literal alias, against the
+ * pattern aliases, writing the expanded source path into the given buffer.
+ * Fails with ENOENT if no pattern alias matches.
+ */
+int vroot_alias_match(const char *dst_path, char *src_path,
+  size_t src_pathsz);
+
+/* Adds the names which pattern aliases provide in the given directory to the
+ * given list (char *).  The names are found by listing the source directory
+ * of patterns whose source path ends with their one wildcard, e.g.
+ * "/data/projects/$1"; other pattern aliases resolve, but are not listed.
+ */
+int vroot_alias_scan_patterns(pool *p, const char *dir_path,
+  array_header *names);
+
+/* Optional per-alias attributes, configured using "name=value" parameters
+ * on the VRootAlias directive.  These are copied as-is into the alias cache
+ * shared between sessions, and thus must not contain pointers.
+ */
+struct vroot_alias_attrs {
+  /* Number of helper threads used to prefetch directory entry metadata;
+   * zero disables prefetching.
+   */
+  unsigned int prefetch_threads;
+
+  /* Maximum number of prefetched, not yet consumed, entries per directory. */
+  unsigned int prefetch_window;
+
+  /* Read-side I/O policy, applied to files opened for reading. */
+  int read_advice;
+  off_t readahead;
+  int noatime;
+  int dontneed;
+
+  /* Number of files, and bytes, read ahead once files are opened in the
+   * order of their directory listing; zero disables this.
+   */
+  unsigned int readahead_files;
+  off_t readahead_bytes;
+
+  /* I/O priority class and level, while files are open. */
+  int ioprio_class;
+  int ioprio_level;
+
+  /* Write-side I/O policy, applied to files opened for writing. */
+  off_t write_behind;
+  int fsync_mode;
+  int preallocate;
+
+  /* Limit, in operations per second, and burst, for metadata operations on
+   * the alias; a zero rate means no limit.
+   */
+  unsigned int metadata_rate;
+  unsigned int metadata_burst;
+
+  /* Number of levels of shard directories, named by the hash of each name,
+   * in which the names directly within the alias are stored; zero disables
+   * sharding.
+   */
+  unsigned int shard_levels;
+};
+
+/* Values for the read_advice attribute. */
+#define VROOT_ALIAS_ADVICE_NONE		0
+#define VROOT_ALIAS_ADVICE_NORMAL	1
+#define VROOT_ALIAS_ADVICE_SEQUENTIAL	2
+#define VROOT_ALIAS_ADVICE_RANDOM	3
+#define VROOT_ALIAS_ADVICE_NOREUSE	4
+
+/* Values for the fsync_mode attribute. */
+#define VROOT_ALIAS_FSYNC_NONE		0
+#define VROOT_ALIAS_FSYNC_DATA		1
+#define VROOT_ALIAS_FSYNC_FULL		2
+
+/* Values for the ioprio_class attribute; these match the kernel's. */
+#define VROOT_ALIAS_IOPRIO_NONE		0
+#define VROOT_ALIAS_IOPRIO_REALTIME	1
+#define VROOT_ALIAS_IOPRIO_BEST_EFFORT	2
+#define VROOT_ALIAS_IOPRIO_IDLE		3
+
+/* Parses the given "name=value" text into the given attributes. */
+int vroot_alias_attrs_parse(pool *p, struct vroot_alias_attrs *attrs,
+  const char *text);
+
+int vroot_alias_set_attrs(const char *dst_path,
+  const struct vroot_alias_attrs *attrs);
+const struct vroot_alias_attrs *vroot_alias_get_attrs(const char *dst_path);
+
+/* Returns the attributes of the alias whose source path contains the given
+ * real path, if any.  If `rel_path` is provided, it is set to the portion
+ * of `real_path` relative to that alias source path.
+ */
+const struct vroot_alias_attrs *vroot_alias_find_attrs(const char *real_path,
+  const char **rel_path);
+
+/* Reentrant versions of the above, using the given context. */
+unsigned int vroot_alias_ctx_count(const struct vroot_ctx *ctx);
+int vroot_alias_ctx_do(const struct vroot_ctx *ctx,
+  int cb(const void *key_data, size_t key_datasz, const void *value_data,
+  size_t value_datasz, void *user_data), void *user_data);
+int vroot_alias_ctx_exists(const struct vroot_ctx *ctx, const char *path);
+const char *vroot_alias_ctx_get(const struct vroot_ctx *ctx,
+  const char *dst_path);
+int vroot_alias_ctx_add(struct vroot_ctx *ctx, const char *dst_path,
+  const char *src_path);
+int vroot_alias_ctx_match(const struct vroot_ctx *ctx, const char *dst_path,
+  char *src_path, size_t src_pathsz);
+int vroot_alias_ctx_scan_patterns(const struct vroot_ctx *ctx, pool *p,
+  const char *dir_path, array_header *names);
+int vroot_alias_ctx_set_attrs(struct vroot_ctx *ctx, const char *dst_path,
+  const struct vroot_alias_attrs *attrs);
+const struct vroot_alias_attrs *vroot_alias_ctx_get_attrs(
+  const struct vroot_ctx *ctx, const char *dst_path);
+const struct vroot_alias_attrs *vroot_alias_ctx_find_attrs(
+  const struct vroot_ctx *ctx, const char *real_path, const char **rel_path);
+
 /* Internal use only. */
 int vroot_alias_init(pool *p);
 int vroot_alias_free(void);
@@ -0,0 +1,534 @@
+/*
+ * ProFTPD - mod_vroot Alias Cache implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "aliascache.h"
+
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+static const char *trace_channel = "vroot.aliascache";
+
+#ifdef HAVE_PTHREAD_H
+
+/* Robust mutexes let sessions recover the lock of the shared table from a
+ * session killed while holding it.
+ */
+#if defined(__linux__) && defined(EOWNERDEAD)
+# define VROOT_ALIASCACHE_ROBUST	1
+#endif
+
+#define VROOT_ALIASCACHE_MAX_KEYSZ	(PR_TUNABLE_PATH_MAX + 256)
+#define VROOT_ALIASCACHE_MAX_DATASZ	(32 * 1024)
+
+/* Number of sessions, per user, counted as attached to the cached aliases;
+ * e.g. the parallel connections of a transfer client.
+ */
+#define VROOT_ALIASCACHE_MAX_SESSIONS	32
+
+/* Number of slots considered, for a given key. */
+#define VROOT_ALIASCACHE_PROBES		4
+
+/* The expanded aliases of a user, shared by all of their sessions.  Each
+ * alias is stored as a flag indicating whether it has attributes, those
+ * attributes, and its NUL-terminated destination and source paths.
+ */
+struct aliascache_slot {
+  char key[VROOT_ALIASCACHE_MAX_KEYSZ];
+  int used;
+
+  /* The attached sessions; the slot is discarded once none are alive. */
+  pid_t pids[VROOT_ALIASCACHE_MAX_SESSIONS];
+
+  /* Bumped for every filesystem change made by an attached session. */
+  unsigned long generation;
+
+  /* Whether aliases are cached, and for which generations. */
+  int valid;
+  unsigned long built_generation;
+  unsigned long config_generation;
+
+  unsigned int naliases;
+  size_t datasz;
+  char data[VROOT_ALIASCACHE_MAX_DATASZ];
+};
+
+struct aliascache_table {
+  pthread_mutex_t mutex;
+
+  /* Bumped whenever the configuration is read. */
+  unsigned long config_generation;
+
+  unsigned int nslots;
+  struct aliascache_slot slots[1];
+};
+
+static struct aliascache_table *aliascache_table = NULL;
+
+/* The slot to which this session is attached, for which key, and the
+ * generation of the slot when attached.
+ */
+static struct aliascache_slot *aliascache_slot = NULL;
+static char aliascache_key[VROOT_ALIASCACHE_MAX_KEYSZ];
+static unsigned long aliascache_generation = 0;
+
+static void table_lock(void) {
+  int res;
+
+  res = pthread_mutex_lock(&(aliascache_table->mutex));
+#if defined(VROOT_ALIASCACHE_ROBUST)
+  if (res == EOWNERDEAD) {
+    /* A slot being updated may be inconsistent; the slots are checked by
+     * key, and their contents are only used once marked valid.
+     */
+    pthread_mutex_consistent(&(aliascache_table->mutex));
+  }
+#else
+  (void) res;
+#endif /* VROOT_ALIASCACHE_ROBUST */
+}
+
+static void table_unlock(void) {
+  pthread_mutex_unlock(&(aliascache_table->mutex));
+}
+
+int vroot_aliascache_init(unsigned int max_users) {
+  struct aliascache_table *table;
+  pthread_mutexattr_t attr;
+  size_t tabsz;
+  void *ptr;
+  int xerrno;
+
+  if (max_users == 0 ||
+      max_users > VROOT_ALIASCACHE_MAX_MAX_USERS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (aliascache_table != NULL) {
+    /* The configuration may have changed; discard the aliases expanded from
+     * the previous one.
+     */
+    table_lock();
+    aliascache_table->config_generation++;
+    table_unlock();
+
+    return 0;
+  }
+
+  tabsz = sizeof(struct aliascache_table) +
+    ((max_users - 1) * sizeof(struct aliascache_slot));
+
+  ptr = mmap(NULL, tabsz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+    -1, 0);
+  if (ptr == MAP_FAILED) {
+    return -1;
+  }
+
+  table = ptr;
+  table->nslots = max_users;
+
+  pthread_mutexattr_init(&attr);
+  xerrno = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  if (xerrno != 0) {
+    pthread_mutexattr_destroy(&attr);
+    (void) munmap(ptr, tabsz);
+    errno = xerrno;
+    return -1;
+  }
+
+#if defined(VROOT_ALIASCACHE_ROBUST)
+  (void) pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif /* VROOT_ALIASCACHE_ROBUST */
+
+  pthread_mutex_init(&(table->mutex), &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  aliascache_table = table;
+
+  pr_trace_msg(trace_channel, 9, "created alias cache for %u users",
+    max_users);
+  return 0;
+}
+
+static unsigned int aliascache_hash(const char *key) {
+  unsigned int h = 2166136261U;
+
+  while (*key) {
+    h ^= (unsigned char) *key++;
+    h *= 16777619U;
+  }
+
+  return h;
+}
+
+/* Forgets the attached sessions which have since exited, returning the
+ * number still alive.
+ */
+static unsigned int slot_prune(struct aliascache_slot *slot) {
+  register unsigned int i;
+  unsigned int count = 0;
+
+  for (i = 0; i < VROOT_ALIASCACHE_MAX_SESSIONS; i++) {
+    if (slot->pids[i] == 0) {
+      continue;
+    }
+
+    if (kill(slot->pids[i], 0) < 0 &&
+        errno == ESRCH) {
+      slot->pids[i] = 0;
+      continue;
+    }
+
+    count++;
+  }
+
+  return count;
+}
+
+static void slot_add_pid(struct aliascache_slot *slot, pid_t pid) {
+  register unsigned int i;
+
+  for (i = 0; i < VROOT_ALIASCACHE_MAX_SESSIONS; i++) {
+    if (slot->pids[i] == 0 ||
+        slot->pids[i] == pid) {
+      slot->pids[i] = pid;
+      return;
+    }
+  }
+
+  /* Sessions beyond the maximum still use the slot, but do not keep it
+   * alive.
+   */
+}
+
+static struct aliascache_slot *slot_find(const char *key) {
+  register unsigned int i;
+  struct aliascache_slot *unused = NULL;
+  unsigned int idx;
+
+  idx = aliascache_hash(key);
+  for (i = 0; i < VROOT_ALIASCACHE_PROBES; i++) {
+    struct aliascache_slot *slot;
+
+    slot = &(aliascache_table->slots[(idx + i) % aliascache_table->nslots]);
+    if (slot->used == TRUE &&
+        strcmp(slot->key, key) == 0) {
+      return slot;
+    }
+
+    if (unused == NULL &&
+        (slot->used == FALSE ||
+         slot_prune(slot) == 0)) {
+      unused = slot;
+    }
+  }
+
+  if (unused == NULL) {
+    errno = ENOSPC;
+    return NULL;
+  }
+
+  memset(unused, 0, sizeof(struct aliascache_slot) -
+    VROOT_ALIASCACHE_MAX_DATASZ);
+  sstrncpy(unused->key, key, sizeof(unused->key));
+  unused->used = TRUE;
+
+  return unused;
+}
+
+static array_header *slot_decode(pool *p, struct aliascache_slot *slot) {
+  register unsigned int i;
+  array_header *aliases;
+  const char *ptr;
+
+  aliases = make_array(p, slot->naliases,
+    sizeof(struct vroot_aliascache_entry));
+  ptr = slot->data;
+
+  for (i = 0; i < slot->naliases; i++) {
+    struct vroot_aliascache_entry *entry;
+
+    entry = push_array(aliases);
+
+    if (*ptr++ != '\0') {
+      struct vroot_alias_attrs *attrs;
+
+      attrs = palloc(p, sizeof(struct vroot_alias_attrs));
+      memcpy(attrs, ptr, sizeof(struct vroot_alias_attrs));
+      ptr += sizeof(struct vroot_alias_attrs);
+      entry->attrs = attrs;
+
+    } else {
+      entry->attrs = NULL;
+    }
+
+    entry->dst_path = pstrdup(p, ptr);
+    ptr += strlen(ptr) + 1;
+    entry->src_path = pstrdup(p, ptr);
+    ptr += strlen(ptr) + 1;
+  }
+
+  return aliases;
+}
+
+static int slot_encode(struct aliascache_slot *slot,
+    const array_header *aliases) {
+  register unsigned int i;
+  struct vroot_aliascache_entry *entries;
+  size_t datasz = 0;
+
+  entries = aliases->elts;
+  for (i = 0; i < aliases->nelts; i++) {
+    size_t entrysz;
+    char *ptr;
+
+    entrysz = 1 + strlen(entries[i].dst_path) + 1 +
+      strlen(entries[i].src_path) + 1;
+    if (entries[i].attrs != NULL) {
+      entrysz += sizeof(struct vroot_alias_attrs);
+    }
+
+    if (datasz + entrysz > VROOT_ALIASCACHE_MAX_DATASZ) {
+      errno = EFBIG;
+      return -1;
+    }
+
+    ptr = slot->data + datasz;
+    if (entries[i].attrs != NULL) {
+      *ptr++ = 1;
+      memcpy(ptr, entries[i].attrs, sizeof(struct vroot_alias_attrs));
+      ptr += sizeof(struct vroot_alias_attrs);
+
+    } else {
+      *ptr++ = '\0';
+    }
+
+    memcpy(ptr, entries[i].dst_path, strlen(entries[i].dst_path) + 1);
+    ptr += strlen(entries[i].dst_path) + 1;
+    memcpy(ptr, entries[i].src_path, strlen(entries[i].src_path) + 1);
+
+    datasz += entrysz;
+  }
+
+  slot->naliases = aliases->nelts;
+  slot->datasz = datasz;
+  return 0;
+}
+
+array_header *vroot_aliascache_attach(pool *p, const char *key) {
+  struct aliascache_slot *slot;
+  array_header *aliases = NULL;
+
+  if (p == NULL ||
+      key == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (strlen(key) >= VROOT_ALIASCACHE_MAX_KEYSZ) {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+
+  if (aliascache_table == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  (void) vroot_aliascache_detach();
+
+  table_lock();
+
+  slot = slot_find(key);
+  if (slot == NULL) {
+    int xerrno = errno;
+
+    table_unlock();
+
+    pr_trace_msg(trace_channel, 9, "no alias cache slot available for '%s'",
+      key);
+    errno = xerrno;
+    return NULL;
+  }
+
+  (void) slot_prune(slot);
+  slot_add_pid(slot, getpid());
+
+  aliascache_slot = slot;
+  sstrncpy(aliascache_key, key, sizeof(aliascache_key));
+  aliascache_generation = slot->generation;
+
+  if (slot->valid == TRUE &&
+      slot->built_generation == slot->generation &&
+      slot->config_generation == aliascache_table->config_generation) {
+    aliases = slot_decode(p, slot);
+  }
+
+  table_unlock();
+
+  if (aliases == NULL) {
+    pr_trace_msg(trace_channel, 15, "no cached aliases for '%s'", key);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  pr_trace_msg(trace_channel, 15, "using %d cached aliases for '%s'",
+    aliases->nelts, key);
+  return aliases;
+}
+
+int vroot_aliascache_publish(const array_header *aliases) {
+  struct aliascache_slot *slot;
+  int res = 0, xerrno = 0;
+
+  if (aliases == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (aliascache_slot == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  table_lock();
+
+  slot = aliascache_slot;
+  if (slot->used == FALSE ||
+      strcmp(slot->key, aliascache_key) != 0 ||
+      slot->generation != aliascache_generation) {
+    /* The slot was reused, or the aliases may have been expanded from a
+     * filesystem since changed by a sibling session.
+     */
+    res = -1;
+    xerrno = EAGAIN;
+
+  } else {
+    slot->valid = FALSE;
+
+    res = slot_encode(slot, aliases);
+    xerrno = errno;
+
+    if (res == 0) {
+      slot->valid = TRUE;
+      slot->built_generation = slot->generation;
+      slot->config_generation = aliascache_table->config_generation;
+    }
+  }
+
+  table_unlock();
+
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 9, "unable to cache aliases for '%s': %s",
+      aliascache_key, strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 15, "cached %d aliases for '%s'",
+    aliases->nelts, aliascache_key);
+  return 0;
+}
+
+void vroot_aliascache_bump(void) {
+  if (aliascache_slot == NULL) {
+    return;
+  }
+
+  table_lock();
+
+  if (aliascache_slot->used == TRUE &&
+      strcmp(aliascache_slot->key, aliascache_key) == 0) {
+    aliascache_slot->generation++;
+  }
+
+  table_unlock();
+}
+
+int vroot_aliascache_detach(void) {
+  register unsigned int i;
+  struct aliascache_slot *slot;
+  pid_t pid;
+
+  if (aliascache_slot == NULL) {
+    return 0;
+  }
+
+  table_lock();
+
+  slot = aliascache_slot;
+  if (slot->used == TRUE &&
+      strcmp(slot->key, aliascache_key) == 0) {
+    pid = getpid();
+
+    for (i = 0; i < VROOT_ALIASCACHE_MAX_SESSIONS; i++) {
+      if (slot->pids[i] == pid) {
+        slot->pids[i] = 0;
+      }
+    }
+
+    if (slot_prune(slot) == 0) {
+      slot->used = FALSE;
+      slot->valid = FALSE;
+    }
+  }
+
+  table_unlock();
+
+  aliascache_slot = NULL;
+  return 0;
+}
+
+#else
+
+int vroot_aliascache_init(unsigned int max_users) {
+  errno = ENOSYS;
+  return -1;
+}
+
+array_header *vroot_aliascache_attach(pool *p, const char *key) {
+  errno = ENOENT;
+  return NULL;
+}
+
+int vroot_aliascache_publish(const array_header *aliases) {
+  errno = ENOSYS;
+  return -1;
+}
+
+void vroot_aliascache_bump(void) {
+}
+
+int vroot_aliascache_detach(void) {
+  return 0;
+}
+
+#endif /* HAVE_PTHREAD_H */
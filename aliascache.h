@@ -0,0 +1,74 @@
+/*
+ * ProFTPD - mod_vroot Alias Cache API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_ALIASCACHE_H
+#define MOD_VROOT_ALIASCACHE_H
+
+#include "mod_vroot.h"
+#include "alias.h"
+
+#define VROOT_ALIASCACHE_DEFAULT_MAX_USERS	256
+#define VROOT_ALIASCACHE_MAX_MAX_USERS		16384
+
+/* An alias, as expanded for a session. */
+struct vroot_aliascache_entry {
+  const char *dst_path;
+  const char *src_path;
+
+  /* May be NULL, for aliases without attributes. */
+  const struct vroot_alias_attrs *attrs;
+};
+
+/* Creates the cache of expanded aliases, for up to `max_users` users, shared
+ * by all sessions.  This is done by the daemon, before sessions are forked;
+ * when done again, e.g. on restart, the aliases already cached are
+ * discarded.
+ */
+int vroot_aliascache_init(unsigned int max_users);
+
+/* Attaches the session to the cached aliases for the given key, which
+ * identifies the user and their configuration.  Returns the cached aliases,
+ * copied into the given pool, or NULL, with errno set to ENOENT, if there
+ * are none; the session is expected to expand its aliases, and publish them
+ * for its sibling sessions.
+ */
+array_header *vroot_aliascache_attach(pool *p, const char *key);
+
+/* Publishes the given expanded aliases, i.e. an array of
+ * struct vroot_aliascache_entry, for the attached key, unless a sibling
+ * session has changed the filesystem since attaching.
+ */
+int vroot_aliascache_publish(const array_header *aliases);
+
+/* Notes that the session changed the filesystem (e.g. created, renamed, or
+ * removed a path), which may change how the aliases are expanded.
+ */
+void vroot_aliascache_bump(void);
+
+/* Detaches the session; the cached aliases are discarded once no sessions
+ * are attached.
+ */
+int vroot_aliascache_detach(void);
+
+#endif /* MOD_VROOT_ALIASCACHE_H */
@@ -0,0 +1,951 @@
+/*
+ * ProFTPD - mod_vroot Cache Tier implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "cachetier.h"
+
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#define VROOT_CACHETIER_BUFSZ		(128 * 1024)
+
+struct vroot_cachetier {
+  const char *src_path;
+  size_t src_pathlen;
+  const char *cache_dir;
+  off_t max_size;
+  unsigned int metadata_ttl;
+};
+
+/* The metadata of the source of a cached copy, kept in a sidecar file next to
+ * the copy, along with when that metadata was last checked.
+ */
+struct cachetier_meta {
+  off_t size;
+  time_t mtime;
+  long mtime_nsec;
+  time_t ctime;
+  long ctime_nsec;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  time_t checked;
+};
+
+static pool *cachetier_pool = NULL;
+static array_header *cachetiers = NULL;
+
+static const char *trace_channel = "vroot.cachetier";
+
+int vroot_cachetier_add(const char *src_path, const char *cache_dir,
+    off_t max_size, unsigned int metadata_ttl) {
+  struct vroot_cachetier *ct;
+  char *path;
+  size_t pathlen;
+
+  if (src_path == NULL ||
+      cache_dir == NULL ||
+      *cache_dir != '/' ||
+      max_size <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (cachetier_pool == NULL) {
+    cachetier_pool = make_sub_pool(session.pool);
+    pr_pool_tag(cachetier_pool, "VRoot Cache Tier Pool");
+
+    cachetiers = make_array(cachetier_pool, 1,
+      sizeof(struct vroot_cachetier *));
+  }
+
+  ct = pcalloc(cachetier_pool, sizeof(struct vroot_cachetier));
+
+  path = pstrdup(cachetier_pool, src_path);
+  pathlen = strlen(path);
+  if (pathlen > 1 &&
+      path[pathlen-1] == '/') {
+    path[--pathlen] = '\0';
+  }
+
+  ct->src_path = path;
+  ct->src_pathlen = pathlen;
+  ct->cache_dir = pstrdup(cachetier_pool, cache_dir);
+  ct->max_size = max_size;
+  ct->metadata_ttl = metadata_ttl;
+
+  *((struct vroot_cachetier **) push_array(cachetiers)) = ct;
+
+  pr_trace_msg(trace_channel, 9,
+    "caching '%s' in '%s' (max %" PR_LU " bytes, metadata TTL %u secs)",
+    ct->src_path, ct->cache_dir, (pr_off_t) max_size, metadata_ttl);
+  return 0;
+}
+
+unsigned int vroot_cachetier_count(void) {
+  if (cachetiers == NULL) {
+    return 0;
+  }
+
+  return cachetiers->nelts;
+}
+
+/* Finds the cache tier whose source directory contains the given real path;
+ * the source directory itself is not cached.
+ */
+static const struct vroot_cachetier *cachetier_get(const char *path) {
+  register unsigned int i;
+  struct vroot_cachetier **elts;
+
+  if (cachetiers == NULL) {
+    return NULL;
+  }
+
+  elts = cachetiers->elts;
+  for (i = 0; i < cachetiers->nelts; i++) {
+    const struct vroot_cachetier *ct;
+
+    ct = elts[i];
+    if (strncmp(path, ct->src_path, ct->src_pathlen) == 0 &&
+        path[ct->src_pathlen] == '/' &&
+        path[ct->src_pathlen + 1] != '\0') {
+      return ct;
+    }
+  }
+
+  return NULL;
+}
+
+/* The nanoseconds of the modification and change times, where available;
+ * these, and the change time, catch rewrites within the same second, and
+ * changes of ownership or permissions.
+ */
+static void cachetier_st_nsecs(const struct stat *st, long *mtime_nsec,
+    long *ctime_nsec) {
+  *mtime_nsec = *ctime_nsec = 0;
+
+#if defined(__APPLE__)
+  *mtime_nsec = st->st_mtimespec.tv_nsec;
+  *ctime_nsec = st->st_ctimespec.tv_nsec;
+#elif defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+      defined(__OpenBSD__) || defined(__sun)
+  *mtime_nsec = st->st_mtim.tv_nsec;
+  *ctime_nsec = st->st_ctim.tv_nsec;
+#endif
+}
+
+/* Returns TRUE if the given source attributes are still the ones recorded
+ * for its cached copy.
+ */
+static int cachetier_st_eq(const struct stat *st1, const struct stat *st2) {
+  long mtime_nsec1, ctime_nsec1, mtime_nsec2, ctime_nsec2;
+
+  cachetier_st_nsecs(st1, &mtime_nsec1, &ctime_nsec1);
+  cachetier_st_nsecs(st2, &mtime_nsec2, &ctime_nsec2);
+
+  return (st1->st_size == st2->st_size &&
+          st1->st_mtime == st2->st_mtime &&
+          mtime_nsec1 == mtime_nsec2 &&
+          st1->st_ctime == st2->st_ctime &&
+          ctime_nsec1 == ctime_nsec2);
+}
+
+static int cachetier_meta_eq(const struct cachetier_meta *meta,
+    const struct stat *st) {
+  long mtime_nsec, ctime_nsec;
+
+  cachetier_st_nsecs(st, &mtime_nsec, &ctime_nsec);
+
+  return (meta->size == st->st_size &&
+          meta->mtime == st->st_mtime &&
+          meta->mtime_nsec == mtime_nsec &&
+          meta->ctime == st->st_ctime &&
+          meta->ctime_nsec == ctime_nsec);
+}
+
+/* The cached copies, and their sidecar files, are readable by whoever may
+ * read the source, so that sessions running as other users can use them.
+ */
+static mode_t cachetier_mode(const struct stat *st) {
+  return (st->st_mode & (S_IRUSR|S_IRGRP|S_IROTH)) | S_IRUSR|S_IWUSR;
+}
+
+/* The cached copies are kept in a single directory, named by the 64-bit
+ * FNV-1a hash of their source paths; the sidecar file records the source
+ * path, in case of collisions.
+ */
+static void cachetier_paths(const char *cache_dir, const char *path,
+    char *data_path, char *meta_path, size_t pathsz) {
+  const unsigned char *ptr;
+  unsigned long long h = 14695981039346656037ULL;
+
+  for (ptr = (const unsigned char *) path; *ptr != '\0'; ptr++) {
+    h ^= *ptr;
+    h *= 1099511628211ULL;
+  }
+
+  snprintf(data_path, pathsz, "%s/%016llx.data", cache_dir, h);
+  snprintf(meta_path, pathsz, "%s/%016llx.meta", cache_dir, h);
+}
+
+/* The cache directory is writable by all logged-in users; only copies, and
+ * sidecar files, made by this user, or by root, are trusted.
+ */
+static int cachetier_trusted(const struct stat *st) {
+  if (!S_ISREG(st->st_mode) ||
+      (st->st_uid != 0 && st->st_uid != geteuid())) {
+    errno = ENOENT;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static int cachetier_read_meta(const char *meta_path, const char *path,
+    struct cachetier_meta *meta) {
+  int fd;
+  ssize_t len;
+  struct stat st;
+  char buf[PR_TUNABLE_PATH_MAX + 256], *ptr;
+  long long size, mtime, ctime, checked;
+  long mtime_nsec, ctime_nsec;
+  unsigned long uid, gid;
+  unsigned int mode;
+
+  fd = open(meta_path, O_RDONLY|O_NOFOLLOW);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0 ||
+      cachetier_trusted(&st) == FALSE) {
+    (void) close(fd);
+    errno = ENOENT;
+    return -1;
+  }
+
+  len = read(fd, buf, sizeof(buf) - 1);
+  (void) close(fd);
+
+  if (len <= 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  buf[len] = '\0';
+
+  ptr = strchr(buf, '\n');
+  if (ptr == NULL ||
+      strcmp(ptr + 1, path) != 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  *ptr = '\0';
+  if (sscanf(buf, "%lld %lld %ld %lld %ld %o %lu %lu %lld", &size, &mtime,
+      &mtime_nsec, &ctime, &ctime_nsec, &mode, &uid, &gid, &checked) != 9) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  meta->size = (off_t) size;
+  meta->mtime = (time_t) mtime;
+  meta->mtime_nsec = mtime_nsec;
+  meta->ctime = (time_t) ctime;
+  meta->ctime_nsec = ctime_nsec;
+  meta->mode = (mode_t) mode;
+  meta->uid = (uid_t) uid;
+  meta->gid = (gid_t) gid;
+  meta->checked = (time_t) checked;
+  return 0;
+}
+
+/* Writes the sidecar file for the given source metadata, replacing any
+ * existing one in a single rename(2).
+ */
+static int cachetier_write_meta(const char *meta_path, const char *path,
+    const struct stat *st, time_t checked) {
+  int fd, res, xerrno;
+  char buf[PR_TUNABLE_PATH_MAX + 256], tmp_path[PR_TUNABLE_PATH_MAX + 1];
+  size_t len;
+  long mtime_nsec, ctime_nsec;
+
+  cachetier_st_nsecs(st, &mtime_nsec, &ctime_nsec);
+
+  len = snprintf(buf, sizeof(buf), "%lld %lld %ld %lld %ld %o %lu %lu %lld\n%s",
+    (long long) st->st_size, (long long) st->st_mtime, mtime_nsec,
+    (long long) st->st_ctime, ctime_nsec, (unsigned int) st->st_mode,
+    (unsigned long) st->st_uid, (unsigned long) st->st_gid,
+    (long long) checked, path);
+  if (len >= sizeof(buf)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", meta_path);
+  fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    return -1;
+  }
+
+  (void) fchmod(fd, cachetier_mode(st));
+
+  res = write(fd, buf, len);
+  xerrno = errno;
+  (void) close(fd);
+
+  if (res != (int) len) {
+    (void) unlink(tmp_path);
+    errno = (res < 0 ? xerrno : ENOSPC);
+    return -1;
+  }
+
+  if (rename(tmp_path, meta_path) < 0) {
+    xerrno = errno;
+    (void) unlink(tmp_path);
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+struct cachetier_entry {
+  char name[32];
+  off_t size;
+  time_t atime;
+};
+
+static int cachetier_entry_cmp(const void *a, const void *b) {
+  const struct cachetier_entry *e1 = a, *e2 = b;
+
+  if (e1->atime < e2->atime) {
+    return -1;
+  }
+
+  return (e1->atime > e2->atime);
+}
+
+/* Removes the least recently used cached copies until at most `max_size`
+ * bytes are used.  The access time of a cached copy is set whenever it is
+ * used, regardless of any noatime mount option.  This only uses memory
+ * obtained from malloc(3), as it is done by the helper thread.
+ */
+static int cachetier_evict(const char *cache_dir, off_t max_size) {
+  register unsigned int i;
+  DIR *dirh;
+  struct dirent *dent;
+  struct cachetier_entry *entries = NULL;
+  unsigned int nentries = 0, nalloc = 0, nevicted = 0;
+  off_t total = 0;
+
+  dirh = opendir(cache_dir);
+  if (dirh == NULL) {
+    return -1;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    struct stat st;
+    size_t namelen;
+
+    namelen = strlen(dent->d_name);
+    if (namelen != 21 ||
+        strcmp(dent->d_name + 16, ".data") != 0 ||
+        fstatat(dirfd(dirh), dent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+      continue;
+    }
+
+    if (nentries == nalloc) {
+      struct cachetier_entry *ptr;
+
+      nalloc = (nalloc > 0 ? nalloc * 2 : 64);
+      ptr = realloc(entries, nalloc * sizeof(struct cachetier_entry));
+      if (ptr == NULL) {
+        free(entries);
+        (void) closedir(dirh);
+        errno = ENOMEM;
+        return -1;
+      }
+
+      entries = ptr;
+    }
+
+    memcpy(entries[nentries].name, dent->d_name, namelen + 1);
+    entries[nentries].size = st.st_size;
+    entries[nentries].atime = st.st_atime;
+    nentries++;
+
+    total += st.st_size;
+  }
+
+  if (total > max_size) {
+    qsort(entries, nentries, sizeof(struct cachetier_entry),
+      cachetier_entry_cmp);
+
+    for (i = 0; i < nentries && total > max_size; i++) {
+      char meta_name[32];
+
+      if (unlinkat(dirfd(dirh), entries[i].name, 0) < 0) {
+        continue;
+      }
+
+      memcpy(meta_name, entries[i].name, 16);
+      memcpy(meta_name + 16, ".meta", 6);
+      (void) unlinkat(dirfd(dirh), meta_name, 0);
+
+      total -= entries[i].size;
+      nevicted++;
+    }
+  }
+
+  (void) closedir(dirh);
+  free(entries);
+
+  return (int) nevicted;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+/* As with the prefetch helpers, the fill thread only ever issues system
+ * calls, and uses memory obtained from malloc(3).  Only one file is copied
+ * into the cache at a time; misses while a copy is in progress are simply
+ * served from the source.
+ */
+struct cachetier_fill {
+  char *src_path;
+  char *cache_dir;
+  char *data_path;
+  char *meta_path;
+  off_t max_size;
+  struct stat src_st;
+
+  pthread_mutex_t mutex;
+  int shutdown;
+  int done;
+  int res;
+};
+
+static struct cachetier_fill *cachetier_fill = NULL;
+static pthread_t cachetier_thread;
+
+static int cachetier_fill_stopped(struct cachetier_fill *cf) {
+  int shutdown;
+
+  pthread_mutex_lock(&(cf->mutex));
+  shutdown = cf->shutdown;
+  pthread_mutex_unlock(&(cf->mutex));
+
+  return shutdown;
+}
+
+static int cachetier_fill_copy(struct cachetier_fill *cf, int src_fd,
+    int dst_fd) {
+  char *buf;
+  off_t copied = 0;
+
+  buf = malloc(VROOT_CACHETIER_BUFSZ);
+  if (buf == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  while (copied < cf->src_st.st_size) {
+    ssize_t nread, nwritten;
+
+    if (cachetier_fill_stopped(cf) == TRUE) {
+      free(buf);
+      errno = ECANCELED;
+      return -1;
+    }
+
+    nread = read(src_fd, buf, VROOT_CACHETIER_BUFSZ);
+    if (nread < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      free(buf);
+      return -1;
+    }
+
+    if (nread == 0) {
+      break;
+    }
+
+    nwritten = write(dst_fd, buf, nread);
+    if (nwritten != nread) {
+      free(buf);
+      if (nwritten >= 0) {
+        errno = ENOSPC;
+      }
+
+      return -1;
+    }
+
+    copied += nread;
+  }
+
+  free(buf);
+
+  /* The source changed while being copied. */
+  if (copied != cf->src_st.st_size) {
+    errno = ESTALE;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void *cachetier_fill_run(void *arg) {
+  struct cachetier_fill *cf;
+  int src_fd, dst_fd, res = -1, xerrno = 0;
+  char tmp_path[PR_TUNABLE_PATH_MAX + 1];
+  struct stat st;
+  struct timespec ts[2];
+
+  cf = arg;
+
+  src_fd = open(cf->src_path, O_RDONLY|O_NOFOLLOW);
+  if (src_fd < 0) {
+    xerrno = errno;
+    goto done;
+  }
+
+  if (fstat(src_fd, &st) < 0 ||
+      cachetier_st_eq(&st, &(cf->src_st)) == FALSE) {
+    xerrno = ESTALE;
+    (void) close(src_fd);
+    goto done;
+  }
+
+  /* Make room for the new copy first. */
+  (void) cachetier_evict(cf->cache_dir, cf->max_size - st.st_size);
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", cf->data_path);
+  dst_fd = mkstemp(tmp_path);
+  if (dst_fd < 0) {
+    xerrno = errno;
+    (void) close(src_fd);
+    goto done;
+  }
+
+  (void) fchmod(dst_fd, cachetier_mode(&st));
+
+  res = cachetier_fill_copy(cf, src_fd, dst_fd);
+  xerrno = errno;
+  (void) close(src_fd);
+
+  if (res == 0) {
+    /* The copy has the modification time of its source. */
+    ts[0].tv_sec = 0;
+    ts[0].tv_nsec = UTIME_NOW;
+    ts[1].tv_sec = st.st_mtime;
+    ts[1].tv_nsec = 0;
+    res = futimens(dst_fd, ts);
+    xerrno = errno;
+  }
+
+  (void) close(dst_fd);
+
+  if (res == 0) {
+    res = rename(tmp_path, cf->data_path);
+    xerrno = errno;
+  }
+
+  if (res < 0) {
+    (void) unlink(tmp_path);
+    goto done;
+  }
+
+  res = cachetier_write_meta(cf->meta_path, cf->src_path, &st, time(NULL));
+  xerrno = errno;
+  if (res < 0) {
+    (void) unlink(cf->data_path);
+  }
+
+done:
+  pthread_mutex_lock(&(cf->mutex));
+  cf->done = TRUE;
+  cf->res = (res == 0 ? 0 : xerrno);
+  pthread_mutex_unlock(&(cf->mutex));
+
+  return NULL;
+}
+
+static void cachetier_fill_destroy(struct cachetier_fill *cf) {
+  free(cf->src_path);
+  free(cf->cache_dir);
+  free(cf->data_path);
+  free(cf->meta_path);
+  pthread_mutex_destroy(&(cf->mutex));
+  free(cf);
+}
+
+/* Joins the fill thread if it has finished, so that another fill can be
+ * started.
+ */
+static int cachetier_fill_reap(void) {
+  int done;
+
+  if (cachetier_fill == NULL) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&(cachetier_fill->mutex));
+  done = cachetier_fill->done;
+  pthread_mutex_unlock(&(cachetier_fill->mutex));
+
+  if (done == FALSE) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  (void) vroot_cachetier_wait();
+  return 0;
+}
+
+static int cachetier_fill_start(const struct vroot_cachetier *ct,
+    const char *path, const char *data_path, const char *meta_path,
+    const struct stat *st) {
+  struct cachetier_fill *cf;
+  sigset_t all_sigs, orig_sigs;
+  int xerrno;
+
+  if (st->st_size > ct->max_size) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  if (cachetier_fill_reap() < 0) {
+    return -1;
+  }
+
+  cf = calloc(1, sizeof(struct cachetier_fill));
+  if (cf == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  cf->src_path = strdup(path);
+  cf->cache_dir = strdup(ct->cache_dir);
+  cf->data_path = strdup(data_path);
+  cf->meta_path = strdup(meta_path);
+  cf->max_size = ct->max_size;
+  memcpy(&(cf->src_st), st, sizeof(struct stat));
+  pthread_mutex_init(&(cf->mutex), NULL);
+
+  if (cf->src_path == NULL ||
+      cf->cache_dir == NULL ||
+      cf->data_path == NULL ||
+      cf->meta_path == NULL) {
+    cachetier_fill_destroy(cf);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  /* Make sure that signals are only ever delivered to the session thread. */
+  sigfillset(&all_sigs);
+  pthread_sigmask(SIG_SETMASK, &all_sigs, &orig_sigs);
+  xerrno = pthread_create(&cachetier_thread, NULL, cachetier_fill_run, cf);
+  pthread_sigmask(SIG_SETMASK, &orig_sigs, NULL);
+
+  if (xerrno != 0) {
+    cachetier_fill_destroy(cf);
+    errno = xerrno;
+    return -1;
+  }
+
+  cachetier_fill = cf;
+  return 0;
+}
+
+int vroot_cachetier_wait(void) {
+  int res;
+
+  if (cachetier_fill == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pthread_join(cachetier_thread, NULL);
+  res = cachetier_fill->res;
+
+  if (res == 0) {
+    pr_trace_msg(trace_channel, 15, "cached copy of '%s' in '%s'",
+      cachetier_fill->src_path, cachetier_fill->data_path);
+
+  } else {
+    pr_trace_msg(trace_channel, 9, "error caching copy of '%s': %s",
+      cachetier_fill->src_path, strerror(res));
+  }
+
+  cachetier_fill_destroy(cachetier_fill);
+  cachetier_fill = NULL;
+
+  if (res != 0) {
+    errno = res;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void cachetier_fill_stop(void) {
+  if (cachetier_fill == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&(cachetier_fill->mutex));
+  cachetier_fill->shutdown = TRUE;
+  pthread_mutex_unlock(&(cachetier_fill->mutex));
+
+  (void) vroot_cachetier_wait();
+}
+
+#else
+
+static int cachetier_fill_start(const struct vroot_cachetier *ct,
+    const char *path, const char *data_path, const char *meta_path,
+    const struct stat *st) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int vroot_cachetier_wait(void) {
+  errno = ENOENT;
+  return -1;
+}
+
+static void cachetier_fill_stop(void) {
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/* Checks, using the effective IDs of the session, whether the source may be
+ * read, without opening it.
+ */
+static int cachetier_can_read(const char *path) {
+#if defined(AT_EACCESS)
+  return faccessat(AT_FDCWD, path, R_OK, AT_EACCESS);
+#else
+  int fd;
+
+  fd = open(path, O_RDONLY|O_NONBLOCK);
+  if (fd < 0) {
+    return -1;
+  }
+
+  (void) close(fd);
+  return 0;
+#endif /* AT_EACCESS */
+}
+
+/* Checks, using the effective IDs of the session, whether the source may be
+ * looked up, as for stat(2): that is, whether its directory may be searched.
+ * The source itself is not looked at, so that the cached metadata still
+ * saves a trip to the source filesystem.
+ */
+static int cachetier_can_stat(const char *path) {
+  char dir_path[PR_TUNABLE_PATH_MAX + 1], *ptr;
+
+  sstrncpy(dir_path, path, sizeof(dir_path));
+  ptr = strrchr(dir_path, '/');
+  if (ptr == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (ptr == dir_path) {
+    ptr++;
+  }
+  *ptr = '\0';
+
+#if defined(AT_EACCESS)
+  return faccessat(AT_FDCWD, dir_path, X_OK, AT_EACCESS);
+#else
+  return access(dir_path, X_OK);
+#endif /* AT_EACCESS */
+}
+
+int vroot_cachetier_open(const char *path) {
+  const struct vroot_cachetier *ct;
+  char data_path[PR_TUNABLE_PATH_MAX + 1], meta_path[PR_TUNABLE_PATH_MAX + 1];
+  struct cachetier_meta meta;
+  struct stat src_st, st;
+  struct timespec ts[2];
+  int fd;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ct = cachetier_get(path);
+  if (ct == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (stat(path, &src_st) < 0) {
+    return -1;
+  }
+
+  if (!S_ISREG(src_st.st_mode)) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  cachetier_paths(ct->cache_dir, path, data_path, meta_path,
+    sizeof(data_path));
+
+  if (cachetier_read_meta(meta_path, path, &meta) == 0 &&
+      cachetier_meta_eq(&meta, &src_st) == TRUE) {
+    /* The copy is only served to sessions which may read the source. */
+    if (cachetier_can_read(path) < 0) {
+      return -1;
+    }
+
+    fd = open(data_path, O_RDONLY|O_NOFOLLOW);
+    if (fd >= 0) {
+      if (fstat(fd, &st) == 0 &&
+          cachetier_trusted(&st) == TRUE &&
+          st.st_size == src_st.st_size) {
+        time_t now;
+
+        /* Note the use of this copy, for eviction. */
+        ts[0].tv_sec = 0;
+        ts[0].tv_nsec = UTIME_NOW;
+        ts[1].tv_sec = 0;
+        ts[1].tv_nsec = UTIME_OMIT;
+        (void) futimens(fd, ts);
+
+        /* A hit changes only the time at which the source was last checked;
+         * the sidecar is rewritten once half of the metadata TTL has passed.
+         */
+        now = time(NULL);
+        if (ct->metadata_ttl > 0 &&
+            meta.checked + (time_t) (ct->metadata_ttl / 2) < now) {
+          (void) cachetier_write_meta(meta_path, path, &src_st, now);
+        }
+
+        pr_trace_msg(trace_channel, 15, "using cached copy '%s' of '%s'",
+          data_path, path);
+        return fd;
+      }
+
+      (void) close(fd);
+    }
+  }
+
+  if (cachetier_fill_start(ct, path, data_path, meta_path, &src_st) < 0) {
+    pr_trace_msg(trace_channel, 9, "not caching copy of '%s': %s", path,
+      strerror(errno));
+
+  } else {
+    pr_trace_msg(trace_channel, 15, "caching copy of '%s' in '%s'", path,
+      data_path);
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+int vroot_cachetier_stat(const char *path, struct stat *st) {
+  const struct vroot_cachetier *ct;
+  char data_path[PR_TUNABLE_PATH_MAX + 1], meta_path[PR_TUNABLE_PATH_MAX + 1];
+  struct cachetier_meta meta;
+
+  if (path == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ct = cachetier_get(path);
+  if (ct == NULL ||
+      ct->metadata_ttl == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  cachetier_paths(ct->cache_dir, path, data_path, meta_path,
+    sizeof(data_path));
+
+  if (cachetier_read_meta(meta_path, path, &meta) < 0 ||
+      meta.checked + (time_t) ct->metadata_ttl < time(NULL) ||
+      lstat(data_path, st) < 0 ||
+      cachetier_trusted(st) == FALSE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* As for stat(2), the caller must be able to look up the source. */
+  if (cachetier_can_stat(path) < 0) {
+    return -1;
+  }
+
+  st->st_size = meta.size;
+  st->st_mtime = meta.mtime;
+  st->st_mode = meta.mode;
+  st->st_uid = meta.uid;
+  st->st_gid = meta.gid;
+
+  pr_trace_msg(trace_channel, 19, "using cached metadata for '%s'", path);
+  return 0;
+}
+
+void vroot_cachetier_invalidate(const char *path) {
+  const struct vroot_cachetier *ct;
+  char data_path[PR_TUNABLE_PATH_MAX + 1], meta_path[PR_TUNABLE_PATH_MAX + 1];
+
+  if (path == NULL) {
+    return;
+  }
+
+  ct = cachetier_get(path);
+  if (ct == NULL) {
+    return;
+  }
+
+  cachetier_paths(ct->cache_dir, path, data_path, meta_path,
+    sizeof(data_path));
+
+  /* The sidecar goes first, so that the copy is never trusted alone. */
+  if (unlink(meta_path) == 0) {
+    (void) unlink(data_path);
+    pr_trace_msg(trace_channel, 15, "discarded cached copy of '%s'", path);
+  }
+}
+
+int vroot_cachetier_free(void) {
+  cachetier_fill_stop();
+
+  if (cachetier_pool != NULL) {
+    destroy_pool(cachetier_pool);
+    cachetier_pool = NULL;
+    cachetiers = NULL;
+  }
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * ProFTPD - mod_vroot Cache Tier API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_CACHETIER_H
+#define MOD_VROOT_CACHETIER_H
+
+#include "mod_vroot.h"
+
+#define VROOT_CACHETIER_DEFAULT_MAX_SIZE	(1024 * 1024 * 1024)
+#define VROOT_CACHETIER_DEFAULT_METADATA_TTL	60
+#define VROOT_CACHETIER_MAX_METADATA_TTL	86400
+
+/* Caches copies of the files within the given (real) source directory in the
+ * given local cache directory, using at most `max_size` bytes.  The metadata
+ * of cached files is trusted, rather than checked against the source, for
+ * `metadata_ttl` seconds; zero means it is always checked.
+ */
+int vroot_cachetier_add(const char *src_path, const char *cache_dir,
+  off_t max_size, unsigned int metadata_ttl);
+unsigned int vroot_cachetier_count(void);
+
+/* Opens, for reading, the cached copy of the given real path, if it matches
+ * the size and modification time of the source.  Otherwise, returns -1 with
+ * errno set to ENOENT, having started copying the source into the cache in a
+ * helper thread, for later opens.
+ */
+int vroot_cachetier_open(const char *path);
+
+/* Answers the stat(2) of the given real path from the metadata of its cached
+ * copy, if that was checked against the source within the metadata TTL.
+ * Returns -1, with errno set to ENOENT, on a miss.
+ */
+int vroot_cachetier_stat(const char *path, struct stat *st);
+
+/* Discards any cached copy of the given real path, e.g. when the source is
+ * changed or removed.
+ */
+void vroot_cachetier_invalidate(const char *path);
+
+/* Waits for any helper thread copying a file into the cache to finish,
+ * returning its result, or -1 with errno set to ENOENT if there is none.
+ */
+int vroot_cachetier_wait(void);
+
+/* Internal use only. */
+int vroot_cachetier_free(void);
+
+#endif /* MOD_VROOT_CACHETIER_H */
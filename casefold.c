@@ -0,0 +1,531 @@
+/*
+ * ProFTPD - mod_vroot Case Folding implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "casefold.h"
+
+struct casefold_dir {
+  pool *pool;
+  const char *path;
+
+  /* The directory attributes for which the index is valid. */
+  ino_t ino;
+  time_t mtime;
+  time_t ctime;
+
+  /* Maps the folded names to the real names. */
+  pr_table_t *names;
+
+  /* Whether several real names fold to the same name; only the first
+   * such name is indexed.
+   */
+  int ambiguous;
+};
+
+struct vroot_casefold {
+  /* The pool for the indexes; NULL for the session pool. */
+  pool *pool;
+
+  /* The indexed directories, most recently used first. */
+  struct casefold_dir *dirs[VROOT_CASEFOLD_MAX_DIRS];
+};
+
+/* The indexes of the session, kept up to date by vroot_casefold_add() and
+ * vroot_casefold_remove().
+ */
+static struct vroot_casefold casefold_default;
+
+static const char *trace_channel = "vroot.casefold";
+
+/* Only ASCII letters are folded, regardless of the locale; this keeps the
+ * folded names the same length as the real names.
+ */
+static void fold_name(char *dst, const char *src, size_t len) {
+  register size_t i;
+
+  for (i = 0; i < len; i++) {
+    char c;
+
+    c = src[i];
+    if (c >= 'A' &&
+        c <= 'Z') {
+      c += ('a' - 'A');
+    }
+
+    dst[i] = c;
+  }
+
+  dst[len] = '\0';
+}
+
+/* Returns the index of the given directory, if any, making it the most
+ * recently used.
+ */
+static struct casefold_dir *dir_get(struct vroot_casefold *cf,
+    const char *path) {
+  register unsigned int i;
+
+  for (i = 0; i < VROOT_CASEFOLD_MAX_DIRS; i++) {
+    struct casefold_dir *cdir;
+
+    cdir = cf->dirs[i];
+    if (cdir == NULL) {
+      break;
+    }
+
+    if (strcmp(cdir->path, path) == 0) {
+      if (i > 0) {
+        memmove(&(cf->dirs[1]), &(cf->dirs[0]),
+          i * sizeof(struct casefold_dir *));
+        cf->dirs[0] = cdir;
+      }
+
+      return cdir;
+    }
+  }
+
+  return NULL;
+}
+
+static void dir_stamp(struct casefold_dir *cdir, const struct stat *st) {
+  cdir->ino = st->st_ino;
+  cdir->mtime = st->st_mtime;
+  cdir->ctime = st->st_ctime;
+
+  /* Changes made within the same second as the directory's last change
+   * cannot be detected; make sure such an index is rebuilt once used again.
+   */
+  if (st->st_ctime >= time(NULL)) {
+    cdir->ctime = 0;
+  }
+}
+
+static int dir_valid(const struct casefold_dir *cdir, const struct stat *st) {
+  if (cdir->ino != st->st_ino ||
+      cdir->mtime != st->st_mtime ||
+      cdir->ctime != st->st_ctime) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void dir_remove(struct vroot_casefold *cf, struct casefold_dir *cdir) {
+  register unsigned int i;
+
+  for (i = 0; i < VROOT_CASEFOLD_MAX_DIRS; i++) {
+    if (cf->dirs[i] == cdir) {
+      memmove(&(cf->dirs[i]), &(cf->dirs[i+1]),
+        (VROOT_CASEFOLD_MAX_DIRS - i - 1) * sizeof(struct casefold_dir *));
+      cf->dirs[VROOT_CASEFOLD_MAX_DIRS-1] = NULL;
+      break;
+    }
+  }
+
+  destroy_pool(cdir->pool);
+}
+
+static struct casefold_dir *dir_build(struct vroot_casefold *cf,
+    const char *path, const struct stat *st) {
+  register unsigned int i;
+  pool *dir_pool;
+  struct casefold_dir *cdir;
+  array_header *names;
+  char **elts;
+  DIR *dirh;
+  struct dirent *dent;
+
+  dirh = opendir(path);
+  if (dirh == NULL) {
+    return NULL;
+  }
+
+  dir_pool = make_sub_pool(cf->pool != NULL ? cf->pool : session.pool);
+  pr_pool_tag(dir_pool, "VRoot Case Folding Pool");
+
+  cdir = pcalloc(dir_pool, sizeof(struct casefold_dir));
+  cdir->pool = dir_pool;
+  cdir->path = pstrdup(dir_pool, path);
+
+  names = make_array(dir_pool, 64, sizeof(char *));
+  while ((dent = readdir(dirh)) != NULL) {
+    pr_signals_handle();
+
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+    *((char **) push_array(names)) = pstrdup(dir_pool, dent->d_name);
+  }
+
+  (void) closedir(dirh);
+
+  /* Size the table for the directory, so that lookups stay O(1) even for
+   * large directories.
+   */
+  cdir->names = pr_table_nalloc(dir_pool, 0,
+    names->nelts > 0 ? names->nelts : 1);
+
+  elts = names->elts;
+  for (i = 0; i < names->nelts; i++) {
+    char *folded;
+    size_t namelen;
+
+    namelen = strlen(elts[i]);
+    folded = palloc(dir_pool, namelen + 1);
+    fold_name(folded, elts[i], namelen);
+
+    if (pr_table_add(cdir->names, folded, elts[i], 0) < 0 &&
+        errno == EEXIST) {
+      cdir->ambiguous = TRUE;
+    }
+  }
+
+  dir_stamp(cdir, st);
+
+  if (cf->dirs[VROOT_CASEFOLD_MAX_DIRS-1] != NULL) {
+    dir_remove(cf, cf->dirs[VROOT_CASEFOLD_MAX_DIRS-1]);
+  }
+
+  memmove(&(cf->dirs[1]), &(cf->dirs[0]),
+    (VROOT_CASEFOLD_MAX_DIRS - 1) * sizeof(struct casefold_dir *));
+  cf->dirs[0] = cdir;
+
+  pr_trace_msg(trace_channel, 15, "indexed %d names in '%s'%s", names->nelts,
+    path, cdir->ambiguous ? " (ambiguous)" : "");
+  return cdir;
+}
+
+/* Returns the real name, in the given directory, for the given name
+ * ignoring case.
+ */
+static const char *dir_find(struct vroot_casefold *cf, const char *path,
+    const char *name, size_t namelen) {
+  struct casefold_dir *cdir;
+  struct stat st;
+  char folded[PR_TUNABLE_PATH_MAX + 1];
+
+  if (namelen >= sizeof(folded)) {
+    return NULL;
+  }
+
+  if (stat(path, &st) < 0 ||
+      !S_ISDIR(st.st_mode)) {
+    return NULL;
+  }
+
+  cdir = dir_get(cf, path);
+  if (cdir != NULL &&
+      dir_valid(cdir, &st) == FALSE) {
+    pr_trace_msg(trace_channel, 17, "'%s' changed, discarding its index",
+      path);
+    dir_remove(cf, cdir);
+    cdir = NULL;
+  }
+
+  if (cdir == NULL) {
+    cdir = dir_build(cf, path, &st);
+    if (cdir == NULL) {
+      return NULL;
+    }
+  }
+
+  fold_name(folded, name, namelen);
+  return pr_table_get(cdir->names, folded, NULL);
+}
+
+int vroot_casefold_ctx_lookup(struct vroot_casefold *cf, char *path,
+    size_t pathsz) {
+  struct stat st;
+  char *end, *ptr;
+
+  if (cf == NULL ||
+      path == NULL ||
+      *path != '/' ||
+      strlen(path) >= pathsz) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* The common case: the path exists as given. */
+  if (lstat(path, &st) == 0 ||
+      errno != ENOENT) {
+    return 0;
+  }
+
+  /* Find the deepest directory which exists as given. */
+  end = path + strlen(path);
+  ptr = end;
+
+  while (ptr > path) {
+    int res;
+
+    pr_signals_handle();
+
+    ptr--;
+    while (ptr > path &&
+           *ptr != '/') {
+      ptr--;
+    }
+
+    if (ptr == path) {
+      break;
+    }
+
+    *ptr = '\0';
+    res = lstat(path, &st);
+    *ptr = '/';
+
+    if (res == 0) {
+      break;
+    }
+
+    if (errno != ENOENT) {
+      return 0;
+    }
+  }
+
+  /* Then replace each following component with its real name, for as long
+   * as there is one.
+   */
+  while (ptr < end) {
+    char *name, *next;
+    const char *real_name;
+    size_t namelen;
+
+    pr_signals_handle();
+
+    name = ptr + 1;
+    next = strchr(name, '/');
+    if (next == NULL) {
+      next = end;
+    }
+
+    namelen = next - name;
+    if (namelen == 0) {
+      ptr = next;
+      continue;
+    }
+
+    if (ptr == path) {
+      real_name = dir_find(cf, "/", name, namelen);
+
+    } else {
+      *ptr = '\0';
+      real_name = dir_find(cf, path, name, namelen);
+      *ptr = '/';
+    }
+
+    if (real_name == NULL) {
+      break;
+    }
+
+    if (strncmp(real_name, name, namelen) != 0) {
+      struct casefold_dir *cdir;
+      int exists = FALSE;
+
+      /* With several names folding to the same name, a name which exists
+       * as given must be used as is.
+       */
+      cdir = cf->dirs[0];
+      if (cdir->ambiguous == TRUE) {
+        char ch;
+
+        ch = *next;
+        *next = '\0';
+        exists = (lstat(path, &st) == 0);
+        *next = ch;
+      }
+
+      if (exists == FALSE) {
+        pr_trace_msg(trace_channel, 19, "using real name '%s' for '%.*s'",
+          real_name, (int) namelen, name);
+        memcpy(name, real_name, namelen);
+      }
+    }
+
+    ptr = next;
+  }
+
+  return 0;
+}
+
+int vroot_casefold_lookup(char *path, size_t pathsz) {
+  return vroot_casefold_ctx_lookup(&casefold_default, path, pathsz);
+}
+
+/* Returns the index of the directory of the given path, if any, and
+ * points `name` at the last component of the path.
+ */
+static struct casefold_dir *path_get_dir(const char *path,
+    const char **name) {
+  char dir_path[PR_TUNABLE_PATH_MAX + 1];
+  const char *ptr;
+  size_t dir_pathlen;
+
+  ptr = strrchr(path, '/');
+  if (ptr == NULL ||
+      ptr[1] == '\0') {
+    return NULL;
+  }
+
+  dir_pathlen = ptr - path;
+  if (dir_pathlen >= sizeof(dir_path)) {
+    return NULL;
+  }
+
+  if (dir_pathlen == 0) {
+    dir_pathlen = 1;
+  }
+
+  memcpy(dir_path, path, dir_pathlen);
+  dir_path[dir_pathlen] = '\0';
+
+  *name = ptr + 1;
+  return dir_get(&casefold_default, dir_path);
+}
+
+/* Notes the changes made by this session to an indexed directory, so that
+ * the index remains valid.
+ */
+static void dir_restamp(struct casefold_dir *cdir) {
+  struct stat st;
+
+  if (stat(cdir->path, &st) < 0) {
+    dir_remove(&casefold_default, cdir);
+    return;
+  }
+
+  dir_stamp(cdir, &st);
+}
+
+int vroot_casefold_add(const char *path) {
+  struct casefold_dir *cdir;
+  const char *name = NULL, *real_name;
+  char *folded;
+  size_t namelen;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  cdir = path_get_dir(path, &name);
+  if (cdir == NULL) {
+    return 0;
+  }
+
+  namelen = strlen(name);
+  folded = palloc(cdir->pool, namelen + 1);
+  fold_name(folded, name, namelen);
+
+  real_name = pr_table_get(cdir->names, folded, NULL);
+  if (real_name == NULL) {
+    (void) pr_table_add(cdir->names, folded, pstrdup(cdir->pool, name), 0);
+
+  } else if (strcmp(real_name, name) != 0) {
+    cdir->ambiguous = TRUE;
+  }
+
+  dir_restamp(cdir);
+  return 0;
+}
+
+int vroot_casefold_remove(const char *path) {
+  struct casefold_dir *cdir;
+  const char *name = NULL, *real_name;
+  char folded[PR_TUNABLE_PATH_MAX + 1];
+  size_t namelen;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  cdir = path_get_dir(path, &name);
+  if (cdir == NULL) {
+    return 0;
+  }
+
+  namelen = strlen(name);
+  if (namelen >= sizeof(folded) ||
+      cdir->ambiguous == TRUE) {
+    /* Another name may now be the one to index; start over. */
+    dir_remove(&casefold_default, cdir);
+    return 0;
+  }
+
+  fold_name(folded, name, namelen);
+
+  real_name = pr_table_get(cdir->names, folded, NULL);
+  if (real_name != NULL &&
+      strcmp(real_name, name) == 0) {
+    (void) pr_table_remove(cdir->names, folded, NULL);
+  }
+
+  dir_restamp(cdir);
+  return 0;
+}
+
+struct vroot_casefold *vroot_casefold_alloc(pool *p) {
+  struct vroot_casefold *cf;
+
+  if (p == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  cf = pcalloc(p, sizeof(struct vroot_casefold));
+  cf->pool = p;
+
+  return cf;
+}
+
+int vroot_casefold_clear(struct vroot_casefold *cf) {
+  register unsigned int i;
+
+  if (cf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (i = 0; i < VROOT_CASEFOLD_MAX_DIRS; i++) {
+    if (cf->dirs[i] == NULL) {
+      break;
+    }
+
+    destroy_pool(cf->dirs[i]->pool);
+    cf->dirs[i] = NULL;
+  }
+
+  return 0;
+}
+
+struct vroot_casefold *vroot_casefold_get_default(void) {
+  return &casefold_default;
+}
+
+int vroot_casefold_free(void) {
+  return vroot_casefold_clear(&casefold_default);
+}
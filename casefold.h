@@ -0,0 +1,63 @@
+/*
+ * ProFTPD - mod_vroot Case Folding API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_CASEFOLD_H
+#define MOD_VROOT_CASEFOLD_H
+
+#include "mod_vroot.h"
+
+/* Maximum number of directories whose folded name index is kept. */
+#define VROOT_CASEFOLD_MAX_DIRS		64
+
+/* The folded name indexes of the most recently looked-up directories. */
+struct vroot_casefold;
+
+/* Allocates a set of indexes, kept in the given pool; clearing it destroys
+ * the indexes, but not the set itself.
+ */
+struct vroot_casefold *vroot_casefold_alloc(pool *p);
+int vroot_casefold_clear(struct vroot_casefold *cf);
+
+/* Returns the indexes of the session, used by vroot_casefold_lookup(). */
+struct vroot_casefold *vroot_casefold_get_default(void);
+
+/* Rewrites, in place, the components of the given real path which do not
+ * exist as given, but which match an existing name ignoring (ASCII) case.
+ * Components which exist as given are left as is; so are all components
+ * after the first which does not match any name.
+ */
+int vroot_casefold_ctx_lookup(struct vroot_casefold *cf, char *path,
+  size_t pathsz);
+int vroot_casefold_lookup(char *path, size_t pathsz);
+
+/* Notes that the given real path has been created, or removed, by this
+ * session, updating the index of its directory, if any.
+ */
+int vroot_casefold_add(const char *path);
+int vroot_casefold_remove(const char *path);
+
+/* Internal use only. */
+int vroot_casefold_free(void);
+
+#endif /* MOD_VROOT_CASEFOLD_H */
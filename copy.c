@@ -0,0 +1,392 @@
+/*
+ * ProFTPD - mod_vroot Copy implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "copy.h"
+
+#if defined(__linux__)
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <linux/fs.h>
+#endif /* Linux */
+
+#define VROOT_COPY_BUFSZ		(128 * 1024)
+
+static const char *trace_channel = "vroot.copy";
+
+static int copy_clone(int src_fd, int dst_fd) {
+#if defined(FICLONE)
+  return ioctl(dst_fd, FICLONE, src_fd);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* FICLONE */
+}
+
+/* Copies as much as possible using copy_file_range(2), returning the number
+ * of bytes copied.  Any remainder is left for the read(2)/write(2) loop,
+ * e.g. when the filesystems involved do not support it.
+ */
+static off_t copy_range(int src_fd, int dst_fd, off_t len) {
+  off_t copied = 0;
+
+#if defined(SYS_copy_file_range)
+  while (copied < len) {
+    loff_t src_off, dst_off;
+    ssize_t res;
+
+    src_off = dst_off = copied;
+    res = syscall(SYS_copy_file_range, src_fd, &src_off, dst_fd, &dst_off,
+      (size_t) (len - copied), 0);
+    if (res < 0) {
+      int xerrno = errno;
+
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 9,
+        "copy_file_range(2) failed after %" PR_LU " bytes: %s",
+        (pr_off_t) copied, strerror(xerrno));
+      break;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    copied += res;
+  }
+#endif /* SYS_copy_file_range */
+
+  return copied;
+}
+
+/* Copies as much as possible using splice(2), through a pipe, starting at the
+ * given offset, and returning the new offset.  Unlike copy_file_range(2),
+ * this works between any filesystems, without the data being copied into
+ * user space.
+ */
+static off_t copy_splice(int src_fd, int dst_fd, off_t offset, off_t len) {
+#if defined(SPLICE_F_MOVE)
+  int fds[2];
+
+  if (offset >= len) {
+    return offset;
+  }
+
+  if (pipe(fds) < 0) {
+    pr_trace_msg(trace_channel, 9, "unable to create pipe for splice(2): %s",
+      strerror(errno));
+    return offset;
+  }
+
+  while (offset < len) {
+    loff_t src_off, dst_off;
+    ssize_t nread, nwritten;
+
+    src_off = offset;
+    nread = splice(src_fd, &src_off, fds[1], NULL, (size_t) (len - offset),
+      SPLICE_F_MOVE);
+    if (nread < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 9,
+        "splice(2) failed after %" PR_LU " bytes: %s", (pr_off_t) offset,
+        strerror(errno));
+      break;
+    }
+
+    if (nread == 0) {
+      break;
+    }
+
+    /* Drain the pipe completely, so that a failure here leaves nothing
+     * buffered which the read/write loop would not know about.
+     */
+    dst_off = offset;
+    while (nread > 0) {
+      nwritten = splice(fds[0], NULL, dst_fd, &dst_off, (size_t) nread,
+        SPLICE_F_MOVE);
+      if (nwritten < 0) {
+        if (errno == EINTR) {
+          pr_signals_handle();
+          continue;
+        }
+
+        break;
+      }
+
+      /* Nothing written, e.g. on a full filesystem, would never end; leave
+       * the rest to the read/write loop, which reports the error.
+       */
+      if (nwritten == 0) {
+        errno = EIO;
+        break;
+      }
+
+      nread -= nwritten;
+    }
+
+    offset = dst_off;
+    if (nread > 0) {
+      pr_trace_msg(trace_channel, 9,
+        "splice(2) failed after %" PR_LU " bytes: %s", (pr_off_t) offset,
+        strerror(errno));
+      break;
+    }
+  }
+
+  (void) close(fds[0]);
+  (void) close(fds[1]);
+#endif /* SPLICE_F_MOVE */
+
+  return offset;
+}
+
+static int copy_rw(pool *p, int src_fd, int dst_fd, off_t offset) {
+  char *buf;
+
+  buf = palloc(p, VROOT_COPY_BUFSZ);
+
+  while (TRUE) {
+    ssize_t nread, nwritten;
+    size_t buflen;
+    char *ptr;
+
+    pr_signals_handle();
+
+    nread = pread(src_fd, buf, VROOT_COPY_BUFSZ, offset);
+    if (nread < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (nread == 0) {
+      break;
+    }
+
+    ptr = buf;
+    buflen = nread;
+
+    while (buflen > 0) {
+      nwritten = pwrite(dst_fd, ptr, buflen, offset);
+      if (nwritten < 0) {
+        if (errno == EINTR) {
+          pr_signals_handle();
+          continue;
+        }
+
+        return -1;
+      }
+
+      ptr += nwritten;
+      buflen -= nwritten;
+      offset += nwritten;
+    }
+  }
+
+  return 0;
+}
+
+static int copy_data(pool *p, int src_fd, int dst_fd, off_t len) {
+  off_t copied;
+
+  if (copy_clone(src_fd, dst_fd) == 0) {
+    pr_trace_msg(trace_channel, 17, "copied %" PR_LU " bytes using FICLONE",
+      (pr_off_t) len);
+    return 0;
+  }
+
+  copied = copy_range(src_fd, dst_fd, len);
+  if (copied > 0) {
+    pr_trace_msg(trace_channel, 17,
+      "copied %" PR_LU " bytes using copy_file_range(2)", (pr_off_t) copied);
+  }
+
+  if (copied < len) {
+    off_t offset;
+
+    offset = copy_splice(src_fd, dst_fd, copied, len);
+    if (offset > copied) {
+      pr_trace_msg(trace_channel, 17, "copied %" PR_LU " bytes using splice(2)",
+        (pr_off_t) (offset - copied));
+      copied = offset;
+    }
+  }
+
+  /* Always finish with the read/write loop, in case the file grew. */
+  return copy_rw(p, src_fd, dst_fd, copied);
+}
+
+static void copy_metadata(int dst_fd, struct stat *st, const char *path) {
+  /* Ownership can only be preserved when privileged; do it before setting
+   * the mode, as chown(2) may clear the set-id bits.
+   */
+  if (fchown(dst_fd, st->st_uid, st->st_gid) < 0) {
+    pr_trace_msg(trace_channel, 9,
+      "unable to preserve ownership (UID %s, GID %s) of '%s': %s",
+      pr_uid2str(NULL, st->st_uid), pr_gid2str(NULL, st->st_gid), path,
+      strerror(errno));
+  }
+
+  if (fchmod(dst_fd, st->st_mode & 07777) < 0) {
+    pr_trace_msg(trace_channel, 9, "unable to preserve mode %04o of '%s': %s",
+      (unsigned int) (st->st_mode & 07777), path, strerror(errno));
+  }
+
+#if defined(UTIME_NOW)
+  {
+    struct timespec ts[2];
+
+    ts[0] = st->st_atim;
+    ts[1] = st->st_mtim;
+
+    if (futimens(dst_fd, ts) < 0) {
+      pr_trace_msg(trace_channel, 9, "unable to preserve times of '%s': %s",
+        path, strerror(errno));
+    }
+  }
+#endif /* UTIME_NOW */
+}
+
+int vroot_copy_file(pool *p, const char *src_path, const char *dst_path,
+    off_t max_size, int flags) {
+  int res, src_fd, dst_fd, xerrno;
+  char *tmp_path, *ptr;
+  struct stat st;
+  pool *tmp_pool;
+
+  if (src_path == NULL ||
+      dst_path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  src_fd = open(src_path, O_RDONLY);
+  if (src_fd < 0) {
+    return -1;
+  }
+
+  if (fstat(src_fd, &st) < 0) {
+    xerrno = errno;
+    (void) close(src_fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Only regular files are copied; anything else is left to the caller. */
+  if (!S_ISREG(st.st_mode)) {
+    (void) close(src_fd);
+    errno = EXDEV;
+    return -1;
+  }
+
+  if (max_size > 0 &&
+      st.st_size > max_size) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "refusing to copy '%s' (%" PR_LU " bytes): exceeds max size (%" PR_LU
+      " bytes)", src_path, (pr_off_t) st.st_size, (pr_off_t) max_size);
+    (void) close(src_fd);
+    errno = EFBIG;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "VRoot copy pool");
+
+  tmp_path = pstrdup(tmp_pool, dst_path);
+  ptr = strrchr(tmp_path, '/');
+  if (ptr != NULL) {
+    *(ptr + 1) = '\0';
+    tmp_path = pstrcat(tmp_pool, tmp_path, ".vroot-copy.XXXXXX", NULL);
+
+  } else {
+    tmp_path = pstrdup(tmp_pool, ".vroot-copy.XXXXXX");
+  }
+
+  dst_fd = mkstemp(tmp_path);
+  if (dst_fd < 0) {
+    xerrno = errno;
+    (void) close(src_fd);
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "copying '%s' to '%s' (via '%s')", src_path,
+    dst_path, tmp_path);
+
+  res = copy_data(tmp_pool, src_fd, dst_fd, st.st_size);
+  if (res == 0) {
+    copy_metadata(dst_fd, &st, dst_path);
+
+    /* When the caller will remove the source once we return, make sure the
+     * copy has hit the disk first.
+     */
+    if (flags & VROOT_COPY_FL_SYNC) {
+      res = fsync(dst_fd);
+    }
+  }
+
+  xerrno = errno;
+  (void) close(src_fd);
+
+  if (close(dst_fd) < 0 &&
+      res == 0) {
+    res = -1;
+    xerrno = errno;
+  }
+
+  if (res == 0) {
+    if (flags & VROOT_COPY_FL_NOREPLACE) {
+      res = link(tmp_path, dst_path);
+      xerrno = errno;
+      (void) unlink(tmp_path);
+
+    } else {
+      res = rename(tmp_path, dst_path);
+      xerrno = errno;
+    }
+  }
+
+  if (res < 0) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error copying '%s' to '%s': %s", src_path, dst_path, strerror(xerrno));
+    (void) unlink(tmp_path);
+    destroy_pool(tmp_pool);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  destroy_pool(tmp_pool);
+  return 0;
+}
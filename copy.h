@@ -0,0 +1,48 @@
+/*
+ * ProFTPD - mod_vroot Copy API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_COPY_H
+#define MOD_VROOT_COPY_H
+
+#include "mod_vroot.h"
+
+/* Copies the given regular file, along with its mode, times and (where
+ * permitted) ownership.  The copy is written to a temporary file in the
+ * destination directory, then renamed into place, so that `dst_path` never
+ * refers to a partial copy.  The data is copied in the kernel where possible,
+ * using a reflink (FICLONE) first, then copy_file_range(2), then splice(2),
+ * and only then read(2)/write(2).
+ *
+ * Files larger than `max_size`, if nonzero, are refused with EFBIG.
+ */
+int vroot_copy_file(pool *p, const char *src_path, const char *dst_path,
+  off_t max_size, int flags);
+
+/* Fail with EEXIST, rather than replacing an existing destination. */
+#define VROOT_COPY_FL_NOREPLACE		0x0001
+
+/* Flush the copy to disk before it replaces the destination. */
+#define VROOT_COPY_FL_SYNC		0x0002
+
+#endif /* MOD_VROOT_COPY_H */
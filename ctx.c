@@ -0,0 +1,66 @@
+/*
+ * ProFTPD: mod_vroot Context API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "ctx.h"
+
+/* The default context; its alias table is allocated by vroot_alias_init(). */
+static struct vroot_ctx vroot_default_ctx;
+
+struct vroot_ctx *vroot_ctx_alloc(pool *p) {
+  pool *ctx_pool;
+  struct vroot_ctx *ctx;
+
+  if (p == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  ctx_pool = make_sub_pool(p);
+  pr_pool_tag(ctx_pool, "VRoot Context Pool");
+
+  ctx = pcalloc(ctx_pool, sizeof(struct vroot_ctx));
+  ctx->ctx_pool = ctx_pool;
+  ctx->alias_tab = pr_table_alloc(ctx_pool, 0);
+  ctx->cwd = "/";
+  ctx->casefold = vroot_casefold_alloc(ctx_pool);
+
+  return ctx;
+}
+
+int vroot_ctx_destroy(struct vroot_ctx *ctx) {
+  if (ctx == NULL ||
+      ctx == &vroot_default_ctx) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_table_empty(ctx->alias_tab);
+  (void) vroot_casefold_clear(ctx->casefold);
+  destroy_pool(ctx->ctx_pool);
+  return 0;
+}
+
+struct vroot_ctx *vroot_ctx_get_default(void) {
+  return &vroot_default_ctx;
+}
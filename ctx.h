@@ -0,0 +1,77 @@
+/*
+ * ProFTPD - mod_vroot Context API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_CTX_H
+#define MOD_VROOT_CTX_H
+
+#include "mod_vroot.h"
+#include "casefold.h"
+#include "hide.h"
+
+/* A context holds the vroot base, the configured aliases, and the rest of
+ * the state which lookups use.  The vroot_path_ctx_* and vroot_alias_ctx_*
+ * functions operate on an explicitly given context; the vroot_path_* and
+ * vroot_alias_* functions operate on the default context, which they first
+ * update from the session (its current directory, VRootOptions, VRootHide,
+ * and HiddenStores upload).
+ *
+ * Lookups handle signals, and log to the trace channels; they are only to be
+ * done by the session process itself.
+ */
+struct vroot_ctx {
+  pool *ctx_pool;
+
+  char base[PR_TUNABLE_PATH_MAX + 1];
+  size_t baselen;
+
+  /* The directory against which "." is looked up. */
+  const char *cwd;
+
+  /* The VRootOptions, and VRootHide patterns, used by lookups. */
+  unsigned int opts;
+  const struct vroot_hide *hide;
+
+  /* A path exempt from hiding, e.g. the HiddenStores upload in progress. */
+  const char *hide_exempt_path;
+
+  /* The folded name indexes, for VROOT_OPT_CASE_INSENSITIVE. */
+  struct vroot_casefold *casefold;
+
+  pr_table_t *alias_tab;
+
+  /* Aliases with configured attributes. */
+  array_header *alias_attrs;
+
+  /* Aliases whose destination name is a pattern, by destination directory. */
+  array_header *alias_pattern_dirs;
+  unsigned int alias_pattern_count;
+};
+
+struct vroot_ctx *vroot_ctx_alloc(pool *p);
+int vroot_ctx_destroy(struct vroot_ctx *ctx);
+
+/* Returns the default context, used by the FSIO callbacks. */
+struct vroot_ctx *vroot_ctx_get_default(void);
+
+#endif /* MOD_VROOT_CTX_H */
@@ -0,0 +1,539 @@
+/*
+ * ProFTPD - mod_vroot Directory Cache implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "dircache.h"
+
+#include <sys/mman.h>
+#include <stdint.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+/* Readers never lock the cache; each slot is guarded by a sequence count,
+ * which writers make odd while updating the slot, and which readers check
+ * before and after copying it.  The count shares one atomic word with the
+ * PID of the writer, so that only one writer can take over the slot of a
+ * writer which died.
+ */
+#if defined(__ATOMIC_ACQUIRE)
+# define VROOT_DIRCACHE_ATOMICS		1
+#endif
+
+/* Number of slots considered, for a given directory, when looking it up and
+ * when choosing which slot to evict.
+ */
+#define VROOT_DIRCACHE_PROBES		4
+
+/* Directories changed more recently than this many seconds are not cached,
+ * as a later change within the same timestamp would go unnoticed.
+ */
+#define VROOT_DIRCACHE_MIN_AGE		2
+
+/* Number of attempts at reading a slot being concurrently updated. */
+#define VROOT_DIRCACHE_READ_ATTEMPTS	3
+
+struct dircache_key {
+  dev_t dev;
+  ino_t ino;
+  time_t mtime_sec;
+  long mtime_nsec;
+  time_t ctime_sec;
+  long ctime_nsec;
+};
+
+/* Each entry is stored as its inode number, its type, and its
+ * NUL-terminated name.
+ */
+#define VROOT_DIRCACHE_ENTRY_HDRSZ	(sizeof(ino_t) + 1)
+
+#define DIRCACHE_STATE(seq, pid) \
+  ((((uint64_t) (uint32_t) (pid)) << 32) | (uint64_t) (uint32_t) (seq))
+#define DIRCACHE_STATE_SEQ(state)	((uint32_t) ((state) & 0xffffffffUL))
+#define DIRCACHE_STATE_PID(state)	((pid_t) ((state) >> 32))
+
+struct dircache_slot {
+  uint64_t state;
+  int used;
+  struct dircache_key key;
+  time_t last_used;
+  unsigned int nentries;
+  size_t datasz;
+  char data[VROOT_DIRCACHE_MAX_LISTING];
+};
+
+struct dircache_table {
+  size_t nslots;
+  struct dircache_slot slots[1];
+};
+
+struct vroot_dircache_listing {
+  pool *pool;
+  struct dircache_key key;
+
+  char *data;
+  size_t datasz, bufsz;
+  unsigned int nentries;
+
+  /* Offset of the next entry provided, for cached listings. */
+  size_t offset;
+
+  /* Set once a recorded listing is too large to be cached. */
+  int overflow;
+};
+
+static struct dircache_table *dircache_table = NULL;
+
+static const char *trace_channel = "vroot.dircache";
+
+static void dircache_key_init(struct dircache_key *key,
+    const struct stat *st) {
+  memset(key, 0, sizeof(struct dircache_key));
+  key->dev = st->st_dev;
+  key->ino = st->st_ino;
+  key->mtime_sec = st->st_mtime;
+  key->ctime_sec = st->st_ctime;
+
+#if defined(__APPLE__)
+  key->mtime_nsec = st->st_mtimespec.tv_nsec;
+  key->ctime_nsec = st->st_ctimespec.tv_nsec;
+#elif defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+      defined(__OpenBSD__) || defined(__sun)
+  key->mtime_nsec = st->st_mtim.tv_nsec;
+  key->ctime_nsec = st->st_ctim.tv_nsec;
+#endif
+}
+
+static int dircache_key_eq(const struct dircache_key *key1,
+    const struct dircache_key *key2) {
+  return (key1->dev == key2->dev &&
+          key1->ino == key2->ino &&
+          key1->mtime_sec == key2->mtime_sec &&
+          key1->mtime_nsec == key2->mtime_nsec &&
+          key1->ctime_sec == key2->ctime_sec &&
+          key1->ctime_nsec == key2->ctime_nsec);
+}
+
+const char *vroot_dircache_next(struct vroot_dircache_listing *listing,
+    ino_t *ino, unsigned char *type) {
+  const char *name;
+
+  if (listing == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (listing->offset + VROOT_DIRCACHE_ENTRY_HDRSZ >= listing->datasz) {
+    return NULL;
+  }
+
+  if (ino != NULL) {
+    memcpy(ino, listing->data + listing->offset, sizeof(ino_t));
+  }
+
+  if (type != NULL) {
+    *type = (unsigned char) listing->data[listing->offset + sizeof(ino_t)];
+  }
+
+  name = listing->data + listing->offset + VROOT_DIRCACHE_ENTRY_HDRSZ;
+  listing->offset += VROOT_DIRCACHE_ENTRY_HDRSZ + strlen(name) + 1;
+
+  return name;
+}
+
+struct vroot_dircache_listing *vroot_dircache_open(pool *p,
+    const struct stat *st) {
+  pool *listing_pool;
+  struct vroot_dircache_listing *listing;
+
+  if (p == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  listing_pool = make_sub_pool(p);
+  pr_pool_tag(listing_pool, "VRoot Directory Cache Listing Pool");
+
+  listing = pcalloc(listing_pool, sizeof(struct vroot_dircache_listing));
+  listing->pool = listing_pool;
+  dircache_key_init(&(listing->key), st);
+
+  return listing;
+}
+
+int vroot_dircache_add(struct vroot_dircache_listing *listing,
+    const char *name, ino_t ino, unsigned char type) {
+  size_t entrysz;
+  char *ptr;
+
+  if (listing == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (listing->overflow == TRUE) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  entrysz = VROOT_DIRCACHE_ENTRY_HDRSZ + strlen(name) + 1;
+  if (listing->datasz + entrysz > VROOT_DIRCACHE_MAX_LISTING) {
+    pr_trace_msg(trace_channel, 15,
+      "listing exceeds %lu bytes, not caching it",
+      (unsigned long) VROOT_DIRCACHE_MAX_LISTING);
+    listing->overflow = TRUE;
+    errno = EFBIG;
+    return -1;
+  }
+
+  if (listing->datasz + entrysz > listing->bufsz) {
+    size_t bufsz;
+    char *buf;
+
+    bufsz = (listing->bufsz > 0 ? listing->bufsz : 4096);
+    while (bufsz < listing->datasz + entrysz) {
+      bufsz *= 2;
+    }
+
+    if (bufsz > VROOT_DIRCACHE_MAX_LISTING) {
+      bufsz = VROOT_DIRCACHE_MAX_LISTING;
+    }
+
+    buf = palloc(listing->pool, bufsz);
+    if (listing->datasz > 0) {
+      memcpy(buf, listing->data, listing->datasz);
+    }
+
+    listing->data = buf;
+    listing->bufsz = bufsz;
+  }
+
+  ptr = listing->data + listing->datasz;
+  memcpy(ptr, &ino, sizeof(ino_t));
+  ptr[sizeof(ino_t)] = (char) type;
+  memcpy(ptr + VROOT_DIRCACHE_ENTRY_HDRSZ, name, strlen(name) + 1);
+
+  listing->datasz += entrysz;
+  listing->nentries++;
+
+  return 0;
+}
+
+int vroot_dircache_close(struct vroot_dircache_listing *listing) {
+  if (listing == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  destroy_pool(listing->pool);
+  return 0;
+}
+
+#if defined(VROOT_DIRCACHE_ATOMICS)
+
+int vroot_dircache_init(size_t size) {
+  size_t nslots, tabsz;
+  void *ptr;
+
+  if (dircache_table != NULL) {
+    return 0;
+  }
+
+  /* The slots are shared between processes, which rules out atomics
+   * emulated with locks.
+   */
+  if (!__atomic_always_lock_free(sizeof(uint64_t), 0)) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  nslots = size / sizeof(struct dircache_slot);
+  if (nslots == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tabsz = sizeof(struct dircache_table) +
+    ((nslots - 1) * sizeof(struct dircache_slot));
+
+  ptr = mmap(NULL, tabsz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+    -1, 0);
+  if (ptr == MAP_FAILED) {
+    return -1;
+  }
+
+  dircache_table = ptr;
+  dircache_table->nslots = nslots;
+
+  pr_trace_msg(trace_channel, 9, "created directory cache of %lu slots",
+    (unsigned long) nslots);
+  return 0;
+}
+
+static size_t dircache_hash(const struct dircache_key *key) {
+  unsigned long long h;
+
+  h = ((unsigned long long) key->ino * 0x9e3779b97f4a7c15ULL) ^
+    (unsigned long long) key->dev;
+  return (size_t) (h % dircache_table->nslots);
+}
+
+static struct dircache_slot *dircache_slot(size_t idx) {
+  return &(dircache_table->slots[idx % dircache_table->nslots]);
+}
+
+/* Copies the given slot, if it holds the listing for the given key; returns
+ * -1, with errno set to EAGAIN, if it is being updated.
+ */
+static int dircache_read_slot(struct dircache_slot *slot,
+    struct vroot_dircache_listing *listing) {
+  uint64_t state1, state2;
+  int matched = FALSE;
+  size_t datasz;
+
+  state1 = __atomic_load_n(&(slot->state), __ATOMIC_ACQUIRE);
+  if (DIRCACHE_STATE_SEQ(state1) & 1) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  if (slot->used == TRUE &&
+      dircache_key_eq(&(slot->key), &(listing->key))) {
+    datasz = slot->datasz;
+    if (datasz <= VROOT_DIRCACHE_MAX_LISTING) {
+      if (datasz > listing->bufsz) {
+        listing->data = palloc(listing->pool, datasz);
+        listing->bufsz = datasz;
+      }
+
+      memcpy(listing->data, slot->data, datasz);
+      listing->datasz = datasz;
+      listing->nentries = slot->nentries;
+      matched = TRUE;
+    }
+  }
+
+  /* Make sure the copy is done before checking the count again. */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  state2 = __atomic_load_n(&(slot->state), __ATOMIC_RELAXED);
+  if (state1 != state2) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  if (matched == FALSE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  __atomic_store_n(&(slot->last_used), time(NULL), __ATOMIC_RELAXED);
+  return 0;
+}
+
+struct vroot_dircache_listing *vroot_dircache_get(pool *p,
+    const struct stat *st) {
+  register unsigned int i;
+  struct vroot_dircache_listing *listing;
+  size_t idx;
+
+  if (p == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (dircache_table == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  listing = vroot_dircache_open(p, st);
+  if (listing == NULL) {
+    return NULL;
+  }
+
+  idx = dircache_hash(&(listing->key));
+  for (i = 0; i < VROOT_DIRCACHE_PROBES; i++) {
+    register unsigned int j;
+    struct dircache_slot *slot;
+
+    slot = dircache_slot(idx + i);
+
+    for (j = 0; j < VROOT_DIRCACHE_READ_ATTEMPTS; j++) {
+      if (dircache_read_slot(slot, listing) == 0) {
+        pr_trace_msg(trace_channel, 17,
+          "using cached listing of %u entries for inode %lu", listing->nentries,
+          (unsigned long) st->st_ino);
+        return listing;
+      }
+
+      if (errno != EAGAIN) {
+        break;
+      }
+    }
+  }
+
+  (void) vroot_dircache_close(listing);
+  errno = ENOENT;
+  return NULL;
+}
+
+/* Chooses the slot for the given key: the slot already used for the same
+ * directory, an unused slot, or else the least recently used slot.
+ */
+static struct dircache_slot *dircache_choose_slot(
+    const struct dircache_key *key) {
+  register unsigned int i;
+  struct dircache_slot *victim = NULL;
+  size_t idx;
+
+  idx = dircache_hash(key);
+  for (i = 0; i < VROOT_DIRCACHE_PROBES; i++) {
+    struct dircache_slot *slot;
+
+    slot = dircache_slot(idx + i);
+    if (slot->used == FALSE ||
+        (slot->key.dev == key->dev &&
+         slot->key.ino == key->ino)) {
+      return slot;
+    }
+
+    if (victim == NULL ||
+        slot->last_used < victim->last_used) {
+      victim = slot;
+    }
+  }
+
+  return victim;
+}
+
+int vroot_dircache_put(struct vroot_dircache_listing *listing,
+    const struct stat *st) {
+  struct dircache_key key;
+  struct dircache_slot *slot;
+  uint64_t state, next_state;
+  uint32_t seq, next_seq;
+  time_t now;
+
+  if (listing == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (dircache_table == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (listing->overflow == TRUE) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  dircache_key_init(&key, st);
+  now = time(NULL);
+
+  if (dircache_key_eq(&key, &(listing->key)) == FALSE ||
+      now - key.mtime_sec < VROOT_DIRCACHE_MIN_AGE ||
+      now - key.ctime_sec < VROOT_DIRCACHE_MIN_AGE) {
+    pr_trace_msg(trace_channel, 15,
+      "inode %lu changed recently, not caching its listing",
+      (unsigned long) st->st_ino);
+    errno = EAGAIN;
+    return -1;
+  }
+
+  slot = dircache_choose_slot(&key);
+
+  /* Writers only skip a slot being updated by another session, unless that
+   * session has since died; the slot then stays odd until rewritten.  Taking
+   * over compares against the state naming the dead writer, thus only one
+   * session can succeed.
+   */
+  state = __atomic_load_n(&(slot->state), __ATOMIC_ACQUIRE);
+  seq = DIRCACHE_STATE_SEQ(state);
+  if (seq & 1) {
+    pid_t writer_pid;
+
+    writer_pid = DIRCACHE_STATE_PID(state);
+    if (writer_pid > 0 &&
+        (kill(writer_pid, 0) == 0 || errno != ESRCH)) {
+      errno = EBUSY;
+      return -1;
+    }
+
+    next_seq = seq + 2;
+
+  } else {
+    next_seq = seq + 1;
+  }
+
+  next_state = DIRCACHE_STATE(next_seq, getpid());
+  if (__atomic_compare_exchange_n(&(slot->state), &state, next_state, FALSE,
+      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) == FALSE) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  slot->used = TRUE;
+  memcpy(&(slot->key), &key, sizeof(struct dircache_key));
+  slot->last_used = now;
+  slot->nentries = listing->nentries;
+  slot->datasz = listing->datasz;
+  if (listing->datasz > 0) {
+    memcpy(slot->data, listing->data, listing->datasz);
+  }
+
+  __atomic_store_n(&(slot->state), DIRCACHE_STATE(next_seq + 1, 0),
+    __ATOMIC_RELEASE);
+
+  pr_trace_msg(trace_channel, 17,
+    "cached listing of %u entries for inode %lu", listing->nentries,
+    (unsigned long) st->st_ino);
+  return 0;
+}
+
+#else
+
+int vroot_dircache_init(size_t size) {
+  errno = ENOSYS;
+  return -1;
+}
+
+struct vroot_dircache_listing *vroot_dircache_get(pool *p,
+    const struct stat *st) {
+  errno = ENOENT;
+  return NULL;
+}
+
+int vroot_dircache_put(struct vroot_dircache_listing *listing,
+    const struct stat *st) {
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif /* VROOT_DIRCACHE_ATOMICS */
@@ -0,0 +1,73 @@
+/*
+ * ProFTPD - mod_vroot Directory Cache API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_DIRCACHE_H
+#define MOD_VROOT_DIRCACHE_H
+
+#include "mod_vroot.h"
+
+#define VROOT_DIRCACHE_DEFAULT_SIZE	(16 * 1024 * 1024)
+
+/* Largest listing, in bytes of entry data, which is cached. */
+#define VROOT_DIRCACHE_MAX_LISTING	(64 * 1024)
+
+struct vroot_dircache_listing;
+
+/* Creates the cache of directory listings, of the given size in bytes,
+ * shared by all sessions.  This is done by the daemon, before sessions are
+ * forked; without it, nothing is cached.
+ */
+int vroot_dircache_init(size_t size);
+
+/* Returns the cached listing of the directory with the given attributes,
+ * copied into the given pool, if still valid for them.  Returns NULL, with
+ * errno set to ENOENT, if there is none.
+ */
+struct vroot_dircache_listing *vroot_dircache_get(pool *p,
+  const struct stat *st);
+
+/* Provides the next entry of the given listing, setting its inode number and
+ * type (as for dirent.d_type); returns NULL at the end of the listing.
+ */
+const char *vroot_dircache_next(struct vroot_dircache_listing *listing,
+  ino_t *ino, unsigned char *type);
+
+/* Starts recording the listing of the directory with the given attributes,
+ * read from disk; entries are then added as they are read.
+ */
+struct vroot_dircache_listing *vroot_dircache_open(pool *p,
+  const struct stat *st);
+int vroot_dircache_add(struct vroot_dircache_listing *listing,
+  const char *name, ino_t ino, unsigned char type);
+
+/* Stores the recorded listing in the cache, if the directory, now having
+ * the given attributes, did not change while being read.
+ */
+int vroot_dircache_put(struct vroot_dircache_listing *listing,
+  const struct stat *st);
+
+/* Releases the memory used by the given listing. */
+int vroot_dircache_close(struct vroot_dircache_listing *listing);
+
+#endif /* MOD_VROOT_DIRCACHE_H */
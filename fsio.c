@@ -25,21 +25,773 @@
 #include "fsio.h"
 #include "path.h"
 #include "alias.h"
+#include "prefetch.h"
+#include "copy.h"
+#include "policy.h"
+#include "seqread.h"
+#include "watchdog.h"
+#include "throttle.h"
+#include "dircache.h"
+#include "aliascache.h"
+#include "casefold.h"
+#include "union.h"
+#include "spread.h"
+#include "hide.h"
+#include "virtdir.h"
+#include "shard.h"
+#include "cachetier.h"
+#include "staging.h"
+#include "mirror.h"
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif /* Linux */
 
 static pool *vroot_dir_pool = NULL;
 static pr_table_t *vroot_dirtab = NULL;
 
+/* Per-handle state for directories opened while aliases are configured;
+ * multiple directories may be open at the same time (e.g. for recursive
+ * listings), hence this is kept per handle rather than globally.
+ */
+struct vroot_dir {
+  const char *path;
+
+  /* Alias names to be appended to the real directory entries. */
+  array_header *aliases;
+  int alias_idx;
+
+  /* Dirent used for returning the alias entries. */
+  struct dirent *dent;
+
+  struct vroot_prefetch *prefetch;
+  struct vroot_seqread *seqread;
+
+  /* The listing being recorded for the shared directory cache or, for
+   * listings served from that cache (there being no real directory handle),
+   * the cached listing.
+   */
+  struct vroot_dircache_listing *dircache;
+  int dircache_hit;
+
+  /* The lower layers to be merged into the listing, for directories within
+   * a union alias.
+   */
+  struct vroot_union_dir *union_dir;
+  int union_lower;
+
+  /* The other targets to be merged into the listing, for directories within
+   * a spread alias.
+   */
+  struct vroot_spread_dir *spread_dir;
+  int spread_other;
+
+  /* For virtual directories which do not exist, there being no real
+   * directory handle, the number of synthesized "." and ".." entries
+   * returned so far.
+   */
+  int virtual_dir;
+  int virtual_idx;
+
+  /* The shards listed, instead of the real directory, for a sharded alias. */
+  struct vroot_shard_dir *shard_dir;
+};
+
 static const char *trace_channel = "vroot.fsio";
 
-int vroot_fsio_stat(pr_fs_t *fs, const char *stat_path, struct stat *st) {
+/* The FSIO callbacks below are written once, as templates taking a set of
+ * flags describing the session configuration.  Each set of callbacks
+ * installed by vroot_fsio_install() passes a constant set of flags, so that
+ * the compiler can discard the checks which do not apply to it.
+ */
+
+/* The callbacks are only used once the vroot base has been set. */
+#define VROOT_FSIO_FL_HAVE_BASE		0x0100
+
+/* Is the given operation not to be virtualized? */
+#define VROOT_FSIO_BYPASS(fl) \
+  (((fl) & VROOT_FSIO_FL_PASSTHROUGH) || \
+   session.curr_phase == LOG_CMD || \
+   session.curr_phase == LOG_CMD_ERR || \
+   (session.sf_flags & SF_ABORT) || \
+   (!((fl) & VROOT_FSIO_FL_HAVE_BASE) && vroot_path_have_base() == FALSE))
+
+static int fsio_allow_symlinks(int fsio_flags) {
+  if (fsio_flags & VROOT_FSIO_FL_GENERIC) {
+    return (vroot_opts & VROOT_OPT_ALLOW_SYMLINKS);
+  }
+
+  return (fsio_flags & VROOT_FSIO_FL_SYMLINKS);
+}
+
+static int fsio_alias_exists(int fsio_flags, const char *path) {
+  if (!(fsio_flags & VROOT_FSIO_FL_ALIASES)) {
+    return FALSE;
+  }
+
+  return vroot_alias_exists(path);
+}
+
+/* Resolves the given path as fsio_lookup() does, choosing the union alias
+ * layer, or spread alias target, if any, by the given VROOT_UNION_OP
+ * operation.
+ */
+static int fsio_lookup_op(pool *p, char *vpath, size_t vpathsz,
+    const char *path, int fsio_flags, char **alias_path, int op) {
+  int flags = 0;
+
+  /* Without any aliases, there is no need to probe for them. */
+  if (!(fsio_flags & VROOT_FSIO_FL_ALIASES)) {
+    flags |= VROOT_LOOKUP_FL_NO_ALIAS;
+  }
+
+  if (vroot_path_lookup(p, vpath, vpathsz, path, flags, alias_path) < 0) {
+    return -1;
+  }
+
+  if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+    if (vroot_union_count() > 0 &&
+        vroot_union_lookup(vpath, vpathsz, op) < 0) {
+      return -1;
+    }
+
+    /* Only new files are placed; anything else is where it was found. */
+    if (vroot_spread_count() > 0) {
+      int spread_op = VROOT_SPREAD_OP_FIND;
+
+      if (op == VROOT_UNION_OP_CREATE ||
+          op == VROOT_UNION_OP_CREATE_EXCL) {
+        spread_op = VROOT_SPREAD_OP_CREATE;
+      }
+
+      if (vroot_spread_lookup(vpath, vpathsz, spread_op) < 0) {
+        return -1;
+      }
+    }
+
+    /* Fail fast, rather than hang, on alias sources known to be unavailable. */
+    return vroot_watchdog_check(vpath);
+  }
+
+  return 0;
+}
+
+static int fsio_lookup(pool *p, char *vpath, size_t vpathsz, const char *path,
+    int fsio_flags, char **alias_path) {
+  return fsio_lookup_op(p, vpath, vpathsz, path, fsio_flags, alias_path,
+    VROOT_UNION_OP_READ);
+}
+
+/* Provides the attributes of the given path, if it is a virtual directory
+ * which does not exist.  Virtual directories are only configured along with
+ * aliases, being mostly the parent directories of aliases.
+ */
+static int fsio_virtdir_stat(const char *vpath, int fsio_flags,
+    struct stat *st) {
+  if (!(fsio_flags & VROOT_FSIO_FL_ALIASES) ||
+      vroot_virtdir_count() == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  return vroot_virtdir_stat(vpath, st);
+}
+
+/* Creates any missing virtual directories, shard directories, or spread
+ * target directories, in which the given path is about to be created.  On
+ * failure, the caller's operation fails for the missing directory as usual.
+ */
+static void fsio_create_parents(const char *vpath, int fsio_flags) {
+  const struct vroot_alias_attrs *attrs;
+  const char *rel_path = NULL;
+
+  if (!(fsio_flags & VROOT_FSIO_FL_ALIASES)) {
+    return;
+  }
+
+  if (vroot_virtdir_count() > 0 &&
+      vroot_virtdir_materialize(vpath) < 0) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error creating virtual directories for '%s': %s", vpath,
+      strerror(errno));
+  }
+
+  if (vroot_spread_count() > 0 &&
+      vroot_spread_mkdirs(vpath) < 0) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error creating spread target directories for '%s': %s", vpath,
+      strerror(errno));
+  }
+
+  attrs = vroot_alias_find_attrs(vpath, &rel_path);
+  if (attrs != NULL &&
+      attrs->shard_levels > 0) {
+    unsigned int depth = 0;
+    const char *ptr;
+
+    /* Only names directly within the sharded alias are in shards. */
+    for (ptr = rel_path; *ptr != '\0'; ptr++) {
+      if (*ptr == '/') {
+        depth++;
+      }
+    }
+
+    if (depth == attrs->shard_levels + 1 &&
+        vroot_shard_mkdirs(vpath, attrs->shard_levels) < 0) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "error creating shard directories for '%s': %s", vpath,
+        strerror(errno));
+    }
+  }
+}
+
+/* Uploads which have not yet been migrated are found in the staging
+ * directory.
+ */
+static int fsio_staging_stat(const char *vpath, struct stat *st) {
+  const char *staged_path;
+
+  if (vroot_staging_count() == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  staged_path = vroot_staging_get(vpath);
+  if (staged_path == NULL) {
+    return -1;
+  }
+
+  return lstat(staged_path, st);
+}
+
+/* Lists an unavailable alias source using its last known attributes, if
+ * any, rather than failing.
+ */
+static int fsio_lookup_stat(char *vpath, size_t vpathsz, const char *path,
+    int fsio_flags, struct stat *st) {
+  int xerrno;
+
+  if (fsio_lookup(NULL, vpath, vpathsz, path, fsio_flags, NULL) == 0) {
+    return 0;
+  }
+
+  xerrno = errno;
+  if (xerrno == ETIMEDOUT &&
+      vroot_watchdog_get_stat(vpath, st) == 0) {
+    return 1;
+  }
+
+  errno = xerrno;
+  return -1;
+}
+
+/* Directory handles for the parent directories of rename(2) sources and
+ * destinations, so that renameat2(2) only needs to resolve the final path
+ * component.  The handles are only cached for the duration of a command,
+ * as the directories may be moved by other sessions.
+ */
+#define VROOT_DIRFD_CACHE_SIZE		4
+
+struct vroot_dirfd {
+  char path[PR_TUNABLE_PATH_MAX + 1];
+  int fd;
+  unsigned long used;
+};
+
+static struct vroot_dirfd vroot_dirfds[VROOT_DIRFD_CACHE_SIZE];
+static unsigned long vroot_dirfd_clock = 0;
+
+/* The rename flags used by the rename callback for the current command. */
+static int vroot_rename_flags = 0;
+
+/* Whether renames across filesystems are done by copying, and the largest
+ * file to copy.
+ */
+static int vroot_xdev_rename = FALSE;
+static off_t vroot_xdev_max_size = 0;
+
+/* Whether listings of alias source directories use the shared cache. */
+static int vroot_use_dircache = FALSE;
+
+static void dirfd_close(struct vroot_dirfd *dfd) {
+  if (dfd->used > 0) {
+    (void) close(dfd->fd);
+  }
+
+  dfd->fd = -1;
+  dfd->used = 0;
+  dfd->path[0] = '\0';
+}
+
+/* Discards any cached handles for the given directory, and those under it. */
+static void dirfd_invalidate(const char *path) {
+  register unsigned int i;
+  size_t pathlen;
+
+  pathlen = strlen(path);
+
+  for (i = 0; i < VROOT_DIRFD_CACHE_SIZE; i++) {
+    struct vroot_dirfd *dfd;
+
+    dfd = &(vroot_dirfds[i]);
+    if (dfd->used == 0) {
+      continue;
+    }
+
+    if (strncmp(dfd->path, path, pathlen) == 0 &&
+        (dfd->path[pathlen] == '\0' || dfd->path[pathlen] == '/')) {
+      dirfd_close(dfd);
+    }
+  }
+}
+
+void vroot_fsio_flush_dirfds(void) {
+  register unsigned int i;
+
+  for (i = 0; i < VROOT_DIRFD_CACHE_SIZE; i++) {
+    dirfd_close(&(vroot_dirfds[i]));
+  }
+
+  vroot_dirfd_clock = 0;
+}
+
+/* Returns a handle on the parent directory of the given path, and a pointer
+ * to its final component.
+ */
+static int dirfd_get(const char *path, const char **name) {
+  register unsigned int i;
+  char dir_path[PR_TUNABLE_PATH_MAX + 1], *ptr;
+  struct vroot_dirfd *dfd = NULL;
+  int fd, open_flags;
+
+  ptr = strrchr(path, '/');
+  if (ptr == NULL ||
+      *(ptr + 1) == '\0') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *name = ptr + 1;
+
+  if (ptr == path) {
+    sstrncpy(dir_path, "/", sizeof(dir_path));
+
+  } else {
+    size_t len;
+
+    len = ptr - path;
+    if (len >= sizeof(dir_path)) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+
+    memcpy(dir_path, path, len);
+    dir_path[len] = '\0';
+  }
+
+  for (i = 0; i < VROOT_DIRFD_CACHE_SIZE; i++) {
+    if (vroot_dirfds[i].used > 0 &&
+        strcmp(vroot_dirfds[i].path, dir_path) == 0) {
+      vroot_dirfds[i].used = ++vroot_dirfd_clock;
+      return vroot_dirfds[i].fd;
+    }
+  }
+
+  open_flags = O_RDONLY|O_DIRECTORY;
+#if defined(O_PATH)
+  open_flags = O_PATH|O_DIRECTORY;
+#endif /* O_PATH */
+#if defined(O_CLOEXEC)
+  open_flags |= O_CLOEXEC;
+#endif /* O_CLOEXEC */
+
+  fd = open(dir_path, open_flags);
+  if (fd < 0) {
+    return -1;
+  }
+
+  /* Replace the least recently used handle. */
+  for (i = 0; i < VROOT_DIRFD_CACHE_SIZE; i++) {
+    if (dfd == NULL ||
+        vroot_dirfds[i].used < dfd->used) {
+      dfd = &(vroot_dirfds[i]);
+    }
+  }
+
+  dirfd_close(dfd);
+  sstrncpy(dfd->path, dir_path, sizeof(dfd->path));
+  dfd->fd = fd;
+  dfd->used = ++vroot_dirfd_clock;
+
+  return fd;
+}
+
+#if !defined(RENAME_NOREPLACE)
+# define RENAME_NOREPLACE	(1 << 0)
+#endif /* RENAME_NOREPLACE */
+
+/* Renames the given path, failing with EEXIST if the destination exists.
+ * The check is atomic when renameat2(2) is supported by the kernel and the
+ * filesystem; otherwise, link(2)/unlink(2) is used for non-directories, and
+ * only directories are left with an existence check before the rename.
+ */
+static int rename_noreplace(const char *from, const char *to) {
+  int res, xerrno;
+  struct stat st;
+#if defined(SYS_renameat2)
+  int fd1, fd2;
+  const char *name1 = NULL, *name2 = NULL;
+
+  fd1 = dirfd_get(from, &name1);
+  if (fd1 < 0) {
+    return -1;
+  }
+
+  fd2 = dirfd_get(to, &name2);
+  if (fd2 < 0) {
+    return -1;
+  }
+
+  res = syscall(SYS_renameat2, fd1, name1, fd2, name2, RENAME_NOREPLACE);
+  if (res == 0) {
+    return 0;
+  }
+
+  xerrno = errno;
+  if (xerrno != ENOSYS &&
+      xerrno != EINVAL) {
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "renameat2(2) RENAME_NOREPLACE not supported for '%s': %s", from,
+    strerror(xerrno));
+#endif /* SYS_renameat2 */
+
+  /* Note that O_PATH handles cannot be used by linkat(2) without
+   * AT_EMPTY_PATH, thus the fallbacks use the full paths.
+   */
+  res = link(from, to);
+  if (res == 0) {
+    if (unlink(from) < 0) {
+      xerrno = errno;
+
+      (void) unlink(to);
+      errno = xerrno;
+      return -1;
+    }
+
+    return 0;
+  }
+
+  xerrno = errno;
+  if (xerrno == EEXIST) {
+    errno = xerrno;
+    return -1;
+  }
+
+  if (lstat(to, &st) == 0) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  return rename(from, to);
+}
+
+int vroot_fsio_set_xdev_rename(int enabled, off_t max_size) {
+  if (max_size < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  vroot_xdev_rename = enabled;
+  vroot_xdev_max_size = max_size;
+  return 0;
+}
+
+int vroot_fsio_set_dircache(int enabled) {
+  vroot_use_dircache = enabled;
+  return 0;
+}
+
+/* Handles a rename which failed with EXDEV, e.g. into an alias on another
+ * filesystem, by copying the file and then removing the original.  The copy
+ * is made under a temporary name, and only takes the place of any existing
+ * destination once the original is gone.
+ */
+static int rename_xdev(const char *from, const char *to, int flags) {
+  int fd, res, xerrno;
+  char tmp_path[PR_TUNABLE_PATH_MAX + 1], *ptr;
+  struct stat st;
+
+  if (vroot_xdev_rename == FALSE) {
+    errno = EXDEV;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 8,
+    "'%s' and '%s' are on different filesystems, copying", from, to);
+
+  sstrncpy(tmp_path, to, sizeof(tmp_path));
+  ptr = strrchr(tmp_path, '/');
+  if (ptr != NULL) {
+    *(ptr + 1) = '\0';
+
+  } else {
+    *tmp_path = '\0';
+  }
+
+  if (strlen(tmp_path) + 20 >= sizeof(tmp_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  sstrcat(tmp_path, ".vroot-rename.XXXXXX", sizeof(tmp_path));
+
+  fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    return -1;
+  }
+  (void) close(fd);
+
+  if (vroot_copy_file(session.pool, from, tmp_path, vroot_xdev_max_size,
+      VROOT_COPY_FL_SYNC) < 0) {
+    xerrno = errno;
+    (void) unlink(tmp_path);
+
+    /* Files we would not copy are treated like any other EXDEV. */
+    if (xerrno == EFBIG) {
+      xerrno = EXDEV;
+    }
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if ((flags & VROOT_FSIO_RENAME_FL_NOREPLACE) &&
+      lstat(to, &st) == 0) {
+    (void) unlink(tmp_path);
+    errno = EEXIST;
+    return -1;
+  }
+
+  if (unlink(from) < 0) {
+    xerrno = errno;
+
+    /* Keep the rename(2) semantics: either the file moved, or it did not. */
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error removing '%s' after copying to '%s', removing copy: %s", from,
+      to, strerror(xerrno));
+    (void) unlink(tmp_path);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (flags & VROOT_FSIO_RENAME_FL_NOREPLACE) {
+    res = link(tmp_path, to);
+    xerrno = errno;
+    if (res == 0) {
+      (void) unlink(tmp_path);
+    }
+
+  } else {
+    res = rename(tmp_path, to);
+    xerrno = errno;
+  }
+
+  if (res < 0) {
+    /* The original is gone; the copy is all there is, so keep it. */
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error renaming copy '%s' of '%s' to '%s', keeping copy: %s", tmp_path,
+      from, to, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+int vroot_fsio_set_rename_flags(int flags) {
+  if (flags & ~VROOT_FSIO_RENAME_FL_NOREPLACE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  vroot_rename_flags = flags;
+  return 0;
+}
+
+/* For the AtomicHiddenStores VRootOption, the HiddenStores file is created
+ * as an unnamed O_TMPFILE in the target directory.  It is only given a name,
+ * using linkat(2), when it is renamed to its final name; aborted uploads
+ * thus leave nothing behind.  There is at most one such file per session.
+ */
+static int vroot_tmpfile_fd = -1;
+static char vroot_tmpfile_path[PR_TUNABLE_PATH_MAX + 1];
+
+static int tmpfile_matches(const char *vpath) {
+  if (vroot_tmpfile_fd < 0) {
+    return FALSE;
+  }
+
+  return (strcmp(vpath, vroot_tmpfile_path) == 0);
+}
+
+int vroot_fsio_discard_tmpfile(void) {
+  if (vroot_tmpfile_fd < 0) {
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 9, "discarding unpublished upload for '%s'",
+    vroot_tmpfile_path);
+
+  (void) close(vroot_tmpfile_fd);
+  vroot_tmpfile_fd = -1;
+  memset(vroot_tmpfile_path, '\0', sizeof(vroot_tmpfile_path));
+
+  return 0;
+}
+
+static int tmpfile_open(const char *path, const char *vpath, int flags) {
+#if defined(O_TMPFILE)
+  char dir_path[PR_TUNABLE_PATH_MAX + 1], *ptr;
+  int fd;
+
+  if (!(vroot_opts & VROOT_OPT_ATOMIC_HIDDEN_STORES) ||
+      session.xfer.path_hidden == NULL ||
+      strcmp(path, session.xfer.path_hidden) != 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* Only brand new files, opened for writing, are candidates. */
+  if (!(flags & O_CREAT) ||
+      (flags & O_APPEND) ||
+      (flags & O_ACCMODE) == O_RDONLY) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  (void) vroot_fsio_discard_tmpfile();
+
+  sstrncpy(dir_path, vpath, sizeof(dir_path));
+  ptr = strrchr(dir_path, '/');
+  if (ptr == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (ptr == dir_path) {
+    ptr++;
+  }
+  *ptr = '\0';
+
+  fd = open(dir_path, O_TMPFILE|(flags & (O_ACCMODE|O_CLOEXEC)),
+    PR_OPEN_MODE);
+  if (fd < 0) {
+    int xerrno = errno;
+
+    /* Not all filesystems support O_TMPFILE; the caller falls back to a
+     * regular HiddenStores file.
+     */
+    pr_trace_msg(trace_channel, 3,
+      "unable to open O_TMPFILE in '%s', using regular HiddenStores: %s",
+      dir_path, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "using O_TMPFILE (fd %d) in '%s' for HiddenStores file '%s'", fd,
+    dir_path, vpath);
+
+  vroot_tmpfile_fd = fd;
+  sstrncpy(vroot_tmpfile_path, vpath, sizeof(vroot_tmpfile_path));
+  return fd;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* O_TMPFILE */
+}
+
+static int tmpfile_linkat(int fd, const char *dst_path) {
+  char proc_path[64];
+  int res = -1;
+
+#if defined(AT_EMPTY_PATH)
+  /* This requires CAP_DAC_READ_SEARCH, which sessions rarely have. */
+  res = linkat(fd, "", AT_FDCWD, dst_path, AT_EMPTY_PATH);
+  if (res == 0) {
+    return 0;
+  }
+
+  if (errno != ENOENT &&
+      errno != EPERM) {
+    return -1;
+  }
+#endif /* AT_EMPTY_PATH */
+
+  snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+  res = linkat(AT_FDCWD, proc_path, AT_FDCWD, dst_path, AT_SYMLINK_FOLLOW);
+  return res;
+}
+
+/* Publishes the pending upload under the given name, with the semantics of
+ * rename(2), or of renameat2(2) when VROOT_FSIO_RENAME_FL_NOREPLACE is used.
+ */
+static int tmpfile_publish(const char *dst_path, int flags) {
+  int res, xerrno;
+
+  res = tmpfile_linkat(vroot_tmpfile_fd, dst_path);
+  if (res < 0 &&
+      errno == EEXIST &&
+      !(flags & VROOT_FSIO_RENAME_FL_NOREPLACE)) {
+    /* linkat(2) will not replace an existing file, so publish under the
+     * HiddenStores name first, then rename that into place.
+     */
+    res = tmpfile_linkat(vroot_tmpfile_fd, vroot_tmpfile_path);
+    if (res == 0) {
+      res = rename(vroot_tmpfile_path, dst_path);
+      if (res < 0) {
+        xerrno = errno;
+        (void) unlink(vroot_tmpfile_path);
+        errno = xerrno;
+      }
+    }
+  }
+
+  if (res < 0) {
+    xerrno = errno;
+
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error publishing upload '%s' as '%s': %s", vroot_tmpfile_path,
+      dst_path, strerror(xerrno));
+
+    /* Keep the file; the caller may yet unlink the HiddenStores name. */
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "published upload '%s' as '%s'",
+    vroot_tmpfile_path, dst_path);
+
+  (void) close(vroot_tmpfile_fd);
+  vroot_tmpfile_fd = -1;
+  memset(vroot_tmpfile_path, '\0', sizeof(vroot_tmpfile_path));
+
+  return 0;
+}
+
+static inline int fsio_stat(pr_fs_t *fs, const char *stat_path, struct stat *st,
+    int fsio_flags) {
   int res, xerrno;
   char vpath[PR_TUNABLE_PATH_MAX + 1], *path = NULL;
   pool *tmp_pool = NULL;
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
@@ -50,14 +802,52 @@ int vroot_fsio_stat(pr_fs_t *fs, const char *stat_path, struct stat *st) {
   pr_pool_tag(tmp_pool, "VRoot FSIO stat pool");
   path = vroot_realpath(tmp_pool, stat_path, 0);
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  res = fsio_lookup_stat(vpath, sizeof(vpath)-1, path, fsio_flags, st);
+  if (res != 0) {
     xerrno = errno;
 
     destroy_pool(tmp_pool);
     errno = xerrno;
-    return -1;
+    return (res > 0 ? 0 : -1);
+  }
+
+  if (tmpfile_matches(vpath)) {
+    destroy_pool(tmp_pool);
+    return fstat(vroot_tmpfile_fd, st);
+  }
+
+  if (fsio_virtdir_stat(vpath, fsio_flags, st) == 0) {
+    destroy_pool(tmp_pool);
+    return 0;
+  }
+
+  /* Cached copies, and staged uploads, are regular files, thus answer both
+   * stat(2) and lstat(2).
+   */
+  if ((fsio_flags & VROOT_FSIO_FL_ALIASES) &&
+      (fsio_staging_stat(vpath, st) == 0 ||
+       vroot_cachetier_stat(vpath, st) == 0)) {
+    destroy_pool(tmp_pool);
+    return 0;
+  }
+
+  /* Prefetched metadata is from lstat(2); it only answers stat(2) for
+   * non-symlinks.  Prefetching is only configured for aliases.
+   */
+  if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+    res = vroot_prefetch_lstat(vpath, st);
+    if (res == 0 &&
+        !S_ISLNK(st->st_mode)) {
+      destroy_pool(tmp_pool);
+      return 0;
+    }
   }
 
+  /* Only the operations which reach the filesystem count against any
+   * metadata operation limits.
+   */
+  (void) vroot_throttle_acquire(vpath);
+
   res = stat(vpath, st);
   xerrno = errno;
 
@@ -66,16 +856,14 @@ int vroot_fsio_stat(pr_fs_t *fs, const char *stat_path, struct stat *st) {
   return res;
 }
 
-int vroot_fsio_lstat(pr_fs_t *fs, const char *lstat_path, struct stat *st) {
+static inline int fsio_lstat(pr_fs_t *fs, const char *lstat_path,
+    struct stat *st, int fsio_flags) {
   int res, xerrno;
   char vpath[PR_TUNABLE_PATH_MAX + 1], *path = NULL;
   size_t pathlen = 0;
   pool *tmp_pool = NULL;
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
@@ -98,16 +886,58 @@ int vroot_fsio_lstat(pr_fs_t *fs, const char *lstat_path, struct stat *st) {
     pathlen--;
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  res = fsio_lookup_stat(vpath, sizeof(vpath)-1, path, fsio_flags, st);
+  if (res != 0) {
     xerrno = errno;
 
     destroy_pool(tmp_pool);
     errno = xerrno;
-    return -1;
+    return (res > 0 ? 0 : -1);
+  }
+
+  if (tmpfile_matches(vpath)) {
+    destroy_pool(tmp_pool);
+    return fstat(vroot_tmpfile_fd, st);
+  }
+
+  if (fsio_virtdir_stat(vpath, fsio_flags, st) == 0) {
+    destroy_pool(tmp_pool);
+    return 0;
+  }
+
+  /* Cached copies, and staged uploads, are regular files, thus answer both
+   * stat(2) and lstat(2).
+   */
+  if ((fsio_flags & VROOT_FSIO_FL_ALIASES) &&
+      (fsio_staging_stat(vpath, st) == 0 ||
+       vroot_cachetier_stat(vpath, st) == 0)) {
+    destroy_pool(tmp_pool);
+    return 0;
+  }
+
+  if ((fsio_flags & VROOT_FSIO_FL_ALIASES) &&
+      vroot_prefetch_lstat(vpath, st) == 0) {
+    if (!S_ISLNK(st->st_mode) ||
+        (!fsio_allow_symlinks(fsio_flags) &&
+         fsio_alias_exists(fsio_flags, path) == FALSE)) {
+      destroy_pool(tmp_pool);
+      return 0;
+    }
+
+    /* A symlink which we need to follow. */
+    (void) vroot_throttle_acquire(vpath);
+    res = stat(vpath, st);
+    xerrno = errno;
+
+    destroy_pool(tmp_pool);
+    errno = xerrno;
+    return res;
   }
 
-  if ((vroot_opts & VROOT_OPT_ALLOW_SYMLINKS) ||
-      vroot_alias_exists(path) == TRUE) {
+  (void) vroot_throttle_acquire(vpath);
+
+  if (fsio_allow_symlinks(fsio_flags) ||
+      fsio_alias_exists(fsio_flags, path) == TRUE) {
     res = lstat(vpath, st);
     if (res < 0) {
       xerrno = errno;
@@ -133,34 +963,116 @@ int vroot_fsio_lstat(pr_fs_t *fs, const char *lstat_path, struct stat *st) {
   return res;
 }
 
-int vroot_fsio_rename(pr_fs_t *fs, const char *from, const char *to) {
+/* Discards anything remembered about the given real path, which is about to
+ * be changed.
+ */
+static void fsio_invalidate(const char *vpath) {
+  vroot_prefetch_invalidate(vpath);
+  vroot_cachetier_invalidate(vpath);
+
+  /* Any staged upload to the path is migrated first, lest it replace the
+   * changed file later.
+   */
+  (void) vroot_staging_flush(vpath);
+}
+
+/* Notes a successful change to the namespace of the filesystem, from which the
+ * aliases shared with the other sessions of this user may have been expanded.
+ */
+static int namespace_changed(int res) {
+  if (res == 0) {
+    vroot_aliascache_bump();
+  }
+
+  return res;
+}
+
+static inline int fsio_rename2(pr_fs_t *fs, const char *from, const char *to,
+    int flags, int fsio_flags) {
   char vpath1[PR_TUNABLE_PATH_MAX + 1], vpath2[PR_TUNABLE_PATH_MAX + 1];
+  int res;
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
+    if (flags & VROOT_FSIO_RENAME_FL_NOREPLACE) {
+      return rename_noreplace(from, to);
+    }
+
     return rename(from, to);
   }
 
-  if (vroot_path_lookup(NULL, vpath1, sizeof(vpath1)-1, from, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath1, sizeof(vpath1)-1, from, fsio_flags, NULL,
+      VROOT_UNION_OP_MODIFY) < 0) {
+    return -1;
+  }
+
+  if (fsio_lookup_op(NULL, vpath2, sizeof(vpath2)-1, to, fsio_flags, NULL,
+      VROOT_UNION_OP_CREATE) < 0) {
     return -1;
   }
 
-  if (vroot_path_lookup(NULL, vpath2, sizeof(vpath2)-1, to, 0, NULL) < 0) {
+  /* Keep a file renamed within a spread alias on its target. */
+  if ((fsio_flags & VROOT_FSIO_FL_ALIASES) &&
+      vroot_spread_count() > 0 &&
+      vroot_spread_colocate(vpath1, vpath2, sizeof(vpath2)-1) < 0) {
     return -1;
   }
 
-  return rename(vpath1, vpath2);
+  fsio_invalidate(vpath1);
+  fsio_invalidate(vpath2);
+  fsio_create_parents(vpath2, fsio_flags);
+
+  if (tmpfile_matches(vpath1)) {
+    res = tmpfile_publish(vpath2, flags);
+    if (res == 0) {
+      (void) vroot_casefold_add(vpath2);
+    }
+
+    return namespace_changed(res);
+  }
+
+  if (flags & VROOT_FSIO_RENAME_FL_NOREPLACE) {
+    res = rename_noreplace(vpath1, vpath2);
+
+  } else {
+    res = rename(vpath1, vpath2);
+  }
+
+  if (res < 0 &&
+      errno == EXDEV) {
+    res = rename_xdev(vpath1, vpath2, flags);
+  }
+
+  if (res == 0) {
+    /* The source may have been a directory with cached handles under it. */
+    dirfd_invalidate(vpath1);
+
+    (void) vroot_casefold_remove(vpath1);
+    (void) vroot_casefold_add(vpath2);
+
+    /* Keep any lower union layer copy of the source hidden. */
+    if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+      (void) vroot_union_whiteout(vpath1);
+    }
+  }
+
+  return namespace_changed(res);
+}
+
+static inline int fsio_rename(pr_fs_t *fs, const char *from, const char *to,
+    int fsio_flags) {
+  return fsio_rename2(fs, from, to, vroot_rename_flags, fsio_flags);
 }
 
-int vroot_fsio_unlink(pr_fs_t *fs, const char *path) {
+static inline int fsio_unlink(pr_fs_t *fs, const char *path, int fsio_flags) {
+  int res;
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (vroot_path_have_base() == FALSE) {
+  if ((fsio_flags & VROOT_FSIO_FL_PASSTHROUGH) ||
+      (!(fsio_flags & VROOT_FSIO_FL_HAVE_BASE) &&
+       vroot_path_have_base() == FALSE)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
@@ -170,65 +1082,228 @@ int vroot_fsio_unlink(pr_fs_t *fs, const char *path) {
   /* Do not allow deleting of aliased files/directories; the aliases may only
    * exist for this user/group.
    */
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path,
-      VROOT_LOOKUP_FL_NO_ALIAS, NULL) < 0) {
-    return -1;
+  if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+    if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path,
+        VROOT_LOOKUP_FL_NO_ALIAS, NULL) < 0) {
+      return -1;
+    }
+
+    if (vroot_alias_exists(vpath) == TRUE) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "denying delete of '%s' because it is a VRootAlias", vpath);
+      errno = EACCES;
+      return -1;
+    }
   }
 
-  if (vroot_alias_exists(vpath) == TRUE) {
-    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
-      "denying delete of '%s' because it is a VRootAlias", vpath);
-    errno = EACCES;
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_TOP) < 0) {
     return -1;
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
-    return -1;
+  fsio_invalidate(vpath);
+
+  /* Deleting an unpublished upload is simply a matter of forgetting it. */
+  if (tmpfile_matches(vpath)) {
+    return vroot_fsio_discard_tmpfile();
+  }
+
+  if ((fsio_flags & VROOT_FSIO_FL_ALIASES) &&
+      vroot_union_count() > 0) {
+    res = vroot_union_unlink(vpath);
+
+  } else {
+    res = unlink(vpath);
+  }
+  if (res == 0) {
+    (void) vroot_casefold_remove(vpath);
+  }
+
+  return namespace_changed(res);
+}
+
+/* Opens a file within an alias, applying the alias's I/O policy. */
+static int open_with_policy(const char *path, int flags,
+    const struct vroot_alias_attrs *attrs) {
+  int fd, policy_flags;
+
+  policy_flags = vroot_policy_open_flags(attrs, flags);
+
+  fd = open(path, policy_flags, PR_OPEN_MODE);
+  if (fd < 0 &&
+      errno == EPERM &&
+      policy_flags != flags) {
+    /* Not allowed to use O_NOATIME for this file. */
+    fd = open(path, flags, PR_OPEN_MODE);
+  }
+
+  if (fd >= 0) {
+    (void) vroot_policy_open(fd, flags, attrs);
+
+    if (attrs->readahead_files > 0 &&
+        (flags & O_ACCMODE) == O_RDONLY) {
+      (void) vroot_seqread_opened(path);
+    }
   }
 
-  return unlink(vpath);
+  return fd;
 }
 
-int vroot_fsio_open(pr_fh_t *fh, const char *path, int flags) {
+static inline int fsio_open(pr_fh_t *fh, const char *path, int flags,
+    int fsio_flags) {
+  int fd, union_op;
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return open(path, flags, PR_OPEN_MODE);
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if ((flags & O_ACCMODE) == O_RDONLY) {
+    union_op = VROOT_UNION_OP_READ;
+
+  } else if (flags & O_TRUNC) {
+    union_op = VROOT_UNION_OP_CREATE;
+
+  } else {
+    union_op = VROOT_UNION_OP_MODIFY;
+  }
+
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      union_op) < 0) {
     return -1;
   }
 
-  return open(vpath, flags, PR_OPEN_MODE);
+  if (flags & O_CREAT) {
+    fsio_create_parents(vpath, fsio_flags);
+
+    /* Where overwriting is not allowed, the upload must not replace a file
+     * which appeared since the existence check made before it.
+     */
+    if ((vroot_rename_flags & VROOT_FSIO_RENAME_FL_NOREPLACE) &&
+        !(flags & O_APPEND) &&
+        session.xfer.path != NULL &&
+        strcmp(path, session.xfer.path) == 0) {
+      flags |= O_EXCL;
+    }
+  }
+
+  if ((flags & O_WRONLY) ||
+      (flags & O_RDWR)) {
+    fsio_invalidate(vpath);
+
+    fd = tmpfile_open(path, vpath, flags);
+    if (fd >= 0) {
+      return fd;
+    }
+  }
+
+  if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+    const struct vroot_alias_attrs *attrs;
+
+    /* Uploads are written to the staging directory, and read from there
+     * until migrated.
+     */
+    if (vroot_staging_count() > 0) {
+      if ((flags & O_ACCMODE) == O_RDONLY) {
+        const char *staged_path;
+
+        /* The upload may have just been migrated, e.g. by another session. */
+        staged_path = vroot_staging_get(vpath);
+        if (staged_path != NULL) {
+          fd = open(staged_path, flags, PR_OPEN_MODE);
+          if (fd >= 0 ||
+              errno != ENOENT) {
+            return fd;
+          }
+        }
+
+      } else {
+        fd = vroot_staging_open(vpath, flags);
+        if (fd >= 0) {
+          (void) vroot_casefold_add(vpath);
+          return fd;
+        }
+
+        if (errno != ENOENT) {
+          return -1;
+        }
+      }
+    }
+
+    /* Downloads from a slow source are served from its local cache, once
+     * cached.
+     */
+    if ((flags & O_ACCMODE) == O_RDONLY &&
+        vroot_cachetier_count() > 0) {
+      fd = vroot_cachetier_open(vpath);
+      if (fd >= 0) {
+        return fd;
+      }
+    }
+
+    attrs = vroot_alias_find_attrs(vpath, NULL);
+
+    /* Downloads from a mirror are read from the replica chosen by its
+     * selection policy; the primary serves everything else.
+     */
+    if ((flags & O_ACCMODE) == O_RDONLY &&
+        vroot_mirror_count() > 0 &&
+        vroot_mirror_contains(vpath) == TRUE) {
+      fd = vroot_mirror_open(vpath, flags);
+      if (fd >= 0 &&
+          attrs != NULL) {
+        (void) vroot_policy_open(fd, flags, attrs);
+      }
+
+      return fd;
+    }
+
+    if (attrs != NULL) {
+      fd = open_with_policy(vpath, flags, attrs);
+
+    } else {
+      fd = open(vpath, flags, PR_OPEN_MODE);
+    }
+
+  } else {
+    fd = open(vpath, flags, PR_OPEN_MODE);
+  }
+
+  if (fd >= 0 &&
+      (flags & O_CREAT)) {
+    (void) vroot_casefold_add(vpath);
+  }
+
+  return fd;
 }
 
-int vroot_fsio_creat(pr_fh_t *fh, const char *path, mode_t mode) {
+static inline int fsio_creat(pr_fh_t *fh, const char *path, mode_t mode,
+    int fsio_flags) {
   int res;
 #if PROFTPD_VERSION_NUMBER < 0x0001030603
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return creat(path, mode);
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_CREATE) < 0) {
     return -1;
   }
 
+  fsio_create_parents(vpath, fsio_flags);
+
   res = creat(vpath, mode);
+  if (res >= 0) {
+    (void) vroot_casefold_add(vpath);
+  }
 #else
   errno = ENOSYS;
   res = -1;
@@ -237,64 +1312,129 @@ int vroot_fsio_creat(pr_fh_t *fh, const char *path, mode_t mode) {
   return res;
 }
 
-int vroot_fsio_link(pr_fs_t *fs, const char *path1, const char *path2) {
+static inline int fsio_close(pr_fh_t *fh, int fd, int fsio_flags) {
+  if (fd >= 0 &&
+      fd == vroot_tmpfile_fd) {
+    /* Keep an unpublished upload open, until it is either renamed to its
+     * final name, or discarded.
+     */
+    pr_trace_msg(trace_channel, 19,
+      "keeping unpublished upload '%s' (fd %d) open", vroot_tmpfile_path, fd);
+    return 0;
+  }
+
+  if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+    /* A staged upload which cannot be completed is a failed upload. */
+    if (vroot_staging_close(fd) < 0 &&
+        errno != ENOENT) {
+      int xerrno = errno;
+
+      (void) close(fd);
+      errno = xerrno;
+      return -1;
+    }
+
+    if (vroot_policy_close(fd) < 0 &&
+        errno != ENOENT) {
+      int xerrno = errno;
+
+      /* The policy failed, e.g. fsync(2) reported a write error; the
+       * descriptor must still be closed, but the client should learn of the
+       * error.
+       */
+      (void) close(fd);
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  return close(fd);
+}
+
+static inline int fsio_write(pr_fh_t *fh, int fd, const char *buf,
+    size_t size, int fsio_flags) {
+  int res;
+
+  res = write(fd, buf, size);
+  if (res > 0 &&
+      (fsio_flags & VROOT_FSIO_FL_ALIASES)) {
+    (void) vroot_policy_write(fd, (size_t) res);
+  }
+
+  return res;
+}
+
+static inline int fsio_link(pr_fs_t *fs, const char *path1, const char *path2,
+    int fsio_flags) {
+  int res;
   char vpath1[PR_TUNABLE_PATH_MAX + 1], vpath2[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return link(path1, path2);
   }
 
-  if (vroot_path_lookup(NULL, vpath1, sizeof(vpath1)-1, path1, 0, NULL) < 0) {
+  if (fsio_lookup(NULL, vpath1, sizeof(vpath1)-1, path1,
+      fsio_flags, NULL) < 0) {
     return -1;
   }
 
-  if (vroot_path_lookup(NULL, vpath2, sizeof(vpath2)-1, path2, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath2, sizeof(vpath2)-1, path2,
+      fsio_flags, NULL, VROOT_UNION_OP_CREATE_EXCL) < 0) {
     return -1;
   }
 
-  return link(vpath1, vpath2);
+  fsio_create_parents(vpath2, fsio_flags);
+
+  res = link(vpath1, vpath2);
+  if (res == 0) {
+    (void) vroot_casefold_add(vpath2);
+  }
+
+  return namespace_changed(res);
 }
 
-int vroot_fsio_symlink(pr_fs_t *fs, const char *path1, const char *path2) {
+static inline int fsio_symlink(pr_fs_t *fs, const char *path1,
+    const char *path2, int fsio_flags) {
+  int res;
   char vpath1[PR_TUNABLE_PATH_MAX + 1], vpath2[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return symlink(path1, path2);
   }
 
-  if (vroot_path_lookup(NULL, vpath1, sizeof(vpath1)-1, path1, 0, NULL) < 0) {
+  if (fsio_lookup(NULL, vpath1, sizeof(vpath1)-1, path1,
+      fsio_flags, NULL) < 0) {
     return -1;
   }
 
-  if (vroot_path_lookup(NULL, vpath2, sizeof(vpath2)-1, path2, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath2, sizeof(vpath2)-1, path2,
+      fsio_flags, NULL, VROOT_UNION_OP_CREATE_EXCL) < 0) {
     return -1;
   }
 
-  return symlink(vpath1, vpath2);
+  fsio_create_parents(vpath2, fsio_flags);
+
+  res = symlink(vpath1, vpath2);
+  if (res == 0) {
+    (void) vroot_casefold_add(vpath2);
+  }
+
+  return namespace_changed(res);
 }
 
-int vroot_fsio_readlink(pr_fs_t *fs, const char *readlink_path, char *buf,
-    size_t bufsz) {
+static inline int fsio_readlink(pr_fs_t *fs, const char *readlink_path,
+    char *buf, size_t bufsz, int fsio_flags) {
   int res, xerrno;
   char vpath[PR_TUNABLE_PATH_MAX + 1], *path = NULL, *alias_path = NULL;
   pool *tmp_pool = NULL;
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
@@ -311,7 +1451,7 @@ int vroot_fsio_readlink(pr_fs_t *fs, const char *readlink_path, char *buf,
 
   path = vroot_realpath(tmp_pool, readlink_path, VROOT_REALPATH_FL_ABS_PATH);
 
-  if (vroot_path_lookup(tmp_pool, vpath, sizeof(vpath)-1, path, 0,
+  if (fsio_lookup(tmp_pool, vpath, sizeof(vpath)-1, path, fsio_flags,
       &alias_path) < 0) {
     xerrno = errno;
 
@@ -321,7 +1461,7 @@ int vroot_fsio_readlink(pr_fs_t *fs, const char *readlink_path, char *buf,
   }
 
   if (alias_path == NULL) {
-    if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, readlink_path, 0,
+    if (fsio_lookup(NULL, vpath, sizeof(vpath)-1, readlink_path, fsio_flags,
         NULL) < 0) {
       xerrno = errno;
 
@@ -339,85 +1479,97 @@ int vroot_fsio_readlink(pr_fs_t *fs, const char *readlink_path, char *buf,
   return res;
 }
 
-int vroot_fsio_truncate(pr_fs_t *fs, const char *path, off_t len) {
+static inline int fsio_truncate(pr_fs_t *fs, const char *path, off_t len,
+    int fsio_flags) {
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return truncate(path, len);
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_MODIFY) < 0) {
     return -1;
   }
 
+  fsio_invalidate(vpath);
   return truncate(vpath, len);
 }
 
-int vroot_fsio_chmod(pr_fs_t *fs, const char *path, mode_t mode) {
+static inline int fsio_chmod(pr_fs_t *fs, const char *path, mode_t mode,
+    int fsio_flags) {
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return chmod(path, mode);
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_MODIFY) < 0) {
     return -1;
   }
 
+  if (tmpfile_matches(vpath)) {
+    return fchmod(vroot_tmpfile_fd, mode);
+  }
+
+  fsio_invalidate(vpath);
   return chmod(vpath, mode);
 }
 
-int vroot_fsio_chown(pr_fs_t *fs, const char *path, uid_t uid, gid_t gid) {
+static inline int fsio_chown(pr_fs_t *fs, const char *path, uid_t uid,
+    gid_t gid, int fsio_flags) {
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return chown(path, uid, gid);
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_MODIFY) < 0) {
     return -1;
   }
 
+  if (tmpfile_matches(vpath)) {
+    return fchown(vroot_tmpfile_fd, uid, gid);
+  }
+
+  fsio_invalidate(vpath);
   return chown(vpath, uid, gid);
 }
 
-int vroot_fsio_lchown(pr_fs_t *fs, const char *path, uid_t uid, gid_t gid) {
+static inline int fsio_lchown(pr_fs_t *fs, const char *path, uid_t uid,
+    gid_t gid, int fsio_flags) {
   int res;
 #if PROFTPD_VERSION_NUMBER >= 0x0001030407
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return lchown(path, uid, gid);
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_MODIFY) < 0) {
     return -1;
   }
 
+  if (tmpfile_matches(vpath)) {
+    return fchown(vroot_tmpfile_fd, uid, gid);
+  }
+
+  fsio_invalidate(vpath);
   res = lchown(vpath, uid, gid);
 #else
   errno = ENOSYS;
@@ -538,20 +1690,27 @@ int vroot_fsio_chroot(pr_fs_t *fs, const char *path) {
 
   vroot_path_set_base(base, baselen);
   session.chroot_path = pstrdup(session.pool, chroot_path);
+
+  /* The base itself, e.g. a home directory which has not been created yet,
+   * may be a virtual directory.
+   */
+  c = find_config(main_server->conf, CONF_PARAM, "VRootOptions", FALSE);
+  if (c != NULL &&
+      (*((unsigned int *) c->argv[0]) & VROOT_OPT_VIRTUAL_DIRS)) {
+    (void) vroot_virtdir_add(base, base);
+  }
   return 0;
 }
 
-int vroot_fsio_chdir(pr_fs_t *fs, const char *path) {
+static inline int fsio_chdir(pr_fs_t *fs, const char *path, int fsio_flags) {
   int res, xerrno;
+  struct stat st;
   const char *base_path;
   size_t base_pathlen = 0;
   char vpath[PR_TUNABLE_PATH_MAX + 1], *vpathp = NULL, *alias_path = NULL;
   pool *tmp_pool = NULL;
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
@@ -561,7 +1720,7 @@ int vroot_fsio_chdir(pr_fs_t *fs, const char *path) {
   tmp_pool = make_sub_pool(session.pool);
   pr_pool_tag(tmp_pool, "VRoot FSIO chdir pool");
 
-  if (vroot_path_lookup(tmp_pool, vpath, sizeof(vpath)-1, path, 0,
+  if (fsio_lookup(tmp_pool, vpath, sizeof(vpath)-1, path, fsio_flags,
       &alias_path) < 0) {
     xerrno = errno;
 
@@ -570,7 +1729,16 @@ int vroot_fsio_chdir(pr_fs_t *fs, const char *path) {
     return -1;
   }
 
-  res = chdir(vpath);
+  /* There is no real directory to change to for a virtual directory which
+   * does not exist; only the current working directory is tracked.
+   */
+  if (fsio_virtdir_stat(vpath, fsio_flags, &st) == 0) {
+    res = 0;
+
+  } else {
+    res = chdir(vpath);
+  }
+
   if (res < 0) {
     xerrno = errno;
 
@@ -606,16 +1774,13 @@ int vroot_fsio_chdir(pr_fs_t *fs, const char *path) {
   return 0;
 }
 
-int vroot_fsio_utimes(pr_fs_t *fs, const char *utimes_path,
-    struct timeval *tvs) {
+static inline int fsio_utimes(pr_fs_t *fs, const char *utimes_path,
+    struct timeval *tvs, int fsio_flags) {
   int res, xerrno;
   char vpath[PR_TUNABLE_PATH_MAX + 1], *path = NULL;
   pool *tmp_pool = NULL;
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
@@ -627,7 +1792,8 @@ int vroot_fsio_utimes(pr_fs_t *fs, const char *utimes_path,
 
   path = vroot_realpath(tmp_pool, utimes_path, VROOT_REALPATH_FL_ABS_PATH);
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_MODIFY) < 0) {
     xerrno = errno;
 
     destroy_pool(tmp_pool);
@@ -635,6 +1801,7 @@ int vroot_fsio_utimes(pr_fs_t *fs, const char *utimes_path,
     return -1;
   }
 
+  fsio_invalidate(vpath);
   res = utimes(vpath, tvs);
   xerrno = errno;
 
@@ -643,7 +1810,8 @@ int vroot_fsio_utimes(pr_fs_t *fs, const char *utimes_path,
   return res;
 }
 
-const char *vroot_fsio_realpath(pr_fs_t *fs, pool *p, const char *path) {
+static inline const char *fsio_realpath(pr_fs_t *fs, pool *p, const char *path,
+    int fsio_flags) {
   const char *res = NULL;
   int xerrno;
   char vpath[PR_TUNABLE_PATH_MAX + 1], *real_path = NULL;
@@ -654,7 +1822,8 @@ const char *vroot_fsio_realpath(pr_fs_t *fs, pool *p, const char *path) {
 
   real_path = vroot_realpath(p, path, VROOT_REALPATH_FL_ABS_PATH);
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, real_path, 0, NULL) < 0) {
+  if (fsio_lookup(NULL, vpath, sizeof(vpath)-1, real_path,
+      fsio_flags, NULL) < 0) {
     xerrno = errno;
 
     destroy_pool(tmp_pool);
@@ -668,7 +1837,6 @@ const char *vroot_fsio_realpath(pr_fs_t *fs, pool *p, const char *path) {
   return res;
 }
 
-static struct dirent *vroot_dent = NULL;
 static size_t vroot_dentsz = 0;
 
 /* On most systems, dirent.d_name is an array into which we can copy the
@@ -682,18 +1850,17 @@ static size_t vroot_dentsz = 0;
  */
 static size_t vroot_dent_namesz = 0;
 
-static array_header *vroot_dir_aliases = NULL;
-static int vroot_dir_idx = -1;
-
 static int vroot_alias_dirscan(const void *key_data, size_t key_datasz,
     const void *value_data, size_t value_datasz, void *user_data) {
   const char *alias_path = NULL, *dir_path = NULL, *real_path = NULL;
   char *ptr = NULL;
   size_t dir_pathlen;
+  struct vroot_dir *vdir;
 
   alias_path = key_data;
   real_path = value_data;
-  dir_path = user_data;
+  vdir = user_data;
+  dir_path = vdir->path;
 
   pr_trace_msg(trace_channel, 19,
     "scanning aliases: aliased path = '%s', real path = '%s' in directory '%s'",
@@ -734,16 +1901,58 @@ static int vroot_alias_dirscan(const void *key_data, size_t key_datasz,
       "adding VRootAlias '%s' to list of aliases contained in '%s'",
       alias_path, dir_path);
     if (ptr != NULL) {
-      *((char **) push_array(vroot_dir_aliases)) = pstrndup(vroot_dir_pool,
+      *((char **) push_array(vdir->aliases)) = pstrndup(vroot_dir_pool,
         alias_rel_path, ptr - alias_rel_path);
 
     } else {
-      *((char **) push_array(vroot_dir_aliases)) = pstrdup(vroot_dir_pool,
+      *((char **) push_array(vdir->aliases)) = pstrdup(vroot_dir_pool,
         alias_rel_path);
     }
   }
 
-  return 0;
+  return 0;
+}
+
+struct vroot_alias_srcscan {
+  const char *path;
+  int found;
+};
+
+static int vroot_alias_srcscan(const void *key_data, size_t key_datasz,
+    const void *value_data, size_t value_datasz, void *user_data) {
+  struct vroot_alias_srcscan *scan;
+  const char *src_path;
+  size_t src_pathlen;
+
+  scan = user_data;
+  src_path = value_data;
+  src_pathlen = strlen(src_path);
+
+  if (strncmp(scan->path, src_path, src_pathlen) == 0 &&
+      (scan->path[src_pathlen] == '\0' ||
+       scan->path[src_pathlen] == '/')) {
+    scan->found = TRUE;
+  }
+
+  return 0;
+}
+
+/* Only the directories within alias sources, shared by many users, are
+ * worth caching across sessions.
+ */
+static int vroot_fsio_use_dircache(const char *path, const struct stat *st) {
+  struct vroot_alias_srcscan scan;
+
+  if (vroot_use_dircache == FALSE ||
+      !S_ISDIR(st->st_mode)) {
+    return FALSE;
+  }
+
+  scan.path = path;
+  scan.found = FALSE;
+  (void) vroot_alias_do(vroot_alias_srcscan, &scan);
+
+  return scan.found;
 }
 
 static int vroot_dirtab_keycmp_cb(const void *key1, size_t keysz1,
@@ -763,7 +1972,31 @@ static unsigned int vroot_dirtab_hash_cb(const void *key, size_t keysz) {
   return h;
 }
 
-void *vroot_fsio_opendir(pr_fs_t *fs, const char *orig_path) {
+static void vroot_fsio_prefetch_opendir(struct vroot_dir *vdir,
+    const struct vroot_alias_attrs *attrs) {
+  vdir->prefetch = vroot_prefetch_open(vdir->path, attrs->prefetch_threads,
+    attrs->prefetch_window);
+  if (vdir->prefetch == NULL) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error prefetching entries for directory '%s': %s", vdir->path,
+      strerror(errno));
+  }
+}
+
+static struct vroot_dir *vroot_dir_get(void *dirh) {
+  unsigned long lookup_dirh;
+
+  if (vroot_dirtab == NULL) {
+    return NULL;
+  }
+
+  lookup_dirh = (unsigned long) dirh;
+  return (struct vroot_dir *) pr_table_kget(vroot_dirtab, &lookup_dirh,
+    sizeof(unsigned long), NULL);
+}
+
+static inline void *fsio_opendir(pr_fs_t *fs, const char *orig_path,
+    int fsio_flags) {
   int res, xerrno;
   char vpath[PR_TUNABLE_PATH_MAX + 1], *path = NULL;
   void *dirh = NULL;
@@ -771,11 +2004,11 @@ void *vroot_fsio_opendir(pr_fs_t *fs, const char *orig_path) {
   size_t pathlen = 0;
   pool *tmp_pool = NULL;
   unsigned int alias_count;
+  int use_dircache = FALSE, virtual_dir = FALSE;
+  unsigned int shard_levels = 0;
+  struct vroot_dircache_listing *listing = NULL;
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
@@ -801,7 +2034,7 @@ void *vroot_fsio_opendir(pr_fs_t *fs, const char *orig_path) {
     pathlen--;
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if (fsio_lookup(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL) < 0) {
     xerrno = errno;
 
     destroy_pool(tmp_pool);
@@ -833,22 +2066,92 @@ void *vroot_fsio_opendir(pr_fs_t *fs, const char *orig_path) {
     res = vroot_fsio_lstat(fs, vpath, &st);
   }
 
-  dirh = opendir(vpath);
-  if (dirh == NULL) {
-    xerrno = errno;
+  alias_count = 0;
+  if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+    alias_count = vroot_alias_count();
+  }
 
-    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
-      "error opening virtualized directory '%s' (from '%s'): %s", vpath, path,
-      strerror(xerrno));
-    destroy_pool(tmp_pool);
+  /* The listing of a sharded alias is that of its shards. */
+  if (alias_count > 0) {
+    const struct vroot_alias_attrs *attrs;
+    const char *rel_path = NULL;
 
-    errno = xerrno;
-    return NULL;
+    attrs = vroot_alias_find_attrs(vpath, &rel_path);
+    if (attrs != NULL &&
+        *rel_path == '\0') {
+      shard_levels = attrs->shard_levels;
+    }
   }
 
-  alias_count = vroot_alias_count();
-  if (alias_count > 0) {
+  /* The cached listings are keyed, and validated, by the attributes of the
+   * real directory.
+   */
+  if (alias_count > 0 &&
+      vroot_use_dircache == TRUE &&
+      shard_levels == 0) {
+    (void) vroot_throttle_acquire(vpath);
+
+    if (stat(vpath, &st) == 0) {
+      use_dircache = vroot_fsio_use_dircache(vpath, &st);
+      if (use_dircache == TRUE) {
+        listing = vroot_dircache_get(session.pool, &st);
+      }
+    }
+
+    /* Listings cached by other sessions are only served to those which
+     * may read the directory themselves.
+     */
+    if (listing != NULL) {
+      int fd;
+
+      fd = open(vpath, O_RDONLY|O_DIRECTORY|O_NONBLOCK);
+      if (fd < 0) {
+        pr_trace_msg(trace_channel, 9,
+          "not using cached listing of '%s': %s", vpath, strerror(errno));
+        (void) vroot_dircache_close(listing);
+        listing = NULL;
+
+      } else {
+        (void) close(fd);
+      }
+    }
+  }
+
+  if (listing != NULL) {
+    /* There is no real directory handle for a cached listing; the listing
+     * itself serves as the handle.
+     */
+    dirh = listing;
+
+  } else {
+    (void) vroot_throttle_acquire(vpath);
+
+    dirh = opendir(vpath);
+    if (dirh == NULL &&
+        errno == ENOENT &&
+        fsio_virtdir_stat(vpath, fsio_flags, &st) == 0) {
+      /* A virtual directory which does not exist has no real directory
+       * handle; its per-handle state serves as the handle.
+       */
+      virtual_dir = TRUE;
+
+    } else if (dirh == NULL) {
+      xerrno = errno;
+
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "error opening virtualized directory '%s' (from '%s'): %s", vpath,
+        path, strerror(xerrno));
+      destroy_pool(tmp_pool);
+
+      errno = xerrno;
+      return NULL;
+    }
+  }
+
+  if (alias_count > 0 ||
+      virtual_dir == TRUE) {
     unsigned long *cache_dirh = NULL;
+    struct vroot_dir *vdir;
 
     if (vroot_dirtab == NULL) {
       vroot_dir_pool = make_sub_pool(session.pool);
@@ -866,19 +2169,119 @@ void *vroot_fsio_opendir(pr_fs_t *fs, const char *orig_path) {
         vroot_dirtab_keycmp_cb);
     }
 
+    vdir = pcalloc(vroot_dir_pool, sizeof(struct vroot_dir));
+    vdir->path = pstrdup(vroot_dir_pool, vpath);
+    vdir->alias_idx = -1;
+
+    if (virtual_dir == TRUE) {
+      vdir->virtual_dir = TRUE;
+      vdir->dent = pcalloc(vroot_dir_pool, vroot_dentsz);
+      dirh = vdir;
+    }
+
     cache_dirh = palloc(vroot_dir_pool, sizeof(unsigned long));
     *cache_dirh = (unsigned long) dirh;
 
+    if (vroot_union_count() > 0) {
+      vdir->union_dir = vroot_union_opendir(vpath);
+    }
+
+    if (vroot_spread_count() > 0) {
+      vdir->spread_dir = vroot_spread_opendir(vpath);
+    }
+
+    /* The real directory handle is kept open, but only the shards are
+     * read.
+     */
+    if (shard_levels > 0) {
+      vdir->shard_dir = vroot_shard_opendir(vroot_dir_pool, vpath,
+        shard_levels);
+      if (vdir->shard_dir == NULL) {
+        (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+          "error listing shards of directory '%s': %s", vpath,
+          strerror(errno));
+      }
+    }
+
+    if (listing != NULL) {
+      vdir->dircache = listing;
+      vdir->dircache_hit = TRUE;
+      vdir->dent = pcalloc(vroot_dir_pool, vroot_dentsz);
+
+    } else if (use_dircache == TRUE) {
+      vdir->dircache = vroot_dircache_open(session.pool, &st);
+    }
+
     if (pr_table_kadd(vroot_dirtab, cache_dirh, sizeof(unsigned long),
-        pstrdup(vroot_dir_pool, vpath), strlen(vpath) + 1) < 0) {
+        vdir, sizeof(struct vroot_dir *)) < 0) {
+      xerrno = errno;
+
       (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
         "error stashing path '%s' (key %p) in directory table: %s", vpath,
-        dirh, strerror(errno));
+        dirh, strerror(xerrno));
+
+      /* Without its table entry, a cached listing cannot be read. */
+      if (vdir->dircache != NULL) {
+        (void) vroot_dircache_close(vdir->dircache);
+        vdir->dircache = NULL;
+      }
+
+      if (vdir->union_dir != NULL) {
+        (void) vroot_union_closedir(vdir->union_dir);
+        vdir->union_dir = NULL;
+      }
+
+      if (vdir->spread_dir != NULL) {
+        (void) vroot_spread_closedir(vdir->spread_dir);
+        vdir->spread_dir = NULL;
+      }
+
+      if (vdir->shard_dir != NULL) {
+        (void) vroot_shard_closedir(vdir->shard_dir);
+        vdir->shard_dir = NULL;
+      }
+
+      if (listing != NULL ||
+          virtual_dir == TRUE) {
+        destroy_pool(tmp_pool);
+        errno = xerrno;
+        return NULL;
+      }
 
     } else {
-      vroot_dir_aliases = make_array(vroot_dir_pool, 0, sizeof(char *));
+      const struct vroot_alias_attrs *attrs;
+
+      /* The entries of a sharded alias are not within the directory
+       * itself, for prefetching or reading ahead.
+       */
+      attrs = vroot_alias_find_attrs(vpath, NULL);
+      if (attrs != NULL &&
+          attrs->prefetch_threads > 0 &&
+          shard_levels == 0) {
+        vroot_fsio_prefetch_opendir(vdir, attrs);
+      }
+
+      if (attrs != NULL &&
+          attrs->readahead_files > 0 &&
+          shard_levels == 0) {
+        vdir->seqread = vroot_seqread_open(vdir->path, attrs->readahead_files,
+          attrs->readahead_bytes);
+      }
+
+      vdir->aliases = make_array(vroot_dir_pool, 0, sizeof(char *));
+
+      res = vroot_alias_do(vroot_alias_dirscan, vdir);
+      if (res == 0) {
+        /* The names of pattern aliases are only found when listing. */
+        res = vroot_alias_scan_patterns(vroot_dir_pool, vpath, vdir->aliases);
+      }
+
+      if (res == 0 &&
+          vroot_staging_count() > 0) {
+        /* New files whose uploads are not yet migrated are listed too. */
+        res = vroot_staging_scan(vroot_dir_pool, vpath, vdir->aliases);
+      }
 
-      res = vroot_alias_do(vroot_alias_dirscan, vpath);
       if (res < 0) {
         (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
           "error doing dirscan on aliases table: %s", strerror(errno));
@@ -887,13 +2290,14 @@ void *vroot_fsio_opendir(pr_fs_t *fs, const char *orig_path) {
         register unsigned int i;
 
         (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
-          "found %d %s in directory '%s'", vroot_dir_aliases->nelts,
-          vroot_dir_aliases->nelts != 1 ? "VRootAliases" : "VRootAlias",
+          "found %d %s in directory '%s'", vdir->aliases->nelts,
+          vdir->aliases->nelts != 1 ? "VRootAliases" : "VRootAlias",
           vpath);
-        vroot_dir_idx = 0;
+        vdir->alias_idx = 0;
+        vdir->dent = pcalloc(vroot_dir_pool, vroot_dentsz);
 
-        for (i = 0; i < vroot_dir_aliases->nelts; i++) {
-          char **elts = vroot_dir_aliases->elts;
+        for (i = 0; i < vdir->aliases->nelts; i++) {
+          char **elts = vdir->aliases->elts;
 
           (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
             "'%s' aliases: [%u] %s", vpath, i, elts[i]);
@@ -906,16 +2310,181 @@ void *vroot_fsio_opendir(pr_fs_t *fs, const char *orig_path) {
   return dirh;
 }
 
-struct dirent *vroot_fsio_readdir(pr_fs_t *fs, void *dirh) {
+/* Provides the next entry of a listing served from the directory cache. */
+static struct dirent *fsio_dircache_readdir(struct vroot_dir *vdir) {
+  const char *name;
+  ino_t ino = 0;
+  unsigned char type = 0;
+
+  name = vroot_dircache_next(vdir->dircache, &ino, &type);
+  if (name == NULL) {
+    return NULL;
+  }
+
+  memset(vdir->dent, 0, vroot_dentsz);
+  vdir->dent->d_ino = ino;
+#if defined(DT_UNKNOWN)
+  vdir->dent->d_type = type;
+#endif /* DT_UNKNOWN */
+
+  if (vroot_dent_namesz == 0) {
+    sstrncpy(vdir->dent->d_name, name, sizeof(vdir->dent->d_name));
+
+  } else {
+    sstrncpy(vdir->dent->d_name, name, vroot_dent_namesz);
+  }
+
+  return vdir->dent;
+}
+
+/* Provides the next entry of a virtual directory which does not exist; only
+ * the "." and ".." entries are synthesized, any aliases within the directory
+ * being appended as for any other directory.
+ */
+static struct dirent *fsio_virtdir_readdir(struct vroot_dir *vdir) {
+  static const char *names[] = { ".", "..", NULL };
+  const char *name;
+
+  name = names[vdir->virtual_idx];
+  if (name == NULL) {
+    return NULL;
+  }
+
+  vdir->virtual_idx++;
+
+  memset(vdir->dent, 0, vroot_dentsz);
+#if defined(DT_DIR)
+  vdir->dent->d_type = DT_DIR;
+#endif /* DT_DIR */
+
+  if (vroot_dent_namesz == 0) {
+    sstrncpy(vdir->dent->d_name, name, sizeof(vdir->dent->d_name));
+
+  } else {
+    sstrncpy(vdir->dent->d_name, name, vroot_dent_namesz);
+  }
+
+  return vdir->dent;
+}
+
+/* Records the given entry, read from disk, for the directory cache; at the
+ * end of the listing, the recorded listing is stored in the cache.
+ */
+static void fsio_dircache_record(struct vroot_dir *vdir, void *dirh,
+    struct dirent *dent) {
+  int res;
+
+  if (dent != NULL) {
+    unsigned char type = 0;
+
+#if defined(DT_UNKNOWN)
+    type = dent->d_type;
+#endif /* DT_UNKNOWN */
+
+    if (vroot_dircache_add(vdir->dircache, dent->d_name, dent->d_ino,
+        type) == 0) {
+      return;
+    }
+
+  } else {
+    struct stat st;
+
+    /* Only a listing of a directory which did not change while being read
+     * is stored.
+     */
+    res = fstat(dirfd((DIR *) dirh), &st);
+    if (res == 0) {
+      (void) vroot_dircache_put(vdir->dircache, &st);
+    }
+  }
+
+  (void) vroot_dircache_close(vdir->dircache);
+  vdir->dircache = NULL;
+}
+
+static inline struct dirent *fsio_readdir(pr_fs_t *fs, void *dirh,
+    int fsio_flags) {
   struct dirent *dent = NULL;
+  struct vroot_dir *vdir;
+
+  vdir = NULL;
+  if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+    vdir = vroot_dir_get(dirh);
+  }
 
 next_dent:
-  dent = readdir((DIR *) dirh);
+  if (vdir != NULL &&
+      vdir->union_lower == TRUE) {
+    dent = vroot_union_readdir(vdir->union_dir);
+
+  } else if (vdir != NULL &&
+      vdir->spread_other == TRUE) {
+    dent = vroot_spread_readdir(vdir->spread_dir);
+
+  } else if (vdir != NULL &&
+      vdir->shard_dir != NULL) {
+    dent = vroot_shard_readdir(vdir->shard_dir);
+
+  } else if (vdir != NULL &&
+      vdir->dircache_hit == TRUE) {
+    dent = fsio_dircache_readdir(vdir);
+
+  } else if (vdir != NULL &&
+      vdir->virtual_dir == TRUE) {
+    dent = fsio_virtdir_readdir(vdir);
+
+  } else {
+    dent = readdir((DIR *) dirh);
+
+    if (vdir != NULL &&
+        vdir->dircache != NULL) {
+      fsio_dircache_record(vdir, dirh, dent);
+    }
+  }
+
+  if (vdir != NULL &&
+      vdir->union_dir != NULL &&
+      vdir->union_lower == FALSE) {
+    if (dent != NULL) {
+      /* Whiteouts are not listed, and hide the entries they name. */
+      if (vroot_union_filter(vdir->union_dir, dent->d_name) == FALSE) {
+        goto next_dent;
+      }
+
+    } else {
+      /* Merge in the entries of the lower union layers. */
+      vdir->union_lower = TRUE;
+      goto next_dent;
+    }
+  }
+
+  if (vdir != NULL &&
+      vdir->spread_dir != NULL &&
+      vdir->spread_other == FALSE) {
+    if (dent != NULL) {
+      /* Names already listed, and the index, are skipped. */
+      if (vroot_spread_filter(vdir->spread_dir, dent->d_name) == FALSE) {
+        goto next_dent;
+      }
+
+    } else {
+      /* Merge in the entries of the other spread targets. */
+      vdir->spread_other = TRUE;
+      goto next_dent;
+    }
+  }
+
+  /* Drop hidden entries before anything else is done for them. */
+  if (dent != NULL &&
+      vroot_hide_name(dent->d_name) == TRUE) {
+    goto next_dent;
+  }
 
-  if (vroot_dir_aliases != NULL) {
+  if (vdir != NULL &&
+      vdir->aliases != NULL) {
     char **elts;
 
-    elts = vroot_dir_aliases->elts;
+    elts = vdir->aliases->elts;
 
     if (dent != NULL) {
       register unsigned int i;
@@ -931,7 +2500,7 @@ next_dent:
        * table, not an array_header, for storing the aliased paths.
        */
 
-      for (i = 0; i < vroot_dir_aliases->nelts; i++) {
+      for (i = 0; i < vdir->aliases->nelts; i++) {
         if (strcmp(dent->d_name, elts[i]) == 0) {
           (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
             "skipping directory entry '%s', as it is aliased", dent->d_name);
@@ -939,42 +2508,109 @@ next_dent:
         }
       }
 
+      /* Entries of the lower union layers, or other spread targets, are
+       * not in this directory.
+       */
+      if (vdir->prefetch != NULL &&
+          vdir->union_lower == FALSE &&
+          vdir->spread_other == FALSE) {
+        (void) vroot_prefetch_add(vdir->prefetch, dent->d_name);
+      }
+
+      if (vdir->seqread != NULL &&
+          vdir->union_lower == FALSE &&
+          vdir->spread_other == FALSE) {
+        (void) vroot_seqread_add(vdir->seqread, dent->d_name);
+      }
+
     } else {
-      if (vroot_dir_idx < 0 ||
-          (unsigned int) vroot_dir_idx >= vroot_dir_aliases->nelts) {
+      if (vdir->alias_idx < 0 ||
+          (unsigned int) vdir->alias_idx >= vdir->aliases->nelts) {
         return NULL;
       }
 
-      memset(vroot_dent, 0, vroot_dentsz);
+      memset(vdir->dent, 0, vroot_dentsz);
 
       if (vroot_dent_namesz == 0) {
-        sstrncpy(vroot_dent->d_name, elts[vroot_dir_idx++],
-          sizeof(vroot_dent->d_name));
+        sstrncpy(vdir->dent->d_name, elts[vdir->alias_idx++],
+          sizeof(vdir->dent->d_name));
 
       } else {
-        sstrncpy(vroot_dent->d_name, elts[vroot_dir_idx++],
+        sstrncpy(vdir->dent->d_name, elts[vdir->alias_idx++],
           vroot_dent_namesz);
       }
 
-      return vroot_dent;
+      return vdir->dent;
     }
   }
 
   return dent;
 }
 
-int vroot_fsio_closedir(pr_fs_t *fs, void *dirh) {
+static inline int fsio_closedir(pr_fs_t *fs, void *dirh, int fsio_flags) {
   int res;
-
-  res = closedir((DIR *) dirh);
+  struct vroot_dir *vdir = NULL;
 
   if (vroot_dirtab != NULL) {
     unsigned long lookup_dirh;
-    int count;
 
     lookup_dirh = (unsigned long) dirh;
-    (void) pr_table_kremove(vroot_dirtab, &lookup_dirh, sizeof(unsigned long),
-      NULL);
+    vdir = (struct vroot_dir *) pr_table_kremove(vroot_dirtab, &lookup_dirh,
+      sizeof(unsigned long), NULL);
+  }
+
+  if (vdir != NULL &&
+      vdir->dircache_hit == TRUE) {
+    /* The handle is the cached listing, released below. */
+    res = 0;
+
+  } else if (vdir != NULL &&
+      vdir->virtual_dir == TRUE) {
+    /* The handle is the per-handle state, released with its pool. */
+    res = 0;
+
+  } else {
+    res = closedir((DIR *) dirh);
+  }
+
+  if (vroot_dirtab != NULL) {
+    int count;
+
+    if (vdir != NULL &&
+        vdir->dircache != NULL) {
+      (void) vroot_dircache_close(vdir->dircache);
+      vdir->dircache = NULL;
+    }
+
+    if (vdir != NULL &&
+        vdir->prefetch != NULL) {
+      (void) vroot_prefetch_close(vdir->prefetch);
+      vdir->prefetch = NULL;
+    }
+
+    if (vdir != NULL &&
+        vdir->seqread != NULL) {
+      (void) vroot_seqread_close(vdir->seqread);
+      vdir->seqread = NULL;
+    }
+
+    if (vdir != NULL &&
+        vdir->union_dir != NULL) {
+      (void) vroot_union_closedir(vdir->union_dir);
+      vdir->union_dir = NULL;
+    }
+
+    if (vdir != NULL &&
+        vdir->spread_dir != NULL) {
+      (void) vroot_spread_closedir(vdir->spread_dir);
+      vdir->spread_dir = NULL;
+    }
+
+    if (vdir != NULL &&
+        vdir->shard_dir != NULL) {
+      (void) vroot_shard_closedir(vdir->shard_dir);
+      vdir->shard_dir = NULL;
+    }
 
     /* If the dirtab table is empty, destroy the table. */
     count = pr_table_count(vroot_dirtab);
@@ -983,41 +2619,52 @@ int vroot_fsio_closedir(pr_fs_t *fs, void *dirh) {
       destroy_pool(vroot_dir_pool);
       vroot_dir_pool = NULL;
       vroot_dirtab = NULL;
-      vroot_dir_aliases = NULL;
-      vroot_dir_idx = -1;
     }
   }
 
   return res;
 }
 
-int vroot_fsio_mkdir(pr_fs_t *fs, const char *path, mode_t mode) {
+static inline int fsio_mkdir(pr_fs_t *fs, const char *path, mode_t mode,
+    int fsio_flags) {
+  int res;
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
     return mkdir(path, mode);
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_TOP) < 0) {
     return -1;
   }
 
-  return mkdir(vpath, mode);
+  fsio_create_parents(vpath, fsio_flags);
+
+  if ((fsio_flags & VROOT_FSIO_FL_ALIASES) &&
+      vroot_union_count() > 0) {
+    res = vroot_union_mkdir(vpath, mode);
+
+  } else {
+    res = mkdir(vpath, mode);
+  }
+
+  if (res == 0) {
+    (void) vroot_casefold_add(vpath);
+    (void) vroot_virtdir_forget(vpath);
+  }
+
+  return namespace_changed(res);
 }
 
-int vroot_fsio_rmdir(pr_fs_t *fs, const char *path) {
+static inline int fsio_rmdir(pr_fs_t *fs, const char *path, int fsio_flags) {
+  int res;
   char vpath[PR_TUNABLE_PATH_MAX + 1];
 
-  if (session.curr_phase == LOG_CMD ||
-      session.curr_phase == LOG_CMD_ERR ||
-      (session.sf_flags & SF_ABORT) ||
-      vroot_path_have_base() == FALSE) {
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
     /* NOTE: once stackable FS modules are supported, have this fall through
      * to the next module in the stack.
      */
@@ -1027,23 +2674,316 @@ int vroot_fsio_rmdir(pr_fs_t *fs, const char *path) {
   /* Do not allow deleting of aliased files/directories; the aliases may only
    * exist for this user/group.
    */
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path,
-      VROOT_LOOKUP_FL_NO_ALIAS, NULL) < 0) {
+  if (fsio_flags & VROOT_FSIO_FL_ALIASES) {
+    if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path,
+        VROOT_LOOKUP_FL_NO_ALIAS, NULL) < 0) {
+      return -1;
+    }
+
+    if (vroot_alias_exists(vpath) == TRUE) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "denying delete of '%s' because it is a VRootAlias", vpath);
+      errno = EACCES;
+      return -1;
+    }
+  }
+
+  if (fsio_lookup_op(NULL, vpath, sizeof(vpath)-1, path, fsio_flags, NULL,
+      VROOT_UNION_OP_TOP) < 0) {
     return -1;
   }
 
-  if (vroot_alias_exists(vpath) == TRUE) {
-    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
-      "denying delete of '%s' because it is a VRootAlias", vpath);
-    errno = EACCES;
+  fsio_invalidate(vpath);
+
+  /* The copies of the directory in the other spread targets go first. */
+  if ((fsio_flags & VROOT_FSIO_FL_ALIASES) &&
+      vroot_spread_count() > 0 &&
+      vroot_spread_rmdir(vpath) < 0) {
+    return -1;
+  }
+
+  if ((fsio_flags & VROOT_FSIO_FL_ALIASES) &&
+      vroot_union_count() > 0) {
+    res = vroot_union_rmdir(vpath);
+
+  } else {
+    res = rmdir(vpath);
+  }
+
+  if (res == 0) {
+    dirfd_invalidate(vpath);
+    (void) vroot_casefold_remove(vpath);
+    (void) vroot_virtdir_forget(vpath);
+  }
+
+  return namespace_changed(res);
+}
+
+/* Defines a complete set of FSIO callbacks, with the given prefix, for the
+ * given constant flags.
+ */
+#define VROOT_FSIO_DEFINE_CALLBACKS(scope, prefix, fl) \
+  scope int prefix##stat(pr_fs_t *fs, const char *path, struct stat *st) { \
+    return fsio_stat(fs, path, st, (fl)); \
+  } \
+  scope int prefix##lstat(pr_fs_t *fs, const char *path, struct stat *st) { \
+    return fsio_lstat(fs, path, st, (fl)); \
+  } \
+  scope int prefix##rename(pr_fs_t *fs, const char *from, const char *to) { \
+    return fsio_rename(fs, from, to, (fl)); \
+  } \
+  scope int prefix##unlink(pr_fs_t *fs, const char *path) { \
+    return fsio_unlink(fs, path, (fl)); \
+  } \
+  scope int prefix##open(pr_fh_t *fh, const char *path, int flags) { \
+    return fsio_open(fh, path, flags, (fl)); \
+  } \
+  scope int prefix##creat(pr_fh_t *fh, const char *path, mode_t mode) { \
+    return fsio_creat(fh, path, mode, (fl)); \
+  } \
+  scope int prefix##close(pr_fh_t *fh, int fd) { \
+    return fsio_close(fh, fd, (fl)); \
+  } \
+  scope int prefix##write(pr_fh_t *fh, int fd, const char *buf, \
+      size_t size) { \
+    return fsio_write(fh, fd, buf, size, (fl)); \
+  } \
+  scope int prefix##link(pr_fs_t *fs, const char *path1, const char *path2) { \
+    return fsio_link(fs, path1, path2, (fl)); \
+  } \
+  scope int prefix##symlink(pr_fs_t *fs, const char *path1, \
+      const char *path2) { \
+    return fsio_symlink(fs, path1, path2, (fl)); \
+  } \
+  scope int prefix##readlink(pr_fs_t *fs, const char *path, char *buf, \
+      size_t bufsz) { \
+    return fsio_readlink(fs, path, buf, bufsz, (fl)); \
+  } \
+  scope int prefix##truncate(pr_fs_t *fs, const char *path, off_t len) { \
+    return fsio_truncate(fs, path, len, (fl)); \
+  } \
+  scope int prefix##chmod(pr_fs_t *fs, const char *path, mode_t mode) { \
+    return fsio_chmod(fs, path, mode, (fl)); \
+  } \
+  scope int prefix##chown(pr_fs_t *fs, const char *path, uid_t uid, \
+      gid_t gid) { \
+    return fsio_chown(fs, path, uid, gid, (fl)); \
+  } \
+  scope int prefix##lchown(pr_fs_t *fs, const char *path, uid_t uid, \
+      gid_t gid) { \
+    return fsio_lchown(fs, path, uid, gid, (fl)); \
+  } \
+  scope int prefix##chdir(pr_fs_t *fs, const char *path) { \
+    return fsio_chdir(fs, path, (fl)); \
+  } \
+  scope int prefix##utimes(pr_fs_t *fs, const char *path, \
+      struct timeval *tvs) { \
+    return fsio_utimes(fs, path, tvs, (fl)); \
+  } \
+  scope const char *prefix##realpath(pr_fs_t *fs, pool *p, \
+      const char *path) { \
+    return fsio_realpath(fs, p, path, (fl)); \
+  } \
+  scope void *prefix##opendir(pr_fs_t *fs, const char *path) { \
+    return fsio_opendir(fs, path, (fl)); \
+  } \
+  scope struct dirent *prefix##readdir(pr_fs_t *fs, void *dirh) { \
+    return fsio_readdir(fs, dirh, (fl)); \
+  } \
+  scope int prefix##closedir(pr_fs_t *fs, void *dirh) { \
+    return fsio_closedir(fs, dirh, (fl)); \
+  } \
+  scope int prefix##mkdir(pr_fs_t *fs, const char *path, mode_t mode) { \
+    return fsio_mkdir(fs, path, mode, (fl)); \
+  } \
+  scope int prefix##rmdir(pr_fs_t *fs, const char *path) { \
+    return fsio_rmdir(fs, path, (fl)); \
+  } \
+  static const struct vroot_fsio_callbacks prefix##callbacks = { \
+    #prefix, \
+    prefix##stat, prefix##lstat, prefix##rename, prefix##unlink, \
+    prefix##open, prefix##creat, prefix##close, prefix##write, \
+    prefix##link, prefix##symlink, \
+    prefix##readlink, prefix##truncate, prefix##chmod, prefix##chown, \
+    prefix##lchown, prefix##chdir, prefix##utimes, prefix##realpath, \
+    prefix##opendir, prefix##readdir, prefix##closedir, prefix##mkdir, \
+    prefix##rmdir \
+  };
+
+struct vroot_fsio_callbacks {
+  const char *name;
+
+  int (*stat)(pr_fs_t *, const char *, struct stat *);
+  int (*lstat)(pr_fs_t *, const char *, struct stat *);
+  int (*rename)(pr_fs_t *, const char *, const char *);
+  int (*unlink)(pr_fs_t *, const char *);
+  int (*open)(pr_fh_t *, const char *, int);
+  int (*creat)(pr_fh_t *, const char *, mode_t);
+  int (*close)(pr_fh_t *, int);
+  int (*write)(pr_fh_t *, int, const char *, size_t);
+  int (*link)(pr_fs_t *, const char *, const char *);
+  int (*symlink)(pr_fs_t *, const char *, const char *);
+  int (*readlink)(pr_fs_t *, const char *, char *, size_t);
+  int (*truncate)(pr_fs_t *, const char *, off_t);
+  int (*chmod)(pr_fs_t *, const char *, mode_t);
+  int (*chown)(pr_fs_t *, const char *, uid_t, gid_t);
+  int (*lchown)(pr_fs_t *, const char *, uid_t, gid_t);
+  int (*chdir)(pr_fs_t *, const char *);
+  int (*utimes)(pr_fs_t *, const char *, struct timeval *);
+  const char *(*realpath)(pr_fs_t *, pool *, const char *);
+  void *(*opendir)(pr_fs_t *, const char *);
+  struct dirent *(*readdir)(pr_fs_t *, void *);
+  int (*closedir)(pr_fs_t *, void *);
+  int (*mkdir)(pr_fs_t *, const char *, mode_t);
+  int (*rmdir)(pr_fs_t *, const char *);
+};
+
+/* The generic callbacks, which check the configuration at runtime, are
+ * used until the session configuration is known.
+ */
+VROOT_FSIO_DEFINE_CALLBACKS(, vroot_fsio_,
+  VROOT_FSIO_FL_GENERIC|VROOT_FSIO_FL_ALIASES)
+
+VROOT_FSIO_DEFINE_CALLBACKS(static, vroot_fsio_plain_,
+  VROOT_FSIO_FL_HAVE_BASE)
+VROOT_FSIO_DEFINE_CALLBACKS(static, vroot_fsio_aliases_,
+  VROOT_FSIO_FL_HAVE_BASE|VROOT_FSIO_FL_ALIASES)
+VROOT_FSIO_DEFINE_CALLBACKS(static, vroot_fsio_symlinks_,
+  VROOT_FSIO_FL_HAVE_BASE|VROOT_FSIO_FL_SYMLINKS)
+VROOT_FSIO_DEFINE_CALLBACKS(static, vroot_fsio_aliases_symlinks_,
+  VROOT_FSIO_FL_HAVE_BASE|VROOT_FSIO_FL_ALIASES|VROOT_FSIO_FL_SYMLINKS)
+
+/* For sessions whose VRootServerRoot chroot left no vroot base. */
+VROOT_FSIO_DEFINE_CALLBACKS(static, vroot_fsio_passthrough_,
+  VROOT_FSIO_FL_PASSTHROUGH|VROOT_FSIO_FL_ALIASES)
+
+int vroot_fsio_rename2(pr_fs_t *fs, const char *from, const char *to,
+    int flags) {
+  if (from == NULL ||
+      to == NULL ||
+      (flags & ~VROOT_FSIO_RENAME_FL_NOREPLACE)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return fsio_rename2(fs, from, to, flags,
+    VROOT_FSIO_FL_GENERIC|VROOT_FSIO_FL_ALIASES);
+}
+
+int vroot_fsio_copy(pr_fs_t *fs, const char *src_path, const char *dst_path,
+    int flags) {
+  char vpath1[PR_TUNABLE_PATH_MAX + 1], vpath2[PR_TUNABLE_PATH_MAX + 1];
+  int copy_flags = 0, fsio_flags;
+
+  if (src_path == NULL ||
+      dst_path == NULL ||
+      (flags & ~VROOT_FSIO_RENAME_FL_NOREPLACE)) {
+    errno = EINVAL;
     return -1;
   }
 
-  if (vroot_path_lookup(NULL, vpath, sizeof(vpath)-1, path, 0, NULL) < 0) {
+  fsio_flags = VROOT_FSIO_FL_GENERIC|VROOT_FSIO_FL_ALIASES;
+
+  if (flags & VROOT_FSIO_RENAME_FL_NOREPLACE) {
+    copy_flags |= VROOT_COPY_FL_NOREPLACE;
+  }
+
+  if (VROOT_FSIO_BYPASS(fsio_flags)) {
+    return vroot_copy_file(session.pool, src_path, dst_path, 0, copy_flags);
+  }
+
+  if (fsio_lookup(NULL, vpath1, sizeof(vpath1)-1, src_path, fsio_flags,
+      NULL) < 0) {
+    return -1;
+  }
+
+  if (fsio_lookup_op(NULL, vpath2, sizeof(vpath2)-1, dst_path, fsio_flags,
+      NULL, VROOT_UNION_OP_CREATE) < 0) {
+    return -1;
+  }
+
+  fsio_invalidate(vpath2);
+  fsio_create_parents(vpath2, fsio_flags);
+
+  return vroot_copy_file(session.pool, vpath1, vpath2, 0, copy_flags);
+}
+
+int vroot_fsio_install(pr_fs_t *fs, int flags) {
+  const struct vroot_fsio_callbacks *cbs;
+
+  if (fs == NULL) {
+    errno = EINVAL;
     return -1;
   }
 
-  return rmdir(vpath);
+  if (flags & VROOT_FSIO_FL_GENERIC) {
+    cbs = &vroot_fsio_callbacks;
+
+  } else if (flags & VROOT_FSIO_FL_PASSTHROUGH) {
+    cbs = &vroot_fsio_passthrough_callbacks;
+
+  } else if (vroot_path_have_base() == FALSE) {
+    /* The specialized callbacks assume that the base has been set. */
+    errno = EPERM;
+    return -1;
+
+  } else {
+    switch (flags & (VROOT_FSIO_FL_ALIASES|VROOT_FSIO_FL_SYMLINKS)) {
+      case VROOT_FSIO_FL_ALIASES:
+        cbs = &vroot_fsio_aliases_callbacks;
+        break;
+
+      case VROOT_FSIO_FL_SYMLINKS:
+        cbs = &vroot_fsio_symlinks_callbacks;
+        break;
+
+      case VROOT_FSIO_FL_ALIASES|VROOT_FSIO_FL_SYMLINKS:
+        cbs = &vroot_fsio_aliases_symlinks_callbacks;
+        break;
+
+      default:
+        cbs = &vroot_fsio_plain_callbacks;
+        break;
+    }
+  }
+
+  pr_trace_msg(trace_channel, 9, "installing '%s' FSIO callbacks", cbs->name);
+
+  /* This module does not provide callbacks for the following (as they are
+   * unnecessary): read() and lseek().
+   */
+  fs->stat = cbs->stat;
+  fs->lstat = cbs->lstat;
+  fs->rename = cbs->rename;
+  fs->unlink = cbs->unlink;
+  fs->open = cbs->open;
+#if PROFTPD_VERSION_NUMBER < 0x0001030603
+  fs->creat = cbs->creat;
+#endif /* ProFTPD 1.3.6rc2 or earlier */
+  fs->close = cbs->close;
+  fs->write = cbs->write;
+  fs->link = cbs->link;
+  fs->readlink = cbs->readlink;
+  fs->symlink = cbs->symlink;
+  fs->truncate = cbs->truncate;
+  fs->chmod = cbs->chmod;
+  fs->chown = cbs->chown;
+#if PROFTPD_VERSION_NUMBER >= 0x0001030407
+  fs->lchown = cbs->lchown;
+#endif /* ProFTPD 1.3.4c or later */
+#if PROFTPD_VERSION_NUMBER >= 0x0001030903
+  fs->realpath = cbs->realpath;
+#endif /* ProFTPD 1.3.9rc3 or later */
+  fs->chdir = cbs->chdir;
+  fs->chroot = vroot_fsio_chroot;
+  fs->utimes = cbs->utimes;
+  fs->opendir = cbs->opendir;
+  fs->readdir = cbs->readdir;
+  fs->closedir = cbs->closedir;
+  fs->mkdir = cbs->mkdir;
+  fs->rmdir = cbs->rmdir;
+
+  return 0;
 }
 
 int vroot_fsio_init(pool *p) {
@@ -1054,8 +2994,8 @@ int vroot_fsio_init(pool *p) {
     return -1;
   }
 
-  /* Allocate the memory for the static struct dirent that we use, including
-   * determining the necessary sizes.
+  /* Determine the necessary sizes of the struct dirent that we allocate for
+   * each directory handle.
    */
   vroot_dentsz = sizeof(dent);
   if (sizeof(dent.d_name) == 1) {
@@ -1064,11 +3004,15 @@ int vroot_fsio_init(pool *p) {
   }
 
   vroot_dentsz += vroot_dent_namesz;
-  vroot_dent = palloc(p, vroot_dentsz);
 
   return 0;
 }
 
 int vroot_fsio_free(void) {
+  (void) vroot_fsio_discard_tmpfile();
+  vroot_fsio_flush_dirfds();
+  (void) vroot_policy_free();
+  (void) vroot_seqread_free();
+  (void) vroot_prefetch_free();
   return 0;
 }
@@ -33,6 +33,8 @@ int vroot_fsio_rename(pr_fs_t *fs, const char *from, const char *to);
 int vroot_fsio_unlink(pr_fs_t *fs, const char *path);
 int vroot_fsio_open(pr_fh_t *fh, const char *path, int flags);
 int vroot_fsio_creat(pr_fh_t *fh, const char *path, mode_t mode);
+int vroot_fsio_close(pr_fh_t *fh, int fd);
+int vroot_fsio_write(pr_fh_t *fh, int fd, const char *buf, size_t size);
 int vroot_fsio_link(pr_fs_t *fs, const char *dst_path, const char *src_path);
 int vroot_fsio_symlink(pr_fs_t *fs, const char *dst_path, const char *src_path);
 int vroot_fsio_readlink(pr_fs_t *fs, const char *path, char *buf, size_t bufsz);
@@ -50,6 +52,57 @@ int vroot_fsio_closedir(pr_fs_t *fs, void *dirh);
 int vroot_fsio_mkdir(pr_fs_t *fs, const char *path, mode_t mode);
 int vroot_fsio_rmdir(pr_fs_t *fs, const char *path);
 
+/* Installs the set of callbacks specialized for the given flags on the
+ * given FS.  The generic callbacks (i.e. the functions above) check the
+ * configuration on every call, and must be used until the vroot base,
+ * aliases and options are known.
+ */
+int vroot_fsio_install(pr_fs_t *fs, int flags);
+#define VROOT_FSIO_FL_GENERIC		0x0001
+#define VROOT_FSIO_FL_ALIASES		0x0002
+#define VROOT_FSIO_FL_SYMLINKS		0x0004
+#define VROOT_FSIO_FL_PASSTHROUGH	0x0008
+
+/* Renames the given path, as for the rename callback, using the given
+ * VROOT_FSIO_RENAME_FL flags.  With VROOT_FSIO_RENAME_FL_NOREPLACE, this
+ * fails with EEXIST, rather than replacing an existing destination.
+ */
+int vroot_fsio_rename2(pr_fs_t *fs, const char *from, const char *to,
+  int flags);
+#define VROOT_FSIO_RENAME_FL_NOREPLACE	0x0001
+
+/* Copies the given file, resolving both paths (including aliases) as the
+ * FSIO callbacks do, and copying the data in the kernel where possible.  Only
+ * the VROOT_FSIO_RENAME_FL_NOREPLACE flag is supported.
+ */
+int vroot_fsio_copy(pr_fs_t *fs, const char *src_path, const char *dst_path,
+  int flags);
+
+/* Sets the VROOT_FSIO_RENAME_FL flags used by the rename callback, e.g. for
+ * commands where overwriting is not allowed.  With
+ * VROOT_FSIO_RENAME_FL_NOREPLACE, the open callback also creates the file
+ * being uploaded (session.xfer.path) exclusively.
+ */
+int vroot_fsio_set_rename_flags(int flags);
+
+/* Configures whether renames across filesystems (i.e. failing with EXDEV) are
+ * done by copying the file, and the largest file to copy; zero means no limit.
+ */
+int vroot_fsio_set_xdev_rename(int enabled, off_t max_size);
+
+/* Configures whether listings of directories within alias sources are
+ * served from, and stored in, the directory cache shared by all sessions.
+ */
+int vroot_fsio_set_dircache(int enabled);
+
+/* Closes the directory handles cached for renames. */
+void vroot_fsio_flush_dirfds(void);
+
+/* Discards any upload, for the AtomicHiddenStores VRootOption, which has not
+ * been published under its final name.
+ */
+int vroot_fsio_discard_tmpfile(void);
+
 /* Internal use only. */
 int vroot_fsio_init(pool *p);
 int vroot_fsio_free(void);
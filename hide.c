@@ -0,0 +1,499 @@
+/*
+ * ProFTPD - mod_vroot Hide implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "hide.h"
+
+/* The patterns are compiled into a nondeterministic automaton, with one
+ * state per pattern element, which is then converted into a deterministic
+ * one (DFA) by the classic subset construction.  Bytes which all of the
+ * elements treat alike share a column of the transition table.
+ */
+#define HIDE_ELT_SET		1
+#define HIDE_ELT_STAR		2
+#define HIDE_ELT_END		3
+
+struct hide_elt {
+  int type;
+
+  /* The bytes matched, for HIDE_ELT_SET. */
+  unsigned char set[32];
+};
+
+struct vroot_hide {
+  unsigned char classes[256];
+  unsigned int nclasses;
+  unsigned int nstates;
+
+  /* State 0 is the dead state, state 1 the start state. */
+  unsigned short *trans;
+  unsigned char *accept;
+};
+
+static const struct vroot_hide *vroot_hide = NULL;
+
+static const char *trace_channel = "vroot.hide";
+
+#define HIDE_SET_HAS(set, b)	((set)[(b) >> 3] & (1 << ((b) & 7)))
+#define HIDE_SET_ADD(set, b)	((set)[(b) >> 3] |= (1 << ((b) & 7)))
+
+static struct hide_elt *elt_add(array_header *elts, int type) {
+  struct hide_elt *elt;
+
+  elt = push_array(elts);
+  memset(elt, 0, sizeof(struct hide_elt));
+  elt->type = type;
+
+  return elt;
+}
+
+static int glob_parse(array_header *elts, const char *pattern) {
+  const unsigned char *ptr;
+  struct hide_elt *elt;
+
+  if (*pattern == '\0' ||
+      strchr(pattern, '/') != NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ptr = (const unsigned char *) pattern;
+  while (*ptr != '\0') {
+    register unsigned int i;
+
+    switch (*ptr) {
+      case '*':
+        (void) elt_add(elts, HIDE_ELT_STAR);
+
+        /* Consecutive stars are the same as a single one. */
+        while (*ptr == '*') {
+          ptr++;
+        }
+        break;
+
+      case '?':
+        elt = elt_add(elts, HIDE_ELT_SET);
+        memset(elt->set, 0xff, sizeof(elt->set));
+        ptr++;
+        break;
+
+      case '[': {
+        int negated = FALSE, first = TRUE;
+
+        elt = elt_add(elts, HIDE_ELT_SET);
+        ptr++;
+
+        if (*ptr == '!' ||
+            *ptr == '^') {
+          negated = TRUE;
+          ptr++;
+        }
+
+        while (*ptr != '\0' &&
+               (*ptr != ']' || first == TRUE)) {
+          unsigned int start, end;
+
+          start = end = *ptr;
+          if (*ptr == '\\' &&
+              ptr[1] != '\0') {
+            start = end = *(++ptr);
+          }
+
+          if (ptr[1] == '-' &&
+              ptr[2] != '\0' &&
+              ptr[2] != ']') {
+            end = ptr[2];
+            ptr += 2;
+          }
+
+          if (start > end) {
+            errno = EINVAL;
+            return -1;
+          }
+
+          for (i = start; i <= end; i++) {
+            HIDE_SET_ADD(elt->set, i);
+          }
+
+          ptr++;
+          first = FALSE;
+        }
+
+        if (*ptr != ']') {
+          errno = EINVAL;
+          return -1;
+        }
+
+        ptr++;
+
+        if (negated == TRUE) {
+          for (i = 0; i < sizeof(elt->set); i++) {
+            elt->set[i] = ~elt->set[i];
+          }
+        }
+        break;
+      }
+
+      case '\\':
+        if (ptr[1] == '\0') {
+          errno = EINVAL;
+          return -1;
+        }
+
+        ptr++;
+
+        /* Fallthrough */
+
+      default:
+        elt = elt_add(elts, HIDE_ELT_SET);
+        HIDE_SET_ADD(elt->set, *ptr);
+        ptr++;
+        break;
+    }
+  }
+
+  (void) elt_add(elts, HIDE_ELT_END);
+  return 0;
+}
+
+/* Adds the other case of every letter in the set. */
+static void set_fold(unsigned char *set) {
+  register unsigned int b;
+
+  for (b = 'A'; b <= 'Z'; b++) {
+    if (HIDE_SET_HAS(set, b) ||
+        HIDE_SET_HAS(set, b + ('a' - 'A'))) {
+      HIDE_SET_ADD(set, b);
+      HIDE_SET_ADD(set, b + ('a' - 'A'));
+    }
+  }
+}
+
+/* Adds the states reachable without consuming a byte, i.e. past stars. */
+static void subset_close(unsigned int *subset, const struct hide_elt *elts,
+    unsigned int nelts) {
+  register unsigned int i;
+
+  /* Stars only lead forward, thus a single ascending pass suffices. */
+  for (i = 0; i < nelts; i++) {
+    if ((subset[i >> 5] & (1U << (i & 31))) &&
+        elts[i].type == HIDE_ELT_STAR) {
+      subset[(i + 1) >> 5] |= (1U << ((i + 1) & 31));
+    }
+  }
+}
+
+static unsigned int subset_hash(const unsigned int *subset,
+    unsigned int nwords) {
+  register unsigned int i;
+  unsigned int h = 2166136261U;
+
+  for (i = 0; i < nwords; i++) {
+    h = (h ^ subset[i]) * 16777619U;
+  }
+
+  return h;
+}
+
+struct vroot_hide *vroot_hide_compile(pool *p, const array_header *patterns,
+    int flags) {
+  register unsigned int i;
+  pool *tmp_pool;
+  array_header *elt_list;
+  struct hide_elt *elts;
+  struct vroot_hide *hide, *compiled;
+  unsigned int nelts, nwords, nstates, tabsz, c;
+  unsigned char reps[256];
+  unsigned int *subsets, *subset;
+  unsigned short *trans;
+  int *tab;
+
+  if (p == NULL ||
+      patterns == NULL ||
+      patterns->nelts == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "VRootHide compile pool");
+
+  elt_list = make_array(tmp_pool, 8, sizeof(struct hide_elt));
+  for (i = 0; i < patterns->nelts; i++) {
+    const char *pattern;
+
+    pattern = ((const char **) patterns->elts)[i];
+    if (glob_parse(elt_list, pattern) < 0) {
+      int xerrno = errno;
+
+      pr_trace_msg(trace_channel, 3, "badly formatted pattern '%s'", pattern);
+      destroy_pool(tmp_pool);
+      errno = xerrno;
+      return NULL;
+    }
+  }
+
+  elts = elt_list->elts;
+  nelts = elt_list->nelts;
+  nwords = (nelts + 31) / 32;
+
+  if (flags & VROOT_HIDE_FL_NOCASE) {
+    for (i = 0; i < nelts; i++) {
+      if (elts[i].type == HIDE_ELT_SET) {
+        set_fold(elts[i].set);
+      }
+    }
+  }
+
+  hide = pcalloc(tmp_pool, sizeof(struct vroot_hide));
+
+  /* Partition the bytes into the classes which no element tells apart. */
+  hide->nclasses = 1;
+  for (i = 0; i < nelts; i++) {
+    int map[512];
+    unsigned int b, nclasses = 0;
+
+    if (elts[i].type != HIDE_ELT_SET) {
+      continue;
+    }
+
+    memset(map, -1, sizeof(map));
+    for (b = 0; b < 256; b++) {
+      unsigned int key;
+
+      key = (hide->classes[b] * 2) + (HIDE_SET_HAS(elts[i].set, b) ? 1 : 0);
+      if (map[key] < 0) {
+        map[key] = nclasses++;
+      }
+
+      hide->classes[b] = map[key];
+    }
+
+    hide->nclasses = nclasses;
+  }
+
+  for (c = 256; c > 0; c--) {
+    reps[hide->classes[c-1]] = c - 1;
+  }
+
+  /* One more subset than states, for computing the next subset. */
+  subsets = pcalloc(tmp_pool,
+    (VROOT_HIDE_MAX_STATES + 1) * nwords * sizeof(unsigned int));
+  trans = pcalloc(tmp_pool,
+    VROOT_HIDE_MAX_STATES * hide->nclasses * sizeof(unsigned short));
+
+  /* Open addressing table of the known subsets, by hash. */
+  tabsz = VROOT_HIDE_MAX_STATES * 2;
+  tab = palloc(tmp_pool, tabsz * sizeof(int));
+  memset(tab, -1, tabsz * sizeof(int));
+
+  /* The dead state, i.e. the empty subset... */
+  tab[subset_hash(subsets, nwords) % tabsz] = 0;
+
+  /* ...and the start state, at the start of every pattern. */
+  subset = subsets + nwords;
+  subset[0] |= 1U;
+  for (i = 1; i < nelts; i++) {
+    if (elts[i-1].type == HIDE_ELT_END) {
+      subset[i >> 5] |= (1U << (i & 31));
+    }
+  }
+  subset_close(subset, elts, nelts);
+  tab[subset_hash(subset, nwords) % tabsz] = 1;
+  nstates = 2;
+
+  for (i = 1; i < nstates; i++) {
+    for (c = 0; c < hide->nclasses; c++) {
+      register unsigned int j;
+      unsigned int *next;
+      unsigned int h;
+      int idx;
+
+      next = subsets + (nstates * nwords);
+      memset(next, 0, nwords * sizeof(unsigned int));
+      subset = subsets + (i * nwords);
+
+      for (j = 0; j < nelts; j++) {
+        if (!(subset[j >> 5] & (1U << (j & 31)))) {
+          continue;
+        }
+
+        if (elts[j].type == HIDE_ELT_STAR) {
+          next[j >> 5] |= (1U << (j & 31));
+
+        } else if (elts[j].type == HIDE_ELT_SET &&
+                   HIDE_SET_HAS(elts[j].set, reps[c])) {
+          next[(j + 1) >> 5] |= (1U << ((j + 1) & 31));
+        }
+      }
+
+      subset_close(next, elts, nelts);
+
+      h = subset_hash(next, nwords) % tabsz;
+      while ((idx = tab[h]) >= 0) {
+        if (memcmp(subsets + (idx * nwords), next,
+            nwords * sizeof(unsigned int)) == 0) {
+          break;
+        }
+
+        h = (h + 1) % tabsz;
+      }
+
+      if (idx < 0) {
+        if (nstates == VROOT_HIDE_MAX_STATES) {
+          pr_trace_msg(trace_channel, 3,
+            "patterns need more than %u states", VROOT_HIDE_MAX_STATES);
+          destroy_pool(tmp_pool);
+          errno = ENOSPC;
+          return NULL;
+        }
+
+        idx = nstates++;
+        tab[h] = idx;
+      }
+
+      trans[(i * hide->nclasses) + c] = (unsigned short) idx;
+    }
+  }
+
+  hide->nstates = nstates;
+  hide->trans = trans;
+  hide->accept = pcalloc(tmp_pool, nstates);
+  for (i = 1; i < nstates; i++) {
+    register unsigned int j;
+
+    subset = subsets + (i * nwords);
+    for (j = 0; j < nelts; j++) {
+      if ((subset[j >> 5] & (1U << (j & 31))) &&
+          elts[j].type == HIDE_ELT_END) {
+        hide->accept[i] = TRUE;
+        break;
+      }
+    }
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "compiled %d %s into %u states, %u byte classes", patterns->nelts,
+    patterns->nelts != 1 ? "patterns" : "pattern", nstates, hide->nclasses);
+
+  /* Keep only the tables, sized for the states actually needed. */
+  compiled = pcalloc(p, sizeof(struct vroot_hide));
+  memcpy(compiled->classes, hide->classes, sizeof(compiled->classes));
+  compiled->nclasses = hide->nclasses;
+  compiled->nstates = nstates;
+  compiled->trans = palloc(p, nstates * hide->nclasses *
+    sizeof(unsigned short));
+  memcpy(compiled->trans, trans,
+    nstates * hide->nclasses * sizeof(unsigned short));
+  compiled->accept = palloc(p, nstates);
+  memcpy(compiled->accept, hide->accept, nstates);
+
+  destroy_pool(tmp_pool);
+  return compiled;
+}
+
+static int hide_match(const struct vroot_hide *hide, const char *name,
+    size_t namelen) {
+  register size_t i;
+  unsigned int state = 1;
+
+  for (i = 0; i < namelen; i++) {
+    state = hide->trans[(state * hide->nclasses) +
+      hide->classes[(unsigned char) name[i]]];
+    if (state == 0) {
+      return FALSE;
+    }
+  }
+
+  return (hide->accept[state] ? TRUE : FALSE);
+}
+
+int vroot_hide_match(const struct vroot_hide *hide, const char *name) {
+  if (hide == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return hide_match(hide, name, strlen(name));
+}
+
+int vroot_hide_set(const struct vroot_hide *hide) {
+  vroot_hide = hide;
+  return 0;
+}
+
+const struct vroot_hide *vroot_hide_get(void) {
+  return vroot_hide;
+}
+
+int vroot_hide_name(const char *name) {
+  if (vroot_hide == NULL ||
+      name == NULL) {
+    return FALSE;
+  }
+
+  if (strcmp(name, ".") == 0 ||
+      strcmp(name, "..") == 0) {
+    return FALSE;
+  }
+
+  return hide_match(vroot_hide, name, strlen(name));
+}
+
+int vroot_hide_match_path(const struct vroot_hide *hide, const char *path) {
+  const char *ptr;
+
+  if (hide == NULL ||
+      path == NULL) {
+    return FALSE;
+  }
+
+  ptr = path;
+  while (*ptr != '\0') {
+    const char *next;
+    size_t len;
+
+    if (*ptr == '/') {
+      ptr++;
+      continue;
+    }
+
+    next = strchr(ptr, '/');
+    len = (next != NULL ? (size_t) (next - ptr) : strlen(ptr));
+
+    if (!(len == 1 && ptr[0] == '.') &&
+        !(len == 2 && ptr[0] == '.' && ptr[1] == '.') &&
+        hide_match(hide, ptr, len) == TRUE) {
+      return TRUE;
+    }
+
+    ptr += len;
+  }
+
+  return FALSE;
+}
+
+int vroot_hide_path(const char *path) {
+  return vroot_hide_match_path(vroot_hide, path);
+}
@@ -0,0 +1,64 @@
+/*
+ * ProFTPD - mod_vroot Hide API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_HIDE_H
+#define MOD_VROOT_HIDE_H
+
+#include "mod_vroot.h"
+
+/* Maximum number of automaton states for the VRootHide patterns. */
+#define VROOT_HIDE_MAX_STATES		1024
+
+struct vroot_hide;
+
+/* Compiles the given glob patterns (char *) into a single automaton which
+ * matches a name against all of them at once.  Patterns match a single
+ * name, thus may not contain slashes.  Fails with EINVAL for a malformed
+ * pattern, or ENOSPC for patterns needing too many states.
+ */
+struct vroot_hide *vroot_hide_compile(pool *p, const array_header *patterns,
+  int flags);
+
+/* Letters in the patterns match either case. */
+#define VROOT_HIDE_FL_NOCASE		0x001
+
+/* Returns TRUE if the given name matches any of the compiled patterns; or,
+ * for a path, if any of its components, other than "." and "..", does.
+ */
+int vroot_hide_match(const struct vroot_hide *hide, const char *name);
+int vroot_hide_match_path(const struct vroot_hide *hide, const char *path);
+
+/* Sets the compiled patterns hiding names for this session; NULL disables
+ * hiding.
+ */
+int vroot_hide_set(const struct vroot_hide *hide);
+const struct vroot_hide *vroot_hide_get(void);
+
+/* Returns TRUE if the given name, or any component of the given path, is
+ * hidden for this session.  The "." and ".." names are never hidden.
+ */
+int vroot_hide_name(const char *name);
+int vroot_hide_path(const char *path);
+
+#endif /* MOD_VROOT_HIDE_H */
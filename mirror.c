@@ -0,0 +1,660 @@
+/*
+ * ProFTPD - mod_vroot Mirror Alias implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mirror.h"
+#include "watchdog.h"
+
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#include <limits.h>
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+/* Robust mutexes let sessions recover the lock of the shared table from a
+ * session killed while holding it.
+ */
+#if defined(HAVE_PTHREAD_H) && defined(__linux__) && defined(EOWNERDEAD)
+# define VROOT_MIRROR_ROBUST	1
+#endif
+
+#define VROOT_MIRROR_MAX_SLOTS		64
+
+/* How much of a file is read when sampling the latency of a replica. */
+#define VROOT_MIRROR_SAMPLE_SIZE	4096
+
+/* Replicas whose latency is within a quarter, plus this many microseconds,
+ * of the best are considered equally fast, and used in turn.
+ */
+#define VROOT_MIRROR_LATENCY_SLACK	1000
+
+/* The latency of a replica, shared by all sessions using it. */
+struct mirror_slot {
+  char path[PR_TUNABLE_PATH_MAX + 1];
+
+  /* The moving average of the time taken to open, and read the first block
+   * of, a file, in microseconds.  The session due to sample the replica
+   * again sets sampled_at first, so that other sessions do not sample it
+   * too.
+   */
+  unsigned long ewma_usecs;
+  unsigned long nsamples;
+  time_t sampled_at;
+
+  /* Until when the replica is avoided, having failed. */
+  time_t failed_until;
+  int xerrno;
+};
+
+struct mirror_table {
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex;
+#endif /* HAVE_PTHREAD_H */
+  unsigned int nslots;
+  struct mirror_slot slots[VROOT_MIRROR_MAX_SLOTS];
+};
+
+struct vroot_mirror {
+  const char *dst_path;
+  int selection;
+
+  /* The real paths of the replicas, primary first, and their latencies. */
+  const char **replicas;
+  size_t *replica_lens;
+  struct mirror_slot **slots;
+  unsigned int nreplicas;
+
+  /* For using replicas in turn. */
+  unsigned int next_replica;
+};
+
+static pool *mirror_pool = NULL;
+static array_header *mirrors = NULL;
+
+static struct mirror_table *mirror_table = NULL;
+static int mirror_table_shared = FALSE;
+
+static const char *trace_channel = "vroot.mirror";
+
+static time_t mirror_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static unsigned long mirror_usecs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((unsigned long) ts.tv_sec * 1000000UL) +
+    ((unsigned long) ts.tv_nsec / 1000UL);
+}
+
+static void table_lock(void) {
+#ifdef HAVE_PTHREAD_H
+  int res;
+
+  res = pthread_mutex_lock(&(mirror_table->mutex));
+# if defined(VROOT_MIRROR_ROBUST)
+  if (res == EOWNERDEAD) {
+    /* The table is only ever updated field by field; it is still usable. */
+    pthread_mutex_consistent(&(mirror_table->mutex));
+  }
+# else
+  (void) res;
+# endif /* VROOT_MIRROR_ROBUST */
+#endif /* HAVE_PTHREAD_H */
+}
+
+static void table_unlock(void) {
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(mirror_table->mutex));
+#endif /* HAVE_PTHREAD_H */
+}
+
+int vroot_mirror_init(void) {
+#ifdef HAVE_PTHREAD_H
+  struct mirror_table *table;
+  pthread_mutexattr_t attr;
+  void *ptr;
+  int xerrno;
+
+  if (mirror_table != NULL) {
+    return 0;
+  }
+
+  ptr = mmap(NULL, sizeof(struct mirror_table), PROT_READ|PROT_WRITE,
+    MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return -1;
+  }
+
+  table = ptr;
+
+  pthread_mutexattr_init(&attr);
+  xerrno = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  if (xerrno != 0) {
+    pthread_mutexattr_destroy(&attr);
+    (void) munmap(ptr, sizeof(struct mirror_table));
+    errno = xerrno;
+    return -1;
+  }
+
+# if defined(VROOT_MIRROR_ROBUST)
+  (void) pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+# endif /* VROOT_MIRROR_ROBUST */
+
+  pthread_mutex_init(&(table->mutex), &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  mirror_table = table;
+  mirror_table_shared = TRUE;
+#endif /* HAVE_PTHREAD_H */
+
+  return 0;
+}
+
+/* Finds the slot for the given replica path, claiming a new one if needed.
+ * Replicas beyond the size of the table keep their latencies in the given
+ * session-local slot.
+ */
+static struct mirror_slot *table_get_slot(const char *path,
+    struct mirror_slot *local_slot) {
+  register unsigned int i;
+  struct mirror_slot *slot = NULL;
+
+  table_lock();
+
+  for (i = 0; i < mirror_table->nslots; i++) {
+    if (strcmp(mirror_table->slots[i].path, path) == 0) {
+      slot = &(mirror_table->slots[i]);
+      break;
+    }
+  }
+
+  if (slot == NULL &&
+      mirror_table->nslots < VROOT_MIRROR_MAX_SLOTS) {
+    slot = &(mirror_table->slots[mirror_table->nslots++]);
+    sstrncpy(slot->path, path, sizeof(slot->path));
+  }
+
+  table_unlock();
+
+  if (slot == NULL) {
+    sstrncpy(local_slot->path, path, sizeof(local_slot->path));
+    slot = local_slot;
+  }
+
+  return slot;
+}
+
+int vroot_mirror_add(const char *dst_path, const array_header *replicas,
+    int selection) {
+  register unsigned int i;
+  struct vroot_mirror *m;
+  char **elts;
+
+  if (dst_path == NULL ||
+      replicas == NULL ||
+      replicas->nelts < 2 ||
+      replicas->nelts > VROOT_MIRROR_MAX_REPLICAS ||
+      (selection != VROOT_MIRROR_SELECT_LATENCY &&
+       selection != VROOT_MIRROR_SELECT_ROTATE)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (mirror_pool == NULL) {
+    mirror_pool = make_sub_pool(session.pool);
+    pr_pool_tag(mirror_pool, "VRoot Mirror Pool");
+
+    mirrors = make_array(mirror_pool, 1, sizeof(struct vroot_mirror *));
+  }
+
+  if (mirror_table == NULL) {
+    mirror_table = pcalloc(mirror_pool, sizeof(struct mirror_table));
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&(mirror_table->mutex), NULL);
+#endif /* HAVE_PTHREAD_H */
+    mirror_table_shared = FALSE;
+  }
+
+  m = pcalloc(mirror_pool, sizeof(struct vroot_mirror));
+  m->dst_path = pstrdup(mirror_pool, dst_path);
+  m->selection = selection;
+  m->nreplicas = replicas->nelts;
+  m->replicas = pcalloc(mirror_pool, m->nreplicas * sizeof(char *));
+  m->replica_lens = pcalloc(mirror_pool, m->nreplicas * sizeof(size_t));
+  m->slots = pcalloc(mirror_pool,
+    m->nreplicas * sizeof(struct mirror_slot *));
+
+  /* Start each session on a different replica, so that rotating sessions
+   * do not all read from the same replica at the same time.
+   */
+  m->next_replica = (unsigned int) getpid() % m->nreplicas;
+
+  elts = replicas->elts;
+  for (i = 0; i < m->nreplicas; i++) {
+    char *replica;
+    size_t replica_len;
+
+    replica = pstrdup(mirror_pool, elts[i]);
+    replica_len = strlen(replica);
+    if (replica_len > 1 &&
+        replica[replica_len-1] == '/') {
+      replica[--replica_len] = '\0';
+    }
+
+    m->replicas[i] = replica;
+    m->replica_lens[i] = replica_len;
+    m->slots[i] = table_get_slot(replica,
+      pcalloc(mirror_pool, sizeof(struct mirror_slot)));
+
+    pr_trace_msg(trace_channel, 9, "mirror '%s': replica %u = '%s'", dst_path,
+      i, replica);
+  }
+
+  *((struct vroot_mirror **) push_array(mirrors)) = m;
+  return 0;
+}
+
+unsigned int vroot_mirror_count(void) {
+  if (mirrors == NULL) {
+    return 0;
+  }
+
+  return mirrors->nelts;
+}
+
+/* Finds the mirror whose primary contains the given real path, setting the
+ * path relative to the primary ("" for the primary itself).
+ */
+static struct vroot_mirror *mirror_get(const char *path,
+    const char **rel_path) {
+  register unsigned int i;
+  struct vroot_mirror **elts;
+
+  if (mirrors == NULL ||
+      path == NULL) {
+    return NULL;
+  }
+
+  elts = mirrors->elts;
+  for (i = 0; i < mirrors->nelts; i++) {
+    struct vroot_mirror *m;
+    size_t len;
+
+    m = elts[i];
+    len = m->replica_lens[0];
+
+    if (strncmp(path, m->replicas[0], len) == 0 &&
+        (path[len] == '\0' || path[len] == '/')) {
+      if (rel_path != NULL) {
+        *rel_path = path + len;
+      }
+
+      return m;
+    }
+  }
+
+  return NULL;
+}
+
+int vroot_mirror_contains(const char *path) {
+  if (mirror_get(path, NULL) != NULL) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Orders the replicas of the given mirror by preference.  Replicas which
+ * failed recently, or whose source is known by the watchdog to be
+ * unavailable, come last, as a last resort.  Returns TRUE if this session
+ * is to sample the latency of the first replica.
+ */
+static int mirror_order(struct vroot_mirror *m, unsigned int *order) {
+  register unsigned int i, j;
+  unsigned long keys[VROOT_MIRROR_MAX_REPLICAS];
+  int down[VROOT_MIRROR_MAX_REPLICAS], stale[VROOT_MIRROR_MAX_REPLICAS];
+  unsigned int nfast;
+  time_t now;
+
+  now = mirror_now();
+
+  table_lock();
+  for (i = 0; i < m->nreplicas; i++) {
+    struct mirror_slot *slot;
+
+    slot = m->slots[i];
+    down[i] = (slot->failed_until > now);
+
+    /* Replicas not sampled yet, or for a while, sort first, so that their
+     * latency is (re)learned.  Those being sampled for the first time, by
+     * another session, sort last.
+     */
+    stale[i] = (slot->sampled_at == 0 ||
+      slot->sampled_at + VROOT_MIRROR_RESAMPLE_INTERVAL <= now);
+    if (stale[i] == TRUE) {
+      keys[i] = 0;
+
+    } else if (slot->nsamples == 0) {
+      keys[i] = ULONG_MAX;
+
+    } else {
+      keys[i] = slot->ewma_usecs;
+    }
+  }
+  table_unlock();
+
+  for (i = 0; i < m->nreplicas; i++) {
+    if (down[i] == FALSE &&
+        vroot_watchdog_check(m->replicas[i]) < 0) {
+      down[i] = TRUE;
+    }
+  }
+
+  if (m->selection == VROOT_MIRROR_SELECT_ROTATE) {
+    unsigned int start;
+
+    start = m->next_replica++ % m->nreplicas;
+    for (i = 0; i < m->nreplicas; i++) {
+      order[i] = (start + i) % m->nreplicas;
+      keys[order[i]] = 0;
+    }
+
+  } else {
+    for (i = 0; i < m->nreplicas; i++) {
+      order[i] = i;
+    }
+  }
+
+  /* A stable insertion sort, by availability and then by latency; for
+   * rotation, all keys are equal.
+   */
+  for (i = 1; i < m->nreplicas; i++) {
+    unsigned int idx;
+
+    idx = order[i];
+    for (j = i; j > 0; j--) {
+      unsigned int prev;
+
+      prev = order[j-1];
+      if (down[prev] < down[idx] ||
+          (down[prev] == down[idx] && keys[prev] <= keys[idx])) {
+        break;
+      }
+
+      order[j] = prev;
+    }
+
+    order[j] = idx;
+  }
+
+  if (m->selection == VROOT_MIRROR_SELECT_ROTATE ||
+      down[order[0]] == TRUE) {
+    return FALSE;
+  }
+
+  if (stale[order[0]] == TRUE) {
+    struct mirror_slot *slot;
+    int sample = FALSE;
+
+    /* Claim the sample, unless another session did so since. */
+    slot = m->slots[order[0]];
+
+    table_lock();
+    if (slot->sampled_at == 0 ||
+        slot->sampled_at + VROOT_MIRROR_RESAMPLE_INTERVAL <= now) {
+      slot->sampled_at = now;
+      sample = TRUE;
+    }
+    table_unlock();
+
+    return sample;
+  }
+
+  /* Use the replicas about as fast as the best in turn, rather than having
+   * every session pile onto the best one.
+   */
+  nfast = 1;
+  for (i = 1; i < m->nreplicas; i++) {
+    unsigned long limit;
+
+    limit = keys[order[0]] + (keys[order[0]] / 4) +
+      VROOT_MIRROR_LATENCY_SLACK;
+    if (down[order[i]] == TRUE ||
+        keys[order[i]] > limit) {
+      break;
+    }
+
+    nfast++;
+  }
+
+  if (nfast > 1) {
+    unsigned int chosen, idx;
+
+    chosen = m->next_replica++ % nfast;
+    idx = order[chosen];
+    for (j = chosen; j > 0; j--) {
+      order[j] = order[j-1];
+    }
+
+    order[0] = idx;
+  }
+
+  return FALSE;
+}
+
+static void mirror_sample(struct mirror_slot *slot, unsigned long usecs) {
+  table_lock();
+
+  if (slot->nsamples == 0) {
+    slot->ewma_usecs = usecs;
+
+  } else if (usecs >= slot->ewma_usecs) {
+    slot->ewma_usecs += (usecs - slot->ewma_usecs) / 4;
+
+  } else {
+    slot->ewma_usecs -= (slot->ewma_usecs - usecs) / 4;
+  }
+
+  slot->nsamples++;
+  slot->failed_until = 0;
+  slot->xerrno = 0;
+
+  table_unlock();
+}
+
+static void mirror_fail(struct vroot_mirror *m, unsigned int idx,
+    const char *path, int xerrno) {
+  struct mirror_slot *slot;
+
+  slot = m->slots[idx];
+
+  table_lock();
+  slot->failed_until = mirror_now() + VROOT_MIRROR_FAIL_COOLDOWN;
+  slot->xerrno = xerrno;
+  table_unlock();
+
+  (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+    "error reading '%s' from replica '%s' of mirror '%s': %s, avoiding "
+    "replica for %u secs", path, m->replicas[idx], m->dst_path,
+    strerror(xerrno), (unsigned int) VROOT_MIRROR_FAIL_COOLDOWN);
+}
+
+/* Errors which say something about the file, rather than the replica, and
+ * thus are not held against the replica.
+ */
+static int mirror_file_error(int xerrno) {
+  switch (xerrno) {
+    case ENOENT:
+    case ENOTDIR:
+    case EACCES:
+    case EPERM:
+    case ELOOP:
+    case ENAMETOOLONG:
+    case EISDIR:
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+int vroot_mirror_open(const char *path, int flags) {
+  register unsigned int i;
+  struct vroot_mirror *m;
+  const char *rel_path = NULL;
+  unsigned int order[VROOT_MIRROR_MAX_REPLICAS];
+  int sample, xerrno = ENOENT;
+
+  m = mirror_get(path, &rel_path);
+  if (m == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  sample = mirror_order(m, order);
+
+  for (i = 0; i < m->nreplicas; i++) {
+    char replica_path[PR_TUNABLE_PATH_MAX + 1];
+    char buf[VROOT_MIRROR_SAMPLE_SIZE];
+    unsigned int idx;
+    unsigned long start_usecs;
+    struct stat st;
+    int fd;
+
+    pr_signals_handle();
+
+    idx = order[i];
+    if (m->replica_lens[idx] + strlen(rel_path) >= sizeof(replica_path)) {
+      xerrno = ENAMETOOLONG;
+      continue;
+    }
+
+    memset(replica_path, '\0', sizeof(replica_path));
+    sstrncpy(replica_path, m->replicas[idx], sizeof(replica_path));
+    sstrcat(replica_path, rel_path, sizeof(replica_path));
+
+    start_usecs = mirror_usecs();
+
+    fd = open(replica_path, flags, PR_OPEN_MODE);
+    if (fd < 0) {
+      int open_errno = errno;
+
+      pr_trace_msg(trace_channel, 8, "error opening '%s': %s", replica_path,
+        strerror(open_errno));
+
+      if (mirror_file_error(open_errno) == FALSE) {
+        mirror_fail(m, idx, replica_path, open_errno);
+      }
+
+      /* Report the error of the preferred replica, unless a later one
+       * failed for a reason other than the file being missing there.
+       */
+      if (i == 0 ||
+          open_errno != ENOENT) {
+        xerrno = open_errno;
+      }
+
+      continue;
+    }
+
+    /* When sampling, reading the first block catches replicas which open
+     * files, but then stall or fail on reading them.
+     */
+    if (i == 0 &&
+        sample == TRUE) {
+      if (fstat(fd, &st) == 0 &&
+          S_ISREG(st.st_mode) &&
+          st.st_size > 0 &&
+          pread(fd, buf, sizeof(buf), 0) < 0) {
+        int read_errno = errno;
+
+        (void) close(fd);
+        mirror_fail(m, idx, replica_path, read_errno);
+        xerrno = read_errno;
+        continue;
+      }
+
+      mirror_sample(m->slots[idx], mirror_usecs() - start_usecs);
+    }
+
+    pr_trace_msg(trace_channel, 15, "reading '%s' from replica '%s'", path,
+      m->replicas[idx]);
+    return fd;
+  }
+
+  errno = xerrno;
+  return -1;
+}
+
+int vroot_mirror_list_replicas(array_header *paths) {
+  register unsigned int i;
+  struct vroot_mirror **elts;
+
+  if (paths == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (mirrors == NULL) {
+    return 0;
+  }
+
+  elts = mirrors->elts;
+  for (i = 0; i < mirrors->nelts; i++) {
+    register unsigned int j;
+    struct vroot_mirror *m;
+
+    m = elts[i];
+    for (j = 1; j < m->nreplicas; j++) {
+      *((char **) push_array(paths)) = pstrdup(paths->pool, m->replicas[j]);
+    }
+  }
+
+  return 0;
+}
+
+int vroot_mirror_free(void) {
+  if (mirror_pool != NULL) {
+    /* A table of our own was allocated from the pool; the shared table is
+     * kept, for use by other sessions.
+     */
+    if (mirror_table_shared == FALSE) {
+      mirror_table = NULL;
+    }
+
+    destroy_pool(mirror_pool);
+    mirror_pool = NULL;
+    mirrors = NULL;
+  }
+
+  return 0;
+}
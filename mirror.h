@@ -0,0 +1,78 @@
+/*
+ * ProFTPD - mod_vroot Mirror Alias API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_MIRROR_H
+#define MOD_VROOT_MIRROR_H
+
+#include "mod_vroot.h"
+
+/* Files are read from the replica with the lowest observed latency, or from
+ * each replica in turn.
+ */
+#define VROOT_MIRROR_SELECT_LATENCY	1
+#define VROOT_MIRROR_SELECT_ROTATE	2
+
+#define VROOT_MIRROR_MAX_REPLICAS	16
+
+/* How long, in seconds, a replica which failed is avoided. */
+#define VROOT_MIRROR_FAIL_COOLDOWN	30
+
+/* How often, in seconds, the latency of a replica is sampled again, by one
+ * of the sessions using it.
+ */
+#define VROOT_MIRROR_RESAMPLE_INTERVAL	30
+
+/* Creates the table of replica latencies, shared by all sessions.  This is
+ * done by the daemon, before sessions are forked; sessions started without
+ * it keep latencies of their own.
+ */
+int vroot_mirror_init(void);
+
+/* Registers the given replicas, given as real paths, for the given alias
+ * destination path.  The first replica, the primary, is also the source of
+ * the alias, and provides the metadata and listings of the mirror.
+ */
+int vroot_mirror_add(const char *dst_path, const array_header *replicas,
+  int selection);
+unsigned int vroot_mirror_count(void);
+
+/* Returns TRUE if the given real path is within the primary of a mirror. */
+int vroot_mirror_contains(const char *path);
+
+/* Opens, for reading, the given real path within the primary of a mirror
+ * from the replica chosen by its selection policy, failing over to the other
+ * replicas if that fails.  Returns -1, with errno set to ENOENT, if the path
+ * is not within a mirror.
+ */
+int vroot_mirror_open(const char *path, int flags);
+
+/* Adds the real paths of the replicas, other than the primaries, to the given
+ * array, e.g. for probing by the watchdog.
+ */
+int vroot_mirror_list_replicas(array_header *paths);
+
+/* Internal use only. */
+int vroot_mirror_free(void);
+
+#endif /* MOD_VROOT_MIRROR_H */
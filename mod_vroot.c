@@ -27,13 +27,29 @@
  *
  * -----DO NOT EDIT BELOW THIS LINE-----
  * $Archive: mod_vroot.a $
+ * $Libraries: -lpthread$
  */
 
 #include "mod_vroot.h"
 #include "privs.h"
 #include "alias.h"
+#include "aliascache.h"
+#include "casefold.h"
+#include "union.h"
+#include "spread.h"
+#include "cachetier.h"
+#include "staging.h"
+#include "mirror.h"
+#include "hide.h"
+#include "virtdir.h"
 #include "path.h"
+#include "dircache.h"
 #include "fsio.h"
+#include "prefetch.h"
+#include "policy.h"
+#include "throttle.h"
+#include "warmup.h"
+#include "watchdog.h"
 
 int vroot_logfd = -1;
 unsigned int vroot_opts = 0;
@@ -41,24 +57,26 @@ unsigned int vroot_opts = 0;
 module vroot_module;
 
 static int vroot_engine = FALSE;
+static pr_fs_t *vroot_fs = NULL;
 static const char *trace_channel = "vroot";
 
 #if PROFTPD_VERSION_NUMBER >= 0x0001030407
 static int vroot_use_mkdtemp = FALSE;
 #endif /* ProFTPD 1.3.4c or later */
 
-static int handle_vrootaliases(void) {
+/* Expands the configured VRootAlias settings, for this session, into a list
+ * of struct vroot_aliascache_entry.
+ */
+static array_header *build_vrootaliases(pool *p) {
   config_rec *c;
-  pool *tmp_pool = NULL;
-
-  /* Handle any VRootAlias settings. */
+  array_header *aliases;
 
-  tmp_pool = make_sub_pool(session.pool);
-  pr_pool_tag(tmp_pool, "VRootAlias pool");
+  aliases = make_array(p, 0, sizeof(struct vroot_aliascache_entry));
 
   c = find_config(main_server->conf, CONF_PARAM, "VRootAlias", FALSE);
   while (c != NULL) {
     char src_path[PR_TUNABLE_PATH_MAX+1], dst_path[PR_TUNABLE_PATH_MAX+1];
+    struct vroot_aliascache_entry *entry;
     const char *ptr;
 
     pr_signals_handle();
@@ -72,7 +90,7 @@ static int handle_vrootaliases(void) {
     ptr = c->argv[0];
 
     /* Check for any expandable variables. */
-    ptr = path_subst_uservar(tmp_pool, &ptr);
+    ptr = path_subst_uservar(p, &ptr);
 
     sstrncpy(src_path, ptr, sizeof(src_path)-1);
     vroot_path_clean(src_path);
@@ -80,18 +98,168 @@ static int handle_vrootaliases(void) {
     ptr = c->argv[1];
 
     /* Check for any expandable variables. */
-    ptr = path_subst_uservar(tmp_pool, &ptr);
+    ptr = path_subst_uservar(p, &ptr);
 
-    ptr = dir_best_path(tmp_pool, ptr);
+    ptr = dir_best_path(p, ptr);
     vroot_path_lookup(NULL, dst_path, sizeof(dst_path)-1, ptr,
       VROOT_LOOKUP_FL_NO_ALIAS, NULL);
 
-    if (vroot_alias_add(dst_path, src_path) < 0) {
+    entry = push_array(aliases);
+    entry->dst_path = pstrdup(p, dst_path);
+    entry->src_path = pstrdup(p, src_path);
+    entry->attrs = NULL;
+
+    if (c->argv[2] != NULL) {
+      register unsigned int i;
+      array_header *attr_list;
+      struct vroot_alias_attrs *attrs;
+
+      attrs = pcalloc(p, sizeof(struct vroot_alias_attrs));
+      attr_list = c->argv[2];
+
+      for (i = 0; i < attr_list->nelts; i++) {
+        const char *text;
+
+        text = ((char **) attr_list->elts)[i];
+        if (vroot_alias_attrs_parse(p, attrs, text) < 0) {
+          (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+            "error handling VRootAlias attribute '%s' for '%s': %s", text,
+            dst_path, strerror(errno));
+        }
+      }
+
+      entry->attrs = attrs;
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "VRootAlias", FALSE);
+  }
+
+  return aliases;
+}
+
+/* Returns the key under which the expanded aliases of this session may be
+ * shared with the other sessions of the same user, i.e. everything on which
+ * the expansion depends.
+ */
+static const char *get_aliascache_key(pool *p) {
+  const char *class_name = "", *base;
+  char sid[32], uid[32];
+
+  if (session.conn_class != NULL &&
+      session.conn_class->cls_name != NULL) {
+    class_name = session.conn_class->cls_name;
+  }
+
+  base = vroot_path_get_base(p, NULL);
+  if (base == NULL) {
+    base = "";
+  }
+
+  memset(sid, '\0', sizeof(sid));
+  snprintf(sid, sizeof(sid)-1, "%u", main_server->sid);
+
+  memset(uid, '\0', sizeof(uid));
+  snprintf(uid, sizeof(uid)-1, "%lu", (unsigned long) session.uid);
+
+  return pstrcat(p, sid, ":", uid, ":", session.user, ":", class_name, ":",
+    base, NULL);
+}
+
+/* With the VirtualDirectories VRootOption, the parent directories of the
+ * given alias path, within the vroot base, need not exist.
+ */
+static void add_alias_virtdirs(pool *p, const char *dst_path) {
+  const char *base;
+  char *dir_path, *ptr;
+
+  if (!(vroot_opts & VROOT_OPT_VIRTUAL_DIRS)) {
+    return;
+  }
+
+  base = vroot_path_get_base(p, NULL);
+  if (base == NULL ||
+      *base == '\0') {
+    return;
+  }
+
+  dir_path = pstrdup(p, dst_path);
+  ptr = strrchr(dir_path, '/');
+  if (ptr == NULL ||
+      ptr == dir_path) {
+    return;
+  }
+
+  *ptr = '\0';
+
+  if (vroot_virtdir_add(dir_path, base) < 0 &&
+      errno != EINVAL) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error adding virtual directories for VRootAlias '%s': %s", dst_path,
+      strerror(errno));
+  }
+}
+
+static int handle_vrootaliases(void) {
+  register unsigned int i;
+  config_rec *c;
+  pool *tmp_pool = NULL;
+  array_header *aliases = NULL;
+  struct vroot_aliascache_entry *entries;
+  int use_aliascache = FALSE;
+
+  /* Handle any VRootAlias settings. */
+
+  tmp_pool = make_sub_pool(session.pool);
+  pr_pool_tag(tmp_pool, "VRootAlias pool");
+
+  c = find_config(main_server->conf, CONF_PARAM, "VRootAliasCache", FALSE);
+  if (c != NULL &&
+      *((int *) c->argv[0]) == TRUE &&
+      session.user != NULL) {
+    use_aliascache = TRUE;
+
+    aliases = vroot_aliascache_attach(tmp_pool, get_aliascache_key(tmp_pool));
+    if (aliases == NULL &&
+        errno != ENOENT) {
+      pr_trace_msg(trace_channel, 3,
+        "unable to use cached VRootAlias settings: %s", strerror(errno));
+      use_aliascache = FALSE;
+    }
+
+    if (aliases != NULL) {
+      pr_trace_msg(trace_channel, 9,
+        "using VRootAlias settings expanded by another session");
+      use_aliascache = FALSE;
+    }
+  }
+
+  if (aliases == NULL) {
+    aliases = build_vrootaliases(tmp_pool);
+
+    if (use_aliascache == TRUE &&
+        vroot_aliascache_publish(aliases) < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "unable to share VRootAlias settings: %s", strerror(errno));
+    }
+  }
+
+  entries = aliases->elts;
+  for (i = 0; i < aliases->nelts; i++) {
+    const char *dst_path, *src_path;
+    const struct vroot_alias_attrs *attrs;
+    int res;
+
+    dst_path = entries[i].dst_path;
+    src_path = entries[i].src_path;
+    attrs = entries[i].attrs;
+
+    res = vroot_alias_add(dst_path, src_path);
+    if (res < 0) {
       /* Make a slightly better log message when there is an alias collision. */
       if (errno == EEXIST) {
         (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
           "VRootAlias already configured for '%s', ignoring bad alias",
-          (char *) c->argv[1]);
+          dst_path);
 
       } else {
         (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
@@ -101,9 +269,276 @@ static int handle_vrootaliases(void) {
     } else {
       (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
         "aliased '%s' to real path '%s'", dst_path, src_path);
+      add_alias_virtdirs(tmp_pool, dst_path);
     }
 
-    c = find_config_next(c, c->next, CONF_PARAM, "VRootAlias", FALSE);
+    if (res == 0 &&
+        attrs != NULL) {
+      if (vroot_alias_set_attrs(dst_path, attrs) < 0) {
+        (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+          "error setting attributes for VRootAlias '%s': %s", dst_path,
+          strerror(errno));
+      }
+
+      if (attrs->metadata_rate > 0 &&
+          vroot_throttle_add_alias(src_path, attrs->metadata_rate,
+            attrs->metadata_burst) < 0) {
+        (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+          "error limiting metadata operations for VRootAlias '%s': %s",
+          dst_path, strerror(errno));
+      }
+    }
+  }
+
+  destroy_pool(tmp_pool);
+  return 0;
+}
+
+/* The parameters of the alias types configured using several paths. */
+struct multialias_params {
+  off_t max_size;
+  unsigned int metadata_ttl;
+  int placement;
+  int selection;
+};
+
+struct multialias_type {
+  const char *directive;
+
+  /* Whether the directive takes "src-path dst-path dir", rather than
+   * "dst-path path1 path2 ...".
+   */
+  int src_first;
+
+  /* Describes the paths, other than the source path, in errors. */
+  const char *path_desc;
+  unsigned int max_paths;
+
+  /* Parses a "name=value" parameter; returns -1 with errno set to ENOENT
+   * for an unknown parameter, or EINVAL for a bad value.
+   */
+  int (*parse_param)(struct multialias_params *, const char *);
+
+  /* Configures the given alias, whose source is the first path. */
+  int (*add)(const char *, array_header *, struct multialias_params *);
+};
+
+static int multialias_parse_cache_param(struct multialias_params *params,
+    const char *param) {
+  if (strncasecmp(param, "max-size=", 9) == 0) {
+    if (pr_str_get_nbytes(param + 9, NULL, &(params->max_size)) < 0 ||
+        params->max_size <= 0) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    return 0;
+  }
+
+  if (strncasecmp(param, "metadata-ttl=", 13) == 0) {
+    char *endp = NULL;
+    unsigned long ttl;
+
+    ttl = strtoul(param + 13, &endp, 10);
+    if (endp == NULL ||
+        *endp != '\0' ||
+        *(param + 13) == '\0' ||
+        *(param + 13) == '-' ||
+        ttl > VROOT_CACHETIER_MAX_METADATA_TTL) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    params->metadata_ttl = (unsigned int) ttl;
+    return 0;
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+static int multialias_parse_spread_param(struct multialias_params *params,
+    const char *param) {
+  if (strncasecmp(param, "placement=", 10) != 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (strcasecmp(param + 10, "space") == 0) {
+    params->placement = VROOT_SPREAD_PLACEMENT_SPACE;
+
+  } else if (strcasecmp(param + 10, "load") == 0) {
+    params->placement = VROOT_SPREAD_PLACEMENT_LOAD;
+
+  } else {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int multialias_parse_mirror_param(struct multialias_params *params,
+    const char *param) {
+  if (strncasecmp(param, "select=", 7) != 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (strcasecmp(param + 7, "latency") == 0) {
+    params->selection = VROOT_MIRROR_SELECT_LATENCY;
+
+  } else if (strcasecmp(param + 7, "rotate") == 0) {
+    params->selection = VROOT_MIRROR_SELECT_ROTATE;
+
+  } else {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int multialias_add_union(const char *dst_path, array_header *paths,
+    struct multialias_params *params) {
+  /* The top layer is the alias source; the union resolves the paths
+   * within it to the other layers.
+   */
+  return vroot_union_add(dst_path, paths);
+}
+
+static int multialias_add_cache(const char *dst_path, array_header *paths,
+    struct multialias_params *params) {
+  char **elts;
+
+  elts = paths->elts;
+  return vroot_cachetier_add(elts[0], elts[1], params->max_size,
+    params->metadata_ttl);
+}
+
+static int multialias_add_spread(const char *dst_path, array_header *paths,
+    struct multialias_params *params) {
+  /* The first target is the alias source; the spread resolves the paths
+   * within it to the other targets.
+   */
+  return vroot_spread_add(dst_path, paths, params->placement);
+}
+
+static int multialias_add_mirror(const char *dst_path, array_header *paths,
+    struct multialias_params *params) {
+  /* The primary is the alias source; the mirror only chooses the replica
+   * from which files are read.
+   */
+  return vroot_mirror_add(dst_path, paths, params->selection);
+}
+
+static int multialias_add_staging(const char *dst_path, array_header *paths,
+    struct multialias_params *params) {
+  char **elts;
+
+  elts = paths->elts;
+  return vroot_staging_add(elts[0], elts[1]);
+}
+
+static const struct multialias_type multialias_union = {
+  "VRootUnionAlias", FALSE, "layer", 0, NULL, multialias_add_union
+};
+
+static const struct multialias_type multialias_cache = {
+  "VRootCacheAlias", TRUE, "cache", 2, multialias_parse_cache_param,
+  multialias_add_cache
+};
+
+static const struct multialias_type multialias_spread = {
+  "VRootSpreadAlias", FALSE, "target", 0, multialias_parse_spread_param,
+  multialias_add_spread
+};
+
+static const struct multialias_type multialias_mirror = {
+  "VRootMirrorAlias", FALSE, "replica", VROOT_MIRROR_MAX_REPLICAS,
+  multialias_parse_mirror_param, multialias_add_mirror
+};
+
+static const struct multialias_type multialias_staging = {
+  "VRootStagingAlias", TRUE, "staging", 2, NULL, multialias_add_staging
+};
+
+static void multialias_params_init(struct multialias_params *params) {
+  params->max_size = VROOT_CACHETIER_DEFAULT_MAX_SIZE;
+  params->metadata_ttl = VROOT_CACHETIER_DEFAULT_METADATA_TTL;
+  params->placement = VROOT_SPREAD_PLACEMENT_SPACE;
+  params->selection = VROOT_MIRROR_SELECT_LATENCY;
+}
+
+static int handle_multialiases(const struct multialias_type *type) {
+  config_rec *c;
+  pool *tmp_pool = NULL;
+
+  tmp_pool = make_sub_pool(session.pool);
+  pr_pool_tag(tmp_pool, type->directive);
+
+  c = find_config(main_server->conf, CONF_PARAM, type->directive, FALSE);
+  while (c != NULL) {
+    register unsigned int i;
+    char dst_path[PR_TUNABLE_PATH_MAX+1];
+    array_header *paths, *configured;
+    struct multialias_params params;
+    const char *ptr;
+
+    pr_signals_handle();
+
+    ptr = c->argv[0];
+
+    /* Check for any expandable variables. */
+    ptr = path_subst_uservar(tmp_pool, &ptr);
+
+    ptr = dir_best_path(tmp_pool, ptr);
+    vroot_path_lookup(NULL, dst_path, sizeof(dst_path)-1, ptr,
+      VROOT_LOOKUP_FL_NO_ALIAS, NULL);
+
+    configured = c->argv[1];
+    paths = make_array(tmp_pool, configured->nelts, sizeof(char *));
+
+    for (i = 0; i < configured->nelts; i++) {
+      char path[PR_TUNABLE_PATH_MAX+1];
+
+      ptr = ((char **) configured->elts)[i];
+
+      /* Check for any expandable variables. */
+      ptr = path_subst_uservar(tmp_pool, &ptr);
+
+      memset(path, '\0', sizeof(path));
+      sstrncpy(path, ptr, sizeof(path)-1);
+      vroot_path_clean(path);
+
+      *((char **) push_array(paths)) = pstrdup(tmp_pool, path);
+    }
+
+    /* The parameters were checked when parsed. */
+    multialias_params_init(&params);
+    configured = c->argv[2];
+    for (i = 0; configured != NULL && i < configured->nelts; i++) {
+      (void) (type->parse_param)(&params, ((char **) configured->elts)[i]);
+    }
+
+    if (vroot_alias_add(dst_path, ((char **) paths->elts)[0]) < 0) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "error stashing %s '%s': %s", type->directive, dst_path,
+        strerror(errno));
+
+    } else if ((type->add)(dst_path, paths, &params) < 0) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "error adding %s paths for %s '%s': %s", type->path_desc,
+        type->directive, dst_path, strerror(errno));
+
+    } else {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "aliased '%s' to real path '%s' (%s)", dst_path,
+        ((char **) paths->elts)[0], type->directive);
+      add_alias_virtdirs(tmp_pool, dst_path);
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, type->directive, FALSE);
   }
 
   destroy_pool(tmp_pool);
@@ -113,11 +548,111 @@ static int handle_vrootaliases(void) {
 /* Configuration handlers
  */
 
-/* usage: VRootAlias src-path dst-path */
+/* Parses the directives of the alias types configured using several paths,
+ * i.e. "src-path dst-path dir [param=value ...]" or
+ * "dst-path path1 path2 ... [param=value ...]".
+ */
+static MODRET set_multialias(cmd_rec *cmd,
+    const struct multialias_type *type) {
+  register unsigned int i;
+  config_rec *c;
+  array_header *paths, *params = NULL;
+  struct multialias_params parsed;
+
+  if (cmd->argc < 4) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+  paths = make_array(c->pool, cmd->argc - 2, sizeof(char *));
+  multialias_params_init(&parsed);
+
+  for (i = 1; i < cmd->argc; i++) {
+    char *param;
+
+    param = cmd->argv[i];
+
+    if (i == (type->src_first ? 2 : 1)) {
+      c->argv[0] = pstrdup(c->pool, param);
+      continue;
+    }
+
+    if (*param != '/' &&
+        strchr(param, '=') != NULL) {
+      /* Check the parameters now, but only apply them at session time,
+       * along with the paths.
+       */
+      if (type->parse_param == NULL ||
+          (type->parse_param)(&parsed, param) < 0) {
+        if (type->parse_param == NULL ||
+            errno == ENOENT) {
+          CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter '",
+            param, "'", NULL));
+        }
+
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted parameter '",
+          param, "'", NULL));
+      }
+
+      if (params == NULL) {
+        params = make_array(c->pool, 1, sizeof(char *));
+      }
+
+      *((char **) push_array(params)) = pstrdup(c->pool, param);
+      continue;
+    }
+
+    if (pr_fs_valid_path(param) < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool,
+        type->src_first && paths->nelts == 0 ? "source" : type->path_desc,
+        " path '", param, "' is not an absolute path", NULL));
+    }
+
+    *((char **) push_array(paths)) = pstrdup(c->pool, param);
+  }
+
+  if (paths->nelts < 2) {
+    if (type->src_first) {
+      CONF_ERROR(cmd, "wrong number of parameters");
+    }
+
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "at least two ", type->path_desc,
+      " paths are required", NULL));
+  }
+
+  if (type->max_paths > 0 &&
+      paths->nelts > type->max_paths) {
+    if (type->src_first) {
+      CONF_ERROR(cmd, "wrong number of parameters");
+    }
+
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "too many ", type->path_desc,
+      " paths", NULL));
+  }
+
+  c->argv[1] = paths;
+  c->argv[2] = params;
+
+  /* Set this flag in order to allow mod_ifsession to work properly with
+   * multiple such directives.
+   */
+  c->flags |= CF_MERGEDOWN_MULTI;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: VRootAlias src-path dst-path [attr1=value1 ...] */
 MODRET set_vrootalias(cmd_rec *cmd) {
+  register unsigned int i;
   config_rec *c;
+  array_header *attr_list = NULL;
+
+  if (cmd->argc < 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
 
-  CHECK_ARGS(cmd, 2);
   CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
 
   if (pr_fs_valid_path(cmd->argv[1]) < 0) {
@@ -125,7 +660,35 @@ MODRET set_vrootalias(cmd_rec *cmd) {
       "' is not an absolute path", NULL));
   }
 
-  c = add_config_param_str(cmd->argv[0], 2, cmd->argv[1], cmd->argv[2]);
+  c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = pstrdup(c->pool, cmd->argv[2]);
+
+  /* Check the attributes now, but only apply them at session time, as
+   * their values may use variables.
+   */
+  for (i = 3; i < cmd->argc; i++) {
+    struct vroot_alias_attrs attrs;
+
+    memset(&attrs, 0, sizeof(attrs));
+    if (vroot_alias_attrs_parse(cmd->tmp_pool, &attrs, cmd->argv[i]) < 0) {
+      if (errno == ENOENT) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown attribute '",
+          cmd->argv[i], "'", NULL));
+      }
+
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted attribute '",
+        cmd->argv[i], "'", NULL));
+    }
+
+    if (attr_list == NULL) {
+      attr_list = make_array(c->pool, cmd->argc - 3, sizeof(char *));
+    }
+
+    *((char **) push_array(attr_list)) = pstrdup(c->pool, cmd->argv[i]);
+  }
+
+  c->argv[2] = attr_list;
 
   /* Set this flag in order to allow mod_ifsession to work properly with
    * multiple VRootAlias directives.
@@ -135,6 +698,139 @@ MODRET set_vrootalias(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: VRootAliasCache on|off [max-users=count] */
+MODRET set_vrootaliascache(cmd_rec *cmd) {
+  int enabled = -1;
+  unsigned int max_users = VROOT_ALIASCACHE_DEFAULT_MAX_USERS;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  enabled = get_boolean(cmd, 1);
+  if (enabled == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  if (cmd->argc == 3) {
+    char *param, *ptr = NULL;
+    unsigned long count;
+
+    param = cmd->argv[2];
+    if (strncasecmp(param, "max-users=", 10) != 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter '", param,
+        "'", NULL));
+    }
+
+    count = strtoul(param + 10, &ptr, 10);
+    if (ptr == NULL ||
+        *ptr != '\0' ||
+        count == 0 ||
+        count > VROOT_ALIASCACHE_MAX_MAX_USERS) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid max-users '",
+        param + 10, "'", NULL));
+    }
+
+    max_users = (unsigned int) count;
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = enabled;
+  c->argv[1] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = max_users;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: VRootCacheAlias src-path dst-path cache-dir [max-size=size]
+ *          [metadata-ttl=secs]
+ */
+MODRET set_vrootcachealias(cmd_rec *cmd) {
+  return set_multialias(cmd, &multialias_cache);
+}
+
+/* usage: VRootCrossDeviceRename on|off [max-size] */
+MODRET set_vrootcrossdevicerename(cmd_rec *cmd) {
+  int enabled = -1;
+  off_t max_size = 0;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  enabled = get_boolean(cmd, 1);
+  if (enabled == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  if (cmd->argc == 3) {
+    if (pr_str_get_nbytes(cmd->argv[2], NULL, &max_size) < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid max size '",
+        cmd->argv[2], "': ", strerror(errno), NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = enabled;
+  c->argv[1] = pcalloc(c->pool, sizeof(off_t));
+  *((off_t *) c->argv[1]) = max_size;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: VRootDirCache on|off [size=bytes] */
+MODRET set_vrootdircache(cmd_rec *cmd) {
+  int enabled = -1;
+  off_t size = VROOT_DIRCACHE_DEFAULT_SIZE;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  enabled = get_boolean(cmd, 1);
+  if (enabled == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  if (cmd->argc == 3) {
+    char *param;
+
+    param = cmd->argv[2];
+    if (strncasecmp(param, "size=", 5) != 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter '", param,
+        "'", NULL));
+    }
+
+    if (pr_str_get_nbytes(param + 5, NULL, &size) < 0 ||
+        size < (VROOT_DIRCACHE_MAX_LISTING * 2)) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid size '", param + 5,
+        "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = enabled;
+  c->argv[1] = pcalloc(c->pool, sizeof(off_t));
+  *((off_t *) c->argv[1]) = size;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: VRootEngine on|off */
 MODRET set_vrootengine(cmd_rec *cmd) {
   int engine = -1;
@@ -155,6 +851,63 @@ MODRET set_vrootengine(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: VRootHide pattern ... */
+MODRET set_vroothide(cmd_rec *cmd) {
+  register unsigned int i;
+  config_rec *c;
+  array_header *patterns;
+  struct vroot_hide *hide;
+
+  if (cmd->argc < 2) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  patterns = make_array(cmd->tmp_pool, cmd->argc - 1, sizeof(char *));
+  for (i = 1; i < cmd->argc; i++) {
+    *((char **) push_array(patterns)) = cmd->argv[i];
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+
+  /* All of the patterns are compiled now, into a single automaton; a second
+   * one, matching either case, is used with VRootOptions CaseInsensitive.
+   */
+  hide = vroot_hide_compile(c->pool, patterns, 0);
+  if (hide != NULL) {
+    c->argv[1] = vroot_hide_compile(c->pool, patterns, VROOT_HIDE_FL_NOCASE);
+    if (c->argv[1] == NULL) {
+      hide = NULL;
+    }
+  }
+
+  if (hide == NULL) {
+    if (errno == ENOSPC) {
+      CONF_ERROR(cmd, "too many, or too complex, patterns");
+    }
+
+    for (i = 0; i < patterns->nelts; i++) {
+      array_header *pattern;
+
+      pattern = make_array(cmd->tmp_pool, 1, sizeof(char *));
+      *((char **) push_array(pattern)) = ((char **) patterns->elts)[i];
+
+      if (vroot_hide_compile(cmd->tmp_pool, pattern, 0) == NULL &&
+          errno == EINVAL) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted pattern '",
+          ((char **) patterns->elts)[i], "'", NULL));
+      }
+    }
+
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error compiling patterns: ",
+      strerror(errno), NULL));
+  }
+
+  c->argv[0] = hide;
+  return PR_HANDLED(cmd);
+}
+
 /* usage: VRootLog path|"none" */
 MODRET set_vrootlog(cmd_rec *cmd) {
   CHECK_ARGS(cmd, 1);
@@ -168,6 +921,13 @@ MODRET set_vrootlog(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: VRootMirrorAlias dst-path primary replica ...
+ *          [select=latency|rotate]
+ */
+MODRET set_vrootmirroralias(cmd_rec *cmd) {
+  return set_multialias(cmd, &multialias_mirror);
+}
+
 /* usage: VRootOptions opt1 opt2 ... optN */
 MODRET set_vrootoptions(cmd_rec *cmd) {
   config_rec *c = NULL;
@@ -178,65 +938,291 @@ MODRET set_vrootoptions(cmd_rec *cmd) {
     CONF_ERROR(cmd, "wrong number of parameters");
   }
 
-  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  for (i = 1; i < cmd->argc; i++) {
+    if (strcasecmp(cmd->argv[i], "AllowSymlinks") == 0) {
+      opts |= VROOT_OPT_ALLOW_SYMLINKS;
+
+    } else if (strcasecmp(cmd->argv[i], "AtomicHiddenStores") == 0) {
+      opts |= VROOT_OPT_ATOMIC_HIDDEN_STORES;
+
+    } else if (strcasecmp(cmd->argv[i], "CaseInsensitive") == 0) {
+      opts |= VROOT_OPT_CASE_INSENSITIVE;
+
+    } else if (strcasecmp(cmd->argv[i], "VirtualDirectories") == 0) {
+      opts |= VROOT_OPT_VIRTUAL_DIRS;
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown VRootOption: '",
+        cmd->argv[i], "'", NULL));
+    }
+  }
+
+  c->argv[0] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = opts;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: VRootServerRoot path */
+MODRET set_vrootserverroot(cmd_rec *cmd) {
+  struct stat st;
+  config_rec *c;
+  char *path;
+  size_t pathlen;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  path = cmd->argv[1];
+
+  if (pr_fs_valid_path(path) < 0) {
+    CONF_ERROR(cmd, "must be an absolute path");
+  }
+
+  if (stat(path, &st) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error checking '", path, "': ",
+      strerror(errno), NULL));
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "'", path, "' is not a directory",
+      NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+
+  /* Make sure the configured path has a trailing path separator ('/').
+   * This is important.
+   */
+
+  pathlen = strlen(path);
+  if (path[pathlen - 1] != '/') {
+    c->argv[0] = pstrcat(c->pool, path, "/", NULL);
+
+  } else {
+    c->argv[0] = pstrdup(c->pool, path);
+  }
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: VRootSpreadAlias dst-path target1 target2 ...
+ *          [placement=space|load]
+ */
+MODRET set_vrootspreadalias(cmd_rec *cmd) {
+  return set_multialias(cmd, &multialias_spread);
+}
+
+/* usage: VRootStagingAlias src-path dst-path staging-dir */
+MODRET set_vrootstagingalias(cmd_rec *cmd) {
+  return set_multialias(cmd, &multialias_staging);
+}
+
+/* usage: VRootThrottle rate [burst=count] */
+MODRET set_vrootthrottle(cmd_rec *cmd) {
+  char *endp = NULL;
+  unsigned long rate, burst = 0;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  rate = strtoul(cmd->argv[1], &endp, 10);
+  if (endp == NULL ||
+      *endp != '\0' ||
+      *((char *) cmd->argv[1]) == '-' ||
+      rate > VROOT_THROTTLE_MAX_RATE) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid rate '",
+      cmd->argv[1], "'", NULL));
+  }
+
+  if (cmd->argc == 3) {
+    char *param;
+
+    param = cmd->argv[2];
+    if (strncasecmp(param, "burst=", 6) != 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter '", param,
+        "'", NULL));
+    }
+
+    burst = strtoul(param + 6, &endp, 10);
+    if (endp == NULL ||
+        *endp != '\0' ||
+        *(param + 6) == '\0' ||
+        *(param + 6) == '-' ||
+        burst == 0 ||
+        burst > VROOT_THROTTLE_MAX_RATE) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted parameter '",
+        param, "'", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = (unsigned int) rate;
+  c->argv[1] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = (unsigned int) burst;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: VRootUnionAlias dst-path top-layer lower-layer ... */
+MODRET set_vrootunionalias(cmd_rec *cmd) {
+  return set_multialias(cmd, &multialias_union);
+}
+
+/* usage: VRootWarmup on|off [max-time=ms] [max-entries=count] [history=path] */
+MODRET set_vrootwarmup(cmd_rec *cmd) {
+  register unsigned int i;
+  int enabled = -1;
+  unsigned int max_millis = VROOT_WARMUP_DEFAULT_MAX_MILLIS;
+  unsigned int max_entries = VROOT_WARMUP_DEFAULT_MAX_ENTRIES;
+  char *history_path = NULL;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  enabled = get_boolean(cmd, 1);
+  if (enabled == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  for (i = 2; i < cmd->argc; i++) {
+    char *param, *endp = NULL;
+    unsigned long val;
+
+    param = cmd->argv[i];
+
+    if (strncasecmp(param, "history=", 8) == 0) {
+      history_path = param + 8;
+      if (pr_fs_valid_path(history_path) < 0) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "history path '", history_path,
+          "' is not an absolute path", NULL));
+      }
+
+      continue;
+    }
+
+    if (strncasecmp(param, "max-time=", 9) == 0) {
+      val = strtoul(param + 9, &endp, 10);
+
+    } else if (strncasecmp(param, "max-entries=", 12) == 0) {
+      val = strtoul(param + 12, &endp, 10);
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter '", param,
+        "'", NULL));
+    }
+
+    if (endp == NULL ||
+        *endp != '\0' ||
+        val == 0 ||
+        val > VROOT_WARMUP_MAX_PARAM) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted parameter '",
+        param, "'", NULL));
+    }
 
-  c = add_config_param(cmd->argv[0], 1, NULL);
-  for (i = 1; i < cmd->argc; i++) {
-    if (strcasecmp(cmd->argv[i], "AllowSymlinks") == 0) {
-      opts |= VROOT_OPT_ALLOW_SYMLINKS;
+    if (strncasecmp(param, "max-time=", 9) == 0) {
+      max_millis = (unsigned int) val;
 
     } else {
-      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown VRootOption: '",
-        cmd->argv[i], "'", NULL));
+      max_entries = (unsigned int) val;
     }
   }
 
-  c->argv[0] = pcalloc(c->pool, sizeof(unsigned int));
-  *((unsigned int *) c->argv[0]) = opts;
+  c = add_config_param(cmd->argv[0], 4, NULL, NULL, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = enabled;
+  c->argv[1] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = max_millis;
+  c->argv[2] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[2]) = max_entries;
+  if (history_path != NULL) {
+    c->argv[3] = pstrdup(c->pool, history_path);
+  }
 
   return PR_HANDLED(cmd);
 }
 
-/* usage: VRootServerRoot path */
-MODRET set_vrootserverroot(cmd_rec *cmd) {
-  struct stat st;
-  config_rec *c;
-  char *path;
-  size_t pathlen;
+/* usage: VRootWatchdog on|off [interval=secs] [timeout=secs] [cooldown=secs] */
+MODRET set_vrootwatchdog(cmd_rec *cmd) {
+  register unsigned int i;
+  int enabled = -1;
+  unsigned int interval = VROOT_WATCHDOG_DEFAULT_INTERVAL;
+  unsigned int timeout = VROOT_WATCHDOG_DEFAULT_TIMEOUT;
+  unsigned int cooldown = VROOT_WATCHDOG_DEFAULT_COOLDOWN;
+  config_rec *c = NULL;
 
-  CHECK_ARGS(cmd, 1);
-  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+  if (cmd->argc < 2) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
 
-  path = cmd->argv[1];
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
 
-  if (pr_fs_valid_path(path) < 0) {
-    CONF_ERROR(cmd, "must be an absolute path");
+  enabled = get_boolean(cmd, 1);
+  if (enabled == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
   }
 
-  if (stat(path, &st) < 0) {
-    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "error checking '", path, "': ",
-      strerror(errno), NULL));
-  }
+  for (i = 2; i < cmd->argc; i++) {
+    char *param, *ptr, *endp = NULL;
+    unsigned long val;
 
-  if (!S_ISDIR(st.st_mode)) {
-    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "'", path, "' is not a directory",
-      NULL));
-  }
+    param = cmd->argv[i];
+    ptr = strchr(param, '=');
+    if (ptr == NULL) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted parameter '",
+        param, "'", NULL));
+    }
 
-  c = add_config_param(cmd->argv[0], 1, NULL);
+    val = strtoul(ptr + 1, &endp, 10);
+    if (endp == NULL ||
+        *endp != '\0' ||
+        *(ptr + 1) == '\0' ||
+        *(ptr + 1) == '-' ||
+        val > 86400) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted parameter '",
+        param, "'", NULL));
+    }
 
-  /* Make sure the configured path has a trailing path separator ('/').
-   * This is important.
-   */
+    if (strncasecmp(param, "interval=", 9) == 0 &&
+        val > 0) {
+      interval = (unsigned int) val;
 
-  pathlen = strlen(path);
-  if (path[pathlen - 1] != '/') {
-    c->argv[0] = pstrcat(c->pool, path, "/", NULL);
+    } else if (strncasecmp(param, "timeout=", 8) == 0 &&
+               val > 0) {
+      timeout = (unsigned int) val;
 
-  } else {
-    c->argv[0] = pstrdup(c->pool, path);
+    } else if (strncasecmp(param, "cooldown=", 9) == 0) {
+      cooldown = (unsigned int) val;
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter '", param,
+        "'", NULL));
+    }
   }
 
+  c = add_config_param(cmd->argv[0], 4, NULL, NULL, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = enabled;
+  c->argv[1] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = interval;
+  c->argv[2] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[2]) = timeout;
+  c->argv[3] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[3]) = cooldown;
+
   return PR_HANDLED(cmd);
 }
 
@@ -498,6 +1484,236 @@ MODRET vroot_post_mkd(cmd_rec *cmd) {
   return PR_DECLINED(cmd);
 }
 
+/* When overwriting is not allowed, have the rename, or the upload, itself
+ * refuse to replace an existing file, rather than relying only on the
+ * existence check made before it.
+ */
+static void set_noreplace(cmd_rec *cmd) {
+  const char *path;
+  config_rec *c;
+  unsigned char *allow_overwrite = NULL;
+
+  path = dir_best_path(cmd->tmp_pool, cmd->arg);
+  if (path == NULL) {
+    return;
+  }
+
+  c = dir_match_path(cmd->tmp_pool, (char *) path);
+  if (c != NULL) {
+    allow_overwrite = get_param_ptr(c->subset, "AllowOverwrite", FALSE);
+  }
+
+  if (allow_overwrite == NULL) {
+    allow_overwrite = get_param_ptr(CURRENT_CONF, "AllowOverwrite", FALSE);
+  }
+
+  if (allow_overwrite == NULL ||
+      *allow_overwrite == FALSE) {
+    pr_trace_msg(trace_channel, 17,
+      "AllowOverwrite off for '%s', using no-replace %s", path,
+      (char *) cmd->argv[0]);
+    (void) vroot_fsio_set_rename_flags(VROOT_FSIO_RENAME_FL_NOREPLACE);
+  }
+}
+
+MODRET vroot_pre_rnto(cmd_rec *cmd) {
+  if (vroot_engine == FALSE ||
+      session.chroot_path == NULL) {
+    return PR_DECLINED(cmd);
+  }
+
+  set_noreplace(cmd);
+  return PR_DECLINED(cmd);
+}
+
+MODRET vroot_pre_stor(cmd_rec *cmd) {
+  if (vroot_engine == FALSE ||
+      session.chroot_path == NULL) {
+    return PR_DECLINED(cmd);
+  }
+
+  /* This covers both the upload itself and, with HiddenStores, the rename
+   * of the finished upload to its name.
+   */
+  set_noreplace(cmd);
+  return PR_DECLINED(cmd);
+}
+
+MODRET vroot_pre_allo(cmd_rec *cmd) {
+  off_t size = 0;
+
+  if (vroot_engine == FALSE ||
+      session.chroot_path == NULL) {
+    return PR_DECLINED(cmd);
+  }
+
+  if (cmd->argc < 2) {
+    return PR_DECLINED(cmd);
+  }
+
+  /* Remember the announced size, for any "preallocate" VRootAlias attribute
+   * of the path then uploaded.
+   */
+  if (pr_str_get_nbytes(cmd->argv[1], NULL, &size) < 0 ||
+      size <= 0) {
+    pr_trace_msg(trace_channel, 9, "ignoring invalid ALLO size '%s'",
+      (char *) cmd->argv[1]);
+    return PR_DECLINED(cmd);
+  }
+
+  (void) vroot_policy_set_alloc_size(size);
+  return PR_DECLINED(cmd);
+}
+
+MODRET vroot_log_any(cmd_rec *cmd) {
+  if (vroot_engine == FALSE ||
+      session.chroot_path == NULL) {
+    return PR_DECLINED(cmd);
+  }
+
+  /* Any prefetched metadata for closed directories is only good for the
+   * duration of the command which used them.
+   */
+  vroot_prefetch_flush();
+
+  /* Likewise, an upload not published by the end of its command, e.g. due to
+   * an aborted transfer, is discarded.
+   */
+  (void) vroot_fsio_discard_tmpfile();
+
+  (void) vroot_fsio_set_rename_flags(0);
+  vroot_fsio_flush_dirfds();
+  vroot_watchdog_poll();
+
+  /* An ALLO size only applies to the upload which follows it. */
+  if (pr_cmd_cmp(cmd, PR_CMD_APPE_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_STOR_ID) == 0 ||
+      pr_cmd_cmp(cmd, PR_CMD_STOU_ID) == 0) {
+    (void) vroot_policy_set_alloc_size(0);
+  }
+
+  return PR_DECLINED(cmd);
+}
+
+static void warmup_add_path(pool *p, array_header *paths, const char *path) {
+  char real_path[PR_TUNABLE_PATH_MAX+1];
+
+  memset(real_path, '\0', sizeof(real_path));
+  if (vroot_path_lookup(p, real_path, sizeof(real_path)-1, path, 0,
+      NULL) < 0) {
+    pr_trace_msg(trace_channel, 9, "unable to warm up '%s': %s", path,
+      strerror(errno));
+    return;
+  }
+
+  *((char **) push_array(paths)) = pstrdup(p, real_path);
+}
+
+static int alias_source_cb(const void *key_data, size_t key_datasz,
+    const void *value_data, size_t value_datasz, void *user_data) {
+  array_header *paths;
+
+  /* Do not let helpers hang on alias sources known to be unavailable. */
+  if (vroot_watchdog_check(value_data) < 0) {
+    return 0;
+  }
+
+  paths = user_data;
+  *((char **) push_array(paths)) = pstrdup(paths->pool, value_data);
+  return 0;
+}
+
+static void vroot_watchdog(void) {
+  config_rec *c;
+  pool *tmp_pool;
+  array_header *paths;
+
+  c = find_config(main_server->conf, CONF_PARAM, "VRootWatchdog", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) == FALSE ||
+      vroot_alias_count() == 0) {
+    return;
+  }
+
+  tmp_pool = make_sub_pool(session.pool);
+  pr_pool_tag(tmp_pool, "VRootWatchdog pool");
+
+  paths = make_array(tmp_pool, 0, sizeof(char *));
+  (void) vroot_alias_do(alias_source_cb, paths);
+
+  /* Probe the other replicas of any mirrors, too, so that reads avoid the
+   * replicas which hang.
+   */
+  (void) vroot_mirror_list_replicas(paths);
+
+  if (vroot_watchdog_start(paths, *((unsigned int *) c->argv[1]),
+      *((unsigned int *) c->argv[2]), *((unsigned int *) c->argv[3])) < 0) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error starting watchdog: %s", strerror(errno));
+  }
+
+  destroy_pool(tmp_pool);
+}
+
+static void vroot_warmup(void) {
+  config_rec *c;
+  pool *tmp_pool;
+  array_header *paths;
+  const char *history_path;
+
+  c = find_config(main_server->conf, CONF_PARAM, "VRootWarmup", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) == FALSE) {
+    return;
+  }
+
+  tmp_pool = make_sub_pool(session.pool);
+  pr_pool_tag(tmp_pool, "VRootWarmup pool");
+
+  paths = make_array(tmp_pool, 0, sizeof(char *));
+
+  /* The first LIST after login is usually of the home directory, then of
+   * any alias targets.
+   */
+  warmup_add_path(tmp_pool, paths, pr_fs_getcwd());
+  (void) vroot_alias_do(alias_source_cb, paths);
+
+  history_path = c->argv[3];
+  if (history_path != NULL) {
+    array_header *history;
+    int xerrno;
+
+    /* Check for any expandable variables. */
+    history_path = path_subst_uservar(tmp_pool, &history_path);
+
+    PRIVS_ROOT
+    history = vroot_warmup_history_read(tmp_pool, history_path);
+    xerrno = errno;
+    PRIVS_RELINQUISH
+
+    if (history != NULL) {
+      register unsigned int i;
+
+      for (i = 0; i < history->nelts; i++) {
+        warmup_add_path(tmp_pool, paths, ((char **) history->elts)[i]);
+      }
+
+    } else if (xerrno != ENOENT) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "error reading VRootWarmup history '%s': %s", history_path,
+        strerror(xerrno));
+    }
+  }
+
+  if (vroot_warmup_start(paths, *((unsigned int *) c->argv[1]),
+      *((unsigned int *) c->argv[2])) < 0) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error starting warm-up: %s", strerror(errno));
+  }
+
+  destroy_pool(tmp_pool);
+}
+
 MODRET vroot_post_pass(cmd_rec *cmd) {
   if (vroot_engine == FALSE) {
     return PR_DECLINED(cmd);
@@ -510,6 +1726,7 @@ MODRET vroot_post_pass(cmd_rec *cmd) {
     fs = pr_unmount_fs("/", "vroot");
     if (fs != NULL) {
       destroy_pool(fs->fs_pool);
+      vroot_fs = NULL;
       pr_log_debug(DEBUG5, MOD_VROOT_VERSION ": vroot unmounted");
       pr_fs_setcwd(pr_fs_getvwd());
       pr_fs_clear_cache();
@@ -528,12 +1745,88 @@ MODRET vroot_post_pass(cmd_rec *cmd) {
       vroot_opts = *((unsigned int *) c->argv[0]);
     }
 
+    c = find_config(main_server->conf, CONF_PARAM, "VRootCrossDeviceRename",
+      FALSE);
+    if (c != NULL) {
+      (void) vroot_fsio_set_xdev_rename(*((int *) c->argv[0]),
+        *((off_t *) c->argv[1]));
+    }
+
+    c = find_config(main_server->conf, CONF_PARAM, "VRootDirCache", FALSE);
+    if (c != NULL) {
+      (void) vroot_fsio_set_dircache(*((int *) c->argv[0]));
+    }
+
+    c = find_config(main_server->conf, CONF_PARAM, "VRootHide", FALSE);
+    if (c != NULL) {
+      /* Names which are found in any case are hidden in any case. */
+      if (vroot_opts & VROOT_OPT_CASE_INSENSITIVE) {
+        (void) vroot_hide_set(c->argv[1]);
+
+      } else {
+        (void) vroot_hide_set(c->argv[0]);
+      }
+    }
+
+    c = find_config(main_server->conf, CONF_PARAM, "VRootThrottle", FALSE);
+    if (c != NULL) {
+      (void) vroot_throttle_set_limit(*((unsigned int *) c->argv[0]),
+        *((unsigned int *) c->argv[1]));
+    }
+
     /* XXX This needs to be in the PRE_CMD PASS handler, as when
      * VRootServer is used, so that a real chroot(2) occurs.
      */
     handle_vrootaliases();
+    handle_multialiases(&multialias_union);
+    handle_multialiases(&multialias_cache);
+    handle_multialiases(&multialias_spread);
+    handle_multialiases(&multialias_mirror);
+    handle_multialiases(&multialias_staging);
+
+    /* Now that the configuration is known, switch to the callbacks
+     * specialized for it.
+     */
+    if (vroot_fs != NULL) {
+      int fsio_flags = 0;
+
+      if (vroot_path_have_base() == FALSE) {
+        fsio_flags |= VROOT_FSIO_FL_PASSTHROUGH;
+      }
+
+      /* Virtual directories are handled along with the aliases, being
+       * mostly their parent directories.
+       */
+      if (vroot_alias_count() > 0 ||
+          vroot_virtdir_count() > 0) {
+        fsio_flags |= VROOT_FSIO_FL_ALIASES;
+      }
+
+      if (vroot_opts & VROOT_OPT_ALLOW_SYMLINKS) {
+        fsio_flags |= VROOT_FSIO_FL_SYMLINKS;
+      }
+
+      if (vroot_fsio_install(vroot_fs, fsio_flags) < 0) {
+        pr_log_debug(DEBUG3, MOD_VROOT_VERSION
+          ": error installing FSIO callbacks: %s", strerror(errno));
+      }
+    }
+
+    vroot_watchdog();
+    vroot_warmup();
+  }
+
+  return PR_DECLINED(cmd);
+}
+
+MODRET vroot_post_cwd(cmd_rec *cmd) {
+  if (vroot_engine == FALSE ||
+      session.chroot_path == NULL) {
+    return PR_DECLINED(cmd);
   }
 
+  /* Remember the directories used, for warming them up next time. */
+  (void) vroot_warmup_history_add(pr_fs_getcwd());
   return PR_DECLINED(cmd);
 }
 
@@ -555,6 +1848,7 @@ static void vroot_chroot_ev(const void *event_data, void *user_data) {
   fs = pr_unmount_fs("/", "vroot");
   if (fs != NULL) {
     destroy_pool(fs->fs_pool);
+    vroot_fs = NULL;
   }
 
   fs = pr_register_fs(main_server->pool, "vroot", "/");
@@ -566,50 +1860,150 @@ static void vroot_chroot_ev(const void *event_data, void *user_data) {
 
   pr_log_debug(DEBUG5, MOD_VROOT_VERSION ": vroot registered");
 
-  /* Add the module's custom FS callbacks here. This module does not
-   * provide callbacks for the following (as they are unnecessary):
-   * close(), read(), write(), and lseek().
+  /* Until the session configuration (e.g. VRootAlias, VRootOptions) is
+   * known, use the generic callbacks, which check it on every call.
    */
-  fs->stat = vroot_fsio_stat;
-  fs->lstat = vroot_fsio_lstat;
-  fs->rename = vroot_fsio_rename;
-  fs->unlink = vroot_fsio_unlink;
-  fs->open = vroot_fsio_open;
-#if PROFTPD_VERSION_NUMBER < 0x0001030603
-  fs->creat = vroot_fsio_creat;
-#endif /* ProFTPD 1.3.6rc2 or earlier */
-  fs->link = vroot_fsio_link;
-  fs->readlink = vroot_fsio_readlink;
-  fs->symlink = vroot_fsio_symlink;
-  fs->truncate = vroot_fsio_truncate;
-  fs->chmod = vroot_fsio_chmod;
-  fs->chown = vroot_fsio_chown;
-#if PROFTPD_VERSION_NUMBER >= 0x0001030407
-  fs->lchown = vroot_fsio_lchown;
-#endif /* ProFTPD 1.3.4c or later */
-#if PROFTPD_VERSION_NUMBER >= 0x0001030903
-  fs->realpath = vroot_fsio_realpath;
-#endif /* ProFTPD 1.3.9rc3 or later */
-  fs->chdir = vroot_fsio_chdir;
-  fs->chroot = vroot_fsio_chroot;
-  fs->utimes = vroot_fsio_utimes;
-  fs->opendir = vroot_fsio_opendir;
-  fs->readdir = vroot_fsio_readdir;
-  fs->closedir = vroot_fsio_closedir;
-  fs->mkdir = vroot_fsio_mkdir;
-  fs->rmdir = vroot_fsio_rmdir;
+  if (vroot_fsio_install(fs, VROOT_FSIO_FL_GENERIC) < 0) {
+    pr_log_debug(DEBUG3, MOD_VROOT_VERSION
+      ": error installing FSIO callbacks: %s", strerror(errno));
+  }
 
+  vroot_fs = fs;
   vroot_engine = TRUE;
 }
 
 static void vroot_exit_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+  unsigned long nops = 0, nthrottled = 0, delay_ms = 0;
+
+  c = find_config(main_server->conf, CONF_PARAM, "VRootWarmup", FALSE);
+  if (c != NULL &&
+      *((int *) c->argv[0]) == TRUE &&
+      c->argv[3] != NULL &&
+      session.chroot_path != NULL) {
+    const char *history_path;
+    int res, xerrno;
+
+    history_path = c->argv[3];
+    history_path = path_subst_uservar(session.pool, &history_path);
+
+    PRIVS_ROOT
+    res = vroot_warmup_history_write(history_path);
+    xerrno = errno;
+    PRIVS_RELINQUISH
+
+    if (res < 0) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "error writing VRootWarmup history '%s': %s", history_path,
+        strerror(xerrno));
+    }
+  }
+
+  if (vroot_throttle_get_stats(&nops, &nthrottled, &delay_ms) == 0 &&
+      nthrottled > 0) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "throttled %lu of %lu metadata operations, delayed %lu ms in total",
+      nthrottled, nops, delay_ms);
+  }
+
+  (void) vroot_aliascache_detach();
+  (void) vroot_casefold_free();
+  (void) vroot_virtdir_free();
+  (void) vroot_union_free();
+  (void) vroot_cachetier_free();
+  (void) vroot_staging_free();
+  (void) vroot_spread_free();
+  (void) vroot_mirror_free();
+  (void) vroot_hide_set(NULL);
+  (void) vroot_throttle_free();
+  (void) vroot_warmup_free();
+  (void) vroot_watchdog_free();
   (void) vroot_alias_free();
   (void) vroot_fsio_free();
 }
 
+static void vroot_postparse_ev(const void *event_data, void *user_data) {
+  server_rec *s;
+  int use_watchdog = FALSE, use_mirror = FALSE;
+  off_t dircache_size = 0;
+  unsigned int aliascache_max_users = 0;
+
+  /* Create the alias source states, the replica latencies, the directory
+   * cache, and the alias cache before any sessions are forked, so that they
+   * are shared by all sessions.
+   */
+  for (s = (server_rec *) server_list->xas_list; s != NULL; s = s->next) {
+    config_rec *c;
+
+    c = find_config(s->conf, CONF_PARAM, "VRootWatchdog", FALSE);
+    if (c != NULL &&
+        *((int *) c->argv[0]) == TRUE) {
+      use_watchdog = TRUE;
+    }
+
+    if (find_config(s->conf, CONF_PARAM, "VRootMirrorAlias", TRUE) != NULL) {
+      use_mirror = TRUE;
+    }
+
+    /* The directory cache is shared by all vhosts; use the largest size
+     * configured.
+     */
+    c = find_config(s->conf, CONF_PARAM, "VRootDirCache", FALSE);
+    if (c != NULL &&
+        *((int *) c->argv[0]) == TRUE &&
+        *((off_t *) c->argv[1]) > dircache_size) {
+      dircache_size = *((off_t *) c->argv[1]);
+    }
+
+    /* The alias cache is usually enabled only for some users, e.g. via
+     * <IfUser>, thus look for it in any section.
+     */
+    c = find_config(s->conf, CONF_PARAM, "VRootAliasCache", TRUE);
+    while (c != NULL) {
+      pr_signals_handle();
+
+      if (*((int *) c->argv[0]) == TRUE &&
+          *((unsigned int *) c->argv[1]) > aliascache_max_users) {
+        aliascache_max_users = *((unsigned int *) c->argv[1]);
+      }
+
+      c = find_config_next(c, c->next, CONF_PARAM, "VRootAliasCache", TRUE);
+    }
+  }
+
+  if (use_watchdog == TRUE &&
+      vroot_watchdog_init() < 0) {
+    pr_log_debug(DEBUG3, MOD_VROOT_VERSION
+      ": error creating watchdog table: %s", strerror(errno));
+  }
+
+  if (use_mirror == TRUE &&
+      vroot_mirror_init() < 0) {
+    pr_log_debug(DEBUG3, MOD_VROOT_VERSION
+      ": error creating mirror table: %s", strerror(errno));
+  }
+
+  if (dircache_size > 0 &&
+      vroot_dircache_init((size_t) dircache_size) < 0) {
+    pr_log_debug(DEBUG3, MOD_VROOT_VERSION
+      ": error creating directory cache: %s", strerror(errno));
+  }
+
+  if (aliascache_max_users > 0 &&
+      vroot_aliascache_init(aliascache_max_users) < 0) {
+    pr_log_debug(DEBUG3, MOD_VROOT_VERSION
+      ": error creating alias cache: %s", strerror(errno));
+  }
+}
+
 /* Initialization routines
  */
 
+static int vroot_init(void) {
+  pr_event_register(&vroot_module, "core.postparse", vroot_postparse_ev, NULL);
+  return 0;
+}
+
 static int vroot_sess_init(void) {
   config_rec *c;
 
@@ -663,10 +2057,22 @@ static int vroot_sess_init(void) {
 
 static conftable vroot_conftab[] = {
   { "VRootAlias",	set_vrootalias,		NULL },
+  { "VRootAliasCache",	set_vrootaliascache,	NULL },
+  { "VRootCacheAlias",	set_vrootcachealias,	NULL },
+  { "VRootCrossDeviceRename", set_vrootcrossdevicerename, NULL },
+  { "VRootDirCache",	set_vrootdircache,	NULL },
   { "VRootEngine",	set_vrootengine,	NULL },
+  { "VRootHide",	set_vroothide,		NULL },
   { "VRootLog",		set_vrootlog,		NULL },
+  { "VRootMirrorAlias",	set_vrootmirroralias,	NULL },
   { "VRootOptions",	set_vrootoptions,	NULL },
   { "VRootServerRoot",	set_vrootserverroot,	NULL },
+  { "VRootSpreadAlias",	set_vrootspreadalias,	NULL },
+  { "VRootStagingAlias", set_vrootstagingalias,	NULL },
+  { "VRootThrottle",	set_vrootthrottle,	NULL },
+  { "VRootUnionAlias",	set_vrootunionalias,	NULL },
+  { "VRootWarmup",	set_vrootwarmup,	NULL },
+  { "VRootWatchdog",	set_vrootwatchdog,	NULL },
   { NULL }
 };
 
@@ -680,6 +2086,15 @@ static cmdtable vroot_cmdtab[] = {
   { POST_CMD,		C_XMKD,	G_NONE,	vroot_post_mkd, FALSE, FALSE },
   { POST_CMD_ERR,	C_XMKD,	G_NONE,	vroot_post_mkd, FALSE, FALSE },
 
+  { PRE_CMD,		C_RNTO,	G_NONE,	vroot_pre_rnto, FALSE, FALSE },
+  { PRE_CMD,		C_STOR,	G_NONE,	vroot_pre_stor, FALSE, FALSE },
+  { PRE_CMD,		C_ALLO,	G_NONE,	vroot_pre_allo, FALSE, FALSE },
+
+  { POST_CMD,		C_CWD,	G_NONE,	vroot_post_cwd, FALSE, FALSE },
+  { POST_CMD,		C_XCWD,	G_NONE,	vroot_post_cwd, FALSE, FALSE },
+  { POST_CMD,		C_CDUP,	G_NONE,	vroot_post_cwd, FALSE, FALSE },
+  { POST_CMD,		C_XCUP,	G_NONE,	vroot_post_cwd, FALSE, FALSE },
+
   /* These command handlers are for manipulating cmd->notes, to get
    * paths properly logged.
    *
@@ -722,6 +2137,9 @@ static cmdtable vroot_cmdtab[] = {
   { PRE_CMD,		C_RETR,	G_NONE, vroot_pre_scp_retr, FALSE, FALSE, CL_READ },
   { PRE_CMD,		C_STOR,	G_NONE, vroot_pre_scp_stor, FALSE, FALSE, CL_WRITE },
 
+  { LOG_CMD,		C_ANY,	G_NONE, vroot_log_any, FALSE, FALSE },
+  { LOG_CMD_ERR,	C_ANY,	G_NONE, vroot_log_any, FALSE, FALSE },
+
   { 0, NULL }
 };
 
@@ -744,7 +2162,7 @@ module vroot_module = {
   NULL,
 
   /* Module initialization function */
-  NULL,
+  vroot_init,
 
   /* Session initialization function */
   vroot_sess_init,
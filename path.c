@@ -24,9 +24,9 @@
 
 #include "path.h"
 #include "alias.h"
-
-static char vroot_base[PR_TUNABLE_PATH_MAX + 1];
-static size_t vroot_baselen = 0;
+#include "casefold.h"
+#include "hide.h"
+#include "shard.h"
 
 static const char *trace_channel = "vroot.path";
 
@@ -47,44 +47,61 @@ static void strmove(register char *dst, register const char *src) {
   *dst = 0;
 }
 
-int vroot_path_have_base(void) {
-  if (*vroot_base == '\0') {
+int vroot_path_ctx_have_base(const struct vroot_ctx *ctx) {
+  if (ctx == NULL ||
+      *(ctx->base) == '\0') {
     return FALSE;
   }
 
   return TRUE;
 }
 
-const char *vroot_path_get_base(pool *p, size_t *baselen) {
-  if (p == NULL) {
+int vroot_path_have_base(void) {
+  return vroot_path_ctx_have_base(vroot_ctx_get_default());
+}
+
+const char *vroot_path_ctx_get_base(const struct vroot_ctx *ctx, pool *p,
+    size_t *baselen) {
+  if (ctx == NULL ||
+      p == NULL) {
     errno = EINVAL;
     return NULL;
   }
 
   if (baselen != NULL) {
-    *baselen = vroot_baselen;
+    *baselen = ctx->baselen;
   }
 
-  return pstrdup(p, vroot_base);
+  return pstrdup(p, ctx->base);
 }
 
-int vroot_path_set_base(const char *base, size_t baselen) {
-  if (base == NULL ||
-      baselen >= sizeof(vroot_base)) {
+const char *vroot_path_get_base(pool *p, size_t *baselen) {
+  return vroot_path_ctx_get_base(vroot_ctx_get_default(), p, baselen);
+}
+
+int vroot_path_ctx_set_base(struct vroot_ctx *ctx, const char *base,
+    size_t baselen) {
+  if (ctx == NULL ||
+      base == NULL ||
+      baselen >= sizeof(ctx->base)) {
     errno = EINVAL;
     return -1;
   }
 
-  memset(vroot_base, '\0', sizeof(vroot_base));
+  memset(ctx->base, '\0', sizeof(ctx->base));
   if (baselen > 0) {
-    memcpy(vroot_base, base, baselen);
-    vroot_base[sizeof(vroot_base)-1] = '\0';
+    memcpy(ctx->base, base, baselen);
+    ctx->base[sizeof(ctx->base)-1] = '\0';
   }
-  vroot_baselen = baselen;
+  ctx->baselen = baselen;
 
   return 0;
 }
 
+int vroot_path_set_base(const char *base, size_t baselen) {
+  return vroot_path_ctx_set_base(vroot_ctx_get_default(), base, baselen);
+}
+
 /* Note that we do in-place modifications of the given `path` buffer here,
  * which means that it MUST be writable; no constant strings, please.
  */
@@ -246,25 +263,84 @@ char *vroot_realpath(pool *p, const char *path, int flags) {
   return real_path;
 }
 
-/* The given `vpath` buffer is the looked-up path for the given `path`. */
-int vroot_path_lookup(pool *p, char *vpath, size_t vpathsz, const char *path,
-    int flags, char **alias_path) {
+/* Provides the shard directories, if the given alias is sharded, of the first
+ * name of the given suffix; otherwise the given buffer is left empty.
+ */
+static void path_get_shard(const struct vroot_ctx *ctx, const char *dst_path,
+    const char *suffix, char *buf, size_t bufsz) {
+  const struct vroot_alias_attrs *attrs;
+  size_t namelen;
+
+  *buf = '\0';
+
+  if (ctx->alias_attrs == NULL) {
+    return;
+  }
+
+  attrs = vroot_alias_ctx_get_attrs(ctx, dst_path);
+  if (attrs == NULL ||
+      attrs->shard_levels == 0) {
+    return;
+  }
+
+  suffix++;
+  namelen = strcspn(suffix, "/");
+
+  if (vroot_shard_get(suffix, namelen, attrs->shard_levels, buf,
+      bufsz) < 0) {
+    *buf = '\0';
+  }
+}
+
+/* Checks the components of the given path, relative to the base, against
+ * VRootHide.  The HiddenStores name of the upload in progress is exempt, lest
+ * patterns such as ".*" fail every upload; its directories are not.
+ */
+static int path_is_hidden(const struct vroot_ctx *ctx, const char *path,
+    const char *hide_path) {
+  char dir_path[PR_TUNABLE_PATH_MAX + 1], *ptr;
+
+  if (ctx->hide_exempt_path == NULL ||
+      strcmp(path, ctx->hide_exempt_path) != 0) {
+    return vroot_hide_match_path(ctx->hide, hide_path);
+  }
+
+  sstrncpy(dir_path, hide_path, sizeof(dir_path));
+  ptr = strrchr(dir_path, '/');
+  if (ptr == NULL) {
+    return FALSE;
+  }
+
+  *ptr = '\0';
+  return vroot_hide_match_path(ctx->hide, dir_path);
+}
+
+/* The given `vpath` buffer is the looked-up path for the given `path`, using
+ * the aliases and base of the given context.
+ */
+int vroot_path_ctx_lookup(const struct vroot_ctx *ctx, pool *p, char *vpath,
+    size_t vpathsz, const char *path, int flags, char **alias_path) {
   char buf[PR_TUNABLE_PATH_MAX + 1], *bufp = NULL;
-  const char *cwd;
+  const char *cwd, *vroot_base, *hide_path;
+  size_t vroot_baselen;
 
-  if (vpath == NULL ||
+  if (ctx == NULL ||
+      vpath == NULL ||
       path == NULL) {
     errno = EINVAL;
     return -1;
   }
 
+  vroot_base = ctx->base;
+  vroot_baselen = ctx->baselen;
+
   memset(buf, '\0', sizeof(buf));
   if (vpath != NULL &&
       vpathsz > 0) {
     memset(vpath, '\0', vpathsz);
   }
 
-  cwd = pr_fs_getcwd();
+  cwd = (ctx->cwd != NULL ? ctx->cwd : "/");
 
   if (strcmp(path, ".") != 0) {
     sstrncpy(buf, path, sizeof(buf));
@@ -377,14 +453,28 @@ loop:
   /* Clean any unnecessary characters added by the above processing. */
   vroot_path_clean(vpath);
 
+  /* Names hidden by VRootHide are not found, whatever the operation. */
+  hide_path = vpath;
+  if (strncmp(vpath, vroot_base, vroot_baselen) == 0) {
+    hide_path += vroot_baselen;
+  }
+
+  if (path_is_hidden(ctx, path, hide_path) == TRUE) {
+    pr_trace_msg(trace_channel, 9, "lookup: '%s' is hidden", path);
+    errno = ENOENT;
+    return -1;
+  }
+
   if (!(flags & VROOT_LOOKUP_FL_NO_ALIAS)) {
     int alias_count;
 
     /* Check to see if this path is an alias; if so, return the real path. */
-    alias_count = vroot_alias_count();
+    alias_count = vroot_alias_ctx_count(ctx);
     if (alias_count > 0) {
       char *start_ptr = NULL, *end_ptr = NULL;
       const char *src_path = NULL;
+      char pattern_src_path[PR_TUNABLE_PATH_MAX + 1];
+      char shard_path[(VROOT_SHARD_MAX_LEVELS * 3) + 1];
 
       /* buf is used here for storing the "suffix", to be appended later when
        * aliases are found.
@@ -400,10 +490,17 @@ loop:
         pr_trace_msg(trace_channel, 15, "checking for alias for '%s'",
           start_ptr);
 
-        src_path = vroot_alias_get(start_ptr);
+        src_path = vroot_alias_ctx_get(ctx, start_ptr);
+        if (src_path == NULL &&
+            ctx->alias_pattern_count > 0 &&
+            vroot_alias_ctx_match(ctx, start_ptr, pattern_src_path,
+              sizeof(pattern_src_path)) == 0) {
+          src_path = pattern_src_path;
+        }
+
         if (src_path != NULL) {
-          pr_trace_msg(trace_channel, 15, "found '%s' for alias '%s'", src_path,
-            start_ptr);
+          pr_trace_msg(trace_channel, 15, "found '%s' for alias '%s'",
+            src_path, start_ptr);
 
           /* If the caller provided a pointer for wanting to know the full
            * alias path (not the true path), then fill that pointer.
@@ -420,9 +517,19 @@ loop:
               *alias_path, start_ptr);
           }
 
+          /* Names directly within a sharded alias are stored in the shard
+           * directories for their hash.
+           */
+          if (end_ptr != NULL) {
+            path_get_shard(ctx, start_ptr, bufp, shard_path,
+              sizeof(shard_path));
+          }
+
           sstrncpy(vpath, src_path, vpathsz);
 
           if (end_ptr != NULL) {
+            sstrcat(vpath, shard_path, vpathsz);
+
             /* Now tack on our suffix from the scratchpad. */
             sstrcat(vpath, bufp, vpathsz);
           }
@@ -453,11 +560,35 @@ loop:
     }
   }
 
+  /* Map any components which only exist with a different case to their
+   * real names.
+   */
+  if (ctx->opts & VROOT_OPT_CASE_INSENSITIVE) {
+    (void) vroot_casefold_ctx_lookup(ctx->casefold, vpath, vpathsz);
+  }
+
   /* Note that logging the session.chroot_path here will not help; mod_vroot
    * deliberately always sets that to just "/".
    */
   pr_trace_msg(trace_channel, 19,
     "lookup: path = '%s', cwd = '%s', base = '%s', vpath = '%s'", path, cwd,
     vroot_base, vpath);
+
   return 0;
 }
+
+/* The given `vpath` buffer is the looked-up path for the given `path`. */
+int vroot_path_lookup(pool *p, char *vpath, size_t vpathsz, const char *path,
+    int flags, char **alias_path) {
+  struct vroot_ctx *ctx;
+
+  ctx = vroot_ctx_get_default();
+  ctx->cwd = pr_fs_getcwd();
+  ctx->opts = vroot_opts;
+  ctx->hide = vroot_hide_get();
+  ctx->hide_exempt_path = session.xfer.path_hidden;
+  ctx->casefold = vroot_casefold_get_default();
+
+  return vroot_path_ctx_lookup(ctx, p, vpath, vpathsz, path, flags,
+    alias_path);
+}
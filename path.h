@@ -26,6 +26,7 @@
 #define MOD_VROOT_PATH_H
 
 #include "mod_vroot.h"
+#include "ctx.h"
 
 int vroot_path_have_base(void);
 const char *vroot_path_get_base(pool *p, size_t *baselen);
@@ -37,6 +38,15 @@ int vroot_path_lookup(pool *p, char *path, size_t pathlen, const char *dir,
   int flags, char **alias_path);
 #define VROOT_LOOKUP_FL_NO_ALIAS	0x001
 
+/* Reentrant versions of the above, using the given context. */
+int vroot_path_ctx_have_base(const struct vroot_ctx *ctx);
+const char *vroot_path_ctx_get_base(const struct vroot_ctx *ctx, pool *p,
+  size_t *baselen);
+int vroot_path_ctx_set_base(struct vroot_ctx *ctx, const char *base,
+  size_t baselen);
+int vroot_path_ctx_lookup(const struct vroot_ctx *ctx, pool *p, char *path,
+  size_t pathlen, const char *dir, int flags, char **alias_path);
+
 char *vroot_realpath(pool *p, const char *path, int flags);
 #define VROOT_REALPATH_FL_ABS_PATH	0x001
 
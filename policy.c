@@ -0,0 +1,463 @@
+/*
+ * ProFTPD - mod_vroot I/O Policy implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "policy.h"
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif /* Linux */
+
+/* Files with close-time policy; only a handful of files are expected to be
+ * open at the same time in a session.
+ */
+#define VROOT_POLICY_MAX_FILES		32
+
+struct policy_file {
+  int fd;
+  int dontneed;
+  int ioprio;
+
+  /* Write-behind state: bytes written since the last flush, and the range
+   * flushed last, whose writeback is waited on at the next flush.
+   */
+  off_t write_behind;
+  off_t pending;
+  off_t prev_offset;
+  off_t prev_len;
+
+  int fsync_mode;
+};
+
+static struct policy_file policy_files[VROOT_POLICY_MAX_FILES];
+static unsigned int policy_nfiles = 0;
+
+/* The size announced by the client (e.g. using ALLO) for the next upload. */
+static off_t policy_alloc_size = 0;
+
+/* The I/O priority is per-process, thus the original priority is restored
+ * once the last file opened with a different priority is closed.
+ */
+static unsigned int policy_ioprio_count = 0;
+static int policy_ioprio_orig = -1;
+
+#define VROOT_IOPRIO_WHO_PROCESS	1
+#define VROOT_IOPRIO_CLASS_SHIFT	13
+
+static const char *trace_channel = "vroot.policy";
+
+static int policy_ioprio_get(void) {
+#if defined(SYS_ioprio_get)
+  return syscall(SYS_ioprio_get, VROOT_IOPRIO_WHO_PROCESS, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* SYS_ioprio_get */
+}
+
+static int policy_ioprio_set(int ioprio) {
+#if defined(SYS_ioprio_set)
+  return syscall(SYS_ioprio_set, VROOT_IOPRIO_WHO_PROCESS, 0, ioprio);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* SYS_ioprio_set */
+}
+
+static int policy_fadvise(int fd, off_t offset, off_t len, int advice,
+    const char *advice_text) {
+#if defined(POSIX_FADV_NORMAL)
+  int res;
+
+  /* Note that posix_fadvise(3) returns the error, rather than setting
+   * errno.
+   */
+  res = posix_fadvise(fd, offset, len, advice);
+  if (res != 0) {
+    pr_trace_msg(trace_channel, 9, "error applying %s advice to fd %d: %s",
+      advice_text, fd, strerror(res));
+    errno = res;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 17, "applied %s advice to fd %d", advice_text,
+    fd);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* POSIX_FADV_NORMAL */
+}
+
+static void policy_read_advice(int fd, int read_advice) {
+#if defined(POSIX_FADV_NORMAL)
+  switch (read_advice) {
+    case VROOT_ALIAS_ADVICE_NORMAL:
+      (void) policy_fadvise(fd, 0, 0, POSIX_FADV_NORMAL, "normal");
+      break;
+
+    case VROOT_ALIAS_ADVICE_SEQUENTIAL:
+      (void) policy_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL, "sequential");
+      break;
+
+    case VROOT_ALIAS_ADVICE_RANDOM:
+      (void) policy_fadvise(fd, 0, 0, POSIX_FADV_RANDOM, "random");
+      break;
+
+    case VROOT_ALIAS_ADVICE_NOREUSE:
+      (void) policy_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE, "noreuse");
+      break;
+
+    default:
+      break;
+  }
+#endif /* POSIX_FADV_NORMAL */
+}
+
+static void policy_readahead(int fd, off_t len) {
+#if defined(__linux__)
+  if (readahead(fd, 0, (size_t) len) < 0) {
+    pr_trace_msg(trace_channel, 9,
+      "error reading ahead %" PR_LU " bytes for fd %d: %s", (pr_off_t) len, fd,
+      strerror(errno));
+
+  } else {
+    pr_trace_msg(trace_channel, 17, "reading ahead %" PR_LU " bytes for fd %d",
+      (pr_off_t) len, fd);
+  }
+#elif defined(POSIX_FADV_WILLNEED)
+  (void) policy_fadvise(fd, 0, len, POSIX_FADV_WILLNEED, "willneed");
+#endif /* Linux */
+}
+
+/* Switches to the configured I/O priority, returning TRUE if the priority
+ * was changed (and thus needs restoring later).
+ */
+static int policy_ioprio_apply(int fd, int ioprio_class, int ioprio_level) {
+  int ioprio;
+
+  ioprio = (ioprio_class << VROOT_IOPRIO_CLASS_SHIFT) | ioprio_level;
+
+  /* Files from aliases with different priorities may be open at the same
+   * time; the most recently opened one wins.
+   */
+  if (policy_ioprio_count == 0) {
+    policy_ioprio_orig = policy_ioprio_get();
+    if (policy_ioprio_orig < 0) {
+      pr_trace_msg(trace_channel, 9, "error getting I/O priority: %s",
+        strerror(errno));
+      return FALSE;
+    }
+  }
+
+  if (policy_ioprio_set(ioprio) < 0) {
+    pr_trace_msg(trace_channel, 9,
+      "error setting I/O priority (class %d, level %d) for fd %d: %s",
+      ioprio_class, ioprio_level, fd, strerror(errno));
+    return FALSE;
+  }
+
+  pr_trace_msg(trace_channel, 17,
+    "set I/O priority (class %d, level %d) for fd %d", ioprio_class,
+    ioprio_level, fd);
+  policy_ioprio_count++;
+  return TRUE;
+}
+
+static void policy_ioprio_release(void) {
+  if (policy_ioprio_count == 0) {
+    return;
+  }
+
+  policy_ioprio_count--;
+  if (policy_ioprio_count > 0) {
+    return;
+  }
+
+  if (policy_ioprio_set(policy_ioprio_orig) < 0) {
+    pr_trace_msg(trace_channel, 9, "error restoring I/O priority: %s",
+      strerror(errno));
+
+  } else {
+    pr_trace_msg(trace_channel, 17, "restored I/O priority");
+  }
+}
+
+int vroot_policy_open_flags(const struct vroot_alias_attrs *attrs,
+    int flags) {
+  if (attrs == NULL) {
+    return flags;
+  }
+
+#if defined(O_NOATIME)
+  /* Only the owner of the file (or a privileged process) may use O_NOATIME;
+   * the caller falls back to the original flags on EPERM.
+   */
+  if (attrs->noatime == TRUE &&
+      (flags & O_ACCMODE) == O_RDONLY) {
+    flags |= O_NOATIME;
+  }
+#endif /* O_NOATIME */
+
+  return flags;
+}
+
+static void policy_preallocate(int fd, off_t len) {
+#if defined(FALLOC_FL_KEEP_SIZE)
+  /* Keep the file size unchanged, so that aborted uploads do not leave
+   * files with the announced size, but not the data.
+   */
+  if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, len) < 0) {
+    pr_trace_msg(trace_channel, 9,
+      "error preallocating %" PR_LU " bytes for fd %d: %s", (pr_off_t) len,
+      fd, strerror(errno));
+
+  } else {
+    pr_trace_msg(trace_channel, 17, "preallocated %" PR_LU " bytes for fd %d",
+      (pr_off_t) len, fd);
+  }
+#endif /* FALLOC_FL_KEEP_SIZE */
+}
+
+static struct policy_file *policy_file_get(int fd) {
+  register unsigned int i;
+
+  for (i = 0; i < policy_nfiles; i++) {
+    if (policy_files[i].fd == fd) {
+      return &(policy_files[i]);
+    }
+  }
+
+  return NULL;
+}
+
+int vroot_policy_open(int fd, int flags,
+    const struct vroot_alias_attrs *attrs) {
+  int reading, dontneed = FALSE, ioprio = FALSE, fsync_mode;
+  off_t write_behind;
+  struct policy_file *pf;
+
+  if (fd < 0 ||
+      attrs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  reading = ((flags & O_ACCMODE) == O_RDONLY);
+
+  if (reading == TRUE) {
+    if (attrs->read_advice != VROOT_ALIAS_ADVICE_NONE) {
+      policy_read_advice(fd, attrs->read_advice);
+    }
+
+    if (attrs->readahead > 0) {
+      policy_readahead(fd, attrs->readahead);
+    }
+
+    dontneed = attrs->dontneed;
+    write_behind = 0;
+    fsync_mode = VROOT_ALIAS_FSYNC_NONE;
+
+  } else {
+    if (attrs->preallocate == TRUE &&
+        policy_alloc_size > 0) {
+      policy_preallocate(fd, policy_alloc_size);
+      policy_alloc_size = 0;
+    }
+
+    write_behind = attrs->write_behind;
+    fsync_mode = attrs->fsync_mode;
+  }
+
+  if (dontneed == FALSE &&
+      write_behind == 0 &&
+      fsync_mode == VROOT_ALIAS_FSYNC_NONE &&
+      attrs->ioprio_class == VROOT_ALIAS_IOPRIO_NONE) {
+    return 0;
+  }
+
+  if (policy_nfiles == VROOT_POLICY_MAX_FILES) {
+    pr_trace_msg(trace_channel, 3,
+      "too many open files with I/O policy, ignoring policy for fd %d", fd);
+    return 0;
+  }
+
+  if (attrs->ioprio_class != VROOT_ALIAS_IOPRIO_NONE) {
+    ioprio = policy_ioprio_apply(fd, attrs->ioprio_class, attrs->ioprio_level);
+  }
+
+  if (dontneed == FALSE &&
+      write_behind == 0 &&
+      fsync_mode == VROOT_ALIAS_FSYNC_NONE &&
+      ioprio == FALSE) {
+    return 0;
+  }
+
+  pf = &(policy_files[policy_nfiles++]);
+  memset(pf, 0, sizeof(struct policy_file));
+  pf->fd = fd;
+  pf->dontneed = dontneed;
+  pf->ioprio = ioprio;
+  pf->write_behind = write_behind;
+  pf->fsync_mode = fsync_mode;
+
+  return 0;
+}
+
+int vroot_policy_write(int fd, size_t len) {
+  struct policy_file *pf;
+  off_t offset;
+
+  pf = policy_file_get(fd);
+  if (pf == NULL ||
+      pf->write_behind == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pf->pending += len;
+  if (pf->pending < pf->write_behind) {
+    return 0;
+  }
+
+  offset = lseek(fd, 0, SEEK_CUR);
+  if (offset < 0 ||
+      offset < pf->pending) {
+    pf->pending = 0;
+    return 0;
+  }
+
+  offset -= pf->pending;
+
+#if defined(SYNC_FILE_RANGE_WRITE)
+  /* Start the writeback of the data just written, then wait for that of
+   * the previous range, which has had a whole window's worth of time to
+   * complete; this keeps at most two windows of dirty pages per upload.
+   */
+  if (sync_file_range(fd, offset, pf->pending, SYNC_FILE_RANGE_WRITE) < 0) {
+    pr_trace_msg(trace_channel, 9,
+      "error starting writeback for fd %d: %s", fd, strerror(errno));
+  }
+
+  if (pf->prev_len > 0) {
+    if (sync_file_range(fd, pf->prev_offset, pf->prev_len,
+        SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WRITE|
+        SYNC_FILE_RANGE_WAIT_AFTER) < 0) {
+      pr_trace_msg(trace_channel, 9,
+        "error waiting for writeback for fd %d: %s", fd, strerror(errno));
+    }
+
+# if defined(POSIX_FADV_DONTNEED)
+    /* The written pages are not needed by this session again. */
+    (void) posix_fadvise(fd, pf->prev_offset, pf->prev_len,
+      POSIX_FADV_DONTNEED);
+# endif /* POSIX_FADV_DONTNEED */
+  }
+#elif defined(POSIX_FADV_DONTNEED)
+  /* Without sync_file_range(2), the kernel at least gets the hint. */
+  (void) posix_fadvise(fd, offset, pf->pending, POSIX_FADV_DONTNEED);
+#endif /* SYNC_FILE_RANGE_WRITE */
+
+  pr_trace_msg(trace_channel, 19,
+    "flushed %" PR_LU " bytes at offset %" PR_LU " for fd %d",
+    (pr_off_t) pf->pending, (pr_off_t) offset, fd);
+
+  pf->prev_offset = offset;
+  pf->prev_len = pf->pending;
+  pf->pending = 0;
+
+  return 0;
+}
+
+int vroot_policy_close(int fd) {
+  register unsigned int i;
+  struct policy_file *pf;
+  int res = 0, xerrno = 0;
+
+  pf = policy_file_get(fd);
+  if (pf == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+#if defined(POSIX_FADV_DONTNEED)
+  /* Drop the file's pages from the cache, so that one-time downloads do not
+   * evict the pages of other, more frequently used files.
+   */
+  if (pf->dontneed == TRUE) {
+    (void) policy_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED, "dontneed");
+  }
+#endif /* POSIX_FADV_DONTNEED */
+
+  if (pf->fsync_mode == VROOT_ALIAS_FSYNC_DATA) {
+    res = fdatasync(fd);
+    xerrno = errno;
+
+  } else if (pf->fsync_mode == VROOT_ALIAS_FSYNC_FULL) {
+    res = fsync(fd);
+    xerrno = errno;
+  }
+
+  if (res < 0) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error syncing fd %d on close: %s", fd, strerror(xerrno));
+  }
+
+  if (pf->ioprio == TRUE) {
+    policy_ioprio_release();
+  }
+
+  i = pf - policy_files;
+  policy_nfiles--;
+  if (i < policy_nfiles) {
+    memcpy(pf, &(policy_files[policy_nfiles]), sizeof(struct policy_file));
+  }
+
+  if (res < 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+int vroot_policy_set_alloc_size(off_t size) {
+  if (size < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  policy_alloc_size = size;
+  return 0;
+}
+
+int vroot_policy_free(void) {
+  if (policy_ioprio_count > 0) {
+    policy_ioprio_count = 1;
+    policy_ioprio_release();
+  }
+
+  policy_nfiles = 0;
+  policy_alloc_size = 0;
+  return 0;
+}
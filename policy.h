@@ -0,0 +1,64 @@
+/*
+ * ProFTPD - mod_vroot I/O Policy API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_POLICY_H
+#define MOD_VROOT_POLICY_H
+
+#include "mod_vroot.h"
+#include "alias.h"
+
+/* Returns the given open(2) flags, adjusted for the I/O policy of the given
+ * alias attributes (e.g. adding O_NOATIME).
+ */
+int vroot_policy_open_flags(const struct vroot_alias_attrs *attrs,
+  int flags);
+
+/* Applies the I/O policy of the given alias attributes to the newly opened
+ * file descriptor, and remembers that policy until vroot_policy_close() is
+ * called for the descriptor.
+ */
+int vroot_policy_open(int fd, int flags,
+  const struct vroot_alias_attrs *attrs);
+
+/* Applies any write-side I/O policy (e.g. write-behind) for the given
+ * number of bytes just written to the file descriptor.  Returns -1, with
+ * errno set to ENOENT, if there is no such policy for the descriptor.
+ */
+int vroot_policy_write(int fd, size_t len);
+
+/* Applies any close-time I/O policy for the given file descriptor, which is
+ * about to be closed.  Returns -1, with errno set to ENOENT, if there is no
+ * policy for the descriptor, or with the error from fsync(2) et al.
+ */
+int vroot_policy_close(int fd);
+
+/* Sets the size announced by the client for its next upload, e.g. using
+ * the ALLO command, for preallocation; zero clears it.
+ */
+int vroot_policy_set_alloc_size(off_t size);
+
+/* Internal use only. */
+int vroot_policy_free(void);
+
+#endif /* MOD_VROOT_POLICY_H */
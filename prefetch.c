@@ -0,0 +1,555 @@
+/*
+ * ProFTPD: mod_vroot Prefetch API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "prefetch.h"
+
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+static const char *trace_channel = "vroot.prefetch";
+
+#ifdef HAVE_PTHREAD_H
+
+/* Note that the helper threads only ever issue system calls, and use memory
+ * obtained from malloc(3).  They never touch pools, tables, logging, or any
+ * other part of the ProFTPD API, none of which are thread-safe.
+ */
+
+#define PREFETCH_ENT_FL_PENDING		1
+#define PREFETCH_ENT_FL_RUNNING		2
+#define PREFETCH_ENT_FL_DONE		3
+#define PREFETCH_ENT_FL_CONSUMED	4
+#define PREFETCH_ENT_FL_SKIPPED		5
+
+#define PREFETCH_NBUCKETS		1024
+#define PREFETCH_MAX_DIRS		8
+
+struct prefetch_ent {
+  struct prefetch_ent *all_next;
+  struct prefetch_ent *hash_next;
+  struct prefetch_ent *todo_next;
+
+  int state;
+  int xerrno;
+  struct stat st;
+
+  /* Must be the last member. */
+  char name[1];
+};
+
+struct vroot_prefetch {
+  struct vroot_prefetch *next;
+
+  char *dir_path;
+  size_t dir_pathlen;
+  int dir_fd;
+  int closed;
+  int shutdown;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  struct prefetch_ent *buckets[PREFETCH_NBUCKETS];
+  struct prefetch_ent *all_head;
+  struct prefetch_ent *todo_head, *todo_tail;
+
+  unsigned int nready;
+  unsigned int window;
+
+  pthread_t *threads;
+  unsigned int nthreads;
+};
+
+static struct vroot_prefetch *prefetch_list = NULL;
+static unsigned int prefetch_count = 0;
+
+static unsigned int prefetch_hash(const char *name) {
+  unsigned int h = 5381;
+
+  while (*name != '\0') {
+    h = ((h << 5) + h) + (unsigned char) *name++;
+  }
+
+  return h % PREFETCH_NBUCKETS;
+}
+
+static void *prefetch_thread(void *data) {
+  struct vroot_prefetch *pf;
+
+  pf = data;
+
+  pthread_mutex_lock(&(pf->mutex));
+
+  while (TRUE) {
+    struct prefetch_ent *ent;
+    struct stat st;
+    int res, xerrno;
+
+    while (pf->shutdown == FALSE &&
+           (pf->todo_head == NULL ||
+            pf->nready >= pf->window)) {
+      pthread_cond_wait(&(pf->cond), &(pf->mutex));
+    }
+
+    if (pf->shutdown == TRUE) {
+      break;
+    }
+
+    ent = pf->todo_head;
+    pf->todo_head = ent->todo_next;
+    if (pf->todo_head == NULL) {
+      pf->todo_tail = NULL;
+    }
+
+    if (ent->state != PREFETCH_ENT_FL_PENDING) {
+      /* The consumer got here first. */
+      continue;
+    }
+
+    ent->state = PREFETCH_ENT_FL_RUNNING;
+    pthread_mutex_unlock(&(pf->mutex));
+
+    res = fstatat(pf->dir_fd, ent->name, &st, AT_SYMLINK_NOFOLLOW);
+    xerrno = errno;
+
+    pthread_mutex_lock(&(pf->mutex));
+
+    /* The entry may have been invalidated while we were busy. */
+    if (ent->state == PREFETCH_ENT_FL_RUNNING) {
+      if (res == 0) {
+        memcpy(&(ent->st), &st, sizeof(struct stat));
+        ent->xerrno = 0;
+
+      } else {
+        ent->xerrno = xerrno;
+      }
+
+      ent->state = PREFETCH_ENT_FL_DONE;
+      pf->nready++;
+    }
+  }
+
+  pthread_mutex_unlock(&(pf->mutex));
+  return NULL;
+}
+
+static void prefetch_destroy(struct vroot_prefetch *pf) {
+  register unsigned int i;
+  struct prefetch_ent *ent;
+
+  pthread_mutex_lock(&(pf->mutex));
+  pf->shutdown = TRUE;
+  pthread_cond_broadcast(&(pf->cond));
+  pthread_mutex_unlock(&(pf->mutex));
+
+  for (i = 0; i < pf->nthreads; i++) {
+    pthread_join(pf->threads[i], NULL);
+  }
+
+  ent = pf->all_head;
+  while (ent != NULL) {
+    struct prefetch_ent *next;
+
+    next = ent->all_next;
+    free(ent);
+    ent = next;
+  }
+
+  pthread_cond_destroy(&(pf->cond));
+  pthread_mutex_destroy(&(pf->mutex));
+  (void) close(pf->dir_fd);
+
+  pr_trace_msg(trace_channel, 15, "destroyed prefetch state for '%s'",
+    pf->dir_path);
+
+  free(pf->threads);
+  free(pf->dir_path);
+  free(pf);
+}
+
+static struct prefetch_ent *prefetch_find(struct vroot_prefetch *pf,
+    const char *name) {
+  struct prefetch_ent *ent;
+
+  for (ent = pf->buckets[prefetch_hash(name)]; ent != NULL;
+       ent = ent->hash_next) {
+    if (strcmp(ent->name, name) == 0) {
+      return ent;
+    }
+  }
+
+  return NULL;
+}
+
+/* Find the prefetch state, and the entry name, for the given real path. */
+static struct vroot_prefetch *prefetch_lookup(const char *path,
+    const char **name) {
+  struct vroot_prefetch *pf;
+  const char *ptr;
+  size_t dir_pathlen;
+
+  ptr = strrchr(path, '/');
+  if (ptr == NULL ||
+      ptr[1] == '\0') {
+    return NULL;
+  }
+
+  dir_pathlen = ptr - path;
+  if (dir_pathlen == 0) {
+    /* Entries of the root directory. */
+    dir_pathlen = 1;
+  }
+
+  for (pf = prefetch_list; pf != NULL; pf = pf->next) {
+    if (pf->dir_pathlen == dir_pathlen &&
+        strncmp(pf->dir_path, path, dir_pathlen) == 0) {
+      *name = ptr + 1;
+      return pf;
+    }
+  }
+
+  return NULL;
+}
+
+struct vroot_prefetch *vroot_prefetch_open(const char *dir_path,
+    unsigned int nthreads, unsigned int window) {
+  register unsigned int i;
+  struct vroot_prefetch *pf;
+  sigset_t all_sigs, orig_sigs;
+  int fd, xerrno;
+
+  if (dir_path == NULL ||
+      nthreads == 0 ||
+      window == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (prefetch_count >= PREFETCH_MAX_DIRS) {
+    vroot_prefetch_flush();
+
+    if (prefetch_count >= PREFETCH_MAX_DIRS) {
+      errno = EAGAIN;
+      return NULL;
+    }
+  }
+
+  fd = open(dir_path, O_RDONLY|O_DIRECTORY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  pf = calloc(1, sizeof(struct vroot_prefetch));
+  if (pf == NULL) {
+    (void) close(fd);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  pf->threads = calloc(nthreads, sizeof(pthread_t));
+  pf->dir_path = strdup(dir_path);
+  if (pf->threads == NULL ||
+      pf->dir_path == NULL) {
+    free(pf->threads);
+    free(pf->dir_path);
+    free(pf);
+    (void) close(fd);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  pf->dir_pathlen = strlen(dir_path);
+  pf->dir_fd = fd;
+  pf->window = window;
+  pthread_mutex_init(&(pf->mutex), NULL);
+  pthread_cond_init(&(pf->cond), NULL);
+
+  /* Make sure that signals are only ever delivered to the session thread,
+   * not to our helpers.
+   */
+  sigfillset(&all_sigs);
+  pthread_sigmask(SIG_SETMASK, &all_sigs, &orig_sigs);
+
+  for (i = 0; i < nthreads; i++) {
+    xerrno = pthread_create(&(pf->threads[i]), NULL, prefetch_thread, pf);
+    if (xerrno != 0) {
+      pr_trace_msg(trace_channel, 3,
+        "error creating prefetch thread #%u: %s", i + 1, strerror(xerrno));
+      break;
+    }
+
+    pf->nthreads++;
+  }
+
+  pthread_sigmask(SIG_SETMASK, &orig_sigs, NULL);
+
+  if (pf->nthreads == 0) {
+    prefetch_destroy(pf);
+    errno = EAGAIN;
+    return NULL;
+  }
+
+  pf->next = prefetch_list;
+  prefetch_list = pf;
+  prefetch_count++;
+
+  pr_trace_msg(trace_channel, 15,
+    "prefetching entries of '%s' using %u %s (window %u)", dir_path,
+    pf->nthreads, pf->nthreads != 1 ? "threads" : "thread", window);
+  return pf;
+}
+
+int vroot_prefetch_add(struct vroot_prefetch *pf, const char *name) {
+  struct prefetch_ent *ent;
+  size_t namelen;
+  unsigned int h;
+
+  if (pf == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* No need to prefetch these. */
+  if (strcmp(name, ".") == 0 ||
+      strcmp(name, "..") == 0) {
+    return 0;
+  }
+
+  namelen = strlen(name);
+  ent = calloc(1, sizeof(struct prefetch_ent) + namelen);
+  if (ent == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  memcpy(ent->name, name, namelen + 1);
+  ent->state = PREFETCH_ENT_FL_PENDING;
+  h = prefetch_hash(name);
+
+  pthread_mutex_lock(&(pf->mutex));
+
+  ent->all_next = pf->all_head;
+  pf->all_head = ent;
+
+  ent->hash_next = pf->buckets[h];
+  pf->buckets[h] = ent;
+
+  if (pf->todo_tail != NULL) {
+    pf->todo_tail->todo_next = ent;
+
+  } else {
+    pf->todo_head = ent;
+  }
+  pf->todo_tail = ent;
+
+  pthread_cond_signal(&(pf->cond));
+  pthread_mutex_unlock(&(pf->mutex));
+
+  return 0;
+}
+
+int vroot_prefetch_close(struct vroot_prefetch *pf) {
+  if (pf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pf->closed = TRUE;
+  return 0;
+}
+
+int vroot_prefetch_lstat(const char *path, struct stat *st) {
+  struct vroot_prefetch *pf;
+  struct prefetch_ent *ent;
+  const char *name = NULL;
+  int res = -1;
+
+  if (path == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (prefetch_list == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pf = prefetch_lookup(path, &name);
+  if (pf == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pthread_mutex_lock(&(pf->mutex));
+
+  ent = prefetch_find(pf, name);
+  if (ent != NULL) {
+    switch (ent->state) {
+      case PREFETCH_ENT_FL_DONE:
+        if (ent->xerrno == 0) {
+          memcpy(st, &(ent->st), sizeof(struct stat));
+          res = 0;
+        }
+
+        ent->state = PREFETCH_ENT_FL_CONSUMED;
+        pf->nready--;
+        pthread_cond_signal(&(pf->cond));
+        break;
+
+      case PREFETCH_ENT_FL_PENDING:
+        /* Not worth waiting for; let the caller do it, and make sure the
+         * helpers skip it.
+         */
+        ent->state = PREFETCH_ENT_FL_SKIPPED;
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  pthread_mutex_unlock(&(pf->mutex));
+
+  if (res < 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 19, "using prefetched metadata for '%s'", path);
+  return 0;
+}
+
+void vroot_prefetch_invalidate(const char *path) {
+  struct vroot_prefetch *pf;
+  struct prefetch_ent *ent;
+  const char *name = NULL;
+
+  if (path == NULL ||
+      prefetch_list == NULL) {
+    return;
+  }
+
+  pf = prefetch_lookup(path, &name);
+  if (pf == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&(pf->mutex));
+
+  ent = prefetch_find(pf, name);
+  if (ent != NULL) {
+    if (ent->state == PREFETCH_ENT_FL_DONE) {
+      pf->nready--;
+      pthread_cond_signal(&(pf->cond));
+    }
+
+    ent->state = PREFETCH_ENT_FL_SKIPPED;
+  }
+
+  pthread_mutex_unlock(&(pf->mutex));
+}
+
+void vroot_prefetch_flush(void) {
+  struct vroot_prefetch *pf, *prev = NULL;
+
+  pf = prefetch_list;
+  while (pf != NULL) {
+    struct vroot_prefetch *next;
+
+    next = pf->next;
+
+    if (pf->closed == TRUE) {
+      if (prev != NULL) {
+        prev->next = next;
+
+      } else {
+        prefetch_list = next;
+      }
+
+      prefetch_destroy(pf);
+      prefetch_count--;
+
+    } else {
+      prev = pf;
+    }
+
+    pf = next;
+  }
+}
+
+int vroot_prefetch_free(void) {
+  struct vroot_prefetch *pf;
+
+  pf = prefetch_list;
+  while (pf != NULL) {
+    struct vroot_prefetch *next;
+
+    next = pf->next;
+    prefetch_destroy(pf);
+    pf = next;
+  }
+
+  prefetch_list = NULL;
+  prefetch_count = 0;
+  return 0;
+}
+
+#else
+
+struct vroot_prefetch *vroot_prefetch_open(const char *dir_path,
+    unsigned int nthreads, unsigned int window) {
+  pr_trace_msg(trace_channel, 9,
+    "unable to prefetch entries of '%s': threads not supported", dir_path);
+  errno = ENOSYS;
+  return NULL;
+}
+
+int vroot_prefetch_add(struct vroot_prefetch *pf, const char *name) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int vroot_prefetch_close(struct vroot_prefetch *pf) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int vroot_prefetch_lstat(const char *path, struct stat *st) {
+  errno = ENOENT;
+  return -1;
+}
+
+void vroot_prefetch_invalidate(const char *path) {
+}
+
+void vroot_prefetch_flush(void) {
+}
+
+int vroot_prefetch_free(void) {
+  return 0;
+}
+#endif /* HAVE_PTHREAD_H */
@@ -0,0 +1,64 @@
+/*
+ * ProFTPD - mod_vroot Prefetch API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_PREFETCH_H
+#define MOD_VROOT_PREFETCH_H
+
+#include "mod_vroot.h"
+
+struct vroot_prefetch;
+
+/* Starts prefetching the metadata of the entries of the given directory,
+ * using `nthreads` helper threads, keeping at most `window` results which
+ * have not yet been consumed.
+ */
+struct vroot_prefetch *vroot_prefetch_open(const char *dir_path,
+  unsigned int nthreads, unsigned int window);
+
+/* Queues the given directory entry name for prefetching. */
+int vroot_prefetch_add(struct vroot_prefetch *pf, const char *name);
+
+/* Indicates that the directory handle for which entries are being prefetched
+ * has been closed; any prefetched results remain available until the next
+ * call to vroot_prefetch_flush().
+ */
+int vroot_prefetch_close(struct vroot_prefetch *pf);
+
+/* Answers the lstat(2) of the given real path from the prefetched results,
+ * if possible.  Returns 0 on a hit, and -1 with errno set to ENOENT on a
+ * miss.  Prefetched errors are treated as misses, since the entry may have
+ * been created since.
+ */
+int vroot_prefetch_lstat(const char *path, struct stat *st);
+
+/* Discards any prefetched result for the given real path. */
+void vroot_prefetch_invalidate(const char *path);
+
+/* Destroys the prefetch state for all closed directories. */
+void vroot_prefetch_flush(void);
+
+/* Internal use only. */
+int vroot_prefetch_free(void);
+
+#endif /* MOD_VROOT_PREFETCH_H */
@@ -0,0 +1,361 @@
+/*
+ * ProFTPD - mod_vroot Sequential Read implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "seqread.h"
+
+/* Mirroring clients list a directory, then download its files, before
+ * moving on to the next directory; only the last few listings are kept.
+ */
+#define VROOT_SEQREAD_MAX_LISTINGS	4
+
+/* Bounds the memory used for recording a single listing. */
+#define VROOT_SEQREAD_MAX_ENTRIES	65536
+
+/* Number of files opened in listing order, before reading ahead. */
+#define VROOT_SEQREAD_MIN_STREAK	2
+
+struct seqread_entry {
+  const char *name;
+
+  /* Number of bytes of this file read ahead, and not yet consumed. */
+  off_t ahead;
+};
+
+struct vroot_seqread {
+  pool *pool;
+  const char *dir_path;
+  size_t dir_pathlen;
+
+  array_header *entries;
+  unsigned int nfiles;
+  off_t max_bytes;
+
+  /* Index of the last file opened, and the number of files opened in
+   * listing order up to it.
+   */
+  int last_idx;
+  unsigned int streak;
+
+  /* Index of the last file read ahead, and the total bytes read ahead. */
+  int ahead_idx;
+  off_t ahead_bytes;
+};
+
+/* The recorded listings, most recently used first. */
+static struct vroot_seqread *seqread_listings[VROOT_SEQREAD_MAX_LISTINGS];
+
+static const char *trace_channel = "vroot.seqread";
+
+struct vroot_seqread *vroot_seqread_open(const char *dir_path,
+    unsigned int nfiles, off_t max_bytes) {
+  pool *sr_pool;
+  struct vroot_seqread *sr;
+
+  if (dir_path == NULL ||
+      nfiles == 0 ||
+      max_bytes <= 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  sr_pool = make_sub_pool(session.pool);
+  pr_pool_tag(sr_pool, "VRoot Sequential Read Pool");
+
+  sr = pcalloc(sr_pool, sizeof(struct vroot_seqread));
+  sr->pool = sr_pool;
+  sr->dir_path = pstrdup(sr_pool, dir_path);
+  sr->dir_pathlen = strlen(dir_path);
+  sr->entries = make_array(sr_pool, 64, sizeof(struct seqread_entry));
+  sr->nfiles = nfiles;
+  sr->max_bytes = max_bytes;
+  sr->last_idx = -1;
+  sr->ahead_idx = -1;
+
+  return sr;
+}
+
+int vroot_seqread_add(struct vroot_seqread *sr, const char *name) {
+  struct seqread_entry *entry;
+
+  if (sr == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (strcmp(name, ".") == 0 ||
+      strcmp(name, "..") == 0) {
+    return 0;
+  }
+
+  if (sr->entries->nelts == VROOT_SEQREAD_MAX_ENTRIES) {
+    pr_trace_msg(trace_channel, 19,
+      "too many entries in '%s', ignoring '%s'", sr->dir_path, name);
+    return 0;
+  }
+
+  entry = push_array(sr->entries);
+  entry->name = pstrdup(sr->pool, name);
+  entry->ahead = 0;
+
+  return 0;
+}
+
+int vroot_seqread_close(struct vroot_seqread *sr) {
+  register unsigned int i;
+  unsigned int slot;
+
+  if (sr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (sr->entries->nelts == 0) {
+    destroy_pool(sr->pool);
+    return 0;
+  }
+
+  /* A new listing of the same directory replaces the old one; otherwise,
+   * the least recently used listing is dropped.
+   */
+  slot = VROOT_SEQREAD_MAX_LISTINGS - 1;
+  for (i = 0; i < VROOT_SEQREAD_MAX_LISTINGS; i++) {
+    if (seqread_listings[i] != NULL &&
+        strcmp(seqread_listings[i]->dir_path, sr->dir_path) == 0) {
+      slot = i;
+      break;
+    }
+  }
+
+  if (seqread_listings[slot] != NULL) {
+    destroy_pool(seqread_listings[slot]->pool);
+  }
+
+  for (i = slot; i > 0; i--) {
+    seqread_listings[i] = seqread_listings[i-1];
+  }
+
+  seqread_listings[0] = sr;
+
+  pr_trace_msg(trace_channel, 17, "recorded listing of %d %s in '%s'",
+    sr->entries->nelts, sr->entries->nelts != 1 ? "entries" : "entry",
+    sr->dir_path);
+  return 0;
+}
+
+/* Starts reading the data of the given entry into the page cache, up to the
+ * given number of bytes, returning the number of bytes requested.
+ */
+static off_t seqread_willneed(struct vroot_seqread *sr,
+    struct seqread_entry *entry, off_t max_len) {
+  char path[PR_TUNABLE_PATH_MAX + 1];
+  int fd;
+  off_t len = 0;
+  struct stat st;
+
+  if (sr->dir_path[sr->dir_pathlen-1] == '/') {
+    snprintf(path, sizeof(path)-1, "%s%s", sr->dir_path, entry->name);
+
+  } else {
+    snprintf(path, sizeof(path)-1, "%s/%s", sr->dir_path, entry->name);
+  }
+
+  /* Do not block on e.g. FIFOs; only regular files are read ahead. */
+  fd = open(path, O_RDONLY|O_NONBLOCK|O_NOCTTY);
+  if (fd < 0) {
+    pr_trace_msg(trace_channel, 19, "unable to open '%s': %s", path,
+      strerror(errno));
+    return 0;
+  }
+
+  if (fstat(fd, &st) == 0 &&
+      S_ISREG(st.st_mode)) {
+    len = st.st_size;
+    if (len > max_len) {
+      len = max_len;
+    }
+  }
+
+#if defined(POSIX_FADV_WILLNEED)
+  if (len > 0) {
+    if (posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED) != 0) {
+      pr_trace_msg(trace_channel, 19, "unable to read ahead '%s'", path);
+      len = 0;
+
+    } else {
+      pr_trace_msg(trace_channel, 17, "reading ahead %" PR_LU " bytes of '%s'",
+        (pr_off_t) len, path);
+    }
+  }
+#else
+  len = 0;
+#endif /* POSIX_FADV_WILLNEED */
+
+  (void) close(fd);
+  return len;
+}
+
+static int seqread_find(struct vroot_seqread *sr, const char *name) {
+  register unsigned int i;
+  struct seqread_entry *entries;
+
+  entries = sr->entries->elts;
+
+  /* The expected case: the entry following the last one opened. */
+  i = sr->last_idx + 1;
+  if (i < sr->entries->nelts &&
+      strcmp(entries[i].name, name) == 0) {
+    return (int) i;
+  }
+
+  for (i = 0; i < sr->entries->nelts; i++) {
+    if (strcmp(entries[i].name, name) == 0) {
+      return (int) i;
+    }
+  }
+
+  return -1;
+}
+
+int vroot_seqread_opened(const char *path) {
+  register unsigned int i;
+  const char *name, *ptr;
+  size_t dir_pathlen;
+  int idx = -1, count = 0;
+  struct vroot_seqread *sr = NULL;
+  struct seqread_entry *entries;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ptr = strrchr(path, '/');
+  if (ptr == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  name = ptr + 1;
+  dir_pathlen = (ptr == path ? 1 : (size_t) (ptr - path));
+
+  for (i = 0; i < VROOT_SEQREAD_MAX_LISTINGS; i++) {
+    sr = seqread_listings[i];
+    if (sr == NULL) {
+      break;
+    }
+
+    if (sr->dir_pathlen == dir_pathlen &&
+        strncmp(sr->dir_path, path, dir_pathlen) == 0) {
+      idx = seqread_find(sr, name);
+      if (idx >= 0) {
+        break;
+      }
+    }
+  }
+
+  if (idx < 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* Keep the listings in most recently used order. */
+  for (; i > 0; i--) {
+    seqread_listings[i] = seqread_listings[i-1];
+  }
+  seqread_listings[0] = sr;
+
+  entries = sr->entries->elts;
+
+  if (sr->last_idx >= 0 &&
+      idx == sr->last_idx + 1) {
+    sr->streak++;
+
+  } else {
+    register int j;
+
+    if (sr->streak >= VROOT_SEQREAD_MIN_STREAK) {
+      pr_trace_msg(trace_channel, 17,
+        "'%s' opened out of listing order, no longer reading ahead in '%s'",
+        name, sr->dir_path);
+    }
+
+    /* Whatever was read ahead will simply age out of the page cache. */
+    for (j = sr->last_idx + 1; j <= sr->ahead_idx; j++) {
+      entries[j].ahead = 0;
+    }
+
+    sr->streak = 1;
+    sr->ahead_idx = idx;
+    sr->ahead_bytes = 0;
+  }
+
+  sr->last_idx = idx;
+
+  /* This file's data, if read ahead, is now being consumed. */
+  sr->ahead_bytes -= entries[idx].ahead;
+  entries[idx].ahead = 0;
+
+  if (sr->streak < VROOT_SEQREAD_MIN_STREAK) {
+    return 0;
+  }
+
+  if (sr->ahead_idx < idx) {
+    sr->ahead_idx = idx;
+  }
+
+  while (sr->ahead_idx < idx + (int) sr->nfiles &&
+         (unsigned int) (sr->ahead_idx + 1) < sr->entries->nelts &&
+         sr->ahead_bytes < sr->max_bytes) {
+    struct seqread_entry *entry;
+    off_t len;
+
+    pr_signals_handle();
+
+    sr->ahead_idx++;
+    entry = &(entries[sr->ahead_idx]);
+
+    len = seqread_willneed(sr, entry, sr->max_bytes - sr->ahead_bytes);
+    if (len > 0) {
+      entry->ahead = len;
+      sr->ahead_bytes += len;
+      count++;
+    }
+  }
+
+  return count;
+}
+
+int vroot_seqread_free(void) {
+  register unsigned int i;
+
+  for (i = 0; i < VROOT_SEQREAD_MAX_LISTINGS; i++) {
+    if (seqread_listings[i] != NULL) {
+      destroy_pool(seqread_listings[i]->pool);
+      seqread_listings[i] = NULL;
+    }
+  }
+
+  return 0;
+}
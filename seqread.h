@@ -0,0 +1,57 @@
+/*
+ * ProFTPD - mod_vroot Sequential Read API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_SEQREAD_H
+#define MOD_VROOT_SEQREAD_H
+
+#include "mod_vroot.h"
+
+struct vroot_seqread;
+
+/* Starts recording the listing order of the given directory.  Once files of
+ * that directory are opened in listing order, the data of up to `nfiles`
+ * following files, and at most `max_bytes` bytes, is read ahead.
+ */
+struct vroot_seqread *vroot_seqread_open(const char *dir_path,
+  unsigned int nfiles, off_t max_bytes);
+
+/* Records the next directory entry name of the listing. */
+int vroot_seqread_add(struct vroot_seqread *sr, const char *name);
+
+/* Indicates that the listing is complete; it is kept for matching against
+ * later opens, in place of the least recently used listing.
+ */
+int vroot_seqread_close(struct vroot_seqread *sr);
+
+/* Notes that the given real path has been opened for reading, reading ahead
+ * the following files if the opens follow the listing order.  Returns the
+ * number of files read ahead, or -1 with errno set to ENOENT if the path is
+ * not in any recorded listing.
+ */
+int vroot_seqread_opened(const char *path);
+
+/* Internal use only. */
+int vroot_seqread_free(void);
+
+#endif /* MOD_VROOT_SEQREAD_H */
@@ -0,0 +1,284 @@
+/*
+ * ProFTPD - mod_vroot Sharding implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "shard.h"
+
+struct vroot_shard_dir {
+  pool *pool;
+  unsigned int levels;
+
+  /* The open directories, from the sharded directory itself (at depth 0)
+   * down to the current shard, and the length of each one's path.
+   */
+  DIR *dirs[VROOT_SHARD_MAX_LEVELS + 1];
+  size_t pathlens[VROOT_SHARD_MAX_LEVELS + 1];
+  unsigned int depth;
+
+  char path[PR_TUNABLE_PATH_MAX + 1];
+};
+
+static const char *trace_channel = "vroot.shard";
+
+/* 32-bit FNV-1a. */
+static unsigned long shard_hash(const char *name, size_t namelen) {
+  register size_t i;
+  unsigned long h = 2166136261UL;
+
+  for (i = 0; i < namelen; i++) {
+    h ^= (unsigned char) name[i];
+    h = (h * 16777619UL) & 0xffffffffUL;
+  }
+
+  return h;
+}
+
+static int is_hex_digit(char c) {
+  return ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'));
+}
+
+static int is_shard_name(const char *name) {
+  return (is_hex_digit(name[0]) &&
+          is_hex_digit(name[1]) &&
+          name[2] == '\0');
+}
+
+static int is_dot_name(const char *name) {
+  return (name[0] == '.' &&
+          (name[1] == '\0' ||
+           (name[1] == '.' && name[2] == '\0')));
+}
+
+int vroot_shard_get(const char *name, size_t namelen, unsigned int levels,
+    char *buf, size_t bufsz) {
+  static const char hex_digits[] = "0123456789abcdef";
+  register unsigned int i;
+  unsigned long h;
+
+  if (name == NULL ||
+      namelen == 0 ||
+      levels == 0 ||
+      levels > VROOT_SHARD_MAX_LEVELS ||
+      buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (bufsz < (levels * 3) + 1) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  h = shard_hash(name, namelen);
+
+  for (i = 0; i < levels; i++) {
+    unsigned int b;
+
+    b = (h >> (i * 8)) & 0xff;
+    buf[i * 3] = '/';
+    buf[(i * 3) + 1] = hex_digits[b >> 4];
+    buf[(i * 3) + 2] = hex_digits[b & 0x0f];
+  }
+
+  buf[levels * 3] = '\0';
+  return 0;
+}
+
+int vroot_shard_mkdirs(const char *path, unsigned int levels) {
+  char dir_path[PR_TUNABLE_PATH_MAX + 1], *ptr;
+  size_t slashes[VROOT_SHARD_MAX_LEVELS];
+  register unsigned int i;
+
+  if (path == NULL ||
+      levels == 0 ||
+      levels > VROOT_SHARD_MAX_LEVELS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  sstrncpy(dir_path, path, sizeof(dir_path));
+  ptr = strrchr(dir_path, '/');
+  if (ptr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *ptr = '\0';
+
+  /* Usually the shard already exists, costing a single mkdir(2). */
+  if (mkdir(dir_path, 0777) == 0 ||
+      errno == EEXIST) {
+    return 0;
+  }
+
+  if (errno != ENOENT) {
+    return -1;
+  }
+
+  /* Find the parent shards, then create them from the top down. */
+  for (i = 0; i < levels; i++) {
+    ptr = strrchr(dir_path, '/');
+    if (ptr == NULL ||
+        ptr == dir_path) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    slashes[i] = ptr - dir_path;
+    *ptr = '\0';
+  }
+
+  for (i = levels; i > 0; i--) {
+    dir_path[slashes[i-1]] = '/';
+
+    if (mkdir(dir_path, 0777) < 0 &&
+        errno != EEXIST) {
+      return -1;
+    }
+  }
+
+  pr_trace_msg(trace_channel, 17, "created shard directory '%s'", dir_path);
+  return 0;
+}
+
+struct vroot_shard_dir *vroot_shard_opendir(pool *p, const char *path,
+    unsigned int levels) {
+  pool *dir_pool;
+  struct vroot_shard_dir *sd;
+  DIR *dirh;
+
+  if (p == NULL ||
+      path == NULL ||
+      levels == 0 ||
+      levels > VROOT_SHARD_MAX_LEVELS) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (strlen(path) + (levels * 3) >= PR_TUNABLE_PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+
+  dirh = opendir(path);
+  if (dirh == NULL) {
+    return NULL;
+  }
+
+  dir_pool = make_sub_pool(p);
+  pr_pool_tag(dir_pool, "VRoot Shard Directory Pool");
+
+  sd = pcalloc(dir_pool, sizeof(struct vroot_shard_dir));
+  sd->pool = dir_pool;
+  sd->levels = levels;
+  sd->dirs[0] = dirh;
+  sstrncpy(sd->path, path, sizeof(sd->path));
+  sd->pathlens[0] = strlen(sd->path);
+
+  return sd;
+}
+
+struct dirent *vroot_shard_readdir(struct vroot_shard_dir *sd) {
+  struct dirent *dent;
+
+  if (sd == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  for (;;) {
+    DIR *dirh;
+    size_t len;
+
+    dent = readdir(sd->dirs[sd->depth]);
+    if (dent == NULL) {
+      if (sd->depth == 0) {
+        return NULL;
+      }
+
+      /* Done with this shard; continue with the next one of its parent. */
+      (void) closedir(sd->dirs[sd->depth]);
+      sd->dirs[sd->depth] = NULL;
+      sd->depth--;
+      sd->path[sd->pathlens[sd->depth]] = '\0';
+      continue;
+    }
+
+    if (is_dot_name(dent->d_name)) {
+      /* The sharded directory's own "." and ".." entries are kept. */
+      if (sd->depth == 0) {
+        return dent;
+      }
+
+      continue;
+    }
+
+    if (sd->depth == sd->levels) {
+      return dent;
+    }
+
+    /* Anything other than a shard outside of the deepest shards cannot be
+     * looked up, and so is not listed.
+     */
+    if (!is_shard_name(dent->d_name)) {
+      continue;
+    }
+
+    len = sd->pathlens[sd->depth];
+    sd->path[len] = '/';
+    sd->path[len + 1] = dent->d_name[0];
+    sd->path[len + 2] = dent->d_name[1];
+    sd->path[len + 3] = '\0';
+
+    dirh = opendir(sd->path);
+    if (dirh == NULL) {
+      pr_trace_msg(trace_channel, 9, "unable to open shard '%s': %s",
+        sd->path, strerror(errno));
+      sd->path[len] = '\0';
+      continue;
+    }
+
+    sd->depth++;
+    sd->dirs[sd->depth] = dirh;
+    sd->pathlens[sd->depth] = len + 3;
+  }
+}
+
+int vroot_shard_closedir(struct vroot_shard_dir *sd) {
+  register unsigned int i;
+
+  if (sd == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (i = 0; i <= sd->depth; i++) {
+    if (sd->dirs[i] != NULL) {
+      (void) closedir(sd->dirs[i]);
+      sd->dirs[i] = NULL;
+    }
+  }
+
+  destroy_pool(sd->pool);
+  return 0;
+}
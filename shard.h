@@ -0,0 +1,57 @@
+/*
+ * ProFTPD - mod_vroot Sharding API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_SHARD_H
+#define MOD_VROOT_SHARD_H
+
+#include "mod_vroot.h"
+
+/* Each level of shard directories uses one byte of the hash of a name, as
+ * two hex digits, for at most 256 directories per level.
+ */
+#define VROOT_SHARD_MAX_LEVELS		3
+
+/* Provides the shard directories, e.g. "/3f/a0", for the given name (of the
+ * given length) directly within a sharded directory.  The hash used does not
+ * change between sessions, or releases.
+ */
+int vroot_shard_get(const char *name, size_t namelen, unsigned int levels,
+  char *buf, size_t bufsz);
+
+/* Creates any missing shard directories for the given real path, which is to
+ * be created within the deepest of the given number of shard directories.
+ */
+int vroot_shard_mkdirs(const char *path, unsigned int levels);
+
+/* Lists the entries of all the shards of the given sharded directory, as if
+ * they were a single directory.
+ */
+struct vroot_shard_dir;
+
+struct vroot_shard_dir *vroot_shard_opendir(pool *p, const char *path,
+  unsigned int levels);
+struct dirent *vroot_shard_readdir(struct vroot_shard_dir *sd);
+int vroot_shard_closedir(struct vroot_shard_dir *sd);
+
+#endif /* MOD_VROOT_SHARD_H */
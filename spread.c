@@ -0,0 +1,1060 @@
+/*
+ * ProFTPD - mod_vroot Spread Alias implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "spread.h"
+
+#include <sys/file.h>
+#include <sys/statvfs.h>
+
+/* The index is compacted, when first loaded, once it holds this many more
+ * lines than entries.
+ */
+#define VROOT_SPREAD_INDEX_COMPACT_LINES	4096
+
+/* Write rates, in bytes per second, within this much of the least rate are
+ * treated alike when placing by load.
+ */
+#define VROOT_SPREAD_LOAD_SLACK		(1024 * 1024)
+
+struct vroot_spread_target {
+  const char *path;
+  size_t path_len;
+
+  /* The free space, in bytes, when last sampled, and the rate, in bytes per
+   * second, at which it was used up since the previous sample.
+   */
+  off_t avail;
+  off_t write_rate;
+  int usable;
+
+  /* When, among the placements of this session, a new file was last placed
+   * on this target.
+   */
+  unsigned long last_placed;
+};
+
+struct vroot_spread {
+  const char *dst_path;
+  int placement;
+
+  struct vroot_spread_target *targets;
+  unsigned int ntargets;
+  time_t sampled;
+  unsigned long placements;
+
+  /* The targets of placed files, by path relative to the targets, as read
+   * from the index file so far.
+   */
+  const char *index_path;
+  pr_table_t *index;
+  ino_t index_ino;
+  off_t index_offset;
+  unsigned int index_lines;
+};
+
+struct vroot_spread_dir {
+  pool *pool;
+  const struct vroot_spread *s;
+  const char *rel_path;
+
+  /* The names already listed. */
+  pr_table_t *seen;
+
+  /* The target of the directory read by the caller, the target being read,
+   * and the next target to read.
+   */
+  unsigned int first_target;
+  unsigned int curr_target;
+  unsigned int next_target;
+  DIR *dirh;
+};
+
+static pool *spread_pool = NULL;
+static array_header *spreads = NULL;
+
+static const char *trace_channel = "vroot.spread";
+
+int vroot_spread_add(const char *dst_path, const array_header *targets,
+    int placement) {
+  register unsigned int i;
+  struct vroot_spread *s;
+  char **elts;
+
+  if (dst_path == NULL ||
+      targets == NULL ||
+      targets->nelts < 2) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (placement != VROOT_SPREAD_PLACEMENT_SPACE &&
+      placement != VROOT_SPREAD_PLACEMENT_LOAD) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (spread_pool == NULL) {
+    spread_pool = make_sub_pool(session.pool);
+    pr_pool_tag(spread_pool, "VRoot Spread Pool");
+
+    spreads = make_array(spread_pool, 1, sizeof(struct vroot_spread *));
+  }
+
+  s = pcalloc(spread_pool, sizeof(struct vroot_spread));
+  s->dst_path = pstrdup(spread_pool, dst_path);
+  s->placement = placement;
+  s->ntargets = targets->nelts;
+  s->targets = pcalloc(spread_pool,
+    s->ntargets * sizeof(struct vroot_spread_target));
+
+  elts = targets->elts;
+  for (i = 0; i < s->ntargets; i++) {
+    char *target;
+    size_t target_len;
+
+    target = pstrdup(spread_pool, elts[i]);
+    target_len = strlen(target);
+    if (target_len > 1 &&
+        target[target_len-1] == '/') {
+      target[--target_len] = '\0';
+    }
+
+    s->targets[i].path = target;
+    s->targets[i].path_len = target_len;
+
+    pr_trace_msg(trace_channel, 9, "spread '%s': target %u = '%s'", dst_path,
+      i, target);
+  }
+
+  s->index_path = pstrcat(spread_pool, s->targets[0].path, "/",
+    VROOT_SPREAD_INDEX_NAME, NULL);
+  s->index = pr_table_alloc(spread_pool, 0);
+
+  *((struct vroot_spread **) push_array(spreads)) = s;
+  return 0;
+}
+
+unsigned int vroot_spread_count(void) {
+  if (spreads == NULL) {
+    return 0;
+  }
+
+  return spreads->nelts;
+}
+
+/* Finds the spread with a target containing the given real path, setting
+ * the target, and the path relative to that target ("" for the target
+ * itself).
+ */
+static struct vroot_spread *spread_get(const char *path, int first_only,
+    unsigned int *target_idx, const char **rel_path) {
+  register unsigned int i;
+  struct vroot_spread **elts;
+
+  if (spreads == NULL) {
+    return NULL;
+  }
+
+  elts = spreads->elts;
+  for (i = 0; i < spreads->nelts; i++) {
+    register unsigned int j;
+    struct vroot_spread *s;
+
+    s = elts[i];
+    for (j = 0; j < s->ntargets; j++) {
+      size_t len;
+
+      len = s->targets[j].path_len;
+      if (strncmp(path, s->targets[j].path, len) == 0 &&
+          (path[len] == '\0' ||
+           path[len] == '/')) {
+        const char *rel;
+
+        rel = path + len;
+        if (*rel == '/') {
+          rel++;
+        }
+
+        *target_idx = j;
+        *rel_path = rel;
+        return s;
+      }
+
+      if (first_only == TRUE) {
+        break;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int vroot_spread_contains(const char *path) {
+  unsigned int target_idx = 0;
+  const char *rel_path = NULL;
+
+  if (path == NULL) {
+    return FALSE;
+  }
+
+  return (spread_get(path, FALSE, &target_idx, &rel_path) != NULL);
+}
+
+static int target_path(char *buf, size_t bufsz, const struct vroot_spread *s,
+    unsigned int target_idx, const char *rel_path) {
+  int len;
+
+  if (*rel_path == '\0') {
+    len = snprintf(buf, bufsz, "%s", s->targets[target_idx].path);
+
+  } else {
+    len = snprintf(buf, bufsz, "%s/%s", s->targets[target_idx].path,
+      rel_path);
+  }
+
+  if (len < 0 ||
+      (size_t) len >= bufsz) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void index_set(struct vroot_spread *s, const char *rel_path,
+    unsigned int target_idx) {
+  struct vroot_spread_target *t;
+
+  t = &(s->targets[target_idx]);
+  if (pr_table_set(s->index, rel_path, t, sizeof(struct vroot_spread_target *))
+      == 0) {
+    return;
+  }
+
+  if (pr_table_count(s->index) >= VROOT_SPREAD_MAX_INDEX_ENTRIES) {
+    return;
+  }
+
+  (void) pr_table_add(s->index, pstrdup(spread_pool, rel_path), t,
+    sizeof(struct vroot_spread_target *));
+}
+
+static int index_get(struct vroot_spread *s, const char *rel_path,
+    unsigned int *target_idx) {
+  const struct vroot_spread_target *t;
+
+  t = pr_table_get(s->index, rel_path, NULL);
+  if (t == NULL) {
+    return -1;
+  }
+
+  *target_idx = (unsigned int) (t - s->targets);
+  return 0;
+}
+
+/* Returns TRUE if the given name is that of the index, or of an index being
+ * compacted.
+ */
+static int is_index_name(const char *name) {
+  size_t namelen;
+
+  namelen = strlen(VROOT_SPREAD_INDEX_NAME);
+  if (strncmp(name, VROOT_SPREAD_INDEX_NAME, namelen) != 0) {
+    return FALSE;
+  }
+
+  return (name[namelen] == '\0' || name[namelen] == '.');
+}
+
+/* Opens, and locks, the index.  The index is replaced when compacted, under
+ * the lock; thus it is opened again if replaced while waiting for the lock.
+ */
+static int index_lock(struct vroot_spread *s, int flags) {
+  register unsigned int i;
+
+  for (i = 0; i < 3; i++) {
+    int fd;
+    struct stat fd_st, st;
+
+    fd = open(s->index_path, flags|O_NOFOLLOW, PR_OPEN_MODE);
+    if (fd < 0) {
+      return -1;
+    }
+
+    while (flock(fd, LOCK_EX) < 0) {
+      if (errno != EINTR) {
+        int xerrno = errno;
+
+        (void) close(fd);
+        errno = xerrno;
+        return -1;
+      }
+
+      pr_signals_handle();
+    }
+
+    if (fstat(fd, &fd_st) == 0 &&
+        lstat(s->index_path, &st) == 0 &&
+        fd_st.st_dev == st.st_dev &&
+        fd_st.st_ino == st.st_ino) {
+      return fd;
+    }
+
+    (void) close(fd);
+  }
+
+  errno = EAGAIN;
+  return -1;
+}
+
+struct index_compact_data {
+  struct vroot_spread *s;
+  FILE *fh;
+  unsigned int count;
+};
+
+static int index_compact_cb(const void *key_data, size_t key_datasz,
+    const void *value_data, size_t value_datasz, void *user_data) {
+  struct index_compact_data *icd;
+  const char *rel_path;
+  unsigned int target_idx;
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+  struct stat st;
+
+  icd = user_data;
+  rel_path = key_data;
+  target_idx = (unsigned int) (((const struct vroot_spread_target *)
+    value_data) - icd->s->targets);
+
+  /* Keep only the entries whose files are where the index says. */
+  if (target_path(buf, sizeof(buf), icd->s, target_idx, rel_path) < 0 ||
+      lstat(buf, &st) < 0) {
+    return 0;
+  }
+
+  if (fprintf(icd->fh, "%u %s\n", target_idx, rel_path) < 0) {
+    return -1;
+  }
+
+  icd->count++;
+  return 0;
+}
+
+/* Rewrites the index with only its entries for files which still exist,
+ * dropping the lines for files since placed again, or removed.
+ */
+static void index_compact(struct vroot_spread *s) {
+  struct index_compact_data icd;
+  char tmp_path[PR_TUNABLE_PATH_MAX + 1];
+  int fd, lock_fd, res;
+  struct stat st;
+
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.%lu", s->index_path,
+      (unsigned long) getpid()) >= (int) sizeof(tmp_path)) {
+    return;
+  }
+
+  /* No lines are appended while the index is locked; the index is only
+   * compacted if this session has read all of its lines.
+   */
+  lock_fd = index_lock(s, O_RDONLY);
+  if (lock_fd < 0) {
+    pr_trace_msg(trace_channel, 3, "error locking index '%s': %s",
+      s->index_path, strerror(errno));
+    return;
+  }
+
+  if (fstat(lock_fd, &st) < 0 ||
+      st.st_ino != s->index_ino ||
+      st.st_size != s->index_offset) {
+    pr_trace_msg(trace_channel, 9,
+      "index '%s' changed since read, not compacting", s->index_path);
+    (void) close(lock_fd);
+    return;
+  }
+
+  fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW, PR_OPEN_MODE);
+  if (fd < 0) {
+    (void) close(lock_fd);
+    return;
+  }
+
+  memset(&icd, 0, sizeof(icd));
+  icd.s = s;
+  icd.fh = fdopen(fd, "w");
+  if (icd.fh == NULL) {
+    (void) close(fd);
+    (void) unlink(tmp_path);
+    (void) close(lock_fd);
+    return;
+  }
+
+  res = pr_table_do(s->index, index_compact_cb, &icd, 0);
+
+  if (fclose(icd.fh) != 0) {
+    res = -1;
+  }
+
+  if (res == 0 &&
+      rename(tmp_path, s->index_path) == 0) {
+    pr_trace_msg(trace_channel, 9, "compacted index '%s' from %u to %u lines",
+      s->index_path, s->index_lines, icd.count);
+
+    /* The new index is read from its start. */
+    s->index_ino = 0;
+    s->index_offset = 0;
+    s->index_lines = 0;
+    (void) close(lock_fd);
+    return;
+  }
+
+  (void) unlink(tmp_path);
+  (void) close(lock_fd);
+}
+
+/* Reads the lines appended to the index, by any session, since last read. */
+static void index_load(struct vroot_spread *s) {
+  FILE *fh;
+  struct stat st;
+  char buf[PR_TUNABLE_PATH_MAX + 32];
+  int first_load;
+
+  fh = fopen(s->index_path, "r");
+  if (fh == NULL) {
+    return;
+  }
+
+  if (fstat(fileno(fh), &st) < 0) {
+    (void) fclose(fh);
+    return;
+  }
+
+  /* A compacted index is read from the start. */
+  if (st.st_ino != s->index_ino ||
+      st.st_size < s->index_offset) {
+    s->index_ino = st.st_ino;
+    s->index_offset = 0;
+    s->index_lines = 0;
+  }
+
+  if (st.st_size == s->index_offset ||
+      fseeko(fh, s->index_offset, SEEK_SET) < 0) {
+    (void) fclose(fh);
+    return;
+  }
+
+  first_load = (s->index_offset == 0 && pr_table_count(s->index) == 0);
+
+  while (fgets(buf, sizeof(buf), fh) != NULL) {
+    size_t buflen;
+    char *ptr = NULL;
+    unsigned long target_idx;
+
+    pr_signals_handle();
+
+    /* A line still being appended is read later. */
+    buflen = strlen(buf);
+    if (buflen == 0 ||
+        buf[buflen-1] != '\n') {
+      break;
+    }
+
+    s->index_offset += buflen;
+    s->index_lines++;
+    buf[--buflen] = '\0';
+
+    target_idx = strtoul(buf, &ptr, 10);
+    if (ptr == buf ||
+        *ptr != ' ' ||
+        *(ptr + 1) == '\0' ||
+        target_idx >= s->ntargets) {
+      continue;
+    }
+
+    index_set(s, ptr + 1, (unsigned int) target_idx);
+  }
+
+  (void) fclose(fh);
+
+  pr_trace_msg(trace_channel, 19, "read index '%s' (%u lines, %d entries)",
+    s->index_path, s->index_lines, pr_table_count(s->index));
+
+  if (first_load == TRUE &&
+      s->index_lines > (unsigned int) pr_table_count(s->index) +
+        VROOT_SPREAD_INDEX_COMPACT_LINES) {
+    index_compact(s);
+  }
+}
+
+/* Notes the target of the given path, for this and all later sessions. */
+static void index_record(struct vroot_spread *s, const char *rel_path,
+    unsigned int target_idx) {
+  char buf[PR_TUNABLE_PATH_MAX + 32];
+  int fd, len;
+
+  index_set(s, rel_path, target_idx);
+
+  len = snprintf(buf, sizeof(buf), "%u %s\n", target_idx, rel_path);
+  if (len < 0 ||
+      (size_t) len >= sizeof(buf)) {
+    return;
+  }
+
+  /* Lines appended in a single write are not interleaved with those of
+   * other sessions; the lock keeps them from being lost to a compaction.
+   */
+  fd = index_lock(s, O_WRONLY|O_APPEND|O_CREAT);
+  if (fd < 0) {
+    pr_trace_msg(trace_channel, 3, "error opening index '%s': %s",
+      s->index_path, strerror(errno));
+    return;
+  }
+
+  if (write(fd, buf, len) != len) {
+    pr_trace_msg(trace_channel, 3, "error writing index '%s': %s",
+      s->index_path, strerror(errno));
+  }
+
+  (void) close(fd);
+}
+
+/* Finds the target providing the given path: first as indexed, then by
+ * probing every target.
+ */
+static int spread_find(struct vroot_spread *s, const char *rel_path,
+    unsigned int *target_idx) {
+  register unsigned int i;
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+  struct stat st;
+
+  if (index_get(s, rel_path, target_idx) < 0) {
+    index_load(s);
+  }
+
+  if (index_get(s, rel_path, target_idx) == 0 &&
+      target_path(buf, sizeof(buf), s, *target_idx, rel_path) == 0 &&
+      lstat(buf, &st) == 0) {
+    return 0;
+  }
+
+  for (i = 0; i < s->ntargets; i++) {
+    pr_signals_handle();
+
+    if (target_path(buf, sizeof(buf), s, i, rel_path) < 0) {
+      return -1;
+    }
+
+    if (lstat(buf, &st) == 0) {
+      pr_trace_msg(trace_channel, 19, "found '%s' in target %u by probing",
+        rel_path, i);
+      index_set(s, rel_path, i);
+
+      *target_idx = i;
+      return 0;
+    }
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+static void targets_sample(struct vroot_spread *s) {
+  register unsigned int i;
+  time_t now;
+
+  now = time(NULL);
+  if (s->sampled != 0 &&
+      now - s->sampled < VROOT_SPREAD_SAMPLE_INTERVAL) {
+    return;
+  }
+
+  for (i = 0; i < s->ntargets; i++) {
+    struct vroot_spread_target *t;
+    struct statvfs fs;
+    off_t avail;
+
+    pr_signals_handle();
+
+    t = &(s->targets[i]);
+    if (statvfs(t->path, &fs) < 0) {
+      pr_trace_msg(trace_channel, 3, "error sampling target '%s': %s",
+        t->path, strerror(errno));
+      t->usable = FALSE;
+      continue;
+    }
+
+    avail = (off_t) fs.f_bavail * (off_t) fs.f_frsize;
+
+    /* Space used up since the last sample is the load of all sessions, and
+     * of anything else writing to the target.
+     */
+    t->write_rate = 0;
+    if (t->usable == TRUE &&
+        now > s->sampled &&
+        t->avail > avail) {
+      t->write_rate = (t->avail - avail) / (now - s->sampled);
+    }
+
+    t->avail = avail;
+    t->usable = TRUE;
+
+    pr_trace_msg(trace_channel, 19,
+      "target '%s': %" PR_LU " bytes free, %" PR_LU " bytes/sec written",
+      t->path, (pr_off_t) t->avail, (pr_off_t) t->write_rate);
+  }
+
+  s->sampled = now;
+}
+
+/* Chooses the target for a new file.  Targets nearly as good as the best
+ * are treated alike, taking turns, so that a burst of new files is spread
+ * over all of them.
+ */
+static unsigned int targets_choose(struct vroot_spread *s) {
+  register unsigned int i;
+  off_t best_avail = 0, least_rate = -1;
+  struct vroot_spread_target *chosen = NULL;
+
+  targets_sample(s);
+
+  for (i = 0; i < s->ntargets; i++) {
+    struct vroot_spread_target *t;
+
+    t = &(s->targets[i]);
+    if (t->usable == FALSE) {
+      continue;
+    }
+
+    if (t->avail > best_avail) {
+      best_avail = t->avail;
+    }
+
+    if (least_rate < 0 ||
+        t->write_rate < least_rate) {
+      least_rate = t->write_rate;
+    }
+  }
+
+  for (i = 0; i < s->ntargets; i++) {
+    struct vroot_spread_target *t;
+
+    t = &(s->targets[i]);
+    if (t->usable == FALSE) {
+      continue;
+    }
+
+    if (s->placement == VROOT_SPREAD_PLACEMENT_SPACE) {
+      if (t->avail < best_avail - (best_avail / 10)) {
+        continue;
+      }
+
+    } else {
+      /* Nearly full targets are avoided, however idle. */
+      if (t->avail < best_avail / 10 ||
+          t->write_rate > least_rate + (least_rate / 10) +
+            VROOT_SPREAD_LOAD_SLACK) {
+        continue;
+      }
+    }
+
+    if (chosen == NULL ||
+        t->last_placed < chosen->last_placed) {
+      chosen = t;
+    }
+  }
+
+  if (chosen == NULL) {
+    return 0;
+  }
+
+  chosen->last_placed = ++(s->placements);
+  return (unsigned int) (chosen - s->targets);
+}
+
+int vroot_spread_lookup(char *path, size_t pathsz, int op) {
+  struct vroot_spread *s;
+  unsigned int target_idx = 0;
+  const char *rel_path = NULL;
+  char rel[PR_TUNABLE_PATH_MAX + 1];
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (op != VROOT_SPREAD_OP_FIND &&
+      op != VROOT_SPREAD_OP_CREATE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  s = spread_get(path, TRUE, &target_idx, &rel_path);
+  if (s == NULL ||
+      *rel_path == '\0') {
+    return 0;
+  }
+
+  if (is_index_name(rel_path) == TRUE) {
+    pr_trace_msg(trace_channel, 9, "denying access to index '%s'", path);
+    errno = EACCES;
+    return -1;
+  }
+
+  sstrncpy(rel, rel_path, sizeof(rel));
+
+  if (spread_find(s, rel, &target_idx) < 0) {
+    if (op == VROOT_SPREAD_OP_FIND) {
+      return 0;
+    }
+
+    target_idx = targets_choose(s);
+    index_record(s, rel, target_idx);
+
+    pr_trace_msg(trace_channel, 15, "placed '%s' on target %u ('%s')", rel,
+      target_idx, s->targets[target_idx].path);
+  }
+
+  if (target_idx > 0) {
+    if (target_path(path, pathsz, s, target_idx, rel) < 0) {
+      return -1;
+    }
+
+    pr_trace_msg(trace_channel, 19, "using target %u path '%s'", target_idx,
+      path);
+  }
+
+  return 0;
+}
+
+int vroot_spread_mkdirs(const char *path) {
+  struct vroot_spread *s;
+  unsigned int target_idx = 0;
+  const char *rel_path = NULL;
+  char rel[PR_TUNABLE_PATH_MAX + 1], buf[PR_TUNABLE_PATH_MAX + 1], *ptr;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  s = spread_get(path, FALSE, &target_idx, &rel_path);
+  if (s == NULL) {
+    return 0;
+  }
+
+  sstrncpy(rel, rel_path, sizeof(rel));
+
+  ptr = rel;
+  while ((ptr = strchr(ptr, '/')) != NULL) {
+    struct stat st;
+
+    pr_signals_handle();
+
+    *ptr = '\0';
+
+    if (target_path(buf, sizeof(buf), s, target_idx, rel) < 0) {
+      return -1;
+    }
+
+    if (lstat(buf, &st) < 0) {
+      char other[PR_TUNABLE_PATH_MAX + 1];
+      unsigned int other_idx = 0;
+
+      if (errno != ENOENT ||
+          spread_find(s, rel, &other_idx) < 0 ||
+          target_path(other, sizeof(other), s, other_idx, rel) < 0 ||
+          stat(other, &st) < 0) {
+        return -1;
+      }
+
+      if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return -1;
+      }
+
+      if (mkdir(buf, st.st_mode & 07777) < 0 &&
+          errno != EEXIST) {
+        return -1;
+      }
+
+      pr_trace_msg(trace_channel, 15, "created directory '%s', as in '%s'",
+        buf, s->targets[other_idx].path);
+    }
+
+    *ptr++ = '/';
+  }
+
+  return 0;
+}
+
+int vroot_spread_colocate(const char *src_path, char *dst_path,
+    size_t dst_pathsz) {
+  struct vroot_spread *s, *dst_s;
+  unsigned int src_idx = 0, dst_idx = 0;
+  const char *src_rel = NULL, *dst_rel = NULL;
+  char rel[PR_TUNABLE_PATH_MAX + 1];
+  struct stat st;
+
+  if (src_path == NULL ||
+      dst_path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  s = spread_get(src_path, FALSE, &src_idx, &src_rel);
+  dst_s = spread_get(dst_path, FALSE, &dst_idx, &dst_rel);
+  if (s == NULL ||
+      s != dst_s ||
+      src_idx == dst_idx ||
+      *dst_rel == '\0') {
+    return 0;
+  }
+
+  if (lstat(dst_path, &st) == 0 ||
+      errno != ENOENT) {
+    return 0;
+  }
+
+  sstrncpy(rel, dst_rel, sizeof(rel));
+  if (target_path(dst_path, dst_pathsz, s, src_idx, rel) < 0) {
+    return -1;
+  }
+
+  index_record(s, rel, src_idx);
+
+  pr_trace_msg(trace_channel, 15, "renaming into '%s', on the target of '%s'",
+    dst_path, src_path);
+  return 0;
+}
+
+/* Returns TRUE if the given directory holds any entries. */
+static int dir_has_entries(const char *path) {
+  DIR *dirh;
+  struct dirent *dent;
+  int found = FALSE;
+
+  dirh = opendir(path);
+  if (dirh == NULL) {
+    return FALSE;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    if (strcmp(dent->d_name, ".") != 0 &&
+        strcmp(dent->d_name, "..") != 0) {
+      found = TRUE;
+      break;
+    }
+  }
+
+  (void) closedir(dirh);
+  return found;
+}
+
+int vroot_spread_rmdir(const char *path) {
+  register unsigned int i;
+  struct vroot_spread *s;
+  unsigned int target_idx = 0;
+  const char *rel_path = NULL;
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  s = spread_get(path, FALSE, &target_idx, &rel_path);
+  if (s == NULL ||
+      *rel_path == '\0') {
+    return 0;
+  }
+
+  /* The merged directory must be empty. */
+  for (i = 0; i < s->ntargets; i++) {
+    if (target_path(buf, sizeof(buf), s, i, rel_path) < 0) {
+      return -1;
+    }
+
+    if (dir_has_entries(buf) == TRUE) {
+      errno = ENOTEMPTY;
+      return -1;
+    }
+  }
+
+  for (i = 0; i < s->ntargets; i++) {
+    if (i == target_idx ||
+        target_path(buf, sizeof(buf), s, i, rel_path) < 0) {
+      continue;
+    }
+
+    if (rmdir(buf) < 0 &&
+        errno != ENOENT) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int spread_dir_filter(struct vroot_spread_dir *sd, const char *name,
+    unsigned int target_idx) {
+  const char *seen;
+
+  if (strcmp(name, ".") == 0 ||
+      strcmp(name, "..") == 0) {
+    return (target_idx == sd->first_target);
+  }
+
+  if (target_idx == 0 &&
+      *(sd->rel_path) == '\0' &&
+      is_index_name(name) == TRUE) {
+    return FALSE;
+  }
+
+  /* Directories may be in several targets. */
+  if (pr_table_get(sd->seen, name, NULL) != NULL) {
+    return FALSE;
+  }
+
+  seen = pstrdup(sd->pool, name);
+  (void) pr_table_add(sd->seen, seen, seen, 0);
+
+  return TRUE;
+}
+
+struct vroot_spread_dir *vroot_spread_opendir(const char *path) {
+  struct vroot_spread *s;
+  struct vroot_spread_dir *sd;
+  unsigned int target_idx = 0;
+  const char *rel_path = NULL;
+  pool *dir_pool;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  s = spread_get(path, FALSE, &target_idx, &rel_path);
+  if (s == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  dir_pool = make_sub_pool(session.pool);
+  pr_pool_tag(dir_pool, "VRoot Spread Directory Pool");
+
+  sd = pcalloc(dir_pool, sizeof(struct vroot_spread_dir));
+  sd->pool = dir_pool;
+  sd->s = s;
+  sd->rel_path = pstrdup(dir_pool, rel_path);
+  sd->seen = pr_table_alloc(dir_pool, 0);
+  sd->first_target = sd->curr_target = target_idx;
+  sd->next_target = 0;
+
+  return sd;
+}
+
+int vroot_spread_filter(struct vroot_spread_dir *sd, const char *name) {
+  if (sd == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return spread_dir_filter(sd, name, sd->first_target);
+}
+
+struct dirent *vroot_spread_readdir(struct vroot_spread_dir *sd) {
+  if (sd == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  while (TRUE) {
+    struct dirent *dent;
+
+    pr_signals_handle();
+
+    if (sd->dirh == NULL) {
+      char buf[PR_TUNABLE_PATH_MAX + 1];
+
+      if (sd->next_target == sd->first_target) {
+        sd->next_target++;
+      }
+
+      if (sd->next_target >= sd->s->ntargets) {
+        errno = 0;
+        return NULL;
+      }
+
+      sd->curr_target = sd->next_target++;
+      if (target_path(buf, sizeof(buf), sd->s, sd->curr_target,
+          sd->rel_path) < 0) {
+        continue;
+      }
+
+      sd->dirh = opendir(buf);
+      if (sd->dirh == NULL) {
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 19, "merging listing of '%s'", buf);
+    }
+
+    dent = readdir(sd->dirh);
+    if (dent == NULL) {
+      (void) closedir(sd->dirh);
+      sd->dirh = NULL;
+      continue;
+    }
+
+    if (spread_dir_filter(sd, dent->d_name, sd->curr_target) == TRUE) {
+      return dent;
+    }
+  }
+}
+
+int vroot_spread_closedir(struct vroot_spread_dir *sd) {
+  if (sd == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (sd->dirh != NULL) {
+    (void) closedir(sd->dirh);
+    sd->dirh = NULL;
+  }
+
+  destroy_pool(sd->pool);
+  return 0;
+}
+
+int vroot_spread_free(void) {
+  if (spread_pool != NULL) {
+    destroy_pool(spread_pool);
+    spread_pool = NULL;
+    spreads = NULL;
+  }
+
+  return 0;
+}
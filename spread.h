@@ -0,0 +1,110 @@
+/*
+ * ProFTPD - mod_vroot Spread Alias API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_SPREAD_H
+#define MOD_VROOT_SPREAD_H
+
+#include "mod_vroot.h"
+
+/* The index of the targets of placed files, kept in the first target. */
+#define VROOT_SPREAD_INDEX_NAME		".vroot-spread"
+
+/* The most index entries loaded by a session; the targets of other files are
+ * found by probing.
+ */
+#define VROOT_SPREAD_MAX_INDEX_ENTRIES	65536
+
+/* How often, in seconds, the free space of the targets is sampled. */
+#define VROOT_SPREAD_SAMPLE_INTERVAL	5
+
+/* New files are placed on the target with the most free space, or with the
+ * least data written to it recently.
+ */
+#define VROOT_SPREAD_PLACEMENT_SPACE	1
+#define VROOT_SPREAD_PLACEMENT_LOAD	2
+
+struct vroot_spread_dir;
+
+/* Registers the given targets, given as real paths, for the given alias
+ * destination path.  The first target, which is also the source of the
+ * alias, holds the index.
+ */
+int vroot_spread_add(const char *dst_path, const array_header *targets,
+  int placement);
+unsigned int vroot_spread_count(void);
+
+/* Returns TRUE if the given real path is within a target of a spread. */
+int vroot_spread_contains(const char *path);
+
+/* Resolves the given real path, within the first target of a spread, for the
+ * given operation, rewriting it in place to the target providing the path.
+ */
+int vroot_spread_lookup(char *path, size_t pathsz, int op);
+
+/* Paths not found in any target are left in the first target. */
+#define VROOT_SPREAD_OP_FIND		1
+
+/* Paths not found in any target are placed on a target chosen by the
+ * placement policy.
+ */
+#define VROOT_SPREAD_OP_CREATE		2
+
+/* Creates the missing parent directories of the given path, within a target
+ * of a spread, as found in the other targets.
+ */
+int vroot_spread_mkdirs(const char *path);
+
+/* Rewrites the given destination of a rename, resolved for creating it, to
+ * the target of the given source, so that the file is renamed rather than
+ * copied.  Destinations which already exist are left as is.
+ */
+int vroot_spread_colocate(const char *src_path, char *dst_path,
+  size_t dst_pathsz);
+
+/* Removes the copies of the given directory from the other targets of its
+ * spread, failing with ENOTEMPTY unless the merged directory is empty.  The
+ * given copy is left for the caller to remove.
+ */
+int vroot_spread_rmdir(const char *path);
+
+/* Merges the listings of the other targets into the listing of the given
+ * directory, which is read by the caller.  Returns NULL, with errno set to
+ * ENOENT, if the directory is not within a spread.
+ */
+struct vroot_spread_dir *vroot_spread_opendir(const char *path);
+
+/* Returns TRUE if the given entry, read by the caller, is to be listed. */
+int vroot_spread_filter(struct vroot_spread_dir *sd, const char *name);
+
+/* Returns the next entry of the other targets not yet listed, or NULL at the
+ * end of the listing.
+ */
+struct dirent *vroot_spread_readdir(struct vroot_spread_dir *sd);
+
+int vroot_spread_closedir(struct vroot_spread_dir *sd);
+
+/* Internal use only. */
+int vroot_spread_free(void);
+
+#endif /* MOD_VROOT_SPREAD_H */
@@ -0,0 +1,1349 @@
+/*
+ * ProFTPD - mod_vroot Staging implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "staging.h"
+
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#define VROOT_STAGING_BUFSZ		(128 * 1024)
+
+struct vroot_staging {
+  const char *src_path;
+  size_t src_pathlen;
+  const char *staging_dir;
+};
+
+/* An upload staged by this session.  Its descriptor is open while the
+ * upload is in progress; once migrated, its staged copy no longer exists.
+ */
+struct staged_upload {
+  const char *path;
+  const char *staging_dir;
+  const char *data_path;
+  const char *journal_path;
+  int fd;
+};
+
+static pool *staging_pool = NULL;
+static array_header *stagings = NULL;
+static array_header *staged_uploads = NULL;
+static unsigned int staging_seq = 0;
+
+static const char *trace_channel = "vroot.staging";
+
+static void staging_migrate_start(void);
+
+int vroot_staging_add(const char *src_path, const char *staging_dir) {
+  struct vroot_staging *vs;
+  char *path;
+  size_t pathlen;
+
+  if (src_path == NULL ||
+      staging_dir == NULL ||
+      *staging_dir != '/') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (staging_pool == NULL) {
+    staging_pool = make_sub_pool(session.pool);
+    pr_pool_tag(staging_pool, "VRoot Staging Pool");
+
+    stagings = make_array(staging_pool, 1, sizeof(struct vroot_staging *));
+    staged_uploads = make_array(staging_pool, 1,
+      sizeof(struct staged_upload *));
+  }
+
+  vs = pcalloc(staging_pool, sizeof(struct vroot_staging));
+
+  path = pstrdup(staging_pool, src_path);
+  pathlen = strlen(path);
+  if (pathlen > 1 &&
+      path[pathlen-1] == '/') {
+    path[--pathlen] = '\0';
+  }
+
+  vs->src_path = path;
+  vs->src_pathlen = pathlen;
+  vs->staging_dir = pstrdup(staging_pool, staging_dir);
+
+  *((struct vroot_staging **) push_array(stagings)) = vs;
+
+  pr_trace_msg(trace_channel, 9, "staging uploads to '%s' in '%s'",
+    vs->src_path, vs->staging_dir);
+
+  /* Migrate anything left behind by earlier sessions. */
+  staging_migrate_start();
+  return 0;
+}
+
+unsigned int vroot_staging_count(void) {
+  if (stagings == NULL) {
+    return 0;
+  }
+
+  return stagings->nelts;
+}
+
+static const struct vroot_staging *staging_get(const char *path) {
+  register unsigned int i;
+  struct vroot_staging **elts;
+
+  if (stagings == NULL) {
+    return NULL;
+  }
+
+  elts = stagings->elts;
+  for (i = 0; i < stagings->nelts; i++) {
+    const struct vroot_staging *vs;
+
+    vs = elts[i];
+    if (strncmp(path, vs->src_path, vs->src_pathlen) == 0 &&
+        path[vs->src_pathlen] == '/' &&
+        path[vs->src_pathlen + 1] != '\0') {
+      return vs;
+    }
+  }
+
+  return NULL;
+}
+
+/* The staged names start with the hash of the real path, for finding them
+ * from any session, and when debugging.
+ */
+static unsigned long long staging_hash(const char *path) {
+  const unsigned char *ptr;
+  unsigned long long h = 14695981039346656037ULL;
+
+  for (ptr = (const unsigned char *) path; *ptr != '\0'; ptr++) {
+    h ^= *ptr;
+    h *= 1099511628211ULL;
+  }
+
+  return h;
+}
+
+/* Staged files, and their journals, are only used, and migrated, by sessions
+ * running as the user who uploaded them.
+ */
+static int staging_owned(const struct stat *st) {
+  if (!S_ISREG(st->st_mode) ||
+      st->st_uid != geteuid()) {
+    errno = EPERM;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Reads the destination recorded in the given journal, provided that this
+ * user wrote it.
+ */
+static int staging_read_journal(int dir_fd, const char *name, char *path,
+    size_t pathsz) {
+  int fd, xerrno;
+  ssize_t len;
+  struct stat st;
+
+  fd = openat(dir_fd, name, O_RDONLY|O_NOFOLLOW);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0 ||
+      staging_owned(&st) == FALSE) {
+    xerrno = errno;
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  len = read(fd, path, pathsz - 1);
+  (void) close(fd);
+
+  if (len <= 0 ||
+      path[0] != '/') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  path[len] = '\0';
+  return 0;
+}
+
+/* Calls the given callback for each completed upload in the given staging
+ * directory which has not yet been migrated, whichever session of this user
+ * made it, until the callback returns TRUE.  Only the journals whose names
+ * start with the given prefix, if any, are read.
+ */
+static int staging_journals_do(const char *staging_dir, const char *prefix,
+    int (*cb)(const char *, const char *, void *), void *user_data) {
+  DIR *dirh;
+  struct dirent *dent;
+  size_t prefixlen;
+
+  dirh = opendir(staging_dir);
+  if (dirh == NULL) {
+    return -1;
+  }
+
+  prefixlen = (prefix != NULL ? strlen(prefix) : 0);
+
+  while ((dent = readdir(dirh)) != NULL) {
+    char dst_path[PR_TUNABLE_PATH_MAX + 1], data_path[PR_TUNABLE_PATH_MAX + 1];
+    const char *ptr;
+    struct stat st;
+
+    if (dent->d_name[0] == '.' ||
+        strncmp(dent->d_name, prefix != NULL ? prefix : "", prefixlen) != 0) {
+      continue;
+    }
+
+    /* Both unclaimed journals, and those claimed for migrating by a
+     * session, but not those still being written.
+     */
+    ptr = strstr(dent->d_name, ".journal");
+    if (ptr == NULL ||
+        (ptr[8] != '\0' &&
+         (ptr[8] != '.' ||
+          strspn(ptr + 9, "0123456789") != strlen(ptr + 9)))) {
+      continue;
+    }
+
+    if (staging_read_journal(dirfd(dirh), dent->d_name, dst_path,
+        sizeof(dst_path)) < 0) {
+      continue;
+    }
+
+    if (snprintf(data_path, sizeof(data_path), "%s/%.*s.data", staging_dir,
+        (int) (ptr - dent->d_name), dent->d_name) >= (int) sizeof(data_path) ||
+        lstat(data_path, &st) < 0 ||
+        staging_owned(&st) == FALSE) {
+      continue;
+    }
+
+    if (cb(dst_path, data_path, user_data) == TRUE) {
+      break;
+    }
+  }
+
+  (void) closedir(dirh);
+  return 0;
+}
+
+/* Finds the upload by this session to the given real path, forgetting any
+ * uploads found to have been migrated along the way.
+ */
+static struct staged_upload *staged_upload_get(const char *path) {
+  register unsigned int i, j;
+  struct staged_upload **elts, *found = NULL;
+
+  if (staged_uploads == NULL) {
+    return NULL;
+  }
+
+  elts = staged_uploads->elts;
+  for (i = 0, j = 0; i < staged_uploads->nelts; i++) {
+    struct staged_upload *su;
+
+    su = elts[i];
+    if (su->fd < 0 &&
+        access(su->data_path, F_OK) < 0) {
+      pr_trace_msg(trace_channel, 19, "upload to '%s' has been migrated",
+        su->path);
+      continue;
+    }
+
+    if (path != NULL &&
+        strcmp(su->path, path) == 0) {
+      found = su;
+    }
+
+    elts[j++] = su;
+  }
+
+  staged_uploads->nelts = j;
+  return found;
+}
+
+int vroot_staging_open(const char *path, int flags) {
+  const struct vroot_staging *vs;
+  struct staged_upload *su;
+  char base[64];
+  int fd;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  vs = staging_get(path);
+  if (vs == NULL ||
+      !(flags & O_CREAT) ||
+      !(flags & (O_TRUNC|O_EXCL))) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (flags & O_EXCL) {
+    struct stat st;
+
+    if (lstat(path, &st) == 0) {
+      errno = EEXIST;
+      return -1;
+    }
+  }
+
+  /* The staged names include the hash of the real path, and the session, for
+   * recovering them.
+   */
+  snprintf(base, sizeof(base), "%016llx.%lu.%u", staging_hash(path),
+    (unsigned long) getpid(), staging_seq++);
+
+  su = pcalloc(staging_pool, sizeof(struct staged_upload));
+  su->path = pstrdup(staging_pool, path);
+  su->staging_dir = vs->staging_dir;
+  su->data_path = pstrcat(staging_pool, vs->staging_dir, "/", base, ".data",
+    NULL);
+  su->journal_path = pstrcat(staging_pool, vs->staging_dir, "/", base,
+    ".journal", NULL);
+
+  fd = open(su->data_path, (flags & O_ACCMODE)|O_CREAT|O_EXCL|O_NOFOLLOW,
+    PR_OPEN_MODE);
+  if (fd < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error staging upload to '%s' in '%s': %s",
+      path, su->data_path, strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  su->fd = fd;
+  *((struct staged_upload **) push_array(staged_uploads)) = su;
+
+  pr_trace_msg(trace_channel, 15, "staging upload to '%s' in '%s'", path,
+    su->data_path);
+  return fd;
+}
+
+/* Writes the journal naming the destination of a completed upload.  The
+ * journal, like the staged data, is on disk before the upload is reported as
+ * complete, so that a migration interrupted by a crash can be resumed.
+ */
+static int staging_write_journal(const struct staged_upload *su) {
+  int fd, res, xerrno;
+  char tmp_path[PR_TUNABLE_PATH_MAX + 1];
+  size_t len;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", su->journal_path);
+  fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    return -1;
+  }
+
+  len = strlen(su->path);
+  res = write(fd, su->path, len);
+  xerrno = errno;
+
+  if (res == (int) len) {
+    res = fsync(fd);
+    xerrno = errno;
+
+  } else if (res >= 0) {
+    res = -1;
+    xerrno = ENOSPC;
+  }
+
+  (void) close(fd);
+
+  if (res == 0) {
+    res = rename(tmp_path, su->journal_path);
+    xerrno = errno;
+  }
+
+  if (res < 0) {
+    (void) unlink(tmp_path);
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+int vroot_staging_close(int fd) {
+  register unsigned int i;
+  struct staged_upload **elts, *su = NULL;
+
+  if (fd < 0 ||
+      staged_uploads == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  elts = staged_uploads->elts;
+  for (i = 0; i < staged_uploads->nelts; i++) {
+    if (elts[i]->fd == fd) {
+      su = elts[i];
+      break;
+    }
+  }
+
+  if (su == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  su->fd = -1;
+
+  if (fsync(fd) < 0 ||
+      staging_write_journal(su) < 0) {
+    int xerrno = errno;
+
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "error completing staged upload to '%s': %s", su->path,
+      strerror(xerrno));
+
+    /* Without its journal, the staged copy would never be migrated. */
+    (void) unlink(su->data_path);
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 15, "staged upload to '%s' complete", su->path);
+  staging_migrate_start();
+  return 0;
+}
+
+struct staging_find {
+  const char *path;
+  char data_path[PR_TUNABLE_PATH_MAX + 1];
+  int found;
+};
+
+static int staging_find_cb(const char *dst_path, const char *data_path,
+    void *user_data) {
+  struct staging_find *sf;
+
+  sf = user_data;
+  if (strcmp(dst_path, sf->path) != 0) {
+    return FALSE;
+  }
+
+  sstrncpy(sf->data_path, data_path, sizeof(sf->data_path));
+  sf->found = TRUE;
+  return TRUE;
+}
+
+/* Finds a completed upload to the given real path by another session of this
+ * user, which has not yet been migrated.
+ */
+static const char *staging_find_shared(const char *path) {
+  static struct staging_find sf;
+  const struct vroot_staging *vs;
+  char prefix[32];
+
+  vs = staging_get(path);
+  if (vs == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  memset(&sf, 0, sizeof(sf));
+  sf.path = path;
+
+  snprintf(prefix, sizeof(prefix), "%016llx.", staging_hash(path));
+  (void) staging_journals_do(vs->staging_dir, prefix, staging_find_cb, &sf);
+
+  if (sf.found == FALSE) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  pr_trace_msg(trace_channel, 19, "found upload to '%s' by another session "
+    "in '%s'", path, sf.data_path);
+  return sf.data_path;
+}
+
+const char *vroot_staging_get(const char *path) {
+  struct staged_upload *su;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  su = staged_upload_get(path);
+  if (su == NULL) {
+    return staging_find_shared(path);
+  }
+
+  return su->data_path;
+}
+
+struct staging_scan {
+  pool *pool;
+  const char *dir_path;
+  size_t dir_pathlen;
+  array_header *names;
+};
+
+/* Adds the name of the given upload, if it is a new file in the directory
+ * being scanned, and not already listed.
+ */
+static int staging_scan_cb(const char *path, const char *data_path,
+    void *user_data) {
+  register unsigned int i;
+  struct staging_scan *ss;
+  const char *name;
+  char **elts;
+  struct stat st;
+
+  ss = user_data;
+  if (strncmp(path, ss->dir_path, ss->dir_pathlen) != 0 ||
+      path[ss->dir_pathlen] != '/' ||
+      strchr(path + ss->dir_pathlen + 1, '/') != NULL) {
+    return FALSE;
+  }
+
+  /* Uploads replacing existing files are already listed. */
+  if (lstat(path, &st) == 0) {
+    return FALSE;
+  }
+
+  name = path + ss->dir_pathlen + 1;
+
+  elts = ss->names->elts;
+  for (i = 0; i < ss->names->nelts; i++) {
+    if (strcmp(elts[i], name) == 0) {
+      return FALSE;
+    }
+  }
+
+  *((char **) push_array(ss->names)) = pstrdup(ss->pool, name);
+  return FALSE;
+}
+
+int vroot_staging_scan(pool *p, const char *dir_path, array_header *names) {
+  register unsigned int i;
+  struct staging_scan ss;
+  struct vroot_staging **stagings_elts;
+  struct staged_upload **elts;
+
+  if (p == NULL ||
+      dir_path == NULL ||
+      names == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (staged_uploads == NULL) {
+    return 0;
+  }
+
+  ss.pool = p;
+  ss.dir_path = dir_path;
+  ss.dir_pathlen = strlen(dir_path);
+  ss.names = names;
+
+  /* The uploads by this session, including those still in progress... */
+  (void) staged_upload_get(NULL);
+
+  elts = staged_uploads->elts;
+  for (i = 0; i < staged_uploads->nelts; i++) {
+    (void) staging_scan_cb(elts[i]->path, elts[i]->data_path, &ss);
+  }
+
+  /* ...and the completed uploads by other sessions of this user. */
+  stagings_elts = stagings->elts;
+  for (i = 0; i < stagings->nelts; i++) {
+    const struct vroot_staging *vs;
+
+    vs = stagings_elts[i];
+    if (strncmp(dir_path, vs->src_path, vs->src_pathlen) != 0 ||
+        (dir_path[vs->src_pathlen] != '/' &&
+         dir_path[vs->src_pathlen] != '\0')) {
+      continue;
+    }
+
+    (void) staging_journals_do(vs->staging_dir, NULL, staging_scan_cb, &ss);
+  }
+
+  return 0;
+}
+
+/* The migration only ever issues system calls, and uses memory obtained from
+ * malloc(3), as it is done by the helper thread.
+ */
+struct staging_migrator {
+  char **dirs;
+  unsigned int ndirs;
+
+  /* The staging directory, and source directory, of each alias; uploads
+   * are only migrated into the source directories of the aliases using
+   * their staging directory.
+   */
+  char **alias_dirs;
+  char **alias_srcs;
+  unsigned int naliases;
+
+  unsigned int nmigrated;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex;
+#endif /* HAVE_PTHREAD_H */
+  int shutdown;
+  int rescan;
+  int done;
+};
+
+static int staging_stopped(struct staging_migrator *sm);
+
+static int pid_exists(pid_t pid) {
+  if (kill(pid, 0) < 0 &&
+      errno == ESRCH) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static int staging_copy(struct staging_migrator *sm, int src_fd, int dst_fd) {
+  char *buf;
+
+  buf = malloc(VROOT_STAGING_BUFSZ);
+  if (buf == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  while (TRUE) {
+    ssize_t nread, nwritten;
+
+    if (staging_stopped(sm) == TRUE) {
+      free(buf);
+      errno = ECANCELED;
+      return -1;
+    }
+
+    nread = read(src_fd, buf, VROOT_STAGING_BUFSZ);
+    if (nread < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      free(buf);
+      return -1;
+    }
+
+    if (nread == 0) {
+      break;
+    }
+
+    nwritten = write(dst_fd, buf, nread);
+    if (nwritten != nread) {
+      free(buf);
+      if (nwritten >= 0) {
+        errno = ENOSPC;
+      }
+
+      return -1;
+    }
+  }
+
+  free(buf);
+  return 0;
+}
+
+/* Checks that the given destination is within the source directory of an
+ * alias using the given staging directory, and has no "." or ".."
+ * components, returning the length of its source directory.
+ */
+static size_t staging_check_dst(struct staging_migrator *sm,
+    const char *dir_path, const char *path) {
+  register unsigned int i;
+  const char *ptr;
+  size_t src_pathlen = 0;
+
+  for (i = 0; i < sm->naliases; i++) {
+    size_t len;
+
+    if (strcmp(sm->alias_dirs[i], dir_path) != 0) {
+      continue;
+    }
+
+    len = strlen(sm->alias_srcs[i]);
+    if (strncmp(path, sm->alias_srcs[i], len) == 0 &&
+        path[len] == '/' &&
+        path[len + 1] != '\0') {
+      src_pathlen = len;
+      break;
+    }
+  }
+
+  if (src_pathlen == 0) {
+    errno = EPERM;
+    return 0;
+  }
+
+  for (ptr = path + src_pathlen; *ptr != '\0'; ptr++) {
+    if (ptr[0] == '/' &&
+        (ptr[1] == '/' ||
+         ptr[1] == '\0' ||
+         (ptr[1] == '.' &&
+          (ptr[2] == '/' || ptr[2] == '\0' ||
+           (ptr[2] == '.' && (ptr[3] == '/' || ptr[3] == '\0')))))) {
+      errno = EPERM;
+      return 0;
+    }
+  }
+
+  return src_pathlen;
+}
+
+/* Opens the parent directory of the given destination, walking down from its
+ * source directory without following any symlinks, and sets the name of the
+ * destination within it.
+ */
+static int staging_open_parent(const char *path, size_t src_pathlen,
+    const char **name) {
+  char component[PR_TUNABLE_PATH_MAX + 1];
+  const char *ptr, *next;
+  int fd;
+
+  memcpy(component, path, src_pathlen);
+  component[src_pathlen] = '\0';
+
+  fd = open(component, O_RDONLY|O_DIRECTORY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  ptr = path + src_pathlen + 1;
+  next = strchr(ptr, '/');
+  while (next != NULL) {
+    int next_fd;
+    size_t len;
+
+    len = next - ptr;
+    memcpy(component, ptr, len);
+    component[len] = '\0';
+
+    next_fd = openat(fd, component, O_RDONLY|O_DIRECTORY|O_NOFOLLOW);
+    (void) close(fd);
+    if (next_fd < 0) {
+      return -1;
+    }
+
+    fd = next_fd;
+    ptr = next + 1;
+    next = strchr(ptr, '/');
+  }
+
+  *name = ptr;
+  return fd;
+}
+
+/* Moves the staged copy named by the given (claimed) journal to its
+ * destination.  The copy replaces the destination in a single rename(2), and
+ * the journal is only removed after that, thus a migration interrupted at any
+ * point is simply done again.
+ */
+static int staging_migrate_upload(struct staging_migrator *sm,
+    const char *dir_path, int dir_fd, const char *base,
+    const char *journal_name) {
+  int data_fd, parent_fd, tmp_fd, res, xerrno;
+  char path[PR_TUNABLE_PATH_MAX + 1], tmp_name[PR_TUNABLE_PATH_MAX + 1];
+  char data_name[PR_TUNABLE_PATH_MAX + 1];
+  const char *name = NULL;
+  size_t src_pathlen;
+  struct stat st;
+
+  if (staging_read_journal(dir_fd, journal_name, path, sizeof(path)) < 0) {
+    return -1;
+  }
+
+  src_pathlen = staging_check_dst(sm, dir_path, path);
+  if (src_pathlen == 0) {
+    return -1;
+  }
+
+  snprintf(data_name, sizeof(data_name), "%s.data", base);
+  data_fd = openat(dir_fd, data_name, O_RDONLY|O_NOFOLLOW);
+  if (data_fd < 0) {
+    return -1;
+  }
+
+  if (fstat(data_fd, &st) < 0 ||
+      staging_owned(&st) == FALSE) {
+    xerrno = errno;
+    (void) close(data_fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  parent_fd = staging_open_parent(path, src_pathlen, &name);
+  if (parent_fd < 0) {
+    xerrno = errno;
+    (void) close(data_fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  /* A staging directory on the same filesystem needs no copying. */
+  if (renameat(dir_fd, data_name, parent_fd, name) == 0) {
+    (void) close(parent_fd);
+    (void) close(data_fd);
+    (void) unlinkat(dir_fd, journal_name, 0);
+    return 0;
+  }
+
+  if (snprintf(tmp_name, sizeof(tmp_name), "%s.vroot-stage.%lu.%s", name,
+      (unsigned long) getpid(), base) >= (int) sizeof(tmp_name)) {
+    (void) close(parent_fd);
+    (void) close(data_fd);
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  tmp_fd = openat(parent_fd, tmp_name, O_WRONLY|O_CREAT|O_EXCL|O_NOFOLLOW,
+    S_IRUSR|S_IWUSR);
+  if (tmp_fd < 0) {
+    xerrno = errno;
+    (void) close(parent_fd);
+    (void) close(data_fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  res = staging_copy(sm, data_fd, tmp_fd);
+  xerrno = errno;
+  (void) close(data_fd);
+
+  if (res == 0) {
+    res = fchmod(tmp_fd, st.st_mode & 07777);
+    xerrno = errno;
+  }
+
+  if (res == 0) {
+    res = fsync(tmp_fd);
+    xerrno = errno;
+  }
+
+  (void) close(tmp_fd);
+
+  if (res == 0) {
+    res = renameat(parent_fd, tmp_name, parent_fd, name);
+    xerrno = errno;
+  }
+
+  if (res < 0) {
+    (void) unlinkat(parent_fd, tmp_name, 0);
+    (void) close(parent_fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  (void) close(parent_fd);
+  (void) unlinkat(dir_fd, journal_name, 0);
+  (void) unlinkat(dir_fd, data_name, 0);
+  return 0;
+}
+
+static int has_suffix(const char *name, const char *suffix) {
+  size_t namelen, suffixlen;
+
+  namelen = strlen(name);
+  suffixlen = strlen(suffix);
+
+  return (namelen > suffixlen &&
+          strcmp(name + namelen - suffixlen, suffix) == 0);
+}
+
+/* Claims the journal with the given name, by renaming it to a name including
+ * this process ID, then migrates its upload.  If that fails, the journal is
+ * released again, for a later attempt.
+ */
+static void staging_claim(struct staging_migrator *sm, const char *dir_path,
+    int dir_fd, const char *name, size_t baselen) {
+  char base[256], claimed[320];
+  struct stat st;
+
+  if (baselen >= sizeof(base)) {
+    return;
+  }
+
+  /* Leave the journals of other users for their own sessions. */
+  if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+      staging_owned(&st) == FALSE) {
+    return;
+  }
+
+  memcpy(base, name, baselen);
+  base[baselen] = '\0';
+
+  snprintf(claimed, sizeof(claimed), "%s.journal.%lu", base,
+    (unsigned long) getpid());
+  if (renameat(dir_fd, name, dir_fd, claimed) < 0) {
+    /* Another session claimed it first. */
+    return;
+  }
+
+  if (staging_migrate_upload(sm, dir_path, dir_fd, base, claimed) == 0) {
+    sm->nmigrated++;
+
+  } else {
+    char journal[320];
+
+    if (errno == EPERM) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "not migrating staged upload '%s' in '%s': destination not allowed",
+        base, dir_path);
+    }
+
+    snprintf(journal, sizeof(journal), "%s.journal", base);
+    (void) renameat(dir_fd, claimed, dir_fd, journal);
+  }
+}
+
+static void staging_migrate_dir(struct staging_migrator *sm,
+    const char *dir_path) {
+  register unsigned int i, j;
+  DIR *dirh;
+  struct dirent *dent;
+  char **names = NULL;
+  unsigned int nnames = 0, nalloc = 0;
+
+  dirh = opendir(dir_path);
+  if (dirh == NULL) {
+    return;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    if (dent->d_name[0] == '.') {
+      continue;
+    }
+
+    if (nnames == nalloc) {
+      char **ptr;
+
+      nalloc = (nalloc > 0 ? nalloc * 2 : 32);
+      ptr = realloc(names, nalloc * sizeof(char *));
+      if (ptr == NULL) {
+        break;
+      }
+
+      names = ptr;
+    }
+
+    names[nnames] = strdup(dent->d_name);
+    if (names[nnames] == NULL) {
+      break;
+    }
+
+    nnames++;
+  }
+
+  for (i = 0; i < nnames; i++) {
+    const char *name, *ptr;
+
+    if (staging_stopped(sm) == TRUE) {
+      break;
+    }
+
+    name = names[i];
+
+    if (has_suffix(name, ".journal")) {
+      staging_claim(sm, dir_path, dirfd(dirh), name, strlen(name) - 8);
+      continue;
+    }
+
+    /* Journals claimed by sessions which have since ended. */
+    ptr = strstr(name, ".journal.");
+    if (ptr != NULL) {
+      pid_t pid;
+
+      pid = (pid_t) strtoul(ptr + 9, NULL, 10);
+      if (pid > 0 &&
+          pid != getpid() &&
+          pid_exists(pid) == FALSE) {
+        staging_claim(sm, dir_path, dirfd(dirh), name, ptr - name);
+      }
+    }
+  }
+
+  /* Staged copies without journals, from uploads by sessions which have since
+   * ended, are incomplete.
+   */
+  for (i = 0; i < nnames && staging_stopped(sm) == FALSE; i++) {
+    const char *name, *ptr;
+    size_t baselen;
+    pid_t pid;
+    int journaled = FALSE;
+    struct stat st;
+
+    name = names[i];
+    if (!has_suffix(name, ".data")) {
+      continue;
+    }
+
+    ptr = strchr(name, '.');
+    pid = (pid_t) strtoul(ptr + 1, NULL, 10);
+    if (pid <= 0 ||
+        pid == getpid() ||
+        pid_exists(pid) == TRUE) {
+      continue;
+    }
+
+    baselen = strlen(name) - 5;
+    for (j = 0; j < nnames; j++) {
+      if (strncmp(names[j], name, baselen) == 0 &&
+          strncmp(names[j] + baselen, ".journal", 8) == 0) {
+        journaled = TRUE;
+        break;
+      }
+    }
+
+    if (journaled == FALSE &&
+        fstatat(dirfd(dirh), name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        staging_owned(&st) == TRUE) {
+      (void) unlinkat(dirfd(dirh), name, 0);
+    }
+  }
+
+  (void) closedir(dirh);
+
+  for (i = 0; i < nnames; i++) {
+    free(names[i]);
+  }
+
+  free(names);
+}
+
+static void staging_migrate_all(struct staging_migrator *sm) {
+  register unsigned int i;
+
+  for (i = 0; i < sm->ndirs; i++) {
+    staging_migrate_dir(sm, sm->dirs[i]);
+  }
+}
+
+static struct staging_migrator *staging_migrator_create(void) {
+  register unsigned int i;
+  struct staging_migrator *sm;
+  struct vroot_staging **elts;
+
+  sm = calloc(1, sizeof(struct staging_migrator));
+  if (sm == NULL) {
+    return NULL;
+  }
+
+  sm->dirs = calloc(stagings->nelts, sizeof(char *));
+  sm->alias_dirs = calloc(stagings->nelts, sizeof(char *));
+  sm->alias_srcs = calloc(stagings->nelts, sizeof(char *));
+  if (sm->dirs == NULL ||
+      sm->alias_dirs == NULL ||
+      sm->alias_srcs == NULL) {
+    free(sm->dirs);
+    free(sm->alias_dirs);
+    free(sm->alias_srcs);
+    free(sm);
+    return NULL;
+  }
+
+  elts = stagings->elts;
+  for (i = 0; i < stagings->nelts; i++) {
+    register unsigned int j;
+    int dup = FALSE;
+
+    sm->alias_dirs[sm->naliases] = strdup(elts[i]->staging_dir);
+    sm->alias_srcs[sm->naliases] = strdup(elts[i]->src_path);
+    if (sm->alias_dirs[sm->naliases] != NULL &&
+        sm->alias_srcs[sm->naliases] != NULL) {
+      sm->naliases++;
+
+    } else {
+      free(sm->alias_dirs[sm->naliases]);
+      free(sm->alias_srcs[sm->naliases]);
+    }
+
+    /* Staging directories may be shared by several aliases. */
+    for (j = 0; j < sm->ndirs; j++) {
+      if (strcmp(sm->dirs[j], elts[i]->staging_dir) == 0) {
+        dup = TRUE;
+        break;
+      }
+    }
+
+    if (dup == FALSE) {
+      sm->dirs[sm->ndirs] = strdup(elts[i]->staging_dir);
+      if (sm->dirs[sm->ndirs] != NULL) {
+        sm->ndirs++;
+      }
+    }
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&(sm->mutex), NULL);
+#endif /* HAVE_PTHREAD_H */
+
+  return sm;
+}
+
+static void staging_migrator_destroy(struct staging_migrator *sm) {
+  register unsigned int i;
+
+  for (i = 0; i < sm->ndirs; i++) {
+    free(sm->dirs[i]);
+  }
+
+  free(sm->dirs);
+
+  for (i = 0; i < sm->naliases; i++) {
+    free(sm->alias_dirs[i]);
+    free(sm->alias_srcs[i]);
+  }
+
+  free(sm->alias_dirs);
+  free(sm->alias_srcs);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&(sm->mutex));
+#endif /* HAVE_PTHREAD_H */
+  free(sm);
+}
+
+#ifdef HAVE_PTHREAD_H
+
+static struct staging_migrator *staging_migrator = NULL;
+static pthread_t staging_thread;
+
+static int staging_stopped(struct staging_migrator *sm) {
+  int shutdown;
+
+  pthread_mutex_lock(&(sm->mutex));
+  shutdown = sm->shutdown;
+  pthread_mutex_unlock(&(sm->mutex));
+
+  return shutdown;
+}
+
+static void *staging_migrate_run(void *arg) {
+  struct staging_migrator *sm;
+  int rescan;
+
+  sm = arg;
+
+  /* Uploads completed while migrating are picked up by another pass. */
+  do {
+    pthread_mutex_lock(&(sm->mutex));
+    sm->rescan = FALSE;
+    pthread_mutex_unlock(&(sm->mutex));
+
+    staging_migrate_all(sm);
+
+    pthread_mutex_lock(&(sm->mutex));
+    rescan = (sm->rescan == TRUE && sm->shutdown == FALSE);
+    if (rescan == FALSE) {
+      sm->done = TRUE;
+    }
+    pthread_mutex_unlock(&(sm->mutex));
+  } while (rescan == TRUE);
+
+  return NULL;
+}
+
+static void staging_migrate_start(void) {
+  struct staging_migrator *sm;
+  sigset_t all_sigs, orig_sigs;
+  int xerrno;
+
+  if (staging_migrator != NULL) {
+    int done;
+
+    pthread_mutex_lock(&(staging_migrator->mutex));
+    done = staging_migrator->done;
+    if (done == FALSE) {
+      staging_migrator->rescan = TRUE;
+    }
+    pthread_mutex_unlock(&(staging_migrator->mutex));
+
+    if (done == FALSE) {
+      return;
+    }
+
+    (void) vroot_staging_wait();
+  }
+
+  sm = staging_migrator_create();
+  if (sm == NULL) {
+    pr_trace_msg(trace_channel, 3, "error allocating migrator: %s",
+      strerror(ENOMEM));
+    return;
+  }
+
+  /* Make sure that signals are only ever delivered to the session thread. */
+  sigfillset(&all_sigs);
+  pthread_sigmask(SIG_SETMASK, &all_sigs, &orig_sigs);
+  xerrno = pthread_create(&staging_thread, NULL, staging_migrate_run, sm);
+  pthread_sigmask(SIG_SETMASK, &orig_sigs, NULL);
+
+  if (xerrno != 0) {
+    pr_trace_msg(trace_channel, 3, "error creating migration thread: %s",
+      strerror(xerrno));
+    staging_migrator_destroy(sm);
+    return;
+  }
+
+  staging_migrator = sm;
+}
+
+int vroot_staging_wait(void) {
+  int nmigrated;
+
+  if (staging_migrator == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pthread_join(staging_thread, NULL);
+  nmigrated = (int) staging_migrator->nmigrated;
+
+  pr_trace_msg(trace_channel, 15, "migrated %d staged %s", nmigrated,
+    nmigrated != 1 ? "uploads" : "upload");
+
+  staging_migrator_destroy(staging_migrator);
+  staging_migrator = NULL;
+
+  return nmigrated;
+}
+
+static void staging_migrate_stop(void) {
+  if (staging_migrator == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&(staging_migrator->mutex));
+  staging_migrator->shutdown = TRUE;
+  pthread_mutex_unlock(&(staging_migrator->mutex));
+
+  (void) vroot_staging_wait();
+}
+
+#else
+
+static int staging_stopped(struct staging_migrator *sm) {
+  return FALSE;
+}
+
+/* Without helper threads, uploads are migrated as soon as they are
+ * complete.
+ */
+static void staging_migrate_start(void) {
+  struct staging_migrator *sm;
+
+  sm = staging_migrator_create();
+  if (sm == NULL) {
+    return;
+  }
+
+  staging_migrate_all(sm);
+  staging_migrator_destroy(sm);
+}
+
+int vroot_staging_wait(void) {
+  errno = ENOENT;
+  return -1;
+}
+
+static void staging_migrate_stop(void) {
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+int vroot_staging_flush(const char *path) {
+  struct staged_upload *su;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  su = staged_upload_get(path);
+  if (su != NULL &&
+      su->fd >= 0) {
+    return 0;
+  }
+
+  /* Completed uploads by other sessions of this user are migrated by any of
+   * their sessions, including this one.
+   */
+  if (su == NULL &&
+      staging_find_shared(path) == NULL) {
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 15, "waiting for migration of upload to '%s'",
+    path);
+
+  /* Make sure the upload is included in the current migration. */
+  staging_migrate_start();
+  (void) vroot_staging_wait();
+
+  if (staged_upload_get(path) != NULL ||
+      staging_find_shared(path) != NULL) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "unable to migrate staged upload to '%s'", path);
+    errno = EAGAIN;
+    return -1;
+  }
+
+  return 0;
+}
+
+int vroot_staging_free(void) {
+  /* Finish migrating the completed uploads of this session before it ends,
+   * rather than leaving them for the next session of its user.
+   */
+  if (staged_uploads != NULL) {
+    (void) staged_upload_get(NULL);
+
+    if (staged_uploads->nelts > 0) {
+      staging_migrate_start();
+      (void) vroot_staging_wait();
+    }
+  }
+
+  staging_migrate_stop();
+
+  if (staging_pool != NULL) {
+    destroy_pool(staging_pool);
+    staging_pool = NULL;
+    stagings = NULL;
+    staged_uploads = NULL;
+  }
+
+  return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * ProFTPD - mod_vroot Staging API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_STAGING_H
+#define MOD_VROOT_STAGING_H
+
+#include "mod_vroot.h"
+
+/* Stages uploads to files within the given (real) source directory in the
+ * given local staging directory, migrating them to the source directory
+ * once complete.  Any completed uploads in the staging directory by other
+ * sessions of the same user are migrated too, provided they are for the
+ * source directory of an alias using that staging directory.
+ */
+int vroot_staging_add(const char *src_path, const char *staging_dir);
+unsigned int vroot_staging_count(void);
+
+/* Opens a staged file for an upload, with the given open(2) flags, to the
+ * given real path.  Only uploads which replace any existing file (i.e. using
+ * O_CREAT with O_TRUNC or O_EXCL) are staged; otherwise, returns -1 with
+ * errno set to ENOENT.
+ */
+int vroot_staging_open(const char *path, int flags);
+
+/* Completes the staged upload using the given file descriptor, which is
+ * about to be closed, and starts migrating it in a helper thread.  Returns
+ * -1, with errno set to ENOENT, if the descriptor is not a staged upload.
+ */
+int vroot_staging_close(int fd);
+
+/* Returns the path of the staged copy of the given real path, if there is an
+ * upload to it by this session, or a completed one by another session of the
+ * same user, which has not yet been migrated.
+ */
+const char *vroot_staging_get(const char *path);
+
+/* Waits for the migration of any completed upload to the given real path by
+ * a session of this user, e.g. before the path is changed.
+ */
+int vroot_staging_flush(const char *path);
+
+/* Adds the names of the uploads to new files within the given real directory
+ * which have not yet been migrated, by this session or completed by another
+ * session of the same user, to the given list.
+ */
+int vroot_staging_scan(pool *p, const char *dir_path, array_header *names);
+
+/* Waits for the helper thread migrating uploads to finish, returning the
+ * number of uploads migrated, or -1 with errno set to ENOENT if there is no
+ * such thread.
+ */
+int vroot_staging_wait(void);
+
+/* Finishes migrating the completed uploads by this session, then frees the
+ * staging state.  Internal use only.
+ */
+int vroot_staging_free(void);
+
+#endif /* MOD_VROOT_STAGING_H */
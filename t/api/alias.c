@@ -134,6 +134,413 @@ START_TEST (alias_do_test) {
 }
 END_TEST
 
+START_TEST (alias_attrs_parse_test) {
+  int res;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+
+  res = vroot_alias_attrs_parse(NULL, NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null pool");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "foo");
+  ck_assert_msg(res < 0, "Failed to handle missing value");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "foo=bar");
+  ck_assert_msg(res < 0, "Failed to handle unknown attribute");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "prefetch-threads=-1");
+  ck_assert_msg(res < 0, "Failed to handle negative thread count");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "prefetch-threads=4");
+  ck_assert_msg(res == 0, "Failed to parse thread count: %s", strerror(errno));
+  ck_assert_msg(attrs.prefetch_threads == 4, "Expected 4, got %u",
+    attrs.prefetch_threads);
+  ck_assert_msg(attrs.prefetch_window > 0, "Expected default window, got 0");
+
+  res = vroot_alias_attrs_parse(p, &attrs, "prefetch-window=0");
+  ck_assert_msg(res < 0, "Failed to handle zero window");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "prefetch-window=32");
+  ck_assert_msg(res == 0, "Failed to parse window: %s", strerror(errno));
+  ck_assert_msg(attrs.prefetch_window == 32, "Expected 32, got %u",
+    attrs.prefetch_window);
+}
+END_TEST
+
+START_TEST (alias_attrs_parse_read_policy_test) {
+  int res;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+
+  res = vroot_alias_attrs_parse(p, &attrs, "read-advice=foo");
+  ck_assert_msg(res < 0, "Failed to handle unknown advice");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "read-advice=sequential");
+  ck_assert_msg(res == 0, "Failed to parse advice: %s", strerror(errno));
+  ck_assert_msg(attrs.read_advice == VROOT_ALIAS_ADVICE_SEQUENTIAL,
+    "Expected sequential advice, got %d", attrs.read_advice);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "readahead=foo");
+  ck_assert_msg(res < 0, "Failed to handle bad readahead");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "readahead=4MB");
+  ck_assert_msg(res == 0, "Failed to parse readahead: %s", strerror(errno));
+  ck_assert_msg(attrs.readahead == 4194304, "Expected 4194304, got %lu",
+    (unsigned long) attrs.readahead);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "readahead-files=1000");
+  ck_assert_msg(res < 0, "Failed to handle too many readahead files");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "readahead-files=4");
+  ck_assert_msg(res == 0, "Failed to parse readahead-files: %s",
+    strerror(errno));
+  ck_assert_msg(attrs.readahead_files == 4, "Expected 4, got %u",
+    attrs.readahead_files);
+  ck_assert_msg(attrs.readahead_bytes > 0,
+    "Expected default readahead-bytes, got %lu",
+    (unsigned long) attrs.readahead_bytes);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "readahead-bytes=0");
+  ck_assert_msg(res < 0, "Failed to handle zero readahead-bytes");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "readahead-bytes=16MB");
+  ck_assert_msg(res == 0, "Failed to parse readahead-bytes: %s",
+    strerror(errno));
+  ck_assert_msg(attrs.readahead_bytes == 16777216, "Expected 16777216, got %lu",
+    (unsigned long) attrs.readahead_bytes);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "noatime=maybe");
+  ck_assert_msg(res < 0, "Failed to handle bad Boolean");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "noatime=on");
+  ck_assert_msg(res == 0, "Failed to parse noatime: %s", strerror(errno));
+  ck_assert_msg(attrs.noatime == TRUE, "Expected noatime");
+
+  res = vroot_alias_attrs_parse(p, &attrs, "dontneed=on");
+  ck_assert_msg(res == 0, "Failed to parse dontneed: %s", strerror(errno));
+  ck_assert_msg(attrs.dontneed == TRUE, "Expected dontneed");
+
+  res = vroot_alias_attrs_parse(p, &attrs, "ioprio=foo");
+  ck_assert_msg(res < 0, "Failed to handle unknown I/O class");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "ioprio=idle:3");
+  ck_assert_msg(res < 0, "Failed to handle level for idle class");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "ioprio=best-effort:8");
+  ck_assert_msg(res < 0, "Failed to handle out-of-range level");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "ioprio=best-effort:7");
+  ck_assert_msg(res == 0, "Failed to parse ioprio: %s", strerror(errno));
+  ck_assert_msg(attrs.ioprio_class == VROOT_ALIAS_IOPRIO_BEST_EFFORT,
+    "Expected best-effort class, got %d", attrs.ioprio_class);
+  ck_assert_msg(attrs.ioprio_level == 7, "Expected level 7, got %d",
+    attrs.ioprio_level);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "ioprio=idle");
+  ck_assert_msg(res == 0, "Failed to parse ioprio: %s", strerror(errno));
+  ck_assert_msg(attrs.ioprio_class == VROOT_ALIAS_IOPRIO_IDLE,
+    "Expected idle class, got %d", attrs.ioprio_class);
+}
+END_TEST
+
+START_TEST (alias_attrs_parse_write_policy_test) {
+  int res;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+
+  res = vroot_alias_attrs_parse(p, &attrs, "write-behind=foo");
+  ck_assert_msg(res < 0, "Failed to handle bad write-behind");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "write-behind=8MB");
+  ck_assert_msg(res == 0, "Failed to parse write-behind: %s", strerror(errno));
+  ck_assert_msg(attrs.write_behind == 8388608, "Expected 8388608, got %lu",
+    (unsigned long) attrs.write_behind);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "fsync=maybe");
+  ck_assert_msg(res < 0, "Failed to handle unknown fsync mode");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "fsync=data");
+  ck_assert_msg(res == 0, "Failed to parse fsync: %s", strerror(errno));
+  ck_assert_msg(attrs.fsync_mode == VROOT_ALIAS_FSYNC_DATA,
+    "Expected data fsync mode, got %d", attrs.fsync_mode);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "fsync=on");
+  ck_assert_msg(res == 0, "Failed to parse fsync: %s", strerror(errno));
+  ck_assert_msg(attrs.fsync_mode == VROOT_ALIAS_FSYNC_FULL,
+    "Expected full fsync mode, got %d", attrs.fsync_mode);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "fsync=off");
+  ck_assert_msg(res == 0, "Failed to parse fsync: %s", strerror(errno));
+  ck_assert_msg(attrs.fsync_mode == VROOT_ALIAS_FSYNC_NONE,
+    "Expected no fsync mode, got %d", attrs.fsync_mode);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "preallocate=on");
+  ck_assert_msg(res == 0, "Failed to parse preallocate: %s", strerror(errno));
+  ck_assert_msg(attrs.preallocate == TRUE, "Expected preallocate");
+
+  res = vroot_alias_attrs_parse(p, &attrs, "metadata-rate=-1");
+  ck_assert_msg(res < 0, "Failed to handle bad metadata-rate");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "metadata-rate=500");
+  ck_assert_msg(res == 0, "Failed to parse metadata-rate: %s", strerror(errno));
+  ck_assert_msg(attrs.metadata_rate == 500, "Expected 500, got %u",
+    attrs.metadata_rate);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "metadata-burst=0");
+  ck_assert_msg(res < 0, "Failed to handle bad metadata-burst");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "metadata-burst=1000");
+  ck_assert_msg(res == 0, "Failed to parse metadata-burst: %s",
+    strerror(errno));
+  ck_assert_msg(attrs.metadata_burst == 1000, "Expected 1000, got %u",
+    attrs.metadata_burst);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "shard-levels=4");
+  ck_assert_msg(res < 0, "Failed to handle too many shard-levels");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_attrs_parse(p, &attrs, "shard-levels=2");
+  ck_assert_msg(res == 0, "Failed to parse shard-levels: %s",
+    strerror(errno));
+  ck_assert_msg(attrs.shard_levels == 2, "Expected 2, got %u",
+    attrs.shard_levels);
+}
+END_TEST
+
+START_TEST (alias_attrs_test) {
+  int res;
+  const char *rel_path = NULL;
+  const struct vroot_alias_attrs *found;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+  attrs.prefetch_threads = 2;
+
+  res = vroot_alias_set_attrs("/home/foo/bar", &attrs);
+  ck_assert_msg(res < 0, "Failed to handle unknown alias");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_alias_add("/home/foo/bar", "/var/ftp/bar");
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  res = vroot_alias_set_attrs("/home/foo/bar", &attrs);
+  ck_assert_msg(res == 0, "Failed to set attributes: %s", strerror(errno));
+
+  found = vroot_alias_get_attrs("/home/foo/bar");
+  ck_assert_msg(found != NULL, "Failed to get attributes: %s",
+    strerror(errno));
+  ck_assert_msg(found->prefetch_threads == 2, "Expected 2, got %u",
+    found->prefetch_threads);
+
+  found = vroot_alias_find_attrs("/var/ftp/barbaz", NULL);
+  ck_assert_msg(found == NULL, "Unexpectedly found attributes");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  found = vroot_alias_find_attrs("/var/ftp/bar/baz/quxx", &rel_path);
+  ck_assert_msg(found != NULL, "Failed to find attributes: %s",
+    strerror(errno));
+  ck_assert_msg(rel_path != NULL, "Expected relative path, got null");
+  ck_assert_msg(strcmp(rel_path, "/baz/quxx") == 0,
+    "Expected '/baz/quxx', got '%s'", rel_path);
+}
+END_TEST
+
+START_TEST (alias_pattern_test) {
+  int res;
+  char src_path[PR_TUNABLE_PATH_MAX + 1];
+
+  res = vroot_alias_match(NULL, NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_match("/projects/foo", src_path, sizeof(src_path));
+  ck_assert_msg(res < 0, "Failed to handle missing pattern aliases");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* The source may only refer to wildcards of the pattern. */
+  res = vroot_alias_add("/projects/*", "/data/$2");
+  ck_assert_msg(res < 0, "Failed to handle bad wildcard reference");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_alias_add("/projects/*", "/data/projects/$1");
+  ck_assert_msg(res == 0, "Failed to add pattern alias: %s", strerror(errno));
+
+  res = vroot_alias_add("/projects/*", "/data/other/$1");
+  ck_assert_msg(res < 0, "Failed to handle duplicate pattern alias");
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  res = vroot_alias_add("/archive/*-?", "/data/archive/$2/$1");
+  ck_assert_msg(res == 0, "Failed to add pattern alias: %s", strerror(errno));
+
+  ck_assert_msg(vroot_alias_count() == 2, "Expected 2 aliases, got %u",
+    vroot_alias_count());
+
+  res = vroot_alias_match("/projects/foo", src_path, sizeof(src_path));
+  ck_assert_msg(res == 0, "Failed to match pattern alias: %s",
+    strerror(errno));
+  ck_assert_msg(strcmp(src_path, "/data/projects/foo") == 0,
+    "Expected '/data/projects/foo', got '%s'", src_path);
+
+  res = vroot_alias_match("/archive/2024-q-1", src_path, sizeof(src_path));
+  ck_assert_msg(res == 0, "Failed to match pattern alias: %s",
+    strerror(errno));
+  ck_assert_msg(strcmp(src_path, "/data/archive/1/2024-q") == 0,
+    "Expected '/data/archive/1/2024-q', got '%s'", src_path);
+
+  res = vroot_alias_match("/archive/2024", src_path, sizeof(src_path));
+  ck_assert_msg(res < 0, "Failed to handle non-matching name");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_alias_match("/projects/foo/bar", src_path, sizeof(src_path));
+  ck_assert_msg(res < 0, "Failed to handle path below pattern directory");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Wildcards do not match text leading out of the source. */
+  res = vroot_alias_add("/sites/*.site", "/data/sites/$1");
+  ck_assert_msg(res == 0, "Failed to add pattern alias: %s", strerror(errno));
+
+  res = vroot_alias_match("/sites/...site", src_path, sizeof(src_path));
+  ck_assert_msg(res < 0, "Failed to handle '..' wildcard text");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_alias_add("/pairs/x??", "/data/pairs/$1$2");
+  ck_assert_msg(res == 0, "Failed to add pattern alias: %s", strerror(errno));
+
+  res = vroot_alias_match("/pairs/x..", src_path, sizeof(src_path));
+  ck_assert_msg(res < 0, "Failed to handle '..' from several wildcards");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_alias_match("/sites/www.site", src_path, sizeof(src_path));
+  ck_assert_msg(res == 0, "Failed to match pattern alias: %s",
+    strerror(errno));
+  ck_assert_msg(strcmp(src_path, "/data/sites/www") == 0,
+    "Expected '/data/sites/www', got '%s'", src_path);
+
+  ck_assert_msg(vroot_alias_exists("/projects/foo") == TRUE,
+    "Expected pattern alias to exist");
+  ck_assert_msg(vroot_alias_exists("/other/foo") == FALSE,
+    "Expected no alias for '/other/foo'");
+}
+END_TEST
+
+START_TEST (alias_scan_patterns_test) {
+  int res;
+  array_header *names;
+  const char *src_dir = "/tmp/vroot-alias-scan.d";
+  register unsigned int i;
+  int found_a = FALSE, found_b = FALSE, found_sub = FALSE;
+
+  (void) mkdir(src_dir, 0755);
+  (void) mkdir("/tmp/vroot-alias-scan.d/a", 0755);
+  (void) mkdir("/tmp/vroot-alias-scan.d/b", 0755);
+
+  res = vroot_alias_add("/home/projects/p-*", "/tmp/vroot-alias-scan.d/$1");
+  ck_assert_msg(res == 0, "Failed to add pattern alias: %s", strerror(errno));
+
+  res = vroot_alias_add("/home/archive/2024/*", "/data/$1/2024");
+  ck_assert_msg(res == 0, "Failed to add pattern alias: %s", strerror(errno));
+
+  names = make_array(p, 0, sizeof(char *));
+  res = vroot_alias_scan_patterns(p, "/home/projects", names);
+  ck_assert_msg(res == 0, "Failed to scan pattern aliases: %s",
+    strerror(errno));
+
+  for (i = 0; i < names->nelts; i++) {
+    const char *name;
+
+    name = ((char **) names->elts)[i];
+    if (strcmp(name, "p-a") == 0) {
+      found_a = TRUE;
+
+    } else if (strcmp(name, "p-b") == 0) {
+      found_b = TRUE;
+
+    } else {
+      ck_assert_msg(FALSE, "Unexpected name '%s'", name);
+    }
+  }
+
+  ck_assert_msg(found_a == TRUE, "Expected 'p-a' name");
+  ck_assert_msg(found_b == TRUE, "Expected 'p-b' name");
+
+  /* Patterns whose names cannot be enumerated still need their directory. */
+  names = make_array(p, 0, sizeof(char *));
+  res = vroot_alias_scan_patterns(p, "/home", names);
+  ck_assert_msg(res == 0, "Failed to scan pattern aliases: %s",
+    strerror(errno));
+
+  for (i = 0; i < names->nelts; i++) {
+    const char *name;
+
+    name = ((char **) names->elts)[i];
+    if (strcmp(name, "archive") == 0) {
+      found_sub = TRUE;
+    }
+  }
+
+  ck_assert_msg(found_sub == TRUE, "Expected 'archive' name");
+
+  names = make_array(p, 0, sizeof(char *));
+  res = vroot_alias_scan_patterns(p, "/home/archive/2024", names);
+  ck_assert_msg(res == 0, "Failed to scan pattern aliases: %s",
+    strerror(errno));
+  ck_assert_msg(names->nelts == 0, "Expected no names, got %d",
+    names->nelts);
+
+  (void) rmdir("/tmp/vroot-alias-scan.d/a");
+  (void) rmdir("/tmp/vroot-alias-scan.d/b");
+  (void) rmdir(src_dir);
+}
+END_TEST
+
 Suite *tests_get_alias_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -149,6 +556,12 @@ Suite *tests_get_alias_suite(void) {
   tcase_add_test(testcase, alias_add_test);
   tcase_add_test(testcase, alias_get_test);
   tcase_add_test(testcase, alias_do_test);
+  tcase_add_test(testcase, alias_attrs_parse_test);
+  tcase_add_test(testcase, alias_attrs_parse_read_policy_test);
+  tcase_add_test(testcase, alias_attrs_parse_write_policy_test);
+  tcase_add_test(testcase, alias_attrs_test);
+  tcase_add_test(testcase, alias_pattern_test);
+  tcase_add_test(testcase, alias_scan_patterns_test);
 
   suite_add_tcase(suite, testcase);
   return suite;
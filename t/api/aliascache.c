@@ -0,0 +1,261 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* Alias cache tests. */
+
+#include "tests.h"
+#include "aliascache.h"
+
+static pool *p = NULL;
+
+static const char *aliascache_test_key = "0:1000:test:users:/tmp";
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.aliascache", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_aliascache_detach();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.aliascache", 0, 0);
+  }
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+static array_header *make_aliases(void) {
+  array_header *aliases;
+  struct vroot_aliascache_entry *entry;
+  struct vroot_alias_attrs *attrs;
+
+  aliases = make_array(p, 0, sizeof(struct vroot_aliascache_entry));
+
+  entry = push_array(aliases);
+  entry->dst_path = "/tmp/home/test/shared";
+  entry->src_path = "/srv/shared";
+  entry->attrs = NULL;
+
+  attrs = pcalloc(p, sizeof(struct vroot_alias_attrs));
+  attrs->metadata_rate = 100;
+  attrs->metadata_burst = 10;
+
+  entry = push_array(aliases);
+  entry->dst_path = "/tmp/home/test/archive";
+  entry->src_path = "/srv/archive";
+  entry->attrs = attrs;
+
+  return aliases;
+}
+
+/* Attaches in a child process, as another session of the same user would,
+ * optionally bumping the generation, and returns whether cached aliases were
+ * found.
+ */
+static int attach_child(const char *key, int bump) {
+  int res, status;
+  pid_t pid;
+
+  pid = fork();
+  ck_assert_msg(pid >= 0, "Failed to fork: %s", strerror(errno));
+
+  if (pid == 0) {
+    array_header *aliases;
+    struct vroot_aliascache_entry *entries;
+
+    aliases = vroot_aliascache_attach(p, key);
+    if (bump == TRUE) {
+      vroot_aliascache_bump();
+    }
+
+    if (aliases == NULL) {
+      _exit(errno == ENOENT ? 1 : 2);
+    }
+
+    entries = aliases->elts;
+    if (aliases->nelts != 2 ||
+        strcmp(entries[0].dst_path, "/tmp/home/test/shared") != 0 ||
+        strcmp(entries[0].src_path, "/srv/shared") != 0 ||
+        entries[0].attrs != NULL ||
+        strcmp(entries[1].src_path, "/srv/archive") != 0 ||
+        entries[1].attrs == NULL ||
+        entries[1].attrs->metadata_rate != 100 ||
+        entries[1].attrs->metadata_burst != 10) {
+      _exit(3);
+    }
+
+    (void) vroot_aliascache_detach();
+    _exit(0);
+  }
+
+  res = waitpid(pid, &status, 0);
+  ck_assert_msg(res == pid, "Failed to wait for child: %s", strerror(errno));
+  ck_assert_msg(WIFEXITED(status), "Child exited abnormally");
+  ck_assert_msg(WEXITSTATUS(status) <= 1, "Child failed (status %d)",
+    WEXITSTATUS(status));
+
+  return WEXITSTATUS(status) == 0 ? TRUE : FALSE;
+}
+
+START_TEST (aliascache_init_test) {
+  int res;
+
+  res = vroot_aliascache_init(0);
+  ck_assert_msg(res < 0, "Failed to handle zero users");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_aliascache_init(VROOT_ALIASCACHE_MAX_MAX_USERS + 1);
+  ck_assert_msg(res < 0, "Failed to handle too many users");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_aliascache_publish(make_aliases());
+  ck_assert_msg(res < 0, "Failed to handle unattached session");
+  ck_assert_msg(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = vroot_aliascache_init(VROOT_ALIASCACHE_DEFAULT_MAX_USERS);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (aliascache_shared_test) {
+  int res;
+  array_header *aliases;
+
+  res = vroot_aliascache_init(VROOT_ALIASCACHE_DEFAULT_MAX_USERS);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+
+  aliases = vroot_aliascache_attach(p, aliascache_test_key);
+  ck_assert_msg(aliases == NULL, "Found unexpected cached aliases");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_aliascache_publish(make_aliases());
+  ck_assert_msg(res == 0, "Failed to publish aliases: %s", strerror(errno));
+
+  /* Another session of the same user uses the published aliases... */
+  res = attach_child(aliascache_test_key, FALSE);
+  ck_assert_msg(res == TRUE, "Expected cached aliases for other session");
+
+  /* ...but not a session of a different user. */
+  res = attach_child("0:1001:other:users:/tmp", FALSE);
+  ck_assert_msg(res == FALSE, "Expected no cached aliases for other user");
+
+  /* Nor after the configuration was re-read. */
+  res = vroot_aliascache_init(VROOT_ALIASCACHE_DEFAULT_MAX_USERS);
+  ck_assert_msg(res == 0, "Failed to re-read cache: %s", strerror(errno));
+
+  res = attach_child(aliascache_test_key, FALSE);
+  ck_assert_msg(res == FALSE, "Expected no cached aliases after reconfigure");
+}
+END_TEST
+
+START_TEST (aliascache_bump_test) {
+  int res;
+  array_header *aliases;
+
+  res = vroot_aliascache_init(VROOT_ALIASCACHE_DEFAULT_MAX_USERS);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+
+  aliases = vroot_aliascache_attach(p, aliascache_test_key);
+  ck_assert_msg(aliases == NULL, "Found unexpected cached aliases");
+
+  /* A sibling changing the filesystem, while the aliases are expanded,
+   * prevents publishing them.
+   */
+  res = attach_child(aliascache_test_key, TRUE);
+  ck_assert_msg(res == FALSE, "Expected no cached aliases");
+
+  res = vroot_aliascache_publish(make_aliases());
+  ck_assert_msg(res < 0, "Published aliases unexpectedly");
+  ck_assert_msg(errno == EAGAIN, "Expected EAGAIN (%d), got %s (%d)", EAGAIN,
+    strerror(errno), errno);
+
+  aliases = vroot_aliascache_attach(p, aliascache_test_key);
+  ck_assert_msg(aliases == NULL, "Found unexpected cached aliases");
+
+  res = vroot_aliascache_publish(make_aliases());
+  ck_assert_msg(res == 0, "Failed to publish aliases: %s", strerror(errno));
+
+  /* Changing the filesystem discards the published aliases. */
+  vroot_aliascache_bump();
+
+  res = attach_child(aliascache_test_key, FALSE);
+  ck_assert_msg(res == FALSE, "Expected no cached aliases after change");
+}
+END_TEST
+
+START_TEST (aliascache_detach_test) {
+  int res;
+  array_header *aliases;
+
+  res = vroot_aliascache_init(VROOT_ALIASCACHE_DEFAULT_MAX_USERS);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+
+  res = vroot_aliascache_detach();
+  ck_assert_msg(res == 0, "Failed to detach unattached session: %s",
+    strerror(errno));
+
+  aliases = vroot_aliascache_attach(p, aliascache_test_key);
+  ck_assert_msg(aliases == NULL, "Found unexpected cached aliases");
+
+  res = vroot_aliascache_publish(make_aliases());
+  ck_assert_msg(res == 0, "Failed to publish aliases: %s", strerror(errno));
+
+  /* Once the last session of the user is gone, so are its aliases. */
+  res = vroot_aliascache_detach();
+  ck_assert_msg(res == 0, "Failed to detach: %s", strerror(errno));
+
+  res = attach_child(aliascache_test_key, FALSE);
+  ck_assert_msg(res == FALSE, "Expected no cached aliases after detach");
+}
+END_TEST
+
+Suite *tests_get_aliascache_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("aliascache");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, aliascache_init_test);
+  tcase_add_test(testcase, aliascache_shared_test);
+  tcase_add_test(testcase, aliascache_bump_test);
+  tcase_add_test(testcase, aliascache_detach_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,336 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Cache tier tests. */
+
+#include "tests.h"
+#include "cachetier.h"
+
+static pool *p = NULL;
+
+static const char *cachetier_src_dir = "/tmp/vroot-cachetier-src.d";
+static const char *cachetier_src_file = "/tmp/vroot-cachetier-src.d/file.txt";
+static const char *cachetier_src_file2 = "/tmp/vroot-cachetier-src.d/file2.txt";
+static const char *cachetier_cache_dir = "/tmp/vroot-cachetier-cache.d";
+
+static void test_cleanup(void) {
+  tests_remove_dir(cachetier_cache_dir);
+  tests_remove_dir(cachetier_src_dir);
+}
+
+static void write_file(const char *path, const char *text, time_t mtime) {
+  struct timeval tvs[2];
+
+  tests_write_file(path, text);
+
+  tvs[0].tv_sec = tvs[1].tv_sec = mtime;
+  tvs[0].tv_usec = tvs[1].tv_usec = 0;
+  (void) utimes(path, tvs);
+}
+
+/* Gives all of the cached copies, and sidecar files, to the given user. */
+static void chown_cache_files(uid_t uid) {
+  DIR *dirh;
+  struct dirent *dent;
+
+  dirh = opendir(cachetier_cache_dir);
+  ck_assert_msg(dirh != NULL, "Failed to open '%s': %s", cachetier_cache_dir,
+    strerror(errno));
+  while ((dent = readdir(dirh)) != NULL) {
+    char path[PR_TUNABLE_PATH_MAX + 1];
+
+    if (dent->d_name[0] == '.') {
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", cachetier_cache_dir, dent->d_name);
+    (void) chown(path, uid, (gid_t) -1);
+  }
+  (void) closedir(dirh);
+}
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  session.pool = p;
+  test_cleanup();
+
+  (void) mkdir(cachetier_src_dir, 0755);
+  (void) mkdir(cachetier_cache_dir, 0755);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.cachetier", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_cachetier_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.cachetier", 0, 0);
+  }
+
+  test_cleanup();
+  session.pool = NULL;
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (cachetier_add_test) {
+  int res;
+
+  res = vroot_cachetier_add(NULL, NULL, 0, 0);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_cachetier_add(cachetier_src_dir, "cache.d", 1024, 0);
+  ck_assert_msg(res < 0, "Failed to handle relative cache directory");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  ck_assert_msg(vroot_cachetier_count() == 0, "Expected no cache tiers");
+
+  res = vroot_cachetier_add(cachetier_src_dir, cachetier_cache_dir, 1024, 0);
+  ck_assert_msg(res == 0, "Failed to add cache tier: %s", strerror(errno));
+  ck_assert_msg(vroot_cachetier_count() == 1, "Expected 1 cache tier");
+
+  /* Paths outside of the source directory are not cached. */
+  res = vroot_cachetier_open("/etc/hosts");
+  ck_assert_msg(res < 0, "Failed to handle uncached path");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (cachetier_open_test) {
+  int fd, res;
+  char buf[32];
+  ssize_t len;
+
+  write_file(cachetier_src_file, "Hello, World!\n", 1000000);
+
+  res = vroot_cachetier_add(cachetier_src_dir, cachetier_cache_dir, 1024, 0);
+  ck_assert_msg(res == 0, "Failed to add cache tier: %s", strerror(errno));
+
+  /* The first open misses, and copies the file into the cache. */
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Unexpectedly found cached copy");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_cachetier_wait();
+  ck_assert_msg(res == 0, "Failed to cache copy: %s", strerror(errno));
+
+  /* Then the cached copy is used. */
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd >= 0, "Failed to open cached copy: %s", strerror(errno));
+
+  len = read(fd, buf, sizeof(buf) - 1);
+  (void) close(fd);
+  ck_assert_msg(len == 14, "Expected 14 bytes, read %d", (int) len);
+  buf[len] = '\0';
+  ck_assert_msg(strcmp(buf, "Hello, World!\n") == 0,
+    "Expected cached data, got '%s'", buf);
+
+  /* Once the source is changed, the cached copy is no longer used. */
+  write_file(cachetier_src_file, "Goodbye, World!\n", 2000000);
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Unexpectedly used stale cached copy");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_cachetier_wait();
+  ck_assert_msg(res == 0, "Failed to cache copy: %s", strerror(errno));
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd >= 0, "Failed to open cached copy: %s", strerror(errno));
+  (void) close(fd);
+
+  /* Changing the permissions of the source, which leaves its size and
+   * modification time as is, also makes the cached copy stale.
+   */
+  usleep(10000);
+  (void) chmod(cachetier_src_file, 0640);
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Unexpectedly used cached copy after chmod");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_cachetier_wait();
+  ck_assert_msg(res == 0, "Failed to cache copy: %s", strerror(errno));
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd >= 0, "Failed to open cached copy: %s", strerror(errno));
+  (void) close(fd);
+
+  /* Invalidated copies are discarded. */
+  vroot_cachetier_invalidate(cachetier_src_file);
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Unexpectedly used invalidated cached copy");
+  (void) vroot_cachetier_wait();
+}
+END_TEST
+
+START_TEST (cachetier_stat_test) {
+  int fd, res;
+  struct stat st;
+
+  write_file(cachetier_src_file, "Hello, World!\n", 1000000);
+
+  res = vroot_cachetier_add(cachetier_src_dir, cachetier_cache_dir, 1024, 60);
+  ck_assert_msg(res == 0, "Failed to add cache tier: %s", strerror(errno));
+
+  res = vroot_cachetier_stat(cachetier_src_file, &st);
+  ck_assert_msg(res < 0, "Unexpectedly found cached metadata");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Unexpectedly found cached copy");
+  res = vroot_cachetier_wait();
+  ck_assert_msg(res == 0, "Failed to cache copy: %s", strerror(errno));
+
+  /* The metadata is that of the source, without looking at the source. */
+  (void) unlink(cachetier_src_file);
+
+  res = vroot_cachetier_stat(cachetier_src_file, &st);
+  ck_assert_msg(res == 0, "Failed to use cached metadata: %s",
+    strerror(errno));
+  ck_assert_msg(st.st_size == 14, "Expected size 14, got %lu",
+    (unsigned long) st.st_size);
+  ck_assert_msg(st.st_mtime == 1000000, "Expected mtime 1000000, got %lu",
+    (unsigned long) st.st_mtime);
+  ck_assert_msg(S_ISREG(st.st_mode), "Expected regular file");
+
+  if (geteuid() != 0) {
+    return;
+  }
+
+  /* As for stat(2), users who cannot search the source directory do not
+   * see the cached metadata.
+   */
+  (void) chmod(cachetier_src_dir, 0700);
+  (void) seteuid(65534);
+  res = vroot_cachetier_stat(cachetier_src_file, &st);
+  (void) seteuid(0);
+  ck_assert_msg(res < 0, "Unexpectedly used cached metadata without access");
+  ck_assert_msg(errno == EACCES, "Expected EACCES (%d), got %s (%d)", EACCES,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (cachetier_trust_test) {
+  int fd, res;
+  struct stat st;
+
+  if (geteuid() != 0) {
+    return;
+  }
+
+  write_file(cachetier_src_file, "Hello, World!\n", 1000000);
+
+  res = vroot_cachetier_add(cachetier_src_dir, cachetier_cache_dir, 1024, 60);
+  ck_assert_msg(res == 0, "Failed to add cache tier: %s", strerror(errno));
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Unexpectedly found cached copy");
+  res = vroot_cachetier_wait();
+  ck_assert_msg(res == 0, "Failed to cache copy: %s", strerror(errno));
+
+  /* Copies, and sidecar files, made by another user are not trusted. */
+  chown_cache_files(65534);
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Unexpectedly used cached copy made by another user");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+  (void) vroot_cachetier_wait();
+
+  chown_cache_files(65534);
+
+  res = vroot_cachetier_stat(cachetier_src_file, &st);
+  ck_assert_msg(res < 0,
+    "Unexpectedly used cached metadata made by another user");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (cachetier_evict_test) {
+  int fd, res;
+
+  write_file(cachetier_src_file, "0123456789", 1000000);
+  write_file(cachetier_src_file2, "abcdefghij", 1000000);
+
+  /* Only one of the files fits in the cache at a time. */
+  res = vroot_cachetier_add(cachetier_src_dir, cachetier_cache_dir, 15, 0);
+  ck_assert_msg(res == 0, "Failed to add cache tier: %s", strerror(errno));
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Unexpectedly found cached copy");
+  res = vroot_cachetier_wait();
+  ck_assert_msg(res == 0, "Failed to cache copy: %s", strerror(errno));
+
+  fd = vroot_cachetier_open(cachetier_src_file2);
+  ck_assert_msg(fd < 0, "Unexpectedly found cached copy");
+  res = vroot_cachetier_wait();
+  ck_assert_msg(res == 0, "Failed to cache copy: %s", strerror(errno));
+
+  fd = vroot_cachetier_open(cachetier_src_file2);
+  ck_assert_msg(fd >= 0, "Failed to open cached copy: %s", strerror(errno));
+  (void) close(fd);
+
+  fd = vroot_cachetier_open(cachetier_src_file);
+  ck_assert_msg(fd < 0, "Failed to evict least recently used copy");
+  (void) vroot_cachetier_wait();
+}
+END_TEST
+
+Suite *tests_get_cachetier_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("cachetier");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, cachetier_add_test);
+  tcase_add_test(testcase, cachetier_open_test);
+  tcase_add_test(testcase, cachetier_stat_test);
+  tcase_add_test(testcase, cachetier_trust_test);
+  tcase_add_test(testcase, cachetier_evict_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
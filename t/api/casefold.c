@@ -0,0 +1,233 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* Case folding tests. */
+
+#include "tests.h"
+#include "casefold.h"
+
+static pool *p = NULL;
+
+static const char *casefold_test_dir = "/tmp/vroot-casefold-test.d";
+static const char *casefold_test_subdir = "/tmp/vroot-casefold-test.d/SubDir";
+static const char *casefold_test_file =
+  "/tmp/vroot-casefold-test.d/SubDir/File.TXT";
+static const char *casefold_test_file2 =
+  "/tmp/vroot-casefold-test.d/SubDir/Added.txt";
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  session.pool = p;
+
+  (void) mkdir(casefold_test_dir, 0755);
+  (void) mkdir(casefold_test_subdir, 0755);
+  tests_write_file(casefold_test_file, "");
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.casefold", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_casefold_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.casefold", 0, 0);
+  }
+
+  tests_remove_dir(casefold_test_dir);
+
+  session.pool = NULL;
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (casefold_lookup_test) {
+  int res;
+  char path[PR_TUNABLE_PATH_MAX + 1];
+
+  res = vroot_casefold_lookup(NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  sstrncpy(path, "SubDir/File.TXT", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res < 0, "Failed to handle relative path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Existing paths are left as is. */
+  sstrncpy(path, casefold_test_file, sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, casefold_test_file) == 0,
+    "Expected '%s', got '%s'", casefold_test_file, path);
+
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/subdir/file.txt", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, casefold_test_file) == 0,
+    "Expected '%s', got '%s'", casefold_test_file, path);
+
+  sstrncpy(path, "/tmp/VROOT-CASEFOLD-TEST.D/SUBDIR/FILE.txt", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, casefold_test_file) == 0,
+    "Expected '%s', got '%s'", casefold_test_file, path);
+
+  /* New names keep their case; only the existing components are mapped. */
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/subdir/New/Name.txt",
+    sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(
+    strcmp(path, "/tmp/vroot-casefold-test.d/SubDir/New/Name.txt") == 0,
+    "Expected '%s', got '%s'", "/tmp/vroot-casefold-test.d/SubDir/New/Name.txt",
+    path);
+}
+END_TEST
+
+START_TEST (casefold_add_remove_test) {
+  int res;
+  char path[PR_TUNABLE_PATH_MAX + 1];
+
+  res = vroot_casefold_add(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_casefold_remove(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Index the directory. */
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/SubDir/file.txt", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+
+  tests_write_file(casefold_test_file2, "");
+  res = vroot_casefold_add(casefold_test_file2);
+  ck_assert_msg(res == 0, "Failed to add '%s': %s", casefold_test_file2,
+    strerror(errno));
+
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/SubDir/ADDED.TXT", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, casefold_test_file2) == 0,
+    "Expected '%s', got '%s'", casefold_test_file2, path);
+
+  (void) unlink(casefold_test_file2);
+  res = vroot_casefold_remove(casefold_test_file2);
+  ck_assert_msg(res == 0, "Failed to remove '%s': %s", casefold_test_file2,
+    strerror(errno));
+
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/SubDir/ADDED.TXT", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(
+    strcmp(path, "/tmp/vroot-casefold-test.d/SubDir/ADDED.TXT") == 0,
+    "Expected '%s', got '%s'", "/tmp/vroot-casefold-test.d/SubDir/ADDED.TXT",
+    path);
+}
+END_TEST
+
+START_TEST (casefold_changed_dir_test) {
+  int res;
+  char path[PR_TUNABLE_PATH_MAX + 1];
+
+  /* Index the directory... */
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/SubDir/file.txt", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+
+  /* ...then change it behind our back. */
+  sleep(1);
+  tests_write_file(casefold_test_file2, "");
+
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/SubDir/added.TXT", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, casefold_test_file2) == 0,
+    "Expected '%s', got '%s'", casefold_test_file2, path);
+}
+END_TEST
+
+START_TEST (casefold_restamp_test) {
+  int res;
+  time_t now;
+  char path[PR_TUNABLE_PATH_MAX + 1];
+  const char *other_file = "/tmp/vroot-casefold-test.d/SubDir/Other.txt";
+
+  /* Index the directory, once its last change is in the past... */
+  sleep(2);
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/SubDir/file.txt", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+
+  /* ...then, within the same second, add a file ourselves, and have another
+   * be added behind our back.
+   */
+  now = time(NULL);
+  while (time(NULL) == now) {
+    usleep(1000);
+  }
+
+  tests_write_file(casefold_test_file2, "");
+  res = vroot_casefold_add(casefold_test_file2);
+  ck_assert_msg(res == 0, "Failed to add '%s': %s", casefold_test_file2,
+    strerror(errno));
+  tests_write_file(other_file, "");
+
+  sstrncpy(path, "/tmp/vroot-casefold-test.d/SubDir/OTHER.TXT", sizeof(path));
+  res = vroot_casefold_lookup(path, sizeof(path));
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, other_file) == 0, "Expected '%s', got '%s'",
+    other_file, path);
+}
+END_TEST
+
+Suite *tests_get_casefold_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("casefold");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, casefold_lookup_test);
+  tcase_add_test(testcase, casefold_add_remove_test);
+  tcase_add_test(testcase, casefold_changed_dir_test);
+  tcase_add_test(testcase, casefold_restamp_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
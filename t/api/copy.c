@@ -0,0 +1,193 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* Copy tests. */
+
+#include "tests.h"
+#include "copy.h"
+
+static pool *p = NULL;
+
+static const char *copy_test_dir = "/tmp/vroot-copy-test.d";
+static const char *copy_src_path = "/tmp/vroot-copy-test.d/src.txt";
+static const char *copy_dst_path = "/tmp/vroot-copy-test.d/dst.txt";
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  (void) mkdir(copy_test_dir, 0755);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.copy", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.copy", 0, 0);
+  }
+
+  (void) unlink(copy_src_path);
+  (void) unlink(copy_dst_path);
+  (void) rmdir(copy_test_dir);
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+static void write_file(const char *path, const char *data, size_t datalen,
+    mode_t mode) {
+  int fd, res;
+
+  fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, mode);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", path, strerror(errno));
+
+  res = write(fd, data, datalen);
+  ck_assert_msg(res == (int) datalen, "Failed to write '%s': %s", path,
+    strerror(errno));
+
+  (void) close(fd);
+}
+
+START_TEST (copy_file_test) {
+  int fd, res;
+  struct stat st;
+  struct timeval tvs[2];
+  char buf[64];
+  const char *data = "Hello, World!\n";
+
+  mark_point();
+  res = vroot_copy_file(p, NULL, NULL, 0, 0);
+  ck_assert_msg(res < 0, "Failed to handle null paths");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_copy_file(p, copy_src_path, copy_dst_path, 0, 0);
+  ck_assert_msg(res < 0, "Failed to handle nonexistent source");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_copy_file(p, copy_test_dir, copy_dst_path, 0, 0);
+  ck_assert_msg(res < 0, "Failed to handle directory source");
+  ck_assert_msg(errno == EXDEV, "Expected EXDEV (%d), got '%s' (%d)", EXDEV,
+    strerror(errno), errno);
+
+  write_file(copy_src_path, data, strlen(data), 0640);
+  (void) chmod(copy_src_path, 0640);
+
+  tvs[0].tv_sec = tvs[1].tv_sec = 1000000000;
+  tvs[0].tv_usec = tvs[1].tv_usec = 0;
+  res = utimes(copy_src_path, tvs);
+  ck_assert_msg(res == 0, "Failed to set times on '%s': %s", copy_src_path,
+    strerror(errno));
+
+  mark_point();
+  res = vroot_copy_file(p, copy_src_path, copy_dst_path, 4, 0);
+  ck_assert_msg(res < 0, "Failed to handle file exceeding max size");
+  ck_assert_msg(errno == EFBIG, "Expected EFBIG (%d), got '%s' (%d)", EFBIG,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_copy_file(p, copy_src_path, copy_dst_path, 0, 0);
+  ck_assert_msg(res == 0, "Failed to copy '%s' to '%s': %s", copy_src_path,
+    copy_dst_path, strerror(errno));
+
+  res = stat(copy_dst_path, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", copy_dst_path,
+    strerror(errno));
+  ck_assert_msg((st.st_mode & 07777) == 0640, "Expected mode 0640, got %04o",
+    (unsigned int) (st.st_mode & 07777));
+  ck_assert_msg(st.st_mtime == 1000000000, "Expected mtime 1000000000, got %lu",
+    (unsigned long) st.st_mtime);
+
+  memset(buf, '\0', sizeof(buf));
+  fd = open(copy_dst_path, O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", copy_dst_path,
+    strerror(errno));
+  res = read(fd, buf, sizeof(buf)-1);
+  (void) close(fd);
+  ck_assert_msg(strcmp(buf, data) == 0, "Expected '%s', got '%s'", data, buf);
+
+  /* The source is left for the caller to remove. */
+  res = stat(copy_src_path, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", copy_src_path,
+    strerror(errno));
+}
+END_TEST
+
+START_TEST (copy_file_noreplace_test) {
+  int res;
+  struct stat st;
+  const char *data = "Hello, World!\n";
+
+  write_file(copy_src_path, data, strlen(data), 0644);
+  write_file(copy_dst_path, "foo", 3, 0644);
+
+  mark_point();
+  res = vroot_copy_file(p, copy_src_path, copy_dst_path, 0,
+    VROOT_COPY_FL_NOREPLACE);
+  ck_assert_msg(res < 0, "Failed to handle existing destination");
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got '%s' (%d)", EEXIST,
+    strerror(errno), errno);
+
+  res = stat(copy_dst_path, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", copy_dst_path,
+    strerror(errno));
+  ck_assert_msg(st.st_size == 3, "Expected size 3, got %lu",
+    (unsigned long) st.st_size);
+
+  /* Without the flag, the destination is replaced. */
+  mark_point();
+  res = vroot_copy_file(p, copy_src_path, copy_dst_path, 0, 0);
+  ck_assert_msg(res == 0, "Failed to copy '%s' to '%s': %s", copy_src_path,
+    copy_dst_path, strerror(errno));
+
+  res = stat(copy_dst_path, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", copy_dst_path,
+    strerror(errno));
+  ck_assert_msg(st.st_size == (off_t) strlen(data), "Expected size %lu, got %lu",
+    (unsigned long) strlen(data), (unsigned long) st.st_size);
+}
+END_TEST
+
+Suite *tests_get_copy_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("copy");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, copy_file_test);
+  tcase_add_test(testcase, copy_file_noreplace_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
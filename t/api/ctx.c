@@ -0,0 +1,231 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+/* Context tests. */
+
+#include "tests.h"
+#include "ctx.h"
+#include "path.h"
+#include "alias.h"
+#include "hide.h"
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.path", 1, 20);
+    pr_trace_set_levels("vroot.alias", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.path", 0, 0);
+    pr_trace_set_levels("vroot.alias", 0, 0);
+  }
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (ctx_alloc_test) {
+  int res;
+  struct vroot_ctx *ctx;
+
+  mark_point();
+  ctx = vroot_ctx_alloc(NULL);
+  ck_assert_msg(ctx == NULL, "Failed to handle null pool");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  ctx = vroot_ctx_alloc(p);
+  ck_assert_msg(ctx != NULL, "Failed to allocate context: %s",
+    strerror(errno));
+  ck_assert_msg(vroot_path_ctx_have_base(ctx) == FALSE,
+    "Have vroot base unexpectedly");
+  ck_assert_msg(vroot_alias_ctx_count(ctx) == 0, "Have aliases unexpectedly");
+
+  mark_point();
+  res = vroot_ctx_destroy(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null context");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_ctx_destroy(vroot_ctx_get_default());
+  ck_assert_msg(res < 0, "Failed to handle default context");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_ctx_destroy(ctx);
+  ck_assert_msg(res == 0, "Failed to destroy context: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (ctx_path_lookup_test) {
+  int res;
+  char vpath[PR_TUNABLE_PATH_MAX + 1];
+  const char *path, *expected;
+  struct vroot_ctx *ctx1, *ctx2;
+
+  ctx1 = vroot_ctx_alloc(p);
+  ctx2 = vroot_ctx_alloc(p);
+
+  mark_point();
+  res = vroot_path_ctx_lookup(NULL, p, vpath, sizeof(vpath), "/", 0, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null context");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_path_ctx_set_base(ctx1, "/chroot1", 8);
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  res = vroot_path_ctx_set_base(ctx2, "/chroot2", 8);
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  /* Setting the base of a context must not affect the default context. */
+  ck_assert_msg(vroot_path_have_base() == FALSE,
+    "Have default vroot base unexpectedly");
+
+  res = vroot_alias_ctx_add(ctx2, "/chroot2/foo", "/var/ftp/foo");
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  mark_point();
+  path = "/foo/bar";
+  expected = "/chroot1/foo/bar";
+  res = vroot_path_ctx_lookup(ctx1, p, vpath, sizeof(vpath), path, 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(vpath, expected) == 0, "Expected '%s', got '%s'",
+    expected, vpath);
+
+  mark_point();
+  expected = "/var/ftp/foo/bar";
+  res = vroot_path_ctx_lookup(ctx2, p, vpath, sizeof(vpath), path, 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(vpath, expected) == 0, "Expected '%s', got '%s'",
+    expected, vpath);
+
+  mark_point();
+  expected = "/chroot2/foo/bar";
+  res = vroot_path_ctx_lookup(ctx2, p, vpath, sizeof(vpath), path,
+    VROOT_LOOKUP_FL_NO_ALIAS, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(vpath, expected) == 0, "Expected '%s', got '%s'",
+    expected, vpath);
+
+  (void) vroot_ctx_destroy(ctx2);
+  (void) vroot_ctx_destroy(ctx1);
+}
+END_TEST
+
+START_TEST (ctx_path_lookup_state_test) {
+  int res;
+  char vpath[PR_TUNABLE_PATH_MAX + 1];
+  const char *path, *expected;
+  array_header *patterns;
+  struct vroot_ctx *ctx1, *ctx2;
+
+  ctx1 = vroot_ctx_alloc(p);
+  ctx2 = vroot_ctx_alloc(p);
+
+  (void) vroot_path_ctx_set_base(ctx1, "/chroot1", 8);
+  (void) vroot_path_ctx_set_base(ctx2, "/chroot2", 8);
+
+  /* The current directory, and hidden names, are those of the context. */
+  ctx1->cwd = "/foo";
+  ctx2->cwd = "/bar";
+
+  patterns = make_array(p, 1, sizeof(char *));
+  *((char **) push_array(patterns)) = "*.tmp";
+  ctx1->hide = vroot_hide_compile(p, patterns, 0);
+  ck_assert_msg(ctx1->hide != NULL, "Failed to compile patterns: %s",
+    strerror(errno));
+
+  mark_point();
+  path = ".";
+  expected = "/chroot1/foo";
+  res = vroot_path_ctx_lookup(ctx1, p, vpath, sizeof(vpath), path, 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(vpath, expected) == 0, "Expected '%s', got '%s'",
+    expected, vpath);
+
+  mark_point();
+  expected = "/chroot2/bar";
+  res = vroot_path_ctx_lookup(ctx2, p, vpath, sizeof(vpath), path, 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(vpath, expected) == 0, "Expected '%s', got '%s'",
+    expected, vpath);
+
+  mark_point();
+  path = "/upload/file.tmp";
+  res = vroot_path_ctx_lookup(ctx1, p, vpath, sizeof(vpath), path, 0, NULL);
+  ck_assert_msg(res < 0, "Failed to hide '%s'", path);
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  mark_point();
+  expected = "/chroot2/upload/file.tmp";
+  res = vroot_path_ctx_lookup(ctx2, p, vpath, sizeof(vpath), path, 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(vpath, expected) == 0, "Expected '%s', got '%s'",
+    expected, vpath);
+
+  /* Nor do lookups using the default context change them. */
+  (void) vroot_path_set_base("/chroot3", 8);
+  res = vroot_path_lookup(p, vpath, sizeof(vpath), path, 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(ctx2->cwd, "/bar") == 0, "Expected '/bar', got '%s'",
+    ctx2->cwd);
+  (void) vroot_path_set_base("", 0);
+
+  (void) vroot_ctx_destroy(ctx2);
+  (void) vroot_ctx_destroy(ctx1);
+}
+END_TEST
+
+Suite *tests_get_ctx_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("ctx");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, ctx_alloc_test);
+  tcase_add_test(testcase, ctx_path_lookup_test);
+  tcase_add_test(testcase, ctx_path_lookup_state_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,248 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* Directory cache tests. */
+
+#include "tests.h"
+#include "dircache.h"
+
+static pool *p = NULL;
+
+static const char *dircache_test_dir = "/tmp/vroot-dircache-test.d";
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  (void) mkdir(dircache_test_dir, 0755);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.dircache", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.dircache", 0, 0);
+  }
+
+  (void) rmdir(dircache_test_dir);
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+/* Gets the attributes of the test directory, backdated so that its listing
+ * may be cached.
+ */
+static void get_test_dir_stat(struct stat *st) {
+  struct timeval tvs[2];
+  int res;
+
+  tvs[0].tv_sec = tvs[1].tv_sec = time(NULL) - 60;
+  tvs[0].tv_usec = tvs[1].tv_usec = 0;
+
+  res = utimes(dircache_test_dir, tvs);
+  ck_assert_msg(res == 0, "Failed to set times on '%s': %s",
+    dircache_test_dir, strerror(errno));
+
+  res = stat(dircache_test_dir, st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", dircache_test_dir,
+    strerror(errno));
+
+  /* The ctime cannot be backdated; pretend it was. */
+  st->st_ctime -= 60;
+}
+
+static struct vroot_dircache_listing *record_listing(struct stat *st) {
+  struct vroot_dircache_listing *listing;
+  int res;
+
+  listing = vroot_dircache_open(p, st);
+  ck_assert_msg(listing != NULL, "Failed to open listing: %s",
+    strerror(errno));
+
+  res = vroot_dircache_add(listing, "foo.txt", 7, 8);
+  ck_assert_msg(res == 0, "Failed to add entry: %s", strerror(errno));
+
+  res = vroot_dircache_add(listing, "bar.d", 9, 4);
+  ck_assert_msg(res == 0, "Failed to add entry: %s", strerror(errno));
+
+  return listing;
+}
+
+START_TEST (dircache_listing_test) {
+  int res;
+  struct vroot_dircache_listing *listing;
+  struct stat st;
+  const char *name;
+  ino_t ino = 0;
+  unsigned char type = 0;
+
+  mark_point();
+  listing = vroot_dircache_open(NULL, NULL);
+  ck_assert_msg(listing == NULL, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  get_test_dir_stat(&st);
+  listing = record_listing(&st);
+
+  /* Without the shared cache, nothing is stored. */
+  res = vroot_dircache_put(listing, &st);
+  ck_assert_msg(res < 0, "Failed to handle missing cache");
+  ck_assert_msg(errno == EPERM, "Expected EPERM (%d), got '%s' (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = vroot_dircache_init(1024);
+  ck_assert_msg(res < 0, "Failed to handle too small cache");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_dircache_init(VROOT_DIRCACHE_DEFAULT_SIZE);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+
+  ck_assert_msg(vroot_dircache_get(p, &st) == NULL,
+    "Unexpectedly found cached listing");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_dircache_put(listing, &st);
+  ck_assert_msg(res == 0, "Failed to cache listing: %s", strerror(errno));
+  (void) vroot_dircache_close(listing);
+
+  listing = vroot_dircache_get(p, &st);
+  ck_assert_msg(listing != NULL, "Failed to get cached listing: %s",
+    strerror(errno));
+
+  name = vroot_dircache_next(listing, &ino, &type);
+  ck_assert_msg(name != NULL, "Expected entry, got none");
+  ck_assert_msg(strcmp(name, "foo.txt") == 0, "Expected 'foo.txt', got '%s'",
+    name);
+  ck_assert_msg(ino == 7, "Expected inode 7, got %lu", (unsigned long) ino);
+  ck_assert_msg(type == 8, "Expected type 8, got %u", type);
+
+  name = vroot_dircache_next(listing, &ino, &type);
+  ck_assert_msg(name != NULL, "Expected entry, got none");
+  ck_assert_msg(strcmp(name, "bar.d") == 0, "Expected 'bar.d', got '%s'",
+    name);
+
+  name = vroot_dircache_next(listing, NULL, NULL);
+  ck_assert_msg(name == NULL, "Expected end of listing, got '%s'", name);
+  (void) vroot_dircache_close(listing);
+
+  /* Once the directory changes, its cached listing is no longer used. */
+  st.st_mtime++;
+  ck_assert_msg(vroot_dircache_get(p, &st) == NULL,
+    "Unexpectedly found stale cached listing");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (dircache_put_changed_test) {
+  int res;
+  struct vroot_dircache_listing *listing;
+  struct stat st, changed_st;
+
+  res = vroot_dircache_init(VROOT_DIRCACHE_DEFAULT_SIZE);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+
+  get_test_dir_stat(&st);
+  listing = record_listing(&st);
+
+  /* A directory changed while being read is not cached... */
+  memcpy(&changed_st, &st, sizeof(struct stat));
+  changed_st.st_mtime++;
+
+  res = vroot_dircache_put(listing, &changed_st);
+  ck_assert_msg(res < 0, "Failed to handle changed directory");
+  ck_assert_msg(errno == EAGAIN, "Expected EAGAIN (%d), got '%s' (%d)", EAGAIN,
+    strerror(errno), errno);
+
+  /* ...nor is a directory changed too recently. */
+  st.st_mtime = time(NULL);
+  (void) vroot_dircache_close(listing);
+  listing = record_listing(&st);
+
+  res = vroot_dircache_put(listing, &st);
+  ck_assert_msg(res < 0, "Failed to handle recently changed directory");
+  ck_assert_msg(errno == EAGAIN, "Expected EAGAIN (%d), got '%s' (%d)", EAGAIN,
+    strerror(errno), errno);
+
+  (void) vroot_dircache_close(listing);
+}
+END_TEST
+
+START_TEST (dircache_shared_test) {
+  int res, status;
+  struct vroot_dircache_listing *listing;
+  struct stat st;
+  pid_t pid;
+
+  res = vroot_dircache_init(VROOT_DIRCACHE_DEFAULT_SIZE);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+
+  get_test_dir_stat(&st);
+
+  /* A listing cached by one session is used by the others. */
+  pid = fork();
+  ck_assert_msg(pid >= 0, "Failed to fork: %s", strerror(errno));
+
+  if (pid == 0) {
+    listing = record_listing(&st);
+    res = vroot_dircache_put(listing, &st);
+    _exit(res == 0 ? 0 : 1);
+  }
+
+  res = waitpid(pid, &status, 0);
+  ck_assert_msg(res == pid, "Failed to wait for child: %s", strerror(errno));
+  ck_assert_msg(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+    "Child failed to cache listing");
+
+  listing = vroot_dircache_get(p, &st);
+  ck_assert_msg(listing != NULL, "Failed to get shared cached listing: %s",
+    strerror(errno));
+  (void) vroot_dircache_close(listing);
+}
+END_TEST
+
+Suite *tests_get_dircache_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("dircache");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, dircache_listing_test);
+  tcase_add_test(testcase, dircache_put_changed_test);
+  tcase_add_test(testcase, dircache_shared_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -26,20 +26,62 @@
 
 #include "tests.h"
 #include "fsio.h"
+#include "path.h"
+#include "alias.h"
+#include "dircache.h"
+#include "throttle.h"
+#include "virtdir.h"
+#include "shard.h"
+#include "cachetier.h"
+#include "staging.h"
+#include "spread.h"
+#include "mirror.h"
 
 static pool *p = NULL;
 
+static const char *fsio_test_dir = "/tmp/vroot-fsio-test.d";
+static const char *fsio_alias_dir = "/tmp/vroot-fsio-alias.d";
+
 static void set_up(void) {
   if (p == NULL) {
     p = make_sub_pool(NULL);
   }
 
+  (void) mkdir(fsio_test_dir, 0755);
+
   if (getenv("TEST_VERBOSE") != NULL) {
     pr_trace_set_levels("vroot.fsio", 1, 20);
   }
 }
 
 static void tear_down(void) {
+  char path[PR_TUNABLE_PATH_MAX+1];
+
+  (void) vroot_fsio_discard_tmpfile();
+  (void) vroot_fsio_set_rename_flags(0);
+  (void) vroot_path_set_base("", 0);
+  vroot_opts = 0;
+  session.xfer.path = NULL;
+  session.xfer.path_hidden = NULL;
+
+  snprintf(path, sizeof(path)-1, "%s/.in.test.txt.", fsio_test_dir);
+  (void) unlink(path);
+  snprintf(path, sizeof(path)-1, "%s/test.txt", fsio_test_dir);
+  (void) unlink(path);
+  snprintf(path, sizeof(path)-1, "%s/test2.txt", fsio_test_dir);
+  (void) unlink(path);
+  vroot_fsio_flush_dirfds();
+  (void) rmdir(fsio_test_dir);
+
+  (void) vroot_fsio_set_dircache(FALSE);
+  session.pool = NULL;
+  (void) vroot_throttle_free();
+  (void) vroot_virtdir_free();
+  (void) vroot_alias_free();
+  snprintf(path, sizeof(path)-1, "%s/test.txt", fsio_alias_dir);
+  (void) unlink(path);
+  (void) rmdir(fsio_alias_dir);
+
   if (getenv("TEST_VERBOSE") != NULL) {
     pr_trace_set_levels("vroot.fsio", 0, 0);
   }
@@ -57,6 +99,947 @@ START_TEST (fsio_stat_test) {
 }
 END_TEST
 
+START_TEST (fsio_install_test) {
+  int res;
+  pr_fs_t fs;
+
+  mark_point();
+  res = vroot_fsio_install(NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null fs");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  memset(&fs, 0, sizeof(fs));
+
+  mark_point();
+  res = vroot_fsio_install(&fs, VROOT_FSIO_FL_GENERIC);
+  ck_assert_msg(res == 0, "Failed to install generic callbacks: %s",
+    strerror(errno));
+  ck_assert_msg(fs.stat == vroot_fsio_stat, "Expected generic stat callback");
+  ck_assert_msg(fs.chroot == vroot_fsio_chroot,
+    "Expected chroot callback");
+
+  /* The specialized callbacks require a vroot base. */
+  mark_point();
+  res = vroot_fsio_install(&fs, VROOT_FSIO_FL_ALIASES);
+  ck_assert_msg(res < 0, "Failed to handle missing vroot base");
+  ck_assert_msg(errno == EPERM, "Expected EPERM (%d), got '%s' (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = vroot_path_set_base("/tmp", 4);
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  mark_point();
+  res = vroot_fsio_install(&fs, VROOT_FSIO_FL_ALIASES);
+  ck_assert_msg(res == 0, "Failed to install alias callbacks: %s",
+    strerror(errno));
+  ck_assert_msg(fs.stat != NULL, "Expected stat callback");
+  ck_assert_msg(fs.stat != vroot_fsio_stat,
+    "Expected specialized stat callback");
+
+  mark_point();
+  res = vroot_fsio_install(&fs, 0);
+  ck_assert_msg(res == 0, "Failed to install plain callbacks: %s",
+    strerror(errno));
+  ck_assert_msg(fs.stat != vroot_fsio_stat,
+    "Expected specialized stat callback");
+
+  (void) vroot_path_set_base("", 0);
+}
+END_TEST
+
+START_TEST (fsio_atomic_hidden_stores_test) {
+  int fd, res;
+  pr_fh_t fh;
+  struct stat st;
+  char path[PR_TUNABLE_PATH_MAX+1];
+  const char *hidden_path = "/.in.test.txt.", *dst_path = "/test.txt";
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  vroot_opts = VROOT_OPT_ATOMIC_HIDDEN_STORES;
+  session.xfer.path_hidden = (char *) hidden_path;
+  memset(&fh, 0, sizeof(fh));
+
+  mark_point();
+  fd = vroot_fsio_open(&fh, hidden_path, O_WRONLY|O_CREAT);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", hidden_path,
+    strerror(errno));
+
+  res = write(fd, "foo\n", 4);
+  ck_assert_msg(res == 4, "Failed to write to '%s': %s", hidden_path,
+    strerror(errno));
+
+  mark_point();
+  res = vroot_fsio_stat(NULL, hidden_path, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", hidden_path,
+    strerror(errno));
+  ck_assert_msg(st.st_size == 4, "Expected size 4, got %lu",
+    (unsigned long) st.st_size);
+
+  mark_point();
+  res = vroot_fsio_close(&fh, fd);
+  ck_assert_msg(res == 0, "Failed to close '%s': %s", hidden_path,
+    strerror(errno));
+
+#if defined(O_TMPFILE)
+  /* The upload should not yet be visible under either name. */
+  snprintf(path, sizeof(path)-1, "%s%s", fsio_test_dir, hidden_path);
+  res = stat(path, &st);
+  ck_assert_msg(res < 0, "Unexpectedly found '%s'", path);
+#endif /* O_TMPFILE */
+
+  mark_point();
+  res = vroot_fsio_rename(NULL, hidden_path, dst_path);
+  ck_assert_msg(res == 0, "Failed to rename '%s' to '%s': %s", hidden_path,
+    dst_path, strerror(errno));
+
+  snprintf(path, sizeof(path)-1, "%s%s", fsio_test_dir, dst_path);
+  res = stat(path, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", path, strerror(errno));
+  ck_assert_msg(st.st_size == 4, "Expected size 4, got %lu",
+    (unsigned long) st.st_size);
+
+  /* The HiddenStores file itself should never have been visible. */
+  snprintf(path, sizeof(path)-1, "%s%s", fsio_test_dir, hidden_path);
+  res = stat(path, &st);
+  ck_assert_msg(res < 0, "Unexpectedly found '%s'", path);
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (fsio_rename2_test) {
+  int fd, res;
+  pr_fh_t fh;
+  struct stat st;
+  char path[PR_TUNABLE_PATH_MAX+1];
+  const char *src_path = "/test.txt", *dst_path = "/test2.txt";
+
+  mark_point();
+  res = vroot_fsio_rename2(NULL, NULL, NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null paths");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  snprintf(path, sizeof(path)-1, "%s%s", fsio_test_dir, src_path);
+  fd = open(path, O_WRONLY|O_CREAT, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(fd);
+
+  snprintf(path, sizeof(path)-1, "%s%s", fsio_test_dir, dst_path);
+  fd = open(path, O_WRONLY|O_CREAT, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(fd);
+
+  mark_point();
+  res = vroot_fsio_rename2(NULL, src_path, dst_path,
+    VROOT_FSIO_RENAME_FL_NOREPLACE);
+  ck_assert_msg(res < 0, "Failed to handle existing '%s'", dst_path);
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got '%s' (%d)", EEXIST,
+    strerror(errno), errno);
+
+  (void) unlink(path);
+
+  mark_point();
+  res = vroot_fsio_rename2(NULL, src_path, dst_path,
+    VROOT_FSIO_RENAME_FL_NOREPLACE);
+  ck_assert_msg(res == 0, "Failed to rename '%s' to '%s': %s", src_path,
+    dst_path, strerror(errno));
+
+  res = stat(path, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", path, strerror(errno));
+
+  snprintf(path, sizeof(path)-1, "%s%s", fsio_test_dir, src_path);
+  res = stat(path, &st);
+  ck_assert_msg(res < 0, "Unexpectedly found '%s'", path);
+
+  /* The rename callback uses the flags for the current command. */
+  res = vroot_fsio_set_rename_flags(-1);
+  ck_assert_msg(res < 0, "Failed to handle invalid flags");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  fd = open(path, O_WRONLY|O_CREAT, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(fd);
+
+  res = vroot_fsio_set_rename_flags(VROOT_FSIO_RENAME_FL_NOREPLACE);
+  ck_assert_msg(res == 0, "Failed to set rename flags: %s", strerror(errno));
+
+  mark_point();
+  res = vroot_fsio_rename(NULL, src_path, dst_path);
+  ck_assert_msg(res < 0, "Failed to handle existing '%s'", dst_path);
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got '%s' (%d)", EEXIST,
+    strerror(errno), errno);
+
+  /* Nor does the upload itself replace an existing file. */
+  memset(&fh, 0, sizeof(fh));
+  session.xfer.path = (char *) dst_path;
+
+  mark_point();
+  fd = vroot_fsio_open(&fh, dst_path, O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(fd < 0, "Failed to handle existing '%s'", dst_path);
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got '%s' (%d)", EEXIST,
+    strerror(errno), errno);
+
+  /* Other files opened during the upload are not affected. */
+  mark_point();
+  fd = vroot_fsio_open(&fh, src_path, O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", src_path,
+    strerror(errno));
+  (void) close(fd);
+
+  session.xfer.path = NULL;
+  (void) vroot_fsio_set_rename_flags(0);
+
+  mark_point();
+  fd = vroot_fsio_open(&fh, dst_path, O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", dst_path,
+    strerror(errno));
+  (void) close(fd);
+
+  mark_point();
+  res = vroot_fsio_rename(NULL, src_path, dst_path);
+  ck_assert_msg(res == 0, "Failed to rename '%s' to '%s': %s", src_path,
+    dst_path, strerror(errno));
+}
+END_TEST
+
+static void write_text(const char *path, const char *text) {
+  int fd;
+
+  fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  ck_assert_msg(write(fd, text, strlen(text)) == (ssize_t) strlen(text),
+    "Failed to write '%s': %s", path, strerror(errno));
+  (void) close(fd);
+}
+
+static void check_text(const char *path, const char *text) {
+  int fd;
+  char buf[64];
+  ssize_t len;
+
+  fd = open(path, O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", path, strerror(errno));
+  len = read(fd, buf, sizeof(buf) - 1);
+  (void) close(fd);
+
+  ck_assert_msg(len >= 0, "Failed to read '%s': %s", path, strerror(errno));
+  buf[len] = '\0';
+  ck_assert_msg(strcmp(buf, text) == 0, "Expected '%s' in '%s', got '%s'",
+    text, path, buf);
+}
+
+START_TEST (fsio_rename_xdev_test) {
+  int res, count = 0;
+  char path[PR_TUNABLE_PATH_MAX+1], src_path[PR_TUNABLE_PATH_MAX+1];
+  const char *xdev_dir = "/dev/shm/vroot-fsio-xdev.d";
+  struct stat st1, st2;
+  DIR *dirh;
+  struct dirent *dent;
+
+  /* This needs root, and a directory on another filesystem. */
+  if (geteuid() != 0) {
+    return;
+  }
+
+  tests_remove_dir(xdev_dir);
+  if (mkdir(xdev_dir, 0755) < 0 ||
+      stat(xdev_dir, &st1) < 0 ||
+      stat(fsio_test_dir, &st2) < 0 ||
+      st1.st_dev == st2.st_dev) {
+    (void) rmdir(xdev_dir);
+    return;
+  }
+
+  (void) chown(xdev_dir, 65534, 65534);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/xdev.d", fsio_test_dir);
+  res = vroot_alias_add(path, xdev_dir);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  session.pool = p;
+  (void) vroot_fsio_set_xdev_rename(TRUE, 0);
+
+  snprintf(src_path, sizeof(src_path)-1, "%s/test.txt", fsio_test_dir);
+  write_text(src_path, "moved\n");
+  snprintf(path, sizeof(path)-1, "%s/test.txt", xdev_dir);
+  write_text(path, "original\n");
+  (void) chown(path, 65534, 65534);
+
+  /* A user who may not remove the source leaves the original destination
+   * as it was, and no copy behind.
+   */
+  (void) seteuid(65534);
+  res = vroot_fsio_rename(NULL, "/test.txt", "/xdev.d/test.txt");
+  (void) seteuid(0);
+  ck_assert_msg(res < 0, "Unexpectedly moved '/test.txt'");
+  ck_assert_msg(errno == EACCES, "Expected EACCES (%d), got '%s' (%d)", EACCES,
+    strerror(errno), errno);
+
+  check_text(path, "original\n");
+  check_text(src_path, "moved\n");
+
+  dirh = opendir(xdev_dir);
+  ck_assert_msg(dirh != NULL, "Failed to open '%s': %s", xdev_dir,
+    strerror(errno));
+  while ((dent = readdir(dirh)) != NULL) {
+    if (strcmp(dent->d_name, ".") != 0 &&
+        strcmp(dent->d_name, "..") != 0) {
+      count++;
+    }
+  }
+  (void) closedir(dirh);
+  ck_assert_msg(count == 1, "Expected 1 entry in '%s', found %d", xdev_dir,
+    count);
+
+  mark_point();
+  res = vroot_fsio_rename(NULL, "/test.txt", "/xdev.d/test.txt");
+  ck_assert_msg(res == 0, "Failed to rename across filesystems: %s",
+    strerror(errno));
+  check_text(path, "moved\n");
+  ck_assert_msg(stat(src_path, &st1) < 0, "Unexpectedly found '%s'",
+    src_path);
+
+  (void) vroot_fsio_set_xdev_rename(FALSE, 0);
+  tests_remove_dir(xdev_dir);
+}
+END_TEST
+
+START_TEST (fsio_copy_test) {
+  int fd, res;
+  char buf[64], path[PR_TUNABLE_PATH_MAX+1];
+  const char *src_path = "/test.txt", *dst_path = "/test2.txt";
+  const char *data = "Hello, World!\n";
+
+  mark_point();
+  res = vroot_fsio_copy(NULL, NULL, NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null paths");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  mark_point();
+  res = vroot_fsio_copy(NULL, src_path, dst_path, 0);
+  ck_assert_msg(res < 0, "Failed to handle nonexistent '%s'", src_path);
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  snprintf(path, sizeof(path)-1, "%s%s", fsio_test_dir, src_path);
+  fd = open(path, O_WRONLY|O_CREAT, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  res = write(fd, data, strlen(data));
+  ck_assert_msg(res == (int) strlen(data), "Failed to write '%s': %s", path,
+    strerror(errno));
+  (void) close(fd);
+
+  mark_point();
+  res = vroot_fsio_copy(NULL, src_path, dst_path, 0);
+  ck_assert_msg(res == 0, "Failed to copy '%s' to '%s': %s", src_path,
+    dst_path, strerror(errno));
+
+  snprintf(path, sizeof(path)-1, "%s%s", fsio_test_dir, dst_path);
+  memset(buf, '\0', sizeof(buf));
+  fd = open(path, O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", path, strerror(errno));
+  res = read(fd, buf, sizeof(buf)-1);
+  (void) close(fd);
+  ck_assert_msg(strcmp(buf, data) == 0, "Expected '%s', got '%s'", data, buf);
+
+  mark_point();
+  res = vroot_fsio_copy(NULL, src_path, dst_path,
+    VROOT_FSIO_RENAME_FL_NOREPLACE);
+  ck_assert_msg(res < 0, "Failed to handle existing '%s'", dst_path);
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got '%s' (%d)", EEXIST,
+    strerror(errno), errno);
+}
+END_TEST
+
+/* Lists the given directory, returning the number of entries. */
+static int list_dir(const char *path, int *found) {
+  void *dirh;
+  struct dirent *dent;
+  int count = 0;
+
+  dirh = vroot_fsio_opendir(NULL, path);
+  ck_assert_msg(dirh != NULL, "Failed to open '%s': %s", path,
+    strerror(errno));
+
+  while ((dent = vroot_fsio_readdir(NULL, dirh)) != NULL) {
+    if (strcmp(dent->d_name, "test.txt") == 0) {
+      *found = TRUE;
+    }
+
+    count++;
+  }
+
+  ck_assert_msg(vroot_fsio_closedir(NULL, dirh) == 0,
+    "Failed to close '%s': %s", path, strerror(errno));
+  return count;
+}
+
+START_TEST (fsio_opendir_dircache_test) {
+  int fd, res, count1, count2, found = FALSE;
+  char path[PR_TUNABLE_PATH_MAX+1];
+  unsigned long nops0 = 0, nops1 = 0, nops2 = 0;
+
+  (void) mkdir(fsio_alias_dir, 0755);
+  snprintf(path, sizeof(path)-1, "%s/test.txt", fsio_alias_dir);
+  fd = open(path, O_WRONLY|O_CREAT, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(fd);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/alias.d", fsio_test_dir);
+  res = vroot_alias_add(path, fsio_alias_dir);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  res = vroot_dircache_init(VROOT_DIRCACHE_DEFAULT_SIZE);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+  (void) vroot_fsio_set_dircache(TRUE);
+
+  /* The listings are allocated from the session pool. */
+  session.pool = p;
+
+  /* Count the operations reaching the filesystem. */
+  (void) vroot_throttle_set_limit(VROOT_THROTTLE_MAX_RATE,
+    VROOT_THROTTLE_MAX_RATE);
+
+  /* Recently changed directories are not cached. */
+  sleep(3);
+
+  (void) vroot_throttle_get_stats(&nops0, NULL, NULL);
+
+  mark_point();
+  count1 = list_dir("/alias.d", &found);
+  ck_assert_msg(found == TRUE, "Expected 'test.txt' in listing");
+  (void) vroot_throttle_get_stats(&nops1, NULL, NULL);
+
+  mark_point();
+  found = FALSE;
+  count2 = list_dir("/alias.d", &found);
+  ck_assert_msg(found == TRUE, "Expected 'test.txt' in cached listing");
+  ck_assert_msg(count1 == count2, "Expected %d entries, got %d", count1,
+    count2);
+  (void) vroot_throttle_get_stats(&nops2, NULL, NULL);
+
+  /* The cached listing only needs the directory attributes. */
+  ck_assert_msg(nops2 - nops1 < nops1 - nops0,
+    "Expected fewer operations for cached listing (%lu vs %lu)",
+    nops2 - nops1, nops1 - nops0);
+}
+END_TEST
+
+START_TEST (fsio_opendir_dircache_access_test) {
+  int fd, res, found = FALSE;
+  char path[PR_TUNABLE_PATH_MAX+1];
+  void *dirh;
+
+  /* A directory which others may search, but not read. */
+  (void) mkdir(fsio_alias_dir, 0711);
+  (void) chmod(fsio_alias_dir, 0711);
+  snprintf(path, sizeof(path)-1, "%s/test.txt", fsio_alias_dir);
+  fd = open(path, O_WRONLY|O_CREAT, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(fd);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/alias.d", fsio_test_dir);
+  res = vroot_alias_add(path, fsio_alias_dir);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  res = vroot_dircache_init(VROOT_DIRCACHE_DEFAULT_SIZE);
+  ck_assert_msg(res == 0, "Failed to create cache: %s", strerror(errno));
+  (void) vroot_fsio_set_dircache(TRUE);
+  session.pool = p;
+
+  /* Recently changed directories are not cached. */
+  sleep(3);
+
+  mark_point();
+  (void) list_dir("/alias.d", &found);
+  ck_assert_msg(found == TRUE, "Expected 'test.txt' in listing");
+
+  if (geteuid() != 0) {
+    return;
+  }
+
+  /* The listing cached by a user who may read the directory is not served
+   * to one who may not.
+   */
+  ck_assert_msg(seteuid(65534) == 0, "Failed to switch user: %s",
+    strerror(errno));
+
+  dirh = vroot_fsio_opendir(NULL, "/alias.d");
+  res = errno;
+  (void) seteuid(0);
+
+  ck_assert_msg(dirh == NULL, "Unexpectedly listed unreadable directory");
+  ck_assert_msg(res == EACCES, "Expected EACCES (%d), got %s (%d)", EACCES,
+    strerror(res), res);
+}
+END_TEST
+
+START_TEST (fsio_virtual_dirs_test) {
+  int fd, res, found = FALSE;
+  pr_fh_t fh;
+  struct stat st;
+  void *dirh;
+  struct dirent *dent;
+  char path[PR_TUNABLE_PATH_MAX+1];
+
+  (void) mkdir(fsio_alias_dir, 0755);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/virt.d/alias.d", fsio_test_dir);
+  res = vroot_alias_add(path, fsio_alias_dir);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  session.pool = p;
+
+  snprintf(path, sizeof(path)-1, "%s/virt.d", fsio_test_dir);
+  res = vroot_virtdir_add(path, fsio_test_dir);
+  ck_assert_msg(res == 0, "Failed to add virtual directory: %s",
+    strerror(errno));
+
+  mark_point();
+  res = vroot_fsio_stat(NULL, "/virt.d", &st);
+  ck_assert_msg(res == 0, "Failed to stat '/virt.d': %s", strerror(errno));
+  ck_assert_msg(S_ISDIR(st.st_mode), "Expected directory attributes");
+
+  mark_point();
+  res = vroot_fsio_chdir(NULL, "/virt.d");
+  ck_assert_msg(res == 0, "Failed to chdir to '/virt.d': %s",
+    strerror(errno));
+  pr_fs_setcwd("/");
+
+  /* The listing of the virtual directory includes its aliases. */
+  mark_point();
+  dirh = vroot_fsio_opendir(NULL, "/virt.d");
+  ck_assert_msg(dirh != NULL, "Failed to open '/virt.d': %s",
+    strerror(errno));
+
+  while ((dent = vroot_fsio_readdir(NULL, dirh)) != NULL) {
+    if (strcmp(dent->d_name, "alias.d") == 0) {
+      found = TRUE;
+    }
+  }
+
+  ck_assert_msg(vroot_fsio_closedir(NULL, dirh) == 0,
+    "Failed to close '/virt.d': %s", strerror(errno));
+  ck_assert_msg(found == TRUE, "Expected 'alias.d' in listing");
+
+  /* Nothing has been created on disk so far. */
+  ck_assert_msg(stat(path, &st) < 0, "Unexpectedly found '%s'", path);
+
+  memset(&fh, 0, sizeof(fh));
+
+  mark_point();
+  fd = vroot_fsio_open(&fh, "/virt.d/test.txt", O_WRONLY|O_CREAT);
+  ck_assert_msg(fd >= 0, "Failed to open '/virt.d/test.txt': %s",
+    strerror(errno));
+  (void) close(fd);
+
+  ck_assert_msg(stat(path, &st) == 0, "Expected '%s' to exist: %s", path,
+    strerror(errno));
+
+  snprintf(path, sizeof(path)-1, "%s/virt.d/test.txt", fsio_test_dir);
+  (void) unlink(path);
+  snprintf(path, sizeof(path)-1, "%s/virt.d", fsio_test_dir);
+  (void) rmdir(path);
+}
+END_TEST
+
+START_TEST (fsio_alias_shard_test) {
+  int fd, res, found = FALSE;
+  pr_fh_t fh;
+  struct stat st;
+  struct vroot_alias_attrs attrs;
+  void *dirh;
+  struct dirent *dent;
+  char path[PR_TUNABLE_PATH_MAX+1], shard_path[32], *ptr;
+
+  (void) mkdir(fsio_alias_dir, 0755);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/drop.d", fsio_test_dir);
+  res = vroot_alias_add(path, fsio_alias_dir);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  memset(&attrs, 0, sizeof(attrs));
+  attrs.shard_levels = 2;
+  res = vroot_alias_set_attrs(path, &attrs);
+  ck_assert_msg(res == 0, "Failed to set alias attributes: %s",
+    strerror(errno));
+
+  memset(&fh, 0, sizeof(fh));
+
+  /* The shard directories are created along with the file. */
+  mark_point();
+  fd = vroot_fsio_open(&fh, "/drop.d/test.txt", O_WRONLY|O_CREAT);
+  ck_assert_msg(fd >= 0, "Failed to open '/drop.d/test.txt': %s",
+    strerror(errno));
+  (void) close(fd);
+
+  res = vroot_shard_get("test.txt", 8, 2, shard_path, sizeof(shard_path));
+  ck_assert_msg(res == 0, "Failed to get shard: %s", strerror(errno));
+
+  snprintf(path, sizeof(path)-1, "%s%s/test.txt", fsio_alias_dir, shard_path);
+  ck_assert_msg(stat(path, &st) == 0, "Expected '%s' to exist: %s", path,
+    strerror(errno));
+
+  /* The listing of the alias is that of its shards. */
+  mark_point();
+  dirh = vroot_fsio_opendir(NULL, "/drop.d");
+  ck_assert_msg(dirh != NULL, "Failed to open '/drop.d': %s",
+    strerror(errno));
+
+  while ((dent = vroot_fsio_readdir(NULL, dirh)) != NULL) {
+    if (strcmp(dent->d_name, "test.txt") == 0) {
+      found = TRUE;
+    }
+  }
+
+  ck_assert_msg(vroot_fsio_closedir(NULL, dirh) == 0,
+    "Failed to close '/drop.d': %s", strerror(errno));
+  ck_assert_msg(found == TRUE, "Expected 'test.txt' in listing");
+
+  (void) unlink(path);
+  ptr = strrchr(path, '/');
+  *ptr = '\0';
+  (void) rmdir(path);
+  ptr = strrchr(path, '/');
+  *ptr = '\0';
+  (void) rmdir(path);
+}
+END_TEST
+
+START_TEST (fsio_cache_alias_test) {
+  int fd, res;
+  pr_fh_t fh;
+  struct stat src_st, st;
+  char path[PR_TUNABLE_PATH_MAX+1], cache_dir[PR_TUNABLE_PATH_MAX+1];
+
+  (void) mkdir(fsio_alias_dir, 0755);
+  snprintf(cache_dir, sizeof(cache_dir)-1, "%s/cache.d", fsio_test_dir);
+  (void) mkdir(cache_dir, 0755);
+
+  snprintf(path, sizeof(path)-1, "%s/test.txt", fsio_alias_dir);
+  fd = open(path, O_CREAT|O_WRONLY, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) write(fd, "Hello, World!\n", 14);
+  (void) close(fd);
+  (void) stat(path, &src_st);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  session.pool = p;
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/archive.d", fsio_test_dir);
+  res = vroot_alias_add(path, fsio_alias_dir);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  res = vroot_cachetier_add(fsio_alias_dir, cache_dir, 1024, 0);
+  ck_assert_msg(res == 0, "Failed to add cache tier: %s", strerror(errno));
+
+  memset(&fh, 0, sizeof(fh));
+
+  /* The first download is served from the source, while it is cached. */
+  mark_point();
+  fd = vroot_fsio_open(&fh, "/archive.d/test.txt", O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open '/archive.d/test.txt': %s",
+    strerror(errno));
+  (void) fstat(fd, &st);
+  (void) close(fd);
+  ck_assert_msg(st.st_ino == src_st.st_ino, "Expected source to be opened");
+
+  res = vroot_cachetier_wait();
+  ck_assert_msg(res == 0, "Failed to cache copy: %s", strerror(errno));
+
+  mark_point();
+  fd = vroot_fsio_open(&fh, "/archive.d/test.txt", O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open '/archive.d/test.txt': %s",
+    strerror(errno));
+  (void) fstat(fd, &st);
+  (void) close(fd);
+  ck_assert_msg(st.st_ino != src_st.st_ino, "Expected cached copy to be used");
+  ck_assert_msg(st.st_size == 14, "Expected 14 bytes, got %lu",
+    (unsigned long) st.st_size);
+
+  /* Changes made through the FSIO discard the cached copy. */
+  mark_point();
+  res = vroot_fsio_unlink(NULL, "/archive.d/test.txt");
+  ck_assert_msg(res == 0, "Failed to delete '/archive.d/test.txt': %s",
+    strerror(errno));
+
+  (void) vroot_cachetier_free();
+  (void) rmdir(cache_dir);
+}
+END_TEST
+
+START_TEST (fsio_staging_alias_test) {
+  int fd, res;
+  pr_fh_t fh;
+  struct stat st;
+  char path[PR_TUNABLE_PATH_MAX+1], staging_dir[PR_TUNABLE_PATH_MAX+1];
+
+  (void) mkdir(fsio_alias_dir, 0755);
+  snprintf(staging_dir, sizeof(staging_dir)-1, "%s/staging.d", fsio_test_dir);
+  (void) mkdir(staging_dir, 0755);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  session.pool = p;
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/upload.d", fsio_test_dir);
+  res = vroot_alias_add(path, fsio_alias_dir);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  res = vroot_staging_add(fsio_alias_dir, staging_dir);
+  ck_assert_msg(res == 0, "Failed to add staging: %s", strerror(errno));
+  (void) vroot_staging_wait();
+
+  memset(&fh, 0, sizeof(fh));
+
+  /* The upload is written to the staging directory, not to the source. */
+  mark_point();
+  fd = vroot_fsio_open(&fh, "/upload.d/test.txt", O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to open '/upload.d/test.txt': %s",
+    strerror(errno));
+  (void) write(fd, "Hello, World!\n", 14);
+
+  snprintf(path, sizeof(path)-1, "%s/test.txt", fsio_alias_dir);
+  ck_assert_msg(stat(path, &st) < 0, "Unexpectedly found '%s'", path);
+
+  mark_point();
+  res = vroot_fsio_stat(NULL, "/upload.d/test.txt", &st);
+  ck_assert_msg(res == 0, "Failed to stat '/upload.d/test.txt': %s",
+    strerror(errno));
+
+  mark_point();
+  res = vroot_fsio_close(&fh, fd);
+  ck_assert_msg(res == 0, "Failed to close '/upload.d/test.txt': %s",
+    strerror(errno));
+
+  res = vroot_staging_wait();
+  ck_assert_msg(res == 1, "Expected 1 migrated upload, got %d", res);
+
+  ck_assert_msg(stat(path, &st) == 0, "Expected '%s' after migration: %s",
+    path, strerror(errno));
+  ck_assert_msg(st.st_size == 14, "Expected 14 bytes, got %lu",
+    (unsigned long) st.st_size);
+
+  (void) unlink(path);
+  (void) vroot_staging_free();
+  (void) rmdir(staging_dir);
+}
+END_TEST
+
+START_TEST (fsio_spread_alias_test) {
+  int fd, res, nfound = 0;
+  pr_fh_t fh;
+  struct stat st;
+  array_header *targets;
+  void *dirh;
+  struct dirent *dent;
+  char path[PR_TUNABLE_PATH_MAX+1];
+  const char *target0 = "/tmp/vroot-fsio-spread0.d";
+  const char *target1 = "/tmp/vroot-fsio-spread1.d";
+
+  (void) mkdir(target0, 0755);
+  (void) mkdir(target1, 0755);
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  session.pool = p;
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/spread.d", fsio_test_dir);
+  res = vroot_alias_add(path, target0);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  targets = make_array(p, 2, sizeof(char *));
+  *((const char **) push_array(targets)) = target0;
+  *((const char **) push_array(targets)) = target1;
+
+  res = vroot_spread_add(path, targets, VROOT_SPREAD_PLACEMENT_SPACE);
+  ck_assert_msg(res == 0, "Failed to add spread: %s", strerror(errno));
+
+  memset(&fh, 0, sizeof(fh));
+
+  /* New files are spread over the targets. */
+  mark_point();
+  fd = vroot_fsio_open(&fh, "/spread.d/a.txt", O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to open '/spread.d/a.txt': %s",
+    strerror(errno));
+  (void) close(fd);
+
+  mark_point();
+  fd = vroot_fsio_open(&fh, "/spread.d/b.txt", O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to open '/spread.d/b.txt': %s",
+    strerror(errno));
+  (void) close(fd);
+
+  snprintf(path, sizeof(path)-1, "%s/a.txt", target0);
+  ck_assert_msg(stat(path, &st) == 0, "Expected '%s' to exist: %s", path,
+    strerror(errno));
+  snprintf(path, sizeof(path)-1, "%s/b.txt", target1);
+  ck_assert_msg(stat(path, &st) == 0, "Expected '%s' to exist: %s", path,
+    strerror(errno));
+
+  mark_point();
+  res = vroot_fsio_stat(NULL, "/spread.d/b.txt", &st);
+  ck_assert_msg(res == 0, "Failed to stat '/spread.d/b.txt': %s",
+    strerror(errno));
+
+  /* The listing merges all of the targets, without the index. */
+  mark_point();
+  dirh = vroot_fsio_opendir(NULL, "/spread.d");
+  ck_assert_msg(dirh != NULL, "Failed to open '/spread.d': %s",
+    strerror(errno));
+
+  while ((dent = vroot_fsio_readdir(NULL, dirh)) != NULL) {
+    ck_assert_msg(strcmp(dent->d_name, VROOT_SPREAD_INDEX_NAME) != 0,
+      "Unexpectedly listed index");
+
+    if (strcmp(dent->d_name, "a.txt") == 0 ||
+        strcmp(dent->d_name, "b.txt") == 0) {
+      nfound++;
+    }
+  }
+
+  ck_assert_msg(vroot_fsio_closedir(NULL, dirh) == 0,
+    "Failed to close '/spread.d': %s", strerror(errno));
+  ck_assert_msg(nfound == 2, "Expected 2 files in listing, got %d", nfound);
+
+  mark_point();
+  res = vroot_fsio_unlink(NULL, "/spread.d/b.txt");
+  ck_assert_msg(res == 0, "Failed to delete '/spread.d/b.txt': %s",
+    strerror(errno));
+  ck_assert_msg(stat(path, &st) < 0, "Expected '%s' to be deleted", path);
+
+  (void) vroot_spread_free();
+
+  tests_remove_dir(target0);
+  tests_remove_dir(target1);
+}
+END_TEST
+
+START_TEST (fsio_mirror_alias_test) {
+  register unsigned int i;
+  int fd, res, nprimary = 0, nreplica = 0;
+  pr_fh_t fh;
+  struct stat st;
+  array_header *replicas;
+  char path[PR_TUNABLE_PATH_MAX+1], buf[32];
+  const char *primary = "/tmp/vroot-fsio-mirror0.d";
+  const char *replica = "/tmp/vroot-fsio-mirror1.d";
+
+  (void) mkdir(primary, 0755);
+  (void) mkdir(replica, 0755);
+
+  snprintf(path, sizeof(path)-1, "%s/a.txt", primary);
+  tests_write_file(path, "primary");
+
+  snprintf(path, sizeof(path)-1, "%s/a.txt", replica);
+  tests_write_file(path, "replica");
+
+  res = vroot_path_set_base(fsio_test_dir, strlen(fsio_test_dir));
+  ck_assert_msg(res == 0, "Failed to set base: %s", strerror(errno));
+
+  session.pool = p;
+
+  (void) vroot_alias_init(p);
+  snprintf(path, sizeof(path)-1, "%s/mirror.d", fsio_test_dir);
+  res = vroot_alias_add(path, primary);
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  replicas = make_array(p, 2, sizeof(char *));
+  *((const char **) push_array(replicas)) = primary;
+  *((const char **) push_array(replicas)) = replica;
+
+  res = vroot_mirror_add(path, replicas, VROOT_MIRROR_SELECT_ROTATE);
+  ck_assert_msg(res == 0, "Failed to add mirror: %s", strerror(errno));
+
+  memset(&fh, 0, sizeof(fh));
+
+  /* Downloads are read from the replicas in turn. */
+  for (i = 0; i < 4; i++) {
+    mark_point();
+    fd = vroot_fsio_open(&fh, "/mirror.d/a.txt", O_RDONLY);
+    ck_assert_msg(fd >= 0, "Failed to open '/mirror.d/a.txt': %s",
+      strerror(errno));
+
+    memset(buf, '\0', sizeof(buf));
+    ck_assert_msg(read(fd, buf, sizeof(buf)-1) == 7,
+      "Failed to read '/mirror.d/a.txt': %s", strerror(errno));
+    (void) close(fd);
+
+    if (strcmp(buf, "primary") == 0) {
+      nprimary++;
+
+    } else if (strcmp(buf, "replica") == 0) {
+      nreplica++;
+    }
+  }
+
+  ck_assert_msg(nprimary == 2 && nreplica == 2,
+    "Expected 2 reads from each replica, got %d/%d", nprimary, nreplica);
+
+  /* Metadata, and uploads, are served by the primary. */
+  mark_point();
+  res = vroot_fsio_stat(NULL, "/mirror.d/a.txt", &st);
+  ck_assert_msg(res == 0, "Failed to stat '/mirror.d/a.txt': %s",
+    strerror(errno));
+
+  mark_point();
+  fd = vroot_fsio_open(&fh, "/mirror.d/b.txt", O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to open '/mirror.d/b.txt': %s",
+    strerror(errno));
+  (void) close(fd);
+
+  snprintf(path, sizeof(path)-1, "%s/b.txt", primary);
+  ck_assert_msg(stat(path, &st) == 0, "Expected '%s' to exist: %s", path,
+    strerror(errno));
+  snprintf(path, sizeof(path)-1, "%s/b.txt", replica);
+  ck_assert_msg(stat(path, &st) < 0, "Expected '%s' to not exist", path);
+
+  (void) vroot_mirror_free();
+
+  tests_remove_dir(primary);
+  tests_remove_dir(replica);
+}
+END_TEST
+
 Suite *tests_get_fsio_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -67,6 +1050,19 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_checked_fixture(testcase, set_up, tear_down);
 
   tcase_add_test(testcase, fsio_stat_test);
+  tcase_add_test(testcase, fsio_install_test);
+  tcase_add_test(testcase, fsio_atomic_hidden_stores_test);
+  tcase_add_test(testcase, fsio_rename2_test);
+  tcase_add_test(testcase, fsio_rename_xdev_test);
+  tcase_add_test(testcase, fsio_copy_test);
+  tcase_add_test(testcase, fsio_opendir_dircache_test);
+  tcase_add_test(testcase, fsio_opendir_dircache_access_test);
+  tcase_add_test(testcase, fsio_virtual_dirs_test);
+  tcase_add_test(testcase, fsio_alias_shard_test);
+  tcase_add_test(testcase, fsio_cache_alias_test);
+  tcase_add_test(testcase, fsio_staging_alias_test);
+  tcase_add_test(testcase, fsio_spread_alias_test);
+  tcase_add_test(testcase, fsio_mirror_alias_test);
 
   suite_add_tcase(suite, testcase);
   return suite;
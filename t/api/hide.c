@@ -0,0 +1,271 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Hide tests. */
+
+#include "tests.h"
+#include "hide.h"
+
+static pool *p = NULL;
+
+static struct vroot_hide *compile_patterns(const char *pattern, ...) {
+  va_list ap;
+  array_header *patterns;
+
+  patterns = make_array(p, 1, sizeof(char *));
+
+  va_start(ap, pattern);
+  while (pattern != NULL) {
+    *((const char **) push_array(patterns)) = pattern;
+    pattern = va_arg(ap, const char *);
+  }
+  va_end(ap);
+
+  return vroot_hide_compile(p, patterns, 0);
+}
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.hide", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_hide_set(NULL);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.hide", 0, 0);
+  }
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (hide_compile_test) {
+  struct vroot_hide *hide;
+  array_header *patterns;
+
+  hide = vroot_hide_compile(NULL, NULL, 0);
+  ck_assert_msg(hide == NULL, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  patterns = make_array(p, 1, sizeof(char *));
+  hide = vroot_hide_compile(p, patterns, 0);
+  ck_assert_msg(hide == NULL, "Failed to handle empty patterns");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  hide = compile_patterns("foo/bar", NULL);
+  ck_assert_msg(hide == NULL, "Failed to handle pattern with slash");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  hide = compile_patterns("*.tmp", "[abc", NULL);
+  ck_assert_msg(hide == NULL, "Failed to handle unterminated class");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  hide = compile_patterns("foo\\", NULL);
+  ck_assert_msg(hide == NULL, "Failed to handle trailing backslash");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  hide = compile_patterns(".*", "*.tmp", "[Tt]humbs.db", NULL);
+  ck_assert_msg(hide != NULL, "Failed to compile patterns: %s",
+    strerror(errno));
+}
+END_TEST
+
+START_TEST (hide_match_test) {
+  int res;
+  struct vroot_hide *hide;
+
+  res = vroot_hide_match(NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  hide = compile_patterns(".*", "*.tmp", "~$*", "[Tt]humbs.db", "core.?",
+    "*[!a-z0-9]", "a\\*b", NULL);
+  ck_assert_msg(hide != NULL, "Failed to compile patterns: %s",
+    strerror(errno));
+
+  ck_assert_msg(vroot_hide_match(hide, ".profile") == TRUE,
+    "Expected '.profile' to match");
+  ck_assert_msg(vroot_hide_match(hide, "upload.tmp") == TRUE,
+    "Expected 'upload.tmp' to match");
+  ck_assert_msg(vroot_hide_match(hide, ".tmp") == TRUE,
+    "Expected '.tmp' to match");
+  ck_assert_msg(vroot_hide_match(hide, "~$report.doc") == TRUE,
+    "Expected '~$report.doc' to match");
+  ck_assert_msg(vroot_hide_match(hide, "thumbs.db") == TRUE,
+    "Expected 'thumbs.db' to match");
+  ck_assert_msg(vroot_hide_match(hide, "Thumbs.db") == TRUE,
+    "Expected 'Thumbs.db' to match");
+  ck_assert_msg(vroot_hide_match(hide, "core.1") == TRUE,
+    "Expected 'core.1' to match");
+  ck_assert_msg(vroot_hide_match(hide, "data_") == TRUE,
+    "Expected 'data_' to match");
+  ck_assert_msg(vroot_hide_match(hide, "a*b") == TRUE,
+    "Expected 'a*b' to match");
+
+  ck_assert_msg(vroot_hide_match(hide, "upload.tmp.txt") == FALSE,
+    "Expected 'upload.tmp.txt' not to match");
+  ck_assert_msg(vroot_hide_match(hide, "THUMBS.db") == FALSE,
+    "Expected 'THUMBS.db' not to match");
+  ck_assert_msg(vroot_hide_match(hide, "core.12") == FALSE,
+    "Expected 'core.12' not to match");
+  ck_assert_msg(vroot_hide_match(hide, "core") == FALSE,
+    "Expected 'core' not to match");
+  ck_assert_msg(vroot_hide_match(hide, "axxb") == FALSE,
+    "Expected 'axxb' not to match");
+  ck_assert_msg(vroot_hide_match(hide, "report2") == FALSE,
+    "Expected 'report2' not to match");
+}
+END_TEST
+
+START_TEST (hide_match_nocase_test) {
+  array_header *patterns;
+  struct vroot_hide *hide;
+
+  patterns = make_array(p, 2, sizeof(char *));
+  *((char **) push_array(patterns)) = "*.tmp";
+  *((char **) push_array(patterns)) = "[T]humbs.DB";
+
+  hide = vroot_hide_compile(p, patterns, VROOT_HIDE_FL_NOCASE);
+  ck_assert_msg(hide != NULL, "Failed to compile patterns: %s",
+    strerror(errno));
+
+  ck_assert_msg(vroot_hide_match(hide, "X.TMP") == TRUE,
+    "Expected 'X.TMP' to match");
+  ck_assert_msg(vroot_hide_match(hide, "x.Tmp") == TRUE,
+    "Expected 'x.Tmp' to match");
+  ck_assert_msg(vroot_hide_match(hide, "thumbs.db") == TRUE,
+    "Expected 'thumbs.db' to match");
+  ck_assert_msg(vroot_hide_match(hide, "THUMBS.DB") == TRUE,
+    "Expected 'THUMBS.DB' to match");
+  ck_assert_msg(vroot_hide_match(hide, "x.tmq") == FALSE,
+    "Expected 'x.tmq' not to match");
+}
+END_TEST
+
+START_TEST (hide_name_path_test) {
+  struct vroot_hide *hide;
+
+  hide = compile_patterns(".*", "*.tmp", NULL);
+  ck_assert_msg(hide != NULL, "Failed to compile patterns: %s",
+    strerror(errno));
+
+  /* Nothing is hidden until the patterns are used. */
+  ck_assert_msg(vroot_hide_name(".profile") == FALSE,
+    "Expected '.profile' not to be hidden");
+
+  (void) vroot_hide_set(hide);
+
+  ck_assert_msg(vroot_hide_name(".profile") == TRUE,
+    "Expected '.profile' to be hidden");
+  ck_assert_msg(vroot_hide_name(".") == FALSE, "Expected '.' not to be hidden");
+  ck_assert_msg(vroot_hide_name("..") == FALSE,
+    "Expected '..' not to be hidden");
+  ck_assert_msg(vroot_hide_name("profile") == FALSE,
+    "Expected 'profile' not to be hidden");
+
+  ck_assert_msg(vroot_hide_path("/home/.ssh/id_rsa") == TRUE,
+    "Expected '/home/.ssh/id_rsa' to be hidden");
+  ck_assert_msg(vroot_hide_path("/upload/file.tmp") == TRUE,
+    "Expected '/upload/file.tmp' to be hidden");
+  ck_assert_msg(vroot_hide_path("/upload/file.tmp/") == TRUE,
+    "Expected '/upload/file.tmp/' to be hidden");
+  ck_assert_msg(vroot_hide_path("/upload/./file.txt") == FALSE,
+    "Expected '/upload/./file.txt' not to be hidden");
+  ck_assert_msg(vroot_hide_path("/upload/../file.txt") == FALSE,
+    "Expected '/upload/../file.txt' not to be hidden");
+  ck_assert_msg(vroot_hide_path("/") == FALSE, "Expected '/' not to be hidden");
+}
+END_TEST
+
+START_TEST (hide_many_patterns_test) {
+  register unsigned int i;
+  array_header *patterns;
+  struct vroot_hide *hide;
+  char name[64];
+
+  patterns = make_array(p, 100, sizeof(char *));
+  for (i = 0; i < 100; i++) {
+    snprintf(name, sizeof(name), "*.ext%u", i);
+    *((char **) push_array(patterns)) = pstrdup(p, name);
+  }
+
+  hide = vroot_hide_compile(p, patterns, 0);
+  ck_assert_msg(hide != NULL, "Failed to compile patterns: %s",
+    strerror(errno));
+
+  for (i = 0; i < 100; i++) {
+    snprintf(name, sizeof(name), "file.ext%u", i);
+    ck_assert_msg(vroot_hide_match(hide, name) == TRUE,
+      "Expected '%s' to match", name);
+  }
+
+  ck_assert_msg(vroot_hide_match(hide, "file.ext100") == FALSE,
+    "Expected 'file.ext100' not to match");
+
+  /* Patterns needing too many states are rejected. */
+  clear_array(patterns);
+  for (i = 0; i < 16; i++) {
+    snprintf(name, sizeof(name), "*a*b*c*d*e*f*g*%c*", 'h' + i);
+    *((char **) push_array(patterns)) = pstrdup(p, name);
+  }
+
+  hide = vroot_hide_compile(p, patterns, 0);
+  ck_assert_msg(hide == NULL, "Failed to reject too complex patterns");
+  ck_assert_msg(errno == ENOSPC, "Expected ENOSPC (%d), got %s (%d)", ENOSPC,
+    strerror(errno), errno);
+}
+END_TEST
+
+Suite *tests_get_hide_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("hide");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, hide_compile_test);
+  tcase_add_test(testcase, hide_match_test);
+  tcase_add_test(testcase, hide_match_nocase_test);
+  tcase_add_test(testcase, hide_name_path_test);
+  tcase_add_test(testcase, hide_many_patterns_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
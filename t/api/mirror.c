@@ -0,0 +1,321 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Mirror alias tests. */
+
+#include "tests.h"
+#include "mirror.h"
+
+static pool *p = NULL;
+
+static const char *mirror_test_dir = "/tmp/vroot-mirror-test.d";
+static const char *mirror_test_replica0 = "/tmp/vroot-mirror-test.d/r0";
+static const char *mirror_test_replica1 = "/tmp/vroot-mirror-test.d/r1";
+static const char *mirror_test_replica2 = "/tmp/vroot-mirror-test.d/r2";
+
+/* Writes the name of the replica into the test file, so that tests can tell
+ * which replica a file was read from.
+ */
+static void create_file(const char *replica) {
+  char path[PR_TUNABLE_PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/test.txt", replica);
+  tests_write_file(path, replica);
+}
+
+/* Returns the replica from which the given descriptor was opened. */
+static const char *read_replica(int fd) {
+  static char buf[PR_TUNABLE_PATH_MAX];
+  ssize_t len;
+
+  memset(buf, '\0', sizeof(buf));
+  len = pread(fd, buf, sizeof(buf)-1, 0);
+  ck_assert_msg(len > 0, "Failed to read file: %s", strerror(errno));
+  (void) close(fd);
+
+  return buf;
+}
+
+static void add_mirror(int selection) {
+  int res;
+  array_header *replicas;
+
+  replicas = make_array(p, 3, sizeof(char *));
+  *((const char **) push_array(replicas)) = mirror_test_replica0;
+  *((const char **) push_array(replicas)) = mirror_test_replica1;
+  *((const char **) push_array(replicas)) = mirror_test_replica2;
+
+  res = vroot_mirror_add("/data", replicas, selection);
+  ck_assert_msg(res == 0, "Failed to add mirror: %s", strerror(errno));
+}
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  session.pool = p;
+
+  tests_remove_dir(mirror_test_dir);
+  (void) mkdir(mirror_test_dir, 0755);
+  (void) mkdir(mirror_test_replica0, 0755);
+  (void) mkdir(mirror_test_replica1, 0755);
+  (void) mkdir(mirror_test_replica2, 0755);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.mirror", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_mirror_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.mirror", 0, 0);
+  }
+
+  tests_remove_dir(mirror_test_dir);
+  session.pool = NULL;
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (mirror_add_test) {
+  int res;
+  array_header *replicas;
+
+  res = vroot_mirror_add(NULL, NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  replicas = make_array(p, 1, sizeof(char *));
+  *((const char **) push_array(replicas)) = mirror_test_replica0;
+
+  res = vroot_mirror_add("/data", replicas, VROOT_MIRROR_SELECT_LATENCY);
+  ck_assert_msg(res < 0, "Failed to handle single replica");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  *((const char **) push_array(replicas)) = mirror_test_replica1;
+
+  res = vroot_mirror_add("/data", replicas, 0);
+  ck_assert_msg(res < 0, "Failed to handle unknown selection policy");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  ck_assert_msg(vroot_mirror_count() == 0, "Expected no mirrors");
+
+  res = vroot_mirror_add("/data", replicas, VROOT_MIRROR_SELECT_LATENCY);
+  ck_assert_msg(res == 0, "Failed to add mirror: %s", strerror(errno));
+  ck_assert_msg(vroot_mirror_count() == 1, "Expected 1 mirror, got %u",
+    vroot_mirror_count());
+
+  ck_assert_msg(vroot_mirror_contains(mirror_test_replica0) == TRUE,
+    "Expected primary to be within mirror");
+  ck_assert_msg(vroot_mirror_contains(
+    "/tmp/vroot-mirror-test.d/r0/test.txt") == TRUE,
+    "Expected path to be within mirror");
+  ck_assert_msg(vroot_mirror_contains(
+    "/tmp/vroot-mirror-test.d/r1/test.txt") == FALSE,
+    "Expected replica path to not be within mirror");
+  ck_assert_msg(vroot_mirror_contains("/tmp/vroot-mirror-test.d/r00") == FALSE,
+    "Expected sibling path to not be within mirror");
+
+  res = vroot_mirror_open("/tmp/vroot-mirror-test.d/r1/test.txt", O_RDONLY);
+  ck_assert_msg(res < 0, "Failed to handle path outside of mirror");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (mirror_rotate_test) {
+  register unsigned int i;
+  int fd, nread[3];
+  const char *path = "/tmp/vroot-mirror-test.d/r0/test.txt";
+
+  create_file(mirror_test_replica0);
+  create_file(mirror_test_replica1);
+  create_file(mirror_test_replica2);
+
+  add_mirror(VROOT_MIRROR_SELECT_ROTATE);
+
+  memset(nread, 0, sizeof(nread));
+
+  for (i = 0; i < 6; i++) {
+    const char *replica;
+
+    mark_point();
+    fd = vroot_mirror_open(path, O_RDONLY);
+    ck_assert_msg(fd >= 0, "Failed to open '%s': %s", path, strerror(errno));
+
+    replica = read_replica(fd);
+    if (strcmp(replica, mirror_test_replica0) == 0) {
+      nread[0]++;
+
+    } else if (strcmp(replica, mirror_test_replica1) == 0) {
+      nread[1]++;
+
+    } else if (strcmp(replica, mirror_test_replica2) == 0) {
+      nread[2]++;
+    }
+  }
+
+  for (i = 0; i < 3; i++) {
+    ck_assert_msg(nread[i] == 2, "Expected 2 reads from replica %u, got %d",
+      i, nread[i]);
+  }
+}
+END_TEST
+
+START_TEST (mirror_failover_test) {
+  register unsigned int i;
+  int fd;
+  const char *path = "/tmp/vroot-mirror-test.d/r0/test.txt";
+
+  /* The file is only present on the last replica; the others fail over to
+   * it.
+   */
+  create_file(mirror_test_replica2);
+
+  add_mirror(VROOT_MIRROR_SELECT_ROTATE);
+
+  for (i = 0; i < 3; i++) {
+    mark_point();
+    fd = vroot_mirror_open(path, O_RDONLY);
+    ck_assert_msg(fd >= 0, "Failed to open '%s': %s", path, strerror(errno));
+    ck_assert_msg(strcmp(read_replica(fd), mirror_test_replica2) == 0,
+      "Expected read from replica '%s'", mirror_test_replica2);
+  }
+
+  /* Files missing everywhere are reported as such. */
+  mark_point();
+  fd = vroot_mirror_open("/tmp/vroot-mirror-test.d/r0/none.txt", O_RDONLY);
+  ck_assert_msg(fd < 0, "Failed to handle missing file");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* A replica which is not a directory fails with ENOTDIR, which is also
+   * failed over.
+   */
+  tests_remove_dir(mirror_test_replica1);
+  create_file(mirror_test_replica0);
+  tests_write_file(mirror_test_replica1, "");
+
+  for (i = 0; i < 3; i++) {
+    const char *replica;
+
+    mark_point();
+    fd = vroot_mirror_open(path, O_RDONLY);
+    ck_assert_msg(fd >= 0, "Failed to open '%s': %s", path, strerror(errno));
+
+    replica = read_replica(fd);
+    ck_assert_msg(strcmp(replica, mirror_test_replica1) != 0,
+      "Unexpectedly read from replica '%s'", mirror_test_replica1);
+  }
+}
+END_TEST
+
+START_TEST (mirror_latency_test) {
+  register unsigned int i;
+  int fd, nread[3];
+  const char *path = "/tmp/vroot-mirror-test.d/r0/test.txt";
+
+  create_file(mirror_test_replica0);
+  create_file(mirror_test_replica1);
+  create_file(mirror_test_replica2);
+
+  add_mirror(VROOT_MIRROR_SELECT_LATENCY);
+
+  /* Every replica is sampled first; with similar latencies, they are then
+   * used in turn.
+   */
+  memset(nread, 0, sizeof(nread));
+
+  for (i = 0; i < 12; i++) {
+    const char *replica;
+
+    mark_point();
+    fd = vroot_mirror_open(path, O_RDONLY);
+    ck_assert_msg(fd >= 0, "Failed to open '%s': %s", path, strerror(errno));
+
+    replica = read_replica(fd);
+    if (strcmp(replica, mirror_test_replica0) == 0) {
+      nread[0]++;
+
+    } else if (strcmp(replica, mirror_test_replica1) == 0) {
+      nread[1]++;
+
+    } else if (strcmp(replica, mirror_test_replica2) == 0) {
+      nread[2]++;
+    }
+
+    if (i == 2) {
+      ck_assert_msg(nread[0] == 1 && nread[1] == 1 && nread[2] == 1,
+        "Expected every replica to be sampled once, got %d/%d/%d", nread[0],
+        nread[1], nread[2]);
+    }
+  }
+
+  ck_assert_msg(nread[0] + nread[1] + nread[2] == 12,
+    "Expected 12 reads, got %d", nread[0] + nread[1] + nread[2]);
+
+  /* Replicas which are missing the file are not held against them. */
+  tests_remove_dir(mirror_test_replica0);
+  (void) mkdir(mirror_test_replica0, 0755);
+
+  for (i = 0; i < 3; i++) {
+    const char *replica;
+
+    mark_point();
+    fd = vroot_mirror_open(path, O_RDONLY);
+    ck_assert_msg(fd >= 0, "Failed to open '%s': %s", path, strerror(errno));
+
+    replica = read_replica(fd);
+    ck_assert_msg(strcmp(replica, mirror_test_replica0) != 0,
+      "Unexpectedly read from replica '%s'", mirror_test_replica0);
+  }
+}
+END_TEST
+
+Suite *tests_get_mirror_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("mirror");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, mirror_add_test);
+  tcase_add_test(testcase, mirror_rotate_test);
+  tcase_add_test(testcase, mirror_failover_test);
+  tcase_add_test(testcase, mirror_latency_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -26,6 +26,9 @@
 
 #include "tests.h"
 #include "path.h"
+#include "casefold.h"
+#include "hide.h"
+#include "alias.h"
 
 static pool *p = NULL;
 
@@ -41,6 +44,8 @@ static void set_up(void) {
 
 static void tear_down(void) {
   (void) vroot_path_set_base("", 0);
+  (void) vroot_hide_set(NULL);
+  vroot_opts = 0;
 
   if (getenv("TEST_VERBOSE") != NULL) {
     pr_trace_set_levels("vroot.path", 0, 0);
@@ -389,6 +394,214 @@ START_TEST (path_lookup_with_alias_test) {
 }
 END_TEST
 
+START_TEST (path_lookup_case_insensitive_test) {
+  int res;
+  char *vpath = NULL;
+  size_t vpathsz = 1024;
+  const char *base = "/tmp/vroot-path-casefold.d";
+  const char *dir = "/tmp/vroot-path-casefold.d/Upload";
+
+  (void) mkdir(base, 0755);
+  (void) mkdir(dir, 0755);
+
+  session.pool = p;
+  vpath = pcalloc(p, vpathsz);
+
+  res = vroot_path_set_base(base, strlen(base));
+  ck_assert_msg(res == 0, "Failed to set base '%s': %s", base,
+    strerror(errno));
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/upload/File.txt", 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup vpath: %s", strerror(errno));
+  ck_assert_msg(
+    strcmp(vpath, "/tmp/vroot-path-casefold.d/upload/File.txt") == 0,
+    "Expected unmapped vpath, got '%s'", vpath);
+
+  vroot_opts |= VROOT_OPT_CASE_INSENSITIVE;
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/upload/File.txt", 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup vpath: %s", strerror(errno));
+  ck_assert_msg(
+    strcmp(vpath, "/tmp/vroot-path-casefold.d/Upload/File.txt") == 0,
+    "Expected mapped vpath, got '%s'", vpath);
+
+  (void) vroot_casefold_free();
+  session.pool = NULL;
+
+  (void) rmdir(dir);
+  (void) rmdir(base);
+}
+END_TEST
+
+START_TEST (path_lookup_hidden_test) {
+  int res;
+  char *vpath = NULL;
+  size_t vpathsz = 1024;
+  const char *base = "/tmp/.vroot-path-hide.d";
+  array_header *patterns;
+  struct vroot_hide *hide;
+
+  vpath = pcalloc(p, vpathsz);
+
+  res = vroot_path_set_base(base, strlen(base));
+  ck_assert_msg(res == 0, "Failed to set base '%s': %s", base,
+    strerror(errno));
+
+  patterns = make_array(p, 2, sizeof(char *));
+  *((char **) push_array(patterns)) = ".*";
+  *((char **) push_array(patterns)) = "*.tmp";
+
+  hide = vroot_hide_compile(p, patterns, 0);
+  ck_assert_msg(hide != NULL, "Failed to compile patterns: %s",
+    strerror(errno));
+  (void) vroot_hide_set(hide);
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/.ssh/id_rsa", 0, NULL);
+  ck_assert_msg(res < 0, "Failed to hide '/.ssh/id_rsa'");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/upload/file.tmp", 0, NULL);
+  ck_assert_msg(res < 0, "Failed to hide '/upload/file.tmp'");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* The components of the base are not subject to hiding. */
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/upload/file.txt", 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup vpath: %s", strerror(errno));
+  ck_assert_msg(strcmp(vpath, "/tmp/.vroot-path-hide.d/upload/file.txt") == 0,
+    "Expected '/tmp/.vroot-path-hide.d/upload/file.txt', got '%s'", vpath);
+
+  /* The HiddenStores name of the upload in progress is not hidden, but its
+   * directories still are.
+   */
+  session.xfer.path_hidden = "/upload/.in.file.txt.";
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/upload/.in.file.txt.", 0,
+    NULL);
+  ck_assert_msg(res == 0, "Failed to lookup HiddenStores path: %s",
+    strerror(errno));
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/upload/.in.other.txt.", 0,
+    NULL);
+  ck_assert_msg(res < 0, "Failed to hide '/upload/.in.other.txt.'");
+
+  session.xfer.path_hidden = "/.upload/.in.file.txt.";
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/.upload/.in.file.txt.", 0,
+    NULL);
+  ck_assert_msg(res < 0, "Failed to hide '/.upload/.in.file.txt.'");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  session.xfer.path_hidden = NULL;
+
+  /* Case-insensitive patterns hide names in any case. */
+  hide = vroot_hide_compile(p, patterns, VROOT_HIDE_FL_NOCASE);
+  ck_assert_msg(hide != NULL, "Failed to compile patterns: %s",
+    strerror(errno));
+  (void) vroot_hide_set(hide);
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/upload/X.TMP", 0, NULL);
+  ck_assert_msg(res < 0, "Failed to hide '/upload/X.TMP'");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (path_lookup_with_pattern_alias_test) {
+  int res;
+  char *vpath = NULL;
+  size_t vpathsz = 1024;
+  const char *base = "/tmp/vroot-path-pattern.d";
+
+  vpath = pcalloc(p, vpathsz);
+  (void) vroot_alias_init(p);
+
+  res = vroot_path_set_base(base, strlen(base));
+  ck_assert_msg(res == 0, "Failed to set base '%s': %s", base,
+    strerror(errno));
+
+  res = vroot_alias_add("/tmp/vroot-path-pattern.d/projects/*",
+    "/data/projects/$1");
+  ck_assert_msg(res == 0, "Failed to add pattern alias: %s", strerror(errno));
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/projects/foo/file.txt", 0,
+    NULL);
+  ck_assert_msg(res == 0, "Failed to lookup vpath: %s", strerror(errno));
+  ck_assert_msg(strcmp(vpath, "/data/projects/foo/file.txt") == 0,
+    "Expected '/data/projects/foo/file.txt', got '%s'", vpath);
+
+  /* The pattern directory itself is not aliased. */
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/projects", 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup vpath: %s", strerror(errno));
+  ck_assert_msg(strcmp(vpath, "/tmp/vroot-path-pattern.d/projects") == 0,
+    "Expected '/tmp/vroot-path-pattern.d/projects', got '%s'", vpath);
+
+  (void) vroot_alias_free();
+}
+END_TEST
+
+START_TEST (path_lookup_with_shard_alias_test) {
+  int res;
+  char *vpath = NULL;
+  size_t vpathsz = 1024;
+  const char *base = "/tmp/vroot-path-shard.d";
+  struct vroot_alias_attrs attrs;
+
+  vpath = pcalloc(p, vpathsz);
+  (void) vroot_alias_init(p);
+
+  res = vroot_path_set_base(base, strlen(base));
+  ck_assert_msg(res == 0, "Failed to set base '%s': %s", base,
+    strerror(errno));
+
+  res = vroot_alias_add("/tmp/vroot-path-shard.d/incoming", "/data/incoming");
+  ck_assert_msg(res == 0, "Failed to add alias: %s", strerror(errno));
+
+  memset(&attrs, 0, sizeof(attrs));
+  attrs.shard_levels = 2;
+
+  res = vroot_alias_set_attrs("/tmp/vroot-path-shard.d/incoming", &attrs);
+  ck_assert_msg(res == 0, "Failed to set alias attributes: %s",
+    strerror(errno));
+
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/incoming/foo", 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup vpath: %s", strerror(errno));
+  ck_assert_msg(strcmp(vpath, "/data/incoming/d7/7e/foo") == 0,
+    "Expected '/data/incoming/d7/7e/foo', got '%s'", vpath);
+
+  /* Only the name directly within the alias is hashed. */
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/incoming/foo/bar.txt", 0,
+    NULL);
+  ck_assert_msg(res == 0, "Failed to lookup vpath: %s", strerror(errno));
+  ck_assert_msg(strcmp(vpath, "/data/incoming/d7/7e/foo/bar.txt") == 0,
+    "Expected '/data/incoming/d7/7e/foo/bar.txt', got '%s'", vpath);
+
+  /* The alias itself is not sharded. */
+  mark_point();
+  res = vroot_path_lookup(p, vpath, vpathsz, "/incoming", 0, NULL);
+  ck_assert_msg(res == 0, "Failed to lookup vpath: %s", strerror(errno));
+  ck_assert_msg(strcmp(vpath, "/data/incoming") == 0,
+    "Expected '/data/incoming', got '%s'", vpath);
+
+  (void) vroot_alias_free();
+}
+END_TEST
+
 Suite *tests_get_path_suite(void) {
   Suite *suite;
   TCase *testcase;
@@ -406,6 +619,10 @@ Suite *tests_get_path_suite(void) {
   tcase_add_test(testcase, path_lookup_test);
   tcase_add_test(testcase, path_lookup_issue1491_test);
   tcase_add_test(testcase, path_lookup_with_alias_test);
+  tcase_add_test(testcase, path_lookup_case_insensitive_test);
+  tcase_add_test(testcase, path_lookup_hidden_test);
+  tcase_add_test(testcase, path_lookup_with_pattern_alias_test);
+  tcase_add_test(testcase, path_lookup_with_shard_alias_test);
 
   suite_add_tcase(suite, testcase);
   return suite;
@@ -0,0 +1,305 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* I/O Policy tests. */
+
+#include "tests.h"
+#include "policy.h"
+
+static pool *p = NULL;
+
+static const char *policy_test_path = "/tmp/vroot-policy-test.txt";
+
+static void set_up(void) {
+  int fd;
+
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  fd = open(policy_test_path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd >= 0) {
+    (void) write(fd, "Hello, World!\n", 14);
+    (void) close(fd);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.policy", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.policy", 0, 0);
+  }
+
+  (void) vroot_policy_free();
+  (void) unlink(policy_test_path);
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (policy_open_flags_test) {
+  int flags;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+
+  flags = vroot_policy_open_flags(NULL, O_RDONLY);
+  ck_assert_msg(flags == O_RDONLY, "Expected O_RDONLY, got %d", flags);
+
+  flags = vroot_policy_open_flags(&attrs, O_RDONLY);
+  ck_assert_msg(flags == O_RDONLY, "Expected O_RDONLY, got %d", flags);
+
+  attrs.noatime = TRUE;
+
+#if defined(O_NOATIME)
+  flags = vroot_policy_open_flags(&attrs, O_RDONLY);
+  ck_assert_msg(flags == (O_RDONLY|O_NOATIME),
+    "Expected O_RDONLY|O_NOATIME, got %d", flags);
+#endif /* O_NOATIME */
+
+  /* O_NOATIME only applies when reading. */
+  flags = vroot_policy_open_flags(&attrs, O_WRONLY);
+  ck_assert_msg(flags == O_WRONLY, "Expected O_WRONLY, got %d", flags);
+}
+END_TEST
+
+START_TEST (policy_open_close_test) {
+  int fd, res;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+
+  mark_point();
+  res = vroot_policy_open(-1, O_RDONLY, &attrs);
+  ck_assert_msg(res < 0, "Failed to handle invalid fd");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  fd = open(policy_test_path, O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", policy_test_path,
+    strerror(errno));
+
+  mark_point();
+  res = vroot_policy_open(fd, O_RDONLY, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null attrs");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Without any close-time policy, nothing is remembered. */
+  attrs.read_advice = VROOT_ALIAS_ADVICE_SEQUENTIAL;
+  attrs.readahead = 1024;
+
+  mark_point();
+  res = vroot_policy_open(fd, O_RDONLY, &attrs);
+  ck_assert_msg(res == 0, "Failed to apply policy: %s", strerror(errno));
+
+  res = vroot_policy_close(fd);
+  ck_assert_msg(res < 0, "Unexpectedly found close policy for fd %d", fd);
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  attrs.dontneed = TRUE;
+
+  mark_point();
+  res = vroot_policy_open(fd, O_RDONLY, &attrs);
+  ck_assert_msg(res == 0, "Failed to apply policy: %s", strerror(errno));
+
+  mark_point();
+  res = vroot_policy_close(fd);
+  ck_assert_msg(res == 0, "Failed to apply close policy: %s", strerror(errno));
+
+  res = vroot_policy_close(fd);
+  ck_assert_msg(res < 0, "Unexpectedly found close policy for fd %d", fd);
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* The dontneed policy only applies when reading. */
+  mark_point();
+  res = vroot_policy_open(fd, O_WRONLY, &attrs);
+  ck_assert_msg(res == 0, "Failed to apply policy: %s", strerror(errno));
+
+  res = vroot_policy_close(fd);
+  ck_assert_msg(res < 0, "Unexpectedly found close policy for fd %d", fd);
+
+  (void) close(fd);
+}
+END_TEST
+
+START_TEST (policy_ioprio_test) {
+  int fd, res;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+  attrs.ioprio_class = VROOT_ALIAS_IOPRIO_BEST_EFFORT;
+  attrs.ioprio_level = 7;
+
+  fd = open(policy_test_path, O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", policy_test_path,
+    strerror(errno));
+
+  mark_point();
+  res = vroot_policy_open(fd, O_RDONLY, &attrs);
+  ck_assert_msg(res == 0, "Failed to apply policy: %s", strerror(errno));
+
+  /* If the platform supports I/O priorities, the priority is restored on
+   * close; otherwise, there is nothing to restore.
+   */
+  mark_point();
+  (void) vroot_policy_close(fd);
+  (void) close(fd);
+}
+END_TEST
+
+START_TEST (policy_write_test) {
+  register unsigned int i;
+  int fd, res;
+  char buf[1024];
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+  memset(buf, 'A', sizeof(buf));
+
+  fd = open(policy_test_path, O_WRONLY|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", policy_test_path,
+    strerror(errno));
+
+  res = vroot_policy_write(fd, sizeof(buf));
+  ck_assert_msg(res < 0, "Unexpectedly found write policy for fd %d", fd);
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  attrs.write_behind = 4096;
+
+  mark_point();
+  res = vroot_policy_open(fd, O_WRONLY, &attrs);
+  ck_assert_msg(res == 0, "Failed to apply policy: %s", strerror(errno));
+
+  /* Enough writes for several write-behind windows. */
+  for (i = 0; i < 16; i++) {
+    ck_assert_msg(write(fd, buf, sizeof(buf)) == sizeof(buf),
+      "Failed to write to '%s': %s", policy_test_path, strerror(errno));
+
+    mark_point();
+    res = vroot_policy_write(fd, sizeof(buf));
+    ck_assert_msg(res == 0, "Failed to apply write policy: %s",
+      strerror(errno));
+  }
+
+  mark_point();
+  res = vroot_policy_close(fd);
+  ck_assert_msg(res == 0, "Failed to apply close policy: %s", strerror(errno));
+
+  (void) close(fd);
+}
+END_TEST
+
+START_TEST (policy_fsync_test) {
+  int fd, res;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+  attrs.fsync_mode = VROOT_ALIAS_FSYNC_DATA;
+
+  fd = open(policy_test_path, O_WRONLY|O_APPEND);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", policy_test_path,
+    strerror(errno));
+
+  /* The fsync policy only applies when writing. */
+  mark_point();
+  res = vroot_policy_open(fd, O_RDONLY, &attrs);
+  ck_assert_msg(res == 0, "Failed to apply policy: %s", strerror(errno));
+
+  res = vroot_policy_close(fd);
+  ck_assert_msg(res < 0, "Unexpectedly found close policy for fd %d", fd);
+
+  mark_point();
+  res = vroot_policy_open(fd, O_WRONLY, &attrs);
+  ck_assert_msg(res == 0, "Failed to apply policy: %s", strerror(errno));
+
+  mark_point();
+  res = vroot_policy_close(fd);
+  ck_assert_msg(res == 0, "Failed to apply close policy: %s", strerror(errno));
+
+  (void) close(fd);
+}
+END_TEST
+
+START_TEST (policy_preallocate_test) {
+  int fd, res;
+  struct stat st;
+  struct vroot_alias_attrs attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+  attrs.preallocate = TRUE;
+
+  res = vroot_policy_set_alloc_size(-1);
+  ck_assert_msg(res < 0, "Failed to handle negative size");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_policy_set_alloc_size(1024 * 1024);
+  ck_assert_msg(res == 0, "Failed to set alloc size: %s", strerror(errno));
+
+  fd = open(policy_test_path, O_WRONLY|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to open '%s': %s", policy_test_path,
+    strerror(errno));
+
+  mark_point();
+  res = vroot_policy_open(fd, O_WRONLY, &attrs);
+  ck_assert_msg(res == 0, "Failed to apply policy: %s", strerror(errno));
+
+  /* Preallocation must not change the file size. */
+  res = fstat(fd, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", policy_test_path,
+    strerror(errno));
+  ck_assert_msg(st.st_size == 0, "Expected size 0, got %lu",
+    (unsigned long) st.st_size);
+
+  (void) close(fd);
+}
+END_TEST
+
+Suite *tests_get_policy_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("policy");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, policy_open_flags_test);
+  tcase_add_test(testcase, policy_open_close_test);
+  tcase_add_test(testcase, policy_ioprio_test);
+  tcase_add_test(testcase, policy_write_test);
+  tcase_add_test(testcase, policy_fsync_test);
+  tcase_add_test(testcase, policy_preallocate_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
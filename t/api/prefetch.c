@@ -0,0 +1,168 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Prefetch tests. */
+
+#include "tests.h"
+#include "prefetch.h"
+
+static pool *p = NULL;
+
+static const char *prefetch_dir = "/tmp/vroot-test-prefetch";
+static const char *prefetch_file = "/tmp/vroot-test-prefetch/foo.txt";
+
+static void set_up(void) {
+  int fd;
+
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  (void) mkdir(prefetch_dir, 0755);
+  fd = open(prefetch_file, O_CREAT|O_WRONLY, 0644);
+  if (fd >= 0) {
+    (void) close(fd);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.prefetch", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_prefetch_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.prefetch", 0, 0);
+  }
+
+  (void) unlink(prefetch_file);
+  (void) rmdir(prefetch_dir);
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (prefetch_open_test) {
+  struct vroot_prefetch *pf;
+
+  mark_point();
+  pf = vroot_prefetch_open(NULL, 0, 0);
+  ck_assert_msg(pf == NULL, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  pf = vroot_prefetch_open(prefetch_dir, 0, 1);
+  ck_assert_msg(pf == NULL, "Failed to handle zero threads");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  pf = vroot_prefetch_open("/no/such/dir", 1, 1);
+  ck_assert_msg(pf == NULL, "Failed to handle nonexistent directory");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  mark_point();
+  pf = vroot_prefetch_open(prefetch_dir, 2, 8);
+  ck_assert_msg(pf != NULL, "Failed to open '%s': %s", prefetch_dir,
+    strerror(errno));
+
+  mark_point();
+  (void) vroot_prefetch_close(pf);
+  vroot_prefetch_flush();
+}
+END_TEST
+
+START_TEST (prefetch_lstat_test) {
+  int res;
+  register unsigned int i;
+  struct vroot_prefetch *pf;
+  struct stat st;
+
+  mark_point();
+  res = vroot_prefetch_lstat(NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_prefetch_lstat(prefetch_file, &st);
+  ck_assert_msg(res < 0, "Failed to handle missing prefetch state");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  mark_point();
+  pf = vroot_prefetch_open(prefetch_dir, 1, 8);
+  ck_assert_msg(pf != NULL, "Failed to open '%s': %s", prefetch_dir,
+    strerror(errno));
+
+  res = vroot_prefetch_add(pf, "foo.txt");
+  ck_assert_msg(res == 0, "Failed to add 'foo.txt': %s", strerror(errno));
+
+  /* Give the helper thread a chance to do its work. */
+  for (i = 0; i < 100; i++) {
+    usleep(10000);
+
+    res = vroot_prefetch_lstat(prefetch_file, &st);
+    if (res == 0) {
+      break;
+    }
+  }
+
+  ck_assert_msg(res == 0, "Failed to use prefetched metadata for '%s': %s",
+    prefetch_file, strerror(errno));
+  ck_assert_msg(S_ISREG(st.st_mode), "Expected regular file for '%s'",
+    prefetch_file);
+
+  /* Prefetched metadata is only used once. */
+  mark_point();
+  res = vroot_prefetch_lstat(prefetch_file, &st);
+  ck_assert_msg(res < 0, "Unexpectedly reused prefetched metadata");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  (void) vroot_prefetch_close(pf);
+  vroot_prefetch_flush();
+}
+END_TEST
+
+Suite *tests_get_prefetch_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("prefetch");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, prefetch_open_test);
+  tcase_add_test(testcase, prefetch_lstat_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,218 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* Sequential Read tests. */
+
+#include "tests.h"
+#include "seqread.h"
+
+static pool *p = NULL;
+
+static const char *seqread_test_dir = "/tmp/vroot-seqread-test.d";
+static const char *seqread_test_names[] = {
+  "a.txt", "b.txt", "c.txt", "d.txt", "e.txt", NULL
+};
+
+static const char *get_test_path(const char *name) {
+  return pdircat(p, seqread_test_dir, name, NULL);
+}
+
+static void set_up(void) {
+  register unsigned int i;
+
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  (void) mkdir(seqread_test_dir, 0755);
+
+  for (i = 0; seqread_test_names[i] != NULL; i++) {
+    int fd;
+
+    fd = open(get_test_path(seqread_test_names[i]), O_WRONLY|O_CREAT|O_TRUNC,
+      0644);
+    if (fd >= 0) {
+      (void) write(fd, "Hello, World!\n", 14);
+      (void) close(fd);
+    }
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.seqread", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  register unsigned int i;
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.seqread", 0, 0);
+  }
+
+  (void) vroot_seqread_free();
+
+  for (i = 0; seqread_test_names[i] != NULL; i++) {
+    (void) unlink(get_test_path(seqread_test_names[i]));
+  }
+  (void) rmdir(seqread_test_dir);
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+static struct vroot_seqread *record_listing(unsigned int nfiles,
+    off_t max_bytes) {
+  register unsigned int i;
+  struct vroot_seqread *sr;
+
+  sr = vroot_seqread_open(seqread_test_dir, nfiles, max_bytes);
+  ck_assert_msg(sr != NULL, "Failed to open listing: %s", strerror(errno));
+
+  (void) vroot_seqread_add(sr, ".");
+  (void) vroot_seqread_add(sr, "..");
+
+  for (i = 0; seqread_test_names[i] != NULL; i++) {
+    ck_assert_msg(vroot_seqread_add(sr, seqread_test_names[i]) == 0,
+      "Failed to add '%s': %s", seqread_test_names[i], strerror(errno));
+  }
+
+  ck_assert_msg(vroot_seqread_close(sr) == 0, "Failed to close listing: %s",
+    strerror(errno));
+  return sr;
+}
+
+START_TEST (seqread_open_test) {
+  struct vroot_seqread *sr;
+  int res;
+
+  mark_point();
+  sr = vroot_seqread_open(NULL, 0, 0);
+  ck_assert_msg(sr == NULL, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  sr = vroot_seqread_open(seqread_test_dir, 0, 1024);
+  ck_assert_msg(sr == NULL, "Failed to handle zero files");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_seqread_add(NULL, "foo");
+  ck_assert_msg(res < 0, "Failed to handle null listing");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_seqread_close(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null listing");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  mark_point();
+  res = vroot_seqread_opened(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Empty listings are not kept. */
+  sr = vroot_seqread_open(seqread_test_dir, 2, 1024);
+  ck_assert_msg(sr != NULL, "Failed to open listing: %s", strerror(errno));
+  res = vroot_seqread_close(sr);
+  ck_assert_msg(res == 0, "Failed to close listing: %s", strerror(errno));
+
+  res = vroot_seqread_opened(get_test_path("a.txt"));
+  ck_assert_msg(res < 0, "Unexpectedly found listing for 'a.txt'");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (seqread_opened_test) {
+  int res;
+
+  (void) record_listing(2, 1024 * 1024);
+
+  res = vroot_seqread_opened("/tmp/foo.txt");
+  ck_assert_msg(res < 0, "Unexpectedly found listing for '/tmp/foo.txt'");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* A single open is not yet a pattern. */
+  res = vroot_seqread_opened(get_test_path("a.txt"));
+  ck_assert_msg(res == 0, "Expected 0 files read ahead, got %d", res);
+
+  res = vroot_seqread_opened(get_test_path("b.txt"));
+  ck_assert_msg(res == 2, "Expected 2 files read ahead, got %d", res);
+
+  /* Only the next file beyond those already read ahead. */
+  res = vroot_seqread_opened(get_test_path("c.txt"));
+  ck_assert_msg(res == 1, "Expected 1 file read ahead, got %d", res);
+
+  /* Breaking the pattern stops the read ahead. */
+  res = vroot_seqread_opened(get_test_path("a.txt"));
+  ck_assert_msg(res == 0, "Expected 0 files read ahead, got %d", res);
+
+  res = vroot_seqread_opened(get_test_path("c.txt"));
+  ck_assert_msg(res == 0, "Expected 0 files read ahead, got %d", res);
+}
+END_TEST
+
+START_TEST (seqread_max_bytes_test) {
+  int res;
+
+  /* Each test file is 14 bytes; the budget covers one more file, plus a
+   * part of another.
+   */
+  (void) record_listing(4, 20);
+
+  res = vroot_seqread_opened(get_test_path("a.txt"));
+  ck_assert_msg(res == 0, "Expected 0 files read ahead, got %d", res);
+
+  res = vroot_seqread_opened(get_test_path("b.txt"));
+  ck_assert_msg(res == 2, "Expected 2 files read ahead, got %d", res);
+
+  /* Opening c.txt consumes its read ahead bytes, freeing up budget. */
+  res = vroot_seqread_opened(get_test_path("c.txt"));
+  ck_assert_msg(res == 1, "Expected 1 file read ahead, got %d", res);
+}
+END_TEST
+
+Suite *tests_get_seqread_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("seqread");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, seqread_open_test);
+  tcase_add_test(testcase, seqread_opened_test);
+  tcase_add_test(testcase, seqread_max_bytes_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,195 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Shard tests. */
+
+#include "tests.h"
+#include "shard.h"
+
+static pool *p = NULL;
+
+static const char *shard_test_dir = "/tmp/vroot-shard-test.d";
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  tests_remove_dir(shard_test_dir);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.shard", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.shard", 0, 0);
+  }
+
+  tests_remove_dir(shard_test_dir);
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (shard_get_test) {
+  int res;
+  char buf[32];
+
+  res = vroot_shard_get(NULL, 0, 0, NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_shard_get("foo", 3, VROOT_SHARD_MAX_LEVELS + 1, buf,
+    sizeof(buf));
+  ck_assert_msg(res < 0, "Failed to handle too many levels");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_shard_get("foo", 3, 2, buf, 6);
+  ck_assert_msg(res < 0, "Failed to handle too-small buffer");
+  ck_assert_msg(errno == ENAMETOOLONG,
+    "Expected ENAMETOOLONG (%d), got %s (%d)", ENAMETOOLONG, strerror(errno),
+    errno);
+
+  /* The shards must not change between releases, lest existing files be
+   * lost.
+   */
+  res = vroot_shard_get("foo", 3, 1, buf, sizeof(buf));
+  ck_assert_msg(res == 0, "Failed to get shard: %s", strerror(errno));
+  ck_assert_msg(strcmp(buf, "/d7") == 0, "Expected '/d7', got '%s'", buf);
+
+  res = vroot_shard_get("foo", 3, 2, buf, sizeof(buf));
+  ck_assert_msg(res == 0, "Failed to get shard: %s", strerror(errno));
+  ck_assert_msg(strcmp(buf, "/d7/7e") == 0, "Expected '/d7/7e', got '%s'",
+    buf);
+
+  /* Only the given length of the name is used. */
+  res = vroot_shard_get("foo.txt", 3, 2, buf, sizeof(buf));
+  ck_assert_msg(res == 0, "Failed to get shard: %s", strerror(errno));
+  ck_assert_msg(strcmp(buf, "/d7/7e") == 0, "Expected '/d7/7e', got '%s'",
+    buf);
+}
+END_TEST
+
+START_TEST (shard_mkdirs_test) {
+  int res;
+  struct stat st;
+
+  res = vroot_shard_mkdirs(NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_shard_mkdirs("/tmp/vroot-shard-test.d/d7/7e/foo", 2);
+  ck_assert_msg(res < 0, "Failed to handle missing sharded directory");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  (void) mkdir(shard_test_dir, 0755);
+
+  res = vroot_shard_mkdirs("/tmp/vroot-shard-test.d/d7/7e/foo", 2);
+  ck_assert_msg(res == 0, "Failed to create shards: %s", strerror(errno));
+
+  res = stat("/tmp/vroot-shard-test.d/d7/7e", &st);
+  ck_assert_msg(res == 0, "Failed to stat shard: %s", strerror(errno));
+  ck_assert_msg(S_ISDIR(st.st_mode), "Expected shard to be a directory");
+
+  /* Existing shards are not an error. */
+  res = vroot_shard_mkdirs("/tmp/vroot-shard-test.d/d7/7e/foo", 2);
+  ck_assert_msg(res == 0, "Failed to handle existing shards: %s",
+    strerror(errno));
+}
+END_TEST
+
+START_TEST (shard_readdir_test) {
+  int res, dot_count = 0, file_count = 0;
+  struct vroot_shard_dir *sd;
+  struct dirent *dent;
+
+  sd = vroot_shard_opendir(NULL, NULL, 0);
+  ck_assert_msg(sd == NULL, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  (void) mkdir(shard_test_dir, 0755);
+
+  res = vroot_shard_mkdirs("/tmp/vroot-shard-test.d/d7/7e/foo", 2);
+  ck_assert_msg(res == 0, "Failed to create shards: %s", strerror(errno));
+  tests_write_file("/tmp/vroot-shard-test.d/d7/7e/foo", "");
+
+  res = vroot_shard_mkdirs("/tmp/vroot-shard-test.d/01/02/bar", 2);
+  ck_assert_msg(res == 0, "Failed to create shards: %s", strerror(errno));
+  tests_write_file("/tmp/vroot-shard-test.d/01/02/bar", "");
+
+  /* Names which are not shards are not listed. */
+  tests_write_file("/tmp/vroot-shard-test.d/baz", "");
+
+  sd = vroot_shard_opendir(p, shard_test_dir, 2);
+  ck_assert_msg(sd != NULL, "Failed to open '%s': %s", shard_test_dir,
+    strerror(errno));
+
+  while ((dent = vroot_shard_readdir(sd)) != NULL) {
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      dot_count++;
+
+    } else if (strcmp(dent->d_name, "foo") == 0 ||
+               strcmp(dent->d_name, "bar") == 0) {
+      file_count++;
+
+    } else {
+      ck_assert_msg(FALSE, "Unexpected entry '%s'", dent->d_name);
+    }
+  }
+
+  ck_assert_msg(dot_count == 2, "Expected 2 dot entries, got %d", dot_count);
+  ck_assert_msg(file_count == 2, "Expected 2 files, got %d", file_count);
+
+  res = vroot_shard_closedir(sd);
+  ck_assert_msg(res == 0, "Failed to close '%s': %s", shard_test_dir,
+    strerror(errno));
+}
+END_TEST
+
+Suite *tests_get_shard_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("shard");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, shard_get_test);
+  tcase_add_test(testcase, shard_mkdirs_test);
+  tcase_add_test(testcase, shard_readdir_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,407 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Spread alias tests. */
+
+#include "tests.h"
+#include "spread.h"
+
+static pool *p = NULL;
+
+static const char *spread_test_dir = "/tmp/vroot-spread-test.d";
+static const char *spread_test_target0 = "/tmp/vroot-spread-test.d/t0";
+static const char *spread_test_target1 = "/tmp/vroot-spread-test.d/t1";
+static const char *spread_test_index =
+  "/tmp/vroot-spread-test.d/t0/.vroot-spread";
+
+static void add_spread(void) {
+  int res;
+  array_header *targets;
+
+  targets = make_array(p, 2, sizeof(char *));
+  *((const char **) push_array(targets)) = spread_test_target0;
+  *((const char **) push_array(targets)) = spread_test_target1;
+
+  res = vroot_spread_add("/incoming", targets, VROOT_SPREAD_PLACEMENT_SPACE);
+  ck_assert_msg(res == 0, "Failed to add spread: %s", strerror(errno));
+}
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  session.pool = p;
+
+  tests_remove_dir(spread_test_dir);
+  (void) mkdir(spread_test_dir, 0755);
+  (void) mkdir(spread_test_target0, 0755);
+  (void) mkdir(spread_test_target1, 0755);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.spread", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_spread_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.spread", 0, 0);
+  }
+
+  tests_remove_dir(spread_test_dir);
+  session.pool = NULL;
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (spread_add_test) {
+  int res;
+  array_header *targets;
+
+  res = vroot_spread_add(NULL, NULL, 0);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  targets = make_array(p, 1, sizeof(char *));
+  *((const char **) push_array(targets)) = spread_test_target0;
+
+  res = vroot_spread_add("/incoming", targets, VROOT_SPREAD_PLACEMENT_SPACE);
+  ck_assert_msg(res < 0, "Failed to handle single target");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  *((const char **) push_array(targets)) = spread_test_target1;
+
+  res = vroot_spread_add("/incoming", targets, -1);
+  ck_assert_msg(res < 0, "Failed to handle unknown placement");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  ck_assert_msg(vroot_spread_count() == 0, "Expected no spreads");
+
+  add_spread();
+  ck_assert_msg(vroot_spread_count() == 1, "Expected 1 spread, got %u",
+    vroot_spread_count());
+
+  ck_assert_msg(vroot_spread_contains("/tmp/vroot-spread-test.d/t1/a.txt") ==
+    TRUE, "Expected target path to be in spread");
+  ck_assert_msg(vroot_spread_contains("/tmp/vroot-spread-test.d/a.txt") ==
+    FALSE, "Expected other path not to be in spread");
+}
+END_TEST
+
+START_TEST (spread_lookup_test) {
+  int res;
+  char path[PR_TUNABLE_PATH_MAX + 1];
+
+  add_spread();
+
+  /* New files take turns among targets with about the same free space. */
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/a.txt", sizeof(path));
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_CREATE);
+  ck_assert_msg(res == 0, "Failed to place a.txt: %s", strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-spread-test.d/t0/a.txt") == 0,
+    "Expected a.txt on first target, got '%s'", path);
+  tests_write_file(path, "");
+
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/b.txt", sizeof(path));
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_CREATE);
+  ck_assert_msg(res == 0, "Failed to place b.txt: %s", strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-spread-test.d/t1/b.txt") == 0,
+    "Expected b.txt on second target, got '%s'", path);
+  tests_write_file(path, "");
+
+  /* Existing files are found where they are, whether reading or replacing
+   * them.
+   */
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/b.txt", sizeof(path));
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_CREATE);
+  ck_assert_msg(res == 0, "Failed to look up b.txt: %s", strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-spread-test.d/t1/b.txt") == 0,
+    "Expected b.txt on second target, got '%s'", path);
+
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/b.txt", sizeof(path));
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_FIND);
+  ck_assert_msg(res == 0, "Failed to look up b.txt: %s", strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-spread-test.d/t1/b.txt") == 0,
+    "Expected b.txt on second target, got '%s'", path);
+
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/c.txt", sizeof(path));
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_FIND);
+  ck_assert_msg(res == 0, "Failed to look up c.txt: %s", strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-spread-test.d/t0/c.txt") == 0,
+    "Expected missing c.txt on first target, got '%s'", path);
+
+  sstrncpy(path, spread_test_index, sizeof(path));
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_FIND);
+  ck_assert_msg(res < 0, "Failed to deny access to index");
+  ck_assert_msg(errno == EACCES, "Expected EACCES (%d), got %s (%d)", EACCES,
+    strerror(errno), errno);
+
+  snprintf(path, sizeof(path), "%s.1234", spread_test_index);
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_FIND);
+  ck_assert_msg(res < 0, "Failed to deny access to compacted index");
+  ck_assert_msg(errno == EACCES, "Expected EACCES (%d), got %s (%d)", EACCES,
+    strerror(errno), errno);
+
+  /* Renamed files stay on their target. */
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/d.txt", sizeof(path));
+  res = vroot_spread_colocate("/tmp/vroot-spread-test.d/t1/b.txt", path,
+    sizeof(path));
+  ck_assert_msg(res == 0, "Failed to colocate d.txt: %s", strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-spread-test.d/t1/d.txt") == 0,
+    "Expected d.txt on second target, got '%s'", path);
+}
+END_TEST
+
+START_TEST (spread_index_test) {
+  int fd, res;
+  char path[PR_TUNABLE_PATH_MAX + 1], buf[256];
+  ssize_t buflen;
+
+  add_spread();
+
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/a.txt", sizeof(path));
+  (void) vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_CREATE);
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/b.txt", sizeof(path));
+  (void) vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_CREATE);
+  tests_write_file(path, "");
+
+  fd = open(spread_test_index, O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open index: %s", strerror(errno));
+  buflen = read(fd, buf, sizeof(buf)-1);
+  (void) close(fd);
+
+  ck_assert_msg(buflen > 0, "Failed to read index: %s", strerror(errno));
+  buf[buflen] = '\0';
+  ck_assert_msg(strcmp(buf, "0 a.txt\n1 b.txt\n") == 0,
+    "Unexpected index '%s'", buf);
+
+  /* A later session finds the files through the index; stale entries are
+   * ignored.
+   */
+  (void) vroot_spread_free();
+  add_spread();
+
+  fd = open(spread_test_index, O_WRONLY|O_APPEND);
+  ck_assert_msg(fd >= 0, "Failed to open index: %s", strerror(errno));
+  ck_assert_msg(write(fd, "0 b.txt\n", 8) == 8, "Failed to write index: %s",
+    strerror(errno));
+  (void) close(fd);
+
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/b.txt", sizeof(path));
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_FIND);
+  ck_assert_msg(res == 0, "Failed to look up b.txt: %s", strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-spread-test.d/t1/b.txt") == 0,
+    "Expected b.txt on second target, got '%s'", path);
+}
+END_TEST
+
+START_TEST (spread_compact_test) {
+  register unsigned int i;
+  int fd, res;
+  char path[PR_TUNABLE_PATH_MAX + 1], buf[256];
+  ssize_t buflen;
+  FILE *fh;
+
+  /* An index with many more lines than entries is compacted when first
+   * read, keeping only the entries for files which exist.
+   */
+  tests_write_file("/tmp/vroot-spread-test.d/t1/a.txt", "");
+
+  fh = fopen(spread_test_index, "w");
+  ck_assert_msg(fh != NULL, "Failed to open index: %s", strerror(errno));
+  for (i = 0; i < 5000; i++) {
+    fprintf(fh, "%u a.txt\n", i % 2);
+  }
+  fprintf(fh, "0 gone.txt\n");
+  (void) fclose(fh);
+
+  add_spread();
+
+  sstrncpy(path, "/tmp/vroot-spread-test.d/t0/a.txt", sizeof(path));
+  res = vroot_spread_lookup(path, sizeof(path), VROOT_SPREAD_OP_FIND);
+  ck_assert_msg(res == 0, "Failed to look up a.txt: %s", strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-spread-test.d/t1/a.txt") == 0,
+    "Expected a.txt on second target, got '%s'", path);
+
+  fd = open(spread_test_index, O_RDONLY);
+  ck_assert_msg(fd >= 0, "Failed to open index: %s", strerror(errno));
+  buflen = read(fd, buf, sizeof(buf)-1);
+  (void) close(fd);
+
+  ck_assert_msg(buflen > 0, "Failed to read index: %s", strerror(errno));
+  buf[buflen] = '\0';
+  ck_assert_msg(strcmp(buf, "1 a.txt\n") == 0, "Unexpected index '%s'", buf);
+
+  snprintf(path, sizeof(path), "%s.%lu", spread_test_index,
+    (unsigned long) getpid());
+  ck_assert_msg(tests_path_exists(path) == FALSE, "Unexpectedly found '%s'",
+    path);
+}
+END_TEST
+
+START_TEST (spread_mkdirs_test) {
+  int res;
+  struct stat st;
+
+  add_spread();
+
+  (void) mkdir("/tmp/vroot-spread-test.d/t0/sub", 0750);
+  (void) chmod("/tmp/vroot-spread-test.d/t0/sub", 0750);
+
+  res = vroot_spread_mkdirs("/tmp/vroot-spread-test.d/t1/sub/new.txt");
+  ck_assert_msg(res == 0, "Failed to create parents: %s", strerror(errno));
+
+  res = stat("/tmp/vroot-spread-test.d/t1/sub", &st);
+  ck_assert_msg(res == 0, "Expected t1/sub to be created: %s",
+    strerror(errno));
+  ck_assert_msg((st.st_mode & 07777) == 0750, "Expected mode 0750, got %04o",
+    (unsigned int) (st.st_mode & 07777));
+
+  res = vroot_spread_mkdirs("/tmp/vroot-spread-test.d/t1/none/new.txt");
+  ck_assert_msg(res < 0, "Failed to handle missing parent");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (spread_readdir_test) {
+  struct vroot_spread_dir *sd;
+  struct dirent *dent;
+  DIR *dirh;
+  int nfiles = 0, ndirs = 0;
+
+  add_spread();
+
+  (void) mkdir("/tmp/vroot-spread-test.d/t0/sub", 0755);
+  (void) mkdir("/tmp/vroot-spread-test.d/t1/sub", 0755);
+  tests_write_file("/tmp/vroot-spread-test.d/t0/a.txt", "");
+  tests_write_file("/tmp/vroot-spread-test.d/t1/b.txt", "");
+  tests_write_file(spread_test_index, "");
+  tests_write_file("/tmp/vroot-spread-test.d/t0/.vroot-spread.1234", "");
+
+  sd = vroot_spread_opendir("/tmp/vroot-other.d");
+  ck_assert_msg(sd == NULL, "Failed to handle path outside of spread");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  sd = vroot_spread_opendir(spread_test_target0);
+  ck_assert_msg(sd != NULL, "Failed to open spread directory: %s",
+    strerror(errno));
+
+  /* The caller reads the first directory, then the other targets. */
+  dirh = opendir(spread_test_target0);
+  ck_assert_msg(dirh != NULL, "Failed to open '%s': %s", spread_test_target0,
+    strerror(errno));
+
+  while ((dent = readdir(dirh)) != NULL) {
+    if (vroot_spread_filter(sd, dent->d_name) == FALSE) {
+      continue;
+    }
+
+    if (strcmp(dent->d_name, "sub") == 0) {
+      ndirs++;
+
+    } else if (strcmp(dent->d_name, "a.txt") == 0) {
+      nfiles++;
+
+    } else if (strcmp(dent->d_name, ".") != 0 &&
+               strcmp(dent->d_name, "..") != 0) {
+      ck_assert_msg(FALSE, "Unexpected entry '%s'", dent->d_name);
+    }
+  }
+  (void) closedir(dirh);
+
+  while ((dent = vroot_spread_readdir(sd)) != NULL) {
+    if (strcmp(dent->d_name, "sub") == 0) {
+      ndirs++;
+
+    } else if (strcmp(dent->d_name, "b.txt") == 0) {
+      nfiles++;
+
+    } else {
+      ck_assert_msg(FALSE, "Unexpected entry '%s'", dent->d_name);
+    }
+  }
+
+  (void) vroot_spread_closedir(sd);
+
+  ck_assert_msg(nfiles == 2, "Expected 2 files, got %d", nfiles);
+  ck_assert_msg(ndirs == 1, "Expected 'sub' once, got %d", ndirs);
+}
+END_TEST
+
+START_TEST (spread_rmdir_test) {
+  int res;
+
+  add_spread();
+
+  (void) mkdir("/tmp/vroot-spread-test.d/t0/sub", 0755);
+  (void) mkdir("/tmp/vroot-spread-test.d/t1/sub", 0755);
+  tests_write_file("/tmp/vroot-spread-test.d/t1/sub/b.txt", "");
+
+  res = vroot_spread_rmdir("/tmp/vroot-spread-test.d/t0/sub");
+  ck_assert_msg(res < 0, "Failed to handle non-empty directory");
+  ck_assert_msg(errno == ENOTEMPTY, "Expected ENOTEMPTY (%d), got %s (%d)",
+    ENOTEMPTY, strerror(errno), errno);
+
+  (void) unlink("/tmp/vroot-spread-test.d/t1/sub/b.txt");
+
+  res = vroot_spread_rmdir("/tmp/vroot-spread-test.d/t0/sub");
+  ck_assert_msg(res == 0, "Failed to remove other copies: %s",
+    strerror(errno));
+  ck_assert_msg(tests_path_exists("/tmp/vroot-spread-test.d/t1/sub") == FALSE,
+    "Expected t1/sub to be removed");
+  ck_assert_msg(tests_path_exists("/tmp/vroot-spread-test.d/t0/sub") == TRUE,
+    "Expected t0/sub to be left for the caller");
+}
+END_TEST
+
+Suite *tests_get_spread_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("spread");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, spread_add_test);
+  tcase_add_test(testcase, spread_lookup_test);
+  tcase_add_test(testcase, spread_index_test);
+  tcase_add_test(testcase, spread_compact_test);
+  tcase_add_test(testcase, spread_mkdirs_test);
+  tcase_add_test(testcase, spread_readdir_test);
+  tcase_add_test(testcase, spread_rmdir_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
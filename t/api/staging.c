@@ -0,0 +1,347 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Staging tests. */
+
+#include "tests.h"
+#include "staging.h"
+
+static pool *p = NULL;
+
+static const char *staging_src_dir = "/tmp/vroot-staging-src.d";
+static const char *staging_src_file = "/tmp/vroot-staging-src.d/file.txt";
+static const char *staging_dir = "/tmp/vroot-staging.d";
+static const char *staging_outside_dir = "/tmp/vroot-staging-outside.d";
+
+static void test_cleanup(void) {
+  tests_remove_dir(staging_dir);
+  tests_remove_dir(staging_src_dir);
+  tests_remove_dir(staging_outside_dir);
+}
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  session.pool = p;
+  test_cleanup();
+
+  (void) mkdir(staging_src_dir, 0755);
+  (void) mkdir(staging_dir, 0755);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.staging", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_staging_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.staging", 0, 0);
+  }
+
+  test_cleanup();
+  session.pool = NULL;
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+/* Provides the ID of a process which no longer exists. */
+static pid_t get_dead_pid(void) {
+  pid_t pid;
+
+  pid = fork();
+  if (pid == 0) {
+    _exit(0);
+  }
+
+  (void) waitpid(pid, NULL, 0);
+  return pid;
+}
+
+START_TEST (staging_add_test) {
+  int res;
+
+  res = vroot_staging_add(NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_staging_add(staging_src_dir, "staging.d");
+  ck_assert_msg(res < 0, "Failed to handle relative staging directory");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  ck_assert_msg(vroot_staging_count() == 0, "Expected no staging");
+
+  res = vroot_staging_add(staging_src_dir, staging_dir);
+  ck_assert_msg(res == 0, "Failed to add staging: %s", strerror(errno));
+  ck_assert_msg(vroot_staging_count() == 1, "Expected 1 staging");
+  (void) vroot_staging_wait();
+
+  /* Appending to a file, or files outside of the source, are not staged. */
+  res = vroot_staging_open(staging_src_file, O_WRONLY|O_CREAT|O_APPEND);
+  ck_assert_msg(res < 0, "Failed to handle append");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_staging_open("/tmp/file.txt", O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(res < 0, "Failed to handle path outside of source");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (staging_upload_test) {
+  int fd, res;
+  const char *staged_path;
+  array_header *names;
+  struct stat st;
+
+  res = vroot_staging_add(staging_src_dir, staging_dir);
+  ck_assert_msg(res == 0, "Failed to add staging: %s", strerror(errno));
+  (void) vroot_staging_wait();
+
+  fd = vroot_staging_open(staging_src_file, O_WRONLY|O_CREAT|O_TRUNC);
+  ck_assert_msg(fd >= 0, "Failed to stage upload: %s", strerror(errno));
+  ck_assert_msg(write(fd, "Hello, World!\n", 14) == 14,
+    "Failed to write upload: %s", strerror(errno));
+
+  /* Until migrated, the upload is only in the staging directory. */
+  staged_path = vroot_staging_get(staging_src_file);
+  ck_assert_msg(staged_path != NULL, "Failed to get staged path: %s",
+    strerror(errno));
+  ck_assert_msg(strncmp(staged_path, staging_dir, strlen(staging_dir)) == 0,
+    "Expected staged path in '%s', got '%s'", staging_dir, staged_path);
+  ck_assert_msg(stat(staging_src_file, &st) < 0,
+    "Unexpectedly found '%s' before migration", staging_src_file);
+
+  names = make_array(p, 1, sizeof(char *));
+  res = vroot_staging_scan(p, staging_src_dir, names);
+  ck_assert_msg(res == 0, "Failed to scan staged uploads: %s",
+    strerror(errno));
+  ck_assert_msg(names->nelts == 1, "Expected 1 staged name, got %d",
+    names->nelts);
+  ck_assert_msg(strcmp(((char **) names->elts)[0], "file.txt") == 0,
+    "Expected 'file.txt', got '%s'", ((char **) names->elts)[0]);
+
+  res = vroot_staging_close(fd);
+  ck_assert_msg(res == 0, "Failed to complete staged upload: %s",
+    strerror(errno));
+  (void) close(fd);
+
+  res = vroot_staging_flush(staging_src_file);
+  ck_assert_msg(res == 0, "Failed to migrate staged upload: %s",
+    strerror(errno));
+
+  ck_assert_msg(stat(staging_src_file, &st) == 0,
+    "Expected '%s' after migration: %s", staging_src_file, strerror(errno));
+  ck_assert_msg(st.st_size == 14, "Expected 14 bytes, got %lu",
+    (unsigned long) st.st_size);
+
+  staged_path = vroot_staging_get(staging_src_file);
+  ck_assert_msg(staged_path == NULL, "Unexpectedly found staged path '%s'",
+    staged_path);
+
+  res = vroot_staging_close(fd);
+  ck_assert_msg(res < 0, "Failed to handle unstaged descriptor");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (staging_recover_test) {
+  int res;
+  pid_t pid;
+  char path[PR_TUNABLE_PATH_MAX];
+  struct stat st;
+
+  /* Left behind by a session which crashed after completing one upload,
+   * and while writing another.
+   */
+  pid = get_dead_pid();
+
+  snprintf(path, sizeof(path), "%s/0000000000000000.%lu.0.data", staging_dir,
+    (unsigned long) pid);
+  tests_write_file(path, "Hello, World!\n");
+  snprintf(path, sizeof(path), "%s/0000000000000000.%lu.0.journal",
+    staging_dir, (unsigned long) pid);
+  tests_write_file(path, staging_src_file);
+
+  snprintf(path, sizeof(path), "%s/0000000000000000.%lu.1.data", staging_dir,
+    (unsigned long) pid);
+  tests_write_file(path, "Hello");
+
+  res = vroot_staging_add(staging_src_dir, staging_dir);
+  ck_assert_msg(res == 0, "Failed to add staging: %s", strerror(errno));
+
+  res = vroot_staging_wait();
+  ck_assert_msg(res == 1, "Expected 1 migrated upload, got %d", res);
+
+  ck_assert_msg(stat(staging_src_file, &st) == 0,
+    "Expected '%s' after recovery: %s", staging_src_file, strerror(errno));
+  ck_assert_msg(st.st_size == 14, "Expected 14 bytes, got %lu",
+    (unsigned long) st.st_size);
+
+  ck_assert_msg(stat(path, &st) < 0, "Expected incomplete upload '%s' to be "
+    "removed", path);
+}
+END_TEST
+
+START_TEST (staging_recover_dst_test) {
+  register unsigned int i;
+  int res;
+  pid_t pid;
+  char path[PR_TUNABLE_PATH_MAX], link_path[PR_TUNABLE_PATH_MAX];
+  const char *dsts[] = {
+    "/tmp/vroot-staging-outside.d/file.txt",
+    "/tmp/vroot-staging-src.d/../vroot-staging-outside.d/file.txt",
+    "/tmp/vroot-staging-src.d/link.d/file.txt",
+    NULL
+  };
+  struct stat st;
+
+  /* Journals naming destinations outside of the source, or reached via
+   * symlinks, are not migrated.
+   */
+  (void) mkdir(staging_outside_dir, 0755);
+  snprintf(link_path, sizeof(link_path), "%s/link.d", staging_src_dir);
+  ck_assert_msg(symlink(staging_outside_dir, link_path) == 0,
+    "Failed to symlink '%s': %s", link_path, strerror(errno));
+
+  pid = get_dead_pid();
+
+  for (i = 0; dsts[i] != NULL; i++) {
+    snprintf(path, sizeof(path), "%s/000000000000000%u.%lu.0.data",
+      staging_dir, i, (unsigned long) pid);
+    tests_write_file(path, "Hello, World!\n");
+    snprintf(path, sizeof(path), "%s/000000000000000%u.%lu.0.journal",
+      staging_dir, i, (unsigned long) pid);
+    tests_write_file(path, dsts[i]);
+  }
+
+  res = vroot_staging_add(staging_src_dir, staging_dir);
+  ck_assert_msg(res == 0, "Failed to add staging: %s", strerror(errno));
+
+  res = vroot_staging_wait();
+  ck_assert_msg(res == 0, "Expected no migrated uploads, got %d", res);
+
+  ck_assert_msg(stat(dsts[0], &st) < 0,
+    "Unexpectedly found '%s' after recovery", dsts[0]);
+}
+END_TEST
+
+START_TEST (staging_shared_test) {
+  int res;
+  const char *staged_path;
+  char path[PR_TUNABLE_PATH_MAX], base[64];
+  const unsigned char *ptr;
+  unsigned long long h = 14695981039346656037ULL;
+  array_header *names;
+  struct stat st;
+
+  res = vroot_staging_add(staging_src_dir, staging_dir);
+  ck_assert_msg(res == 0, "Failed to add staging: %s", strerror(errno));
+  (void) vroot_staging_wait();
+
+  /* A completed upload by another, still running, session of this user. */
+  for (ptr = (const unsigned char *) staging_src_file; *ptr != '\0'; ptr++) {
+    h ^= *ptr;
+    h *= 1099511628211ULL;
+  }
+
+  snprintf(base, sizeof(base), "%016llx.%lu.0", h, (unsigned long) getppid());
+  snprintf(path, sizeof(path), "%s/%s.data", staging_dir, base);
+  tests_write_file(path, "Hello, World!\n");
+  snprintf(path, sizeof(path), "%s/%s.journal", staging_dir, base);
+  tests_write_file(path, staging_src_file);
+
+  /* This session sees it, until it is migrated... */
+  staged_path = vroot_staging_get(staging_src_file);
+  ck_assert_msg(staged_path != NULL, "Failed to get staged path: %s",
+    strerror(errno));
+  snprintf(path, sizeof(path), "%s/%s.data", staging_dir, base);
+  ck_assert_msg(strcmp(staged_path, path) == 0, "Expected '%s', got '%s'",
+    path, staged_path);
+
+  names = make_array(p, 1, sizeof(char *));
+  res = vroot_staging_scan(p, staging_src_dir, names);
+  ck_assert_msg(res == 0, "Failed to scan staged uploads: %s",
+    strerror(errno));
+  ck_assert_msg(names->nelts == 1, "Expected 1 staged name, got %d",
+    names->nelts);
+  ck_assert_msg(strcmp(((char **) names->elts)[0], "file.txt") == 0,
+    "Expected 'file.txt', got '%s'", ((char **) names->elts)[0]);
+
+  /* ...which it may do itself, before changing the file. */
+  res = vroot_staging_flush(staging_src_file);
+  ck_assert_msg(res == 0, "Failed to migrate staged upload: %s",
+    strerror(errno));
+  ck_assert_msg(stat(staging_src_file, &st) == 0,
+    "Expected '%s' after migration: %s", staging_src_file, strerror(errno));
+
+  staged_path = vroot_staging_get(staging_src_file);
+  ck_assert_msg(staged_path == NULL, "Unexpectedly found staged path '%s'",
+    staged_path);
+
+  /* The uploads of other users are not seen. */
+  if (geteuid() == 0) {
+    (void) unlink(staging_src_file);
+    snprintf(path, sizeof(path), "%s/%s.data", staging_dir, base);
+    tests_write_file(path, "Hello, World!\n");
+    (void) chown(path, 65534, 65534);
+    snprintf(path, sizeof(path), "%s/%s.journal", staging_dir, base);
+    tests_write_file(path, staging_src_file);
+    (void) chown(path, 65534, 65534);
+
+    staged_path = vroot_staging_get(staging_src_file);
+    ck_assert_msg(staged_path == NULL,
+      "Unexpectedly found staged path '%s' of another user", staged_path);
+  }
+}
+END_TEST
+
+Suite *tests_get_staging_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("staging");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, staging_add_test);
+  tcase_add_test(testcase, staging_upload_test);
+  tcase_add_test(testcase, staging_recover_test);
+  tcase_add_test(testcase, staging_recover_dst_test);
+  tcase_add_test(testcase, staging_shared_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -33,10 +33,81 @@ static struct testsuite_info suites[] = {
   { "path",		tests_get_path_suite },
   { "alias",		tests_get_alias_suite },
   { "fsio",		tests_get_fsio_suite },
+  { "prefetch",		tests_get_prefetch_suite },
+  { "ctx",		tests_get_ctx_suite },
+  { "copy",		tests_get_copy_suite },
+  { "policy",		tests_get_policy_suite },
+  { "seqread",		tests_get_seqread_suite },
+  { "warmup",		tests_get_warmup_suite },
+  { "watchdog",		tests_get_watchdog_suite },
+  { "throttle",		tests_get_throttle_suite },
+  { "dircache",		tests_get_dircache_suite },
+  { "aliascache",	tests_get_aliascache_suite },
+  { "casefold",		tests_get_casefold_suite },
+  { "union",		tests_get_union_suite },
+  { "hide",		tests_get_hide_suite },
+  { "virtdir",		tests_get_virtdir_suite },
+  { "shard",		tests_get_shard_suite },
+  { "cachetier",	tests_get_cachetier_suite },
+  { "staging",	tests_get_staging_suite },
+  { "spread",	tests_get_spread_suite },
+  { "mirror",	tests_get_mirror_suite },
 
   { NULL, NULL }
 };
 
+void tests_remove_dir(const char *path) {
+  DIR *dirh;
+  struct dirent *dent;
+  struct stat st;
+
+  /* Symlinks are removed, not followed. */
+  if (lstat(path, &st) < 0 ||
+      !S_ISDIR(st.st_mode)) {
+    (void) unlink(path);
+    return;
+  }
+
+  dirh = opendir(path);
+  if (dirh == NULL) {
+    return;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    char child_path[PR_TUNABLE_PATH_MAX];
+
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+    snprintf(child_path, sizeof(child_path), "%s/%s", path, dent->d_name);
+    tests_remove_dir(child_path);
+  }
+
+  (void) closedir(dirh);
+  (void) rmdir(path);
+}
+
+void tests_write_file(const char *path, const char *text) {
+  int fd;
+  size_t textlen;
+
+  fd = open(path, O_CREAT|O_TRUNC|O_WRONLY, 0644);
+  ck_assert_msg(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+
+  textlen = strlen(text);
+  ck_assert_msg(write(fd, text, textlen) == (ssize_t) textlen,
+    "Failed to write '%s': %s", path, strerror(errno));
+  (void) close(fd);
+}
+
+int tests_path_exists(const char *path) {
+  struct stat st;
+
+  return (lstat(path, &st) == 0);
+}
+
 static Suite *tests_get_suite(const char *suite) {
   register unsigned int i;
 
@@ -38,6 +38,34 @@
 Suite *tests_get_path_suite(void);
 Suite *tests_get_alias_suite(void);
 Suite *tests_get_fsio_suite(void);
+Suite *tests_get_prefetch_suite(void);
+Suite *tests_get_ctx_suite(void);
+Suite *tests_get_copy_suite(void);
+Suite *tests_get_policy_suite(void);
+Suite *tests_get_seqread_suite(void);
+Suite *tests_get_warmup_suite(void);
+Suite *tests_get_watchdog_suite(void);
+Suite *tests_get_throttle_suite(void);
+Suite *tests_get_dircache_suite(void);
+Suite *tests_get_aliascache_suite(void);
+Suite *tests_get_casefold_suite(void);
+Suite *tests_get_union_suite(void);
+Suite *tests_get_hide_suite(void);
+Suite *tests_get_virtdir_suite(void);
+Suite *tests_get_shard_suite(void);
+Suite *tests_get_cachetier_suite(void);
+Suite *tests_get_staging_suite(void);
+Suite *tests_get_spread_suite(void);
+Suite *tests_get_mirror_suite(void);
+
+/* Removes the given file, or directory and everything within it. */
+void tests_remove_dir(const char *path);
+
+/* Creates, or truncates, the given file, and writes the given text to it. */
+void tests_write_file(const char *path, const char *text);
+
+/* Returns TRUE if the given path exists, without following symlinks. */
+int tests_path_exists(const char *path);
 
 extern volatile unsigned int recvd_signal_flags;
 extern pid_t mpid;
@@ -0,0 +1,160 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* Throttle tests. */
+
+#include "tests.h"
+#include "throttle.h"
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.throttle", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.throttle", 0, 0);
+  }
+
+  (void) vroot_throttle_free();
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (throttle_set_limit_test) {
+  int res;
+  unsigned long nops = 0, nthrottled = 0;
+
+  mark_point();
+  res = vroot_throttle_set_limit(VROOT_THROTTLE_MAX_RATE + 1, 0);
+  ck_assert_msg(res < 0, "Failed to handle excessive rate");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_throttle_get_stats(NULL, NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Without any limits, operations are neither delayed nor counted. */
+  res = vroot_throttle_acquire("/foo");
+  ck_assert_msg(res == 0, "Expected no delay, got %d ms", res);
+
+  res = vroot_throttle_get_stats(&nops, NULL, NULL);
+  ck_assert_msg(res == 0, "Failed to get stats: %s", strerror(errno));
+  ck_assert_msg(nops == 0, "Expected 0 operations, got %lu", nops);
+
+  mark_point();
+  res = vroot_throttle_set_limit(20, 2);
+  ck_assert_msg(res == 0, "Failed to set limit: %s", strerror(errno));
+
+  /* The burst is not delayed... */
+  res = vroot_throttle_acquire("/foo");
+  ck_assert_msg(res == 0, "Expected no delay, got %d ms", res);
+  res = vroot_throttle_acquire("/foo");
+  ck_assert_msg(res == 0, "Expected no delay, got %d ms", res);
+
+  /* ...but operations beyond it are. */
+  res = vroot_throttle_acquire("/foo");
+  ck_assert_msg(res > 0, "Expected delay, got none");
+  ck_assert_msg(res <= 50, "Expected delay of at most 50 ms, got %d ms", res);
+
+  res = vroot_throttle_get_stats(&nops, &nthrottled, NULL);
+  ck_assert_msg(res == 0, "Failed to get stats: %s", strerror(errno));
+  ck_assert_msg(nops == 3, "Expected 3 operations, got %lu", nops);
+  ck_assert_msg(nthrottled == 1, "Expected 1 throttled operation, got %lu",
+    nthrottled);
+
+  /* Removing the limit stops any delays. */
+  res = vroot_throttle_set_limit(0, 0);
+  ck_assert_msg(res == 0, "Failed to remove limit: %s", strerror(errno));
+
+  res = vroot_throttle_acquire("/foo");
+  ck_assert_msg(res == 0, "Expected no delay, got %d ms", res);
+}
+END_TEST
+
+START_TEST (throttle_add_alias_test) {
+  int res;
+  unsigned long nops = 0, nthrottled = 0, delay_ms = 0;
+
+  mark_point();
+  res = vroot_throttle_add_alias(NULL, 1, 0);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_throttle_add_alias("/srv/nfs", 0, 0);
+  ck_assert_msg(res < 0, "Failed to handle zero rate");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_throttle_add_alias("/srv/nfs", 20, 1);
+  ck_assert_msg(res == 0, "Failed to add alias limit: %s", strerror(errno));
+
+  /* Paths outside of the alias source are not limited. */
+  res = vroot_throttle_acquire("/srv/nfs2/foo");
+  ck_assert_msg(res == 0, "Expected no delay, got %d ms", res);
+  res = vroot_throttle_acquire("/srv/nfs2/foo");
+  ck_assert_msg(res == 0, "Expected no delay, got %d ms", res);
+
+  res = vroot_throttle_acquire("/srv/nfs");
+  ck_assert_msg(res == 0, "Expected no delay, got %d ms", res);
+
+  res = vroot_throttle_acquire("/srv/nfs/foo/bar");
+  ck_assert_msg(res > 0, "Expected delay, got none");
+
+  res = vroot_throttle_get_stats(&nops, &nthrottled, &delay_ms);
+  ck_assert_msg(res == 0, "Failed to get stats: %s", strerror(errno));
+  ck_assert_msg(nops == 2, "Expected 2 operations, got %lu", nops);
+  ck_assert_msg(nthrottled == 1, "Expected 1 throttled operation, got %lu",
+    nthrottled);
+  ck_assert_msg(delay_ms > 0, "Expected delay, got none");
+}
+END_TEST
+
+Suite *tests_get_throttle_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("throttle");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, throttle_set_limit_test);
+  tcase_add_test(testcase, throttle_add_alias_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,344 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Union alias tests. */
+
+#include "tests.h"
+#include "union.h"
+
+static pool *p = NULL;
+
+static const char *union_test_dir = "/tmp/vroot-union-test.d";
+static const char *union_test_top = "/tmp/vroot-union-test.d/top";
+static const char *union_test_lower = "/tmp/vroot-union-test.d/lower";
+
+static void add_union(void) {
+  int res;
+  array_header *layers;
+
+  layers = make_array(p, 2, sizeof(char *));
+  *((const char **) push_array(layers)) = union_test_top;
+  *((const char **) push_array(layers)) = union_test_lower;
+
+  res = vroot_union_add("/shared", layers);
+  ck_assert_msg(res == 0, "Failed to add union: %s", strerror(errno));
+}
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  session.pool = p;
+
+  (void) mkdir(union_test_dir, 0755);
+  (void) mkdir(union_test_top, 0755);
+  (void) mkdir(union_test_lower, 0755);
+  (void) mkdir("/tmp/vroot-union-test.d/lower/sub", 0755);
+  tests_write_file("/tmp/vroot-union-test.d/lower/sub/lower.txt", "");
+  tests_write_file("/tmp/vroot-union-test.d/lower/both.txt", "");
+  tests_write_file("/tmp/vroot-union-test.d/top/both.txt", "");
+  tests_write_file("/tmp/vroot-union-test.d/top/top.txt", "");
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.union", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_union_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.union", 0, 0);
+  }
+
+  tests_remove_dir(union_test_dir);
+
+  session.pool = NULL;
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (union_add_test) {
+  int res;
+  array_header *layers;
+
+  res = vroot_union_add(NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  layers = make_array(p, 1, sizeof(char *));
+  *((const char **) push_array(layers)) = union_test_top;
+
+  res = vroot_union_add("/shared", layers);
+  ck_assert_msg(res < 0, "Failed to handle single layer");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  ck_assert_msg(vroot_union_count() == 0, "Expected no unions");
+
+  add_union();
+  ck_assert_msg(vroot_union_count() == 1, "Expected 1 union, got %u",
+    vroot_union_count());
+}
+END_TEST
+
+START_TEST (union_lookup_test) {
+  int res;
+  char path[PR_TUNABLE_PATH_MAX + 1];
+
+  res = vroot_union_lookup(NULL, 0, VROOT_UNION_OP_READ);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  add_union();
+
+  /* Paths outside of any union are left as is. */
+  sstrncpy(path, "/tmp/other.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_READ);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/other.txt") == 0,
+    "Expected '/tmp/other.txt', got '%s'", path);
+
+  /* The top layer wins. */
+  sstrncpy(path, "/tmp/vroot-union-test.d/top/both.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_READ);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-union-test.d/top/both.txt") == 0,
+    "Expected top layer path, got '%s'", path);
+
+  sstrncpy(path, "/tmp/vroot-union-test.d/top/sub/lower.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_READ);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(
+    strcmp(path, "/tmp/vroot-union-test.d/lower/sub/lower.txt") == 0,
+    "Expected lower layer path, got '%s'", path);
+
+  /* Missing paths stay in the top layer. */
+  sstrncpy(path, "/tmp/vroot-union-test.d/top/missing.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_READ);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-union-test.d/top/missing.txt") == 0,
+    "Expected top layer path, got '%s'", path);
+}
+END_TEST
+
+START_TEST (union_lookup_write_test) {
+  int res;
+  char path[PR_TUNABLE_PATH_MAX + 1];
+
+  add_union();
+
+  /* Lower layer files are read-only. */
+  sstrncpy(path, "/tmp/vroot-union-test.d/top/sub/lower.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_MODIFY);
+  ck_assert_msg(res < 0, "Failed to handle lower layer path '%s'", path);
+  ck_assert_msg(errno == EROFS, "Expected EROFS (%d), got %s (%d)", EROFS,
+    strerror(errno), errno);
+
+  sstrncpy(path, "/tmp/vroot-union-test.d/top/sub/lower.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_CREATE_EXCL);
+  ck_assert_msg(res < 0, "Failed to handle existing path '%s'", path);
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  /* New files go to the top layer, along with their parent directories. */
+  ck_assert_msg(tests_path_exists("/tmp/vroot-union-test.d/top/sub") == FALSE,
+    "Expected no top layer directory");
+
+  sstrncpy(path, "/tmp/vroot-union-test.d/top/sub/new.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_CREATE);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-union-test.d/top/sub/new.txt") == 0,
+    "Expected top layer path, got '%s'", path);
+  ck_assert_msg(tests_path_exists("/tmp/vroot-union-test.d/top/sub") == TRUE,
+    "Expected copied up top layer directory");
+}
+END_TEST
+
+START_TEST (union_unlink_test) {
+  int res;
+  char path[PR_TUNABLE_PATH_MAX + 1];
+
+  res = vroot_union_unlink(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  add_union();
+
+  /* Deleting a lower layer file leaves a whiteout hiding it. */
+  res = vroot_union_unlink("/tmp/vroot-union-test.d/top/sub/lower.txt");
+  ck_assert_msg(res == 0, "Failed to unlink lower layer file: %s",
+    strerror(errno));
+  ck_assert_msg(
+    tests_path_exists("/tmp/vroot-union-test.d/lower/sub/lower.txt") == TRUE,
+    "Expected lower layer file to remain");
+  ck_assert_msg(
+    tests_path_exists("/tmp/vroot-union-test.d/top/sub/.wh.lower.txt") == TRUE,
+    "Expected whiteout");
+
+  sstrncpy(path, "/tmp/vroot-union-test.d/top/sub/lower.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_READ);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(strcmp(path, "/tmp/vroot-union-test.d/top/sub/lower.txt") == 0,
+    "Expected top layer path, got '%s'", path);
+
+  /* Deleting a top layer file hides any lower layer copy as well. */
+  res = vroot_union_unlink("/tmp/vroot-union-test.d/top/both.txt");
+  ck_assert_msg(res == 0, "Failed to unlink top layer file: %s",
+    strerror(errno));
+  ck_assert_msg(
+    tests_path_exists("/tmp/vroot-union-test.d/top/.wh.both.txt") == TRUE,
+    "Expected whiteout");
+
+  res = vroot_union_unlink("/tmp/vroot-union-test.d/top/missing.txt");
+  ck_assert_msg(res < 0, "Failed to handle missing file");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Recreating the file removes its whiteout. */
+  sstrncpy(path, "/tmp/vroot-union-test.d/top/both.txt", sizeof(path));
+  res = vroot_union_lookup(path, sizeof(path), VROOT_UNION_OP_CREATE);
+  ck_assert_msg(res == 0, "Failed to lookup '%s': %s", path, strerror(errno));
+  ck_assert_msg(
+    tests_path_exists("/tmp/vroot-union-test.d/top/.wh.both.txt") == FALSE,
+    "Expected whiteout to be removed");
+}
+END_TEST
+
+START_TEST (union_readdir_test) {
+  struct vroot_union_dir *ud;
+  struct dirent *dent;
+  unsigned int nlower = 0;
+  int res;
+
+  ud = vroot_union_opendir("/tmp/vroot-union-test.d/top");
+  ck_assert_msg(ud == NULL, "Failed to handle path outside of any union");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  add_union();
+
+  ud = vroot_union_opendir("/tmp/vroot-union-test.d/top");
+  ck_assert_msg(ud != NULL, "Failed to open union directory: %s",
+    strerror(errno));
+
+  /* The caller reads the top layer itself, filtering its entries. */
+  res = vroot_union_filter(ud, "top.txt");
+  ck_assert_msg(res == TRUE, "Expected 'top.txt' to be listed");
+
+  res = vroot_union_filter(ud, "both.txt");
+  ck_assert_msg(res == TRUE, "Expected 'both.txt' to be listed");
+
+  res = vroot_union_filter(ud, ".wh.sub");
+  ck_assert_msg(res == FALSE, "Expected whiteout not to be listed");
+
+  /* The lower layer entries already listed, or hidden, are skipped. */
+  while ((dent = vroot_union_readdir(ud)) != NULL) {
+    ck_assert_msg(strcmp(dent->d_name, "both.txt") != 0,
+      "Expected 'both.txt' to be listed only once");
+    ck_assert_msg(strcmp(dent->d_name, "sub") != 0,
+      "Expected 'sub' to be hidden by its whiteout");
+    ck_assert_msg(strcmp(dent->d_name, ".") != 0 &&
+      strcmp(dent->d_name, "..") != 0, "Expected '%s' to be skipped",
+      dent->d_name);
+    nlower++;
+  }
+
+  ck_assert_msg(nlower == 0, "Expected no lower layer entries, got %u",
+    nlower);
+
+  res = vroot_union_closedir(ud);
+  ck_assert_msg(res == 0, "Failed to close union directory: %s",
+    strerror(errno));
+
+  /* Without any whiteout, the lower directory is merged in. */
+  ud = vroot_union_opendir("/tmp/vroot-union-test.d/top");
+  ck_assert_msg(ud != NULL, "Failed to open union directory: %s",
+    strerror(errno));
+
+  nlower = 0;
+  while ((dent = vroot_union_readdir(ud)) != NULL) {
+    if (strcmp(dent->d_name, "sub") == 0 ||
+        strcmp(dent->d_name, "both.txt") == 0) {
+      nlower++;
+    }
+  }
+
+  ck_assert_msg(nlower == 2, "Expected 2 lower layer entries, got %u",
+    nlower);
+  (void) vroot_union_closedir(ud);
+}
+END_TEST
+
+START_TEST (union_rmdir_test) {
+  int res;
+
+  add_union();
+
+  res = vroot_union_rmdir("/tmp/vroot-union-test.d/top/sub");
+  ck_assert_msg(res < 0, "Failed to handle non-empty merged directory");
+  ck_assert_msg(errno == ENOTEMPTY, "Expected ENOTEMPTY (%d), got %s (%d)",
+    ENOTEMPTY, strerror(errno), errno);
+
+  res = vroot_union_unlink("/tmp/vroot-union-test.d/top/sub/lower.txt");
+  ck_assert_msg(res == 0, "Failed to unlink lower layer file: %s",
+    strerror(errno));
+
+  res = vroot_union_rmdir("/tmp/vroot-union-test.d/top/sub");
+  ck_assert_msg(res == 0, "Failed to remove merged directory: %s",
+    strerror(errno));
+  ck_assert_msg(tests_path_exists("/tmp/vroot-union-test.d/top/sub") == FALSE,
+    "Expected top layer directory to be removed");
+  ck_assert_msg(
+    tests_path_exists("/tmp/vroot-union-test.d/top/.wh.sub") == TRUE,
+    "Expected whiteout");
+}
+END_TEST
+
+Suite *tests_get_union_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("union");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, union_add_test);
+  tcase_add_test(testcase, union_lookup_test);
+  tcase_add_test(testcase, union_lookup_write_test);
+  tcase_add_test(testcase, union_unlink_test);
+  tcase_add_test(testcase, union_readdir_test);
+  tcase_add_test(testcase, union_rmdir_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,239 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Virtual directory tests. */
+
+#include "tests.h"
+#include "virtdir.h"
+
+static pool *p = NULL;
+
+static const char *virtdir_test_dir = "/tmp/vroot-virtdir-test.d";
+static const char *virtdir_test_subdir = "/tmp/vroot-virtdir-test.d/a";
+static const char *virtdir_test_subdir2 = "/tmp/vroot-virtdir-test.d/a/b";
+static const char *virtdir_test_file = "/tmp/vroot-virtdir-test.d/a/b/file.txt";
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  session.pool = p;
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.virtdir", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) vroot_virtdir_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.virtdir", 0, 0);
+  }
+
+  (void) unlink(virtdir_test_file);
+  (void) rmdir(virtdir_test_subdir2);
+  (void) rmdir(virtdir_test_subdir);
+  (void) rmdir(virtdir_test_dir);
+
+  session.pool = NULL;
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (virtdir_add_test) {
+  int res;
+
+  res = vroot_virtdir_add(NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Only paths within the top directory can be virtual. */
+  res = vroot_virtdir_add("/tmp/vroot-virtdir-test.dd", virtdir_test_dir);
+  ck_assert_msg(res < 0, "Failed to handle path outside of top directory");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  ck_assert_msg(vroot_virtdir_count() == 0, "Expected no virtual directories");
+
+  res = vroot_virtdir_add(virtdir_test_subdir2, virtdir_test_dir);
+  ck_assert_msg(res == 0, "Failed to add '%s': %s", virtdir_test_subdir2,
+    strerror(errno));
+  ck_assert_msg(vroot_virtdir_count() == 3,
+    "Expected 3 virtual directories, got %u", vroot_virtdir_count());
+
+  /* Adding the same directories again changes nothing. */
+  res = vroot_virtdir_add(virtdir_test_subdir, virtdir_test_dir);
+  ck_assert_msg(res == 0, "Failed to add '%s': %s", virtdir_test_subdir,
+    strerror(errno));
+  ck_assert_msg(vroot_virtdir_count() == 3,
+    "Expected 3 virtual directories, got %u", vroot_virtdir_count());
+}
+END_TEST
+
+START_TEST (virtdir_stat_test) {
+  int res;
+  struct stat st;
+
+  res = vroot_virtdir_stat(NULL, NULL);
+  ck_assert_msg(res < 0, "Failed to handle null arguments");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_virtdir_stat(virtdir_test_subdir, &st);
+  ck_assert_msg(res < 0, "Failed to handle unregistered path");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_virtdir_add(virtdir_test_subdir2, virtdir_test_dir);
+  ck_assert_msg(res == 0, "Failed to add '%s': %s", virtdir_test_subdir2,
+    strerror(errno));
+
+  res = vroot_virtdir_stat(virtdir_test_subdir, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", virtdir_test_subdir,
+    strerror(errno));
+  ck_assert_msg(S_ISDIR(st.st_mode), "Expected directory attributes");
+  ck_assert_msg(st.st_uid == session.uid, "Expected UID %lu, got %lu",
+    (unsigned long) session.uid, (unsigned long) st.st_uid);
+
+  /* Virtual directories which do exist use their real attributes. */
+  (void) mkdir(virtdir_test_dir, 0755);
+
+  res = vroot_virtdir_stat(virtdir_test_dir, &st);
+  ck_assert_msg(res < 0, "Failed to handle existing directory");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (virtdir_materialize_test) {
+  int res;
+  struct stat st;
+
+  res = vroot_virtdir_materialize(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Without any virtual directories, there is nothing to do. */
+  res = vroot_virtdir_materialize(virtdir_test_file);
+  ck_assert_msg(res == 0, "Failed to handle missing virtual directories: %s",
+    strerror(errno));
+  ck_assert_msg(stat(virtdir_test_dir, &st) < 0,
+    "Expected '%s' to not exist", virtdir_test_dir);
+
+  res = vroot_virtdir_add(virtdir_test_subdir2, virtdir_test_dir);
+  ck_assert_msg(res == 0, "Failed to add '%s': %s", virtdir_test_subdir2,
+    strerror(errno));
+
+  res = vroot_virtdir_stat(virtdir_test_subdir2, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", virtdir_test_subdir2,
+    strerror(errno));
+
+  /* Entries created elsewhere do not create the virtual directories. */
+  res = vroot_virtdir_materialize("/tmp/vroot-virtdir-test.d/c/file.txt");
+  ck_assert_msg(res == 0, "Failed to materialize: %s", strerror(errno));
+  ck_assert_msg(stat(virtdir_test_dir, &st) < 0,
+    "Expected '%s' to not exist", virtdir_test_dir);
+
+  res = vroot_virtdir_materialize(virtdir_test_file);
+  ck_assert_msg(res == 0, "Failed to materialize '%s': %s", virtdir_test_file,
+    strerror(errno));
+  ck_assert_msg(stat(virtdir_test_subdir2, &st) == 0,
+    "Expected '%s' to exist: %s", virtdir_test_subdir2, strerror(errno));
+
+  /* Once created, the real attributes are used. */
+  res = vroot_virtdir_stat(virtdir_test_subdir2, &st);
+  ck_assert_msg(res < 0, "Failed to handle created directory");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_virtdir_materialize(virtdir_test_file);
+  ck_assert_msg(res == 0, "Failed to materialize '%s' again: %s",
+    virtdir_test_file, strerror(errno));
+}
+END_TEST
+
+START_TEST (virtdir_forget_test) {
+  int res;
+  struct stat st;
+
+  res = vroot_virtdir_forget(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_virtdir_forget(virtdir_test_dir);
+  ck_assert_msg(res < 0, "Failed to handle unregistered path");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = vroot_virtdir_add(virtdir_test_dir, virtdir_test_dir);
+  ck_assert_msg(res == 0, "Failed to add '%s': %s", virtdir_test_dir,
+    strerror(errno));
+
+  res = vroot_virtdir_stat(virtdir_test_dir, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", virtdir_test_dir,
+    strerror(errno));
+
+  /* A directory created by other means is only noticed once forgotten. */
+  (void) mkdir(virtdir_test_dir, 0755);
+
+  res = vroot_virtdir_stat(virtdir_test_dir, &st);
+  ck_assert_msg(res == 0, "Failed to stat '%s': %s", virtdir_test_dir,
+    strerror(errno));
+
+  res = vroot_virtdir_forget(virtdir_test_dir);
+  ck_assert_msg(res == 0, "Failed to forget '%s': %s", virtdir_test_dir,
+    strerror(errno));
+
+  res = vroot_virtdir_stat(virtdir_test_dir, &st);
+  ck_assert_msg(res < 0, "Failed to handle existing directory");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+Suite *tests_get_virtdir_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("virtdir");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, virtdir_add_test);
+  tcase_add_test(testcase, virtdir_stat_test);
+  tcase_add_test(testcase, virtdir_materialize_test);
+  tcase_add_test(testcase, virtdir_forget_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,206 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* Warm-up tests. */
+
+#include "tests.h"
+#include "warmup.h"
+
+static pool *p = NULL;
+
+static const char *warmup_test_dir = "/tmp/vroot-warmup-test.d";
+static const char *warmup_test_history = "/tmp/vroot-warmup-test.hist";
+
+static void set_up(void) {
+  register unsigned int i;
+
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  (void) mkdir(warmup_test_dir, 0755);
+  for (i = 0; i < 3; i++) {
+    char path[PR_TUNABLE_PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path)-1, "%s/file%u.txt", warmup_test_dir, i);
+    fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd >= 0) {
+      (void) close(fd);
+    }
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.warmup", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  register unsigned int i;
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.warmup", 0, 0);
+  }
+
+  (void) vroot_warmup_free();
+
+  for (i = 0; i < 3; i++) {
+    char path[PR_TUNABLE_PATH_MAX];
+
+    snprintf(path, sizeof(path)-1, "%s/file%u.txt", warmup_test_dir, i);
+    (void) unlink(path);
+  }
+  (void) rmdir(warmup_test_dir);
+  (void) unlink(warmup_test_history);
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+START_TEST (warmup_start_test) {
+  int res;
+  array_header *paths;
+
+  mark_point();
+  res = vroot_warmup_start(NULL, 0, 0);
+  ck_assert_msg(res < 0, "Failed to handle null paths");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = vroot_warmup_wait();
+  ck_assert_msg(res < 0, "Failed to handle missing warm-up");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  paths = make_array(p, 0, sizeof(char *));
+  *((char **) push_array(paths)) = pstrdup(p, warmup_test_dir);
+  *((char **) push_array(paths)) = pstrdup(p, "/tmp/vroot-warmup-missing.d");
+
+  mark_point();
+  res = vroot_warmup_start(paths, 1000, 1000);
+  ck_assert_msg(res == 0, "Failed to start warm-up: %s", strerror(errno));
+
+  res = vroot_warmup_start(paths, 1000, 1000);
+  ck_assert_msg(res < 0, "Failed to handle running warm-up");
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got '%s' (%d)", EEXIST,
+    strerror(errno), errno);
+
+  /* The directory, its three files, and the missing directory. */
+  mark_point();
+  res = vroot_warmup_wait();
+  ck_assert_msg(res == 5, "Expected 5 entries, got %d", res);
+}
+END_TEST
+
+START_TEST (warmup_max_entries_test) {
+  int res;
+  array_header *paths;
+
+  paths = make_array(p, 0, sizeof(char *));
+  *((char **) push_array(paths)) = pstrdup(p, warmup_test_dir);
+
+  mark_point();
+  res = vroot_warmup_start(paths, 1000, 2);
+  ck_assert_msg(res == 0, "Failed to start warm-up: %s", strerror(errno));
+
+  mark_point();
+  res = vroot_warmup_wait();
+  ck_assert_msg(res == 2, "Expected 2 entries, got %d", res);
+}
+END_TEST
+
+START_TEST (warmup_history_test) {
+  int res;
+  array_header *history;
+  char **elts;
+
+  mark_point();
+  res = vroot_warmup_history_add(NULL);
+  ck_assert_msg(res < 0, "Failed to handle null path");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  history = vroot_warmup_history_read(p, warmup_test_history);
+  ck_assert_msg(history == NULL, "Unexpectedly read missing history");
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  (void) vroot_warmup_history_add("/foo");
+  (void) vroot_warmup_history_add("/bar");
+  (void) vroot_warmup_history_add("/foo");
+
+  res = vroot_warmup_history_write(warmup_test_history);
+  ck_assert_msg(res == 0, "Failed to write history: %s", strerror(errno));
+
+  (void) vroot_warmup_free();
+
+  mark_point();
+  history = vroot_warmup_history_read(p, warmup_test_history);
+  ck_assert_msg(history != NULL, "Failed to read history: %s",
+    strerror(errno));
+  ck_assert_msg(history->nelts == 2, "Expected 2 directories, got %d",
+    history->nelts);
+
+  /* Most recently used first. */
+  elts = history->elts;
+  ck_assert_msg(strcmp(elts[0], "/foo") == 0, "Expected '/foo', got '%s'",
+    elts[0]);
+  ck_assert_msg(strcmp(elts[1], "/bar") == 0, "Expected '/bar', got '%s'",
+    elts[1]);
+
+  /* Reading the history keeps it for the next write. */
+  (void) vroot_warmup_history_add("/baz");
+
+  res = vroot_warmup_history_write(warmup_test_history);
+  ck_assert_msg(res == 0, "Failed to write history: %s", strerror(errno));
+
+  history = vroot_warmup_history_read(p, warmup_test_history);
+  ck_assert_msg(history != NULL, "Failed to read history: %s",
+    strerror(errno));
+  ck_assert_msg(history->nelts == 3, "Expected 3 directories, got %d",
+    history->nelts);
+
+  elts = history->elts;
+  ck_assert_msg(strcmp(elts[0], "/baz") == 0, "Expected '/baz', got '%s'",
+    elts[0]);
+}
+END_TEST
+
+Suite *tests_get_warmup_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("warmup");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, warmup_start_test);
+  tcase_add_test(testcase, warmup_max_entries_test);
+  tcase_add_test(testcase, warmup_history_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
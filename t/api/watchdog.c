@@ -0,0 +1,191 @@
+/*
+ * ProFTPD - mod_vroot testsuite
+ * Copyright (c) 2025 TJ Saunders <tj@castaglia.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+/* Watchdog tests. */
+
+#include "tests.h"
+#include "watchdog.h"
+
+static pool *p = NULL;
+
+static const char *watchdog_test_dir = "/tmp/vroot-watchdog-test.d";
+static const char *watchdog_test_link = "/tmp/vroot-watchdog-test.lnk";
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = make_sub_pool(NULL);
+  }
+
+  (void) mkdir(watchdog_test_dir, 0755);
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.watchdog", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("vroot.watchdog", 0, 0);
+  }
+
+  (void) vroot_watchdog_free();
+  (void) rmdir(watchdog_test_dir);
+  (void) unlink(watchdog_test_link);
+  (void) rmdir(watchdog_test_link);
+
+  if (p != NULL) {
+    destroy_pool(p);
+    p = NULL;
+  }
+}
+
+/* Waits up to the given number of seconds for the given path to have the
+ * expected availability.
+ */
+static int wait_for_check(const char *path, int expected, int secs) {
+  register int i;
+
+  for (i = 0; i < secs * 10; i++) {
+    int res;
+
+    res = vroot_watchdog_check(path);
+    if (res == expected) {
+      return 0;
+    }
+
+    usleep(100000);
+  }
+
+  return -1;
+}
+
+START_TEST (watchdog_start_test) {
+  register unsigned int i;
+  int res;
+  array_header *paths;
+  struct stat st;
+
+  mark_point();
+  res = vroot_watchdog_start(NULL, 1, 1, 1);
+  ck_assert_msg(res < 0, "Failed to handle null paths");
+  ck_assert_msg(errno == EINVAL, "Expected EINVAL (%d), got '%s' (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Without a watchdog, everything is available. */
+  res = vroot_watchdog_check(watchdog_test_dir);
+  ck_assert_msg(res == 0, "Failed to check '%s': %s", watchdog_test_dir,
+    strerror(errno));
+
+  res = vroot_watchdog_get_stat(watchdog_test_dir, &st);
+  ck_assert_msg(res < 0, "Unexpectedly found attributes for '%s'",
+    watchdog_test_dir);
+  ck_assert_msg(errno == ENOENT, "Expected ENOENT (%d), got '%s' (%d)", ENOENT,
+    strerror(errno), errno);
+
+  paths = make_array(p, 0, sizeof(char *));
+  *((char **) push_array(paths)) = pstrdup(p, watchdog_test_dir);
+
+  mark_point();
+  res = vroot_watchdog_start(paths, 1, 1, 1);
+  ck_assert_msg(res == 0, "Failed to start watchdog: %s", strerror(errno));
+
+  res = vroot_watchdog_start(paths, 1, 1, 1);
+  ck_assert_msg(res < 0, "Failed to handle running watchdog");
+  ck_assert_msg(errno == EEXIST, "Expected EEXIST (%d), got '%s' (%d)", EEXIST,
+    strerror(errno), errno);
+
+  /* Wait for the first probe to provide the attributes. */
+  res = -1;
+  for (i = 0; i < 30 && res < 0; i++) {
+    usleep(100000);
+    res = vroot_watchdog_get_stat(watchdog_test_dir, &st);
+  }
+
+  ck_assert_msg(res == 0, "Failed to get attributes for '%s': %s",
+    watchdog_test_dir, strerror(errno));
+  ck_assert_msg(S_ISDIR(st.st_mode), "Expected directory attributes");
+
+  res = vroot_watchdog_check(pdircat(p, watchdog_test_dir, "foo.txt", NULL));
+  ck_assert_msg(res == 0, "Failed to check path: %s", strerror(errno));
+
+  mark_point();
+  res = vroot_watchdog_free();
+  ck_assert_msg(res == 0, "Failed to stop watchdog: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (watchdog_unavailable_test) {
+  int res;
+  array_header *paths;
+  const char *path;
+
+  /* A symlink loop makes for a source whose probes fail. */
+  res = symlink(watchdog_test_link, watchdog_test_link);
+  ck_assert_msg(res == 0, "Failed to symlink '%s': %s", watchdog_test_link,
+    strerror(errno));
+
+  paths = make_array(p, 0, sizeof(char *));
+  *((char **) push_array(paths)) = pstrdup(p, watchdog_test_link);
+
+  mark_point();
+  res = vroot_watchdog_start(paths, 1, 1, 1);
+  ck_assert_msg(res == 0, "Failed to start watchdog: %s", strerror(errno));
+
+  path = pdircat(p, watchdog_test_link, "foo.txt", NULL);
+  res = wait_for_check(path, -1, 5);
+  ck_assert_msg(res == 0, "Expected '%s' to become unavailable", path);
+  ck_assert_msg(vroot_watchdog_check(path) < 0 && errno == ETIMEDOUT,
+    "Expected ETIMEDOUT (%d), got '%s' (%d)", ETIMEDOUT, strerror(errno),
+    errno);
+
+  /* Paths outside of the source are not affected. */
+  res = vroot_watchdog_check("/tmp/vroot-watchdog-test.lnk2");
+  ck_assert_msg(res == 0, "Failed to check path: %s", strerror(errno));
+
+  /* Once fixed, the source becomes available again after the cooldown. */
+  (void) unlink(watchdog_test_link);
+  (void) mkdir(watchdog_test_link, 0755);
+
+  res = wait_for_check(path, 0, 10);
+  ck_assert_msg(res == 0, "Expected '%s' to become available", path);
+}
+END_TEST
+
+Suite *tests_get_watchdog_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("watchdog");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, watchdog_start_test);
+  tcase_add_test(testcase, watchdog_unavailable_test);
+
+  /* Allow for the probes, and their cooldowns. */
+  tcase_set_timeout(testcase, 30);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
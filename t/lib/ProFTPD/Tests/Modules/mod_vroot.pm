@@ -367,6 +367,76 @@ my $TESTS = {
     test_class => [qw(bug forking)],
   },
 
+  vroot_options_atomic_hidden_stores => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_options_atomic_hidden_stores_aborted => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_rnto_allow_overwrite_off => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_throttle => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_options_case_insensitive => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_union_alias => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_hide => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_options_virtual_dirs => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_alias_shard => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_cache_alias => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_staging_alias => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_spread_alias => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_mirror_alias => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  vroot_warmup_history => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
 };
 
 sub new {
@@ -12321,4 +12391,1764 @@ sub vroot_root_paths_hidden_issue1491 {
   test_cleanup($setup->{log_file}, $ex);
 }
 
+sub vroot_options_atomic_hidden_stores {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $hidden_file = File::Spec->rel2abs("$setup->{home_dir}/.in.test.txt.");
+  my $test_file = File::Spec->rel2abs("$setup->{home_dir}/test.txt");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.fsio:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    HiddenStores => 'on',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootOptions => 'AtomicHiddenStores',
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my $conn = $client->stor_raw('test.txt');
+      unless ($conn) {
+        die("Failed to STOR test.txt: " . $client->response_code() . ' ' .
+          $client->response_msg());
+      }
+
+      my $buf = "Hello, World!";
+      $conn->write($buf, length($buf), 5);
+
+      # The upload is written to an unnamed file, thus neither name is
+      # visible until the upload completes.
+      if (-f $hidden_file) {
+        die("File $hidden_file exists unexpectedly");
+      }
+
+      if (-f $test_file) {
+        die("File $test_file exists unexpectedly");
+      }
+
+      eval { $conn->close() };
+
+      my $resp_code = $client->response_code();
+      my $resp_msg = $client->response_msg();
+      $self->assert_transfer_ok($resp_code, $resp_msg);
+
+      $client->quit();
+
+      unless (-f $test_file) {
+        die("File $test_file does not exist as expected");
+      }
+
+      my $size = -s $test_file;
+      $self->assert(length($buf) == $size,
+        test_msg("Expected file size " . length($buf) . ", got $size"));
+
+      if (-f $hidden_file) {
+        die("File $hidden_file exists unexpectedly");
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_options_atomic_hidden_stores_aborted {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $hidden_file = File::Spec->rel2abs("$setup->{home_dir}/.in.test.txt.");
+  my $test_file = File::Spec->rel2abs("$setup->{home_dir}/test.txt");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.fsio:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    HiddenStores => 'on',
+    DeleteAbortedStores => 'on',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootOptions => 'AtomicHiddenStores',
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my $conn = $client->stor_raw('test.txt');
+      unless ($conn) {
+        die("Failed to STOR test.txt: " . $client->response_code() . ' ' .
+          $client->response_msg());
+      }
+
+      my $buf = "Hello, World!";
+      $conn->write($buf, length($buf), 5);
+
+      eval { $conn->abort() };
+
+      my $resp_code = $client->response_code();
+      my $resp_msg = $client->response_msg();
+      $self->assert_transfer_ok($resp_code, $resp_msg, 1);
+
+      $client->quit();
+
+      if (-f $test_file) {
+        die("File $test_file exists unexpectedly");
+      }
+
+      if (-f $hidden_file) {
+        die("File $hidden_file exists unexpectedly");
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_rnto_allow_overwrite_off {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $src_file = File::Spec->rel2abs("$setup->{home_dir}/src.txt");
+  my $dst_file = File::Spec->rel2abs("$setup->{home_dir}/dst.txt");
+  my $new_file = File::Spec->rel2abs("$setup->{home_dir}/new.txt");
+
+  foreach my $path ($src_file, $dst_file) {
+    if (open(my $fh, "> $path")) {
+      print $fh "$path\n";
+      unless (close($fh)) {
+        die("Can't write $path: $!");
+      }
+
+    } else {
+      die("Can't open $path: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.fsio:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    AllowOverwrite => 'off',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      $client->rnfr('src.txt');
+      eval { $client->rnto('dst.txt') };
+      unless ($@) {
+        die("RNTO dst.txt succeeded unexpectedly");
+      }
+
+      my $resp_code = $client->response_code();
+      my $resp_msg = $client->response_msg();
+
+      my $expected = 550;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $client->rnfr('src.txt');
+      $client->rnto('new.txt');
+      $client->quit();
+
+      if (-f $src_file) {
+        die("File $src_file exists unexpectedly");
+      }
+
+      unless (-f $new_file) {
+        die("File $new_file does not exist as expected");
+      }
+
+      unless (-f $dst_file) {
+        die("File $dst_file does not exist as expected");
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_warmup_history {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $sub_dir = File::Spec->rel2abs("$setup->{home_dir}/sub.d");
+  mkpath($sub_dir);
+
+  my $history_file = File::Spec->rel2abs("$tmpdir/$setup->{user}.history");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.warmup:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootWarmup => "on max-time=500 history=$tmpdir/%u.history",
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      # The first session records the directories used...
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+      $client->cwd('sub.d');
+      $client->quit();
+
+      # Allow for the session to exit
+      sleep(1);
+
+      # ...which the next session warms up.
+      $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+      $client->quit();
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    if (open(my $fh, "< $history_file")) {
+      my $line = <$fh>;
+      close($fh);
+
+      chomp($line);
+      $self->assert($line eq '/sub.d',
+        test_msg("Expected '/sub.d', got '$line'"));
+
+    } else {
+      die("Can't read $history_file: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_throttle {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $test_file = File::Spec->rel2abs("$setup->{home_dir}/test.txt");
+  if (open(my $fh, "> $test_file")) {
+    close($fh);
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
+  my $vroot_log = File::Spec->rel2abs("$tmpdir/vroot.log");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.throttle:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $vroot_log,
+        VRootThrottle => '5 burst=1',
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      # These are delayed, not failed.
+      for (my $i = 0; $i < 10; $i++) {
+        $client->mdtm('test.txt');
+      }
+
+      $client->quit();
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    if (open(my $fh, "< $vroot_log")) {
+      my $throttled = 0;
+
+      while (my $line = <$fh>) {
+        chomp($line);
+
+        if ($line =~ /throttled (\d+) of \d+ metadata operations/) {
+          $throttled = $1;
+          last;
+        }
+      }
+
+      close($fh);
+
+      $self->assert($throttled > 0,
+        test_msg("Expected throttled metadata operations, found none"));
+
+    } else {
+      die("Can't read $vroot_log: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_options_case_insensitive {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $sub_dir = File::Spec->rel2abs("$setup->{home_dir}/SubDir");
+  mkpath($sub_dir);
+
+  my $test_file = File::Spec->rel2abs("$sub_dir/Test.txt");
+  if (open(my $fh, "> $test_file")) {
+    print $fh "Hello, World!\n";
+    unless (close($fh)) {
+      die("Can't write $test_file: $!");
+    }
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.casefold:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootOptions => 'CaseInsensitive',
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my ($resp_code, $resp_msg) = $client->size('subdir/TEST.TXT');
+
+      my $expected = 213;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $expected = 14;
+      $self->assert($expected == $resp_msg,
+        test_msg("Expected response message '$expected', got '$resp_msg'"));
+
+      ($resp_code, $resp_msg) = $client->cwd('SUBDIR');
+
+      $expected = 250;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $client->quit();
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_union_alias {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $top_dir = File::Spec->rel2abs("$tmpdir/top.d");
+  mkpath($top_dir);
+
+  my $lower_dir = File::Spec->rel2abs("$tmpdir/lower.d");
+  mkpath($lower_dir);
+
+  foreach my $path ("$top_dir/top.txt", "$lower_dir/lower.txt") {
+    if (open(my $fh, "> $path")) {
+      print $fh "Hello, World!\n";
+      unless (close($fh)) {
+        die("Can't write $path: $!");
+      }
+
+    } else {
+      die("Can't open $path: $!");
+    }
+  }
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $top_dir, "$top_dir/top.txt")) {
+      die("Can't set owner of $top_dir to $setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.union:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        DefaultRoot => '~',
+
+        VRootUnionAlias => "~/shared.d $top_dir $lower_dir",
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my $conn = $client->nlst_raw('shared.d');
+      unless ($conn) {
+        die("Failed to NLST: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      my $buf;
+      $conn->read($buf, 8192, 5);
+      eval { $conn->close() };
+
+      my $res = {};
+      my $lines = [split(/\r?\n/, $buf)];
+      foreach my $line (@$lines) {
+        $line =~ s/^.*\///;
+        $res->{$line} = 1;
+      }
+
+      foreach my $name ('top.txt', 'lower.txt') {
+        $self->assert(defined($res->{$name}),
+          test_msg("Expected '$name' in NLST data"));
+      }
+
+      my ($resp_code, $resp_msg) = $client->dele('shared.d/lower.txt');
+
+      my $expected = 250;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      eval { $client->size('shared.d/lower.txt') };
+      unless ($@) {
+        die("SIZE of deleted 'shared.d/lower.txt' succeeded unexpectedly");
+      }
+
+      $client->quit();
+
+      $self->assert(-f "$lower_dir/lower.txt",
+        test_msg("Expected lower layer file to remain"));
+
+      $self->assert(-f "$top_dir/.wh.lower.txt",
+        test_msg("Expected whiteout in top layer"));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_hide {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  foreach my $name ('visible.txt', '.hidden', 'upload.tmp') {
+    my $path = File::Spec->rel2abs("$setup->{home_dir}/$name");
+    if (open(my $fh, "> $path")) {
+      print $fh "Hello, World!\n";
+      unless (close($fh)) {
+        die("Can't write $path: $!");
+      }
+
+    } else {
+      die("Can't open $path: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.hide:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootHide => '.* *.tmp',
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my $conn = $client->nlst_raw('-a');
+      unless ($conn) {
+        die("Failed to NLST: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      my $buf;
+      $conn->read($buf, 8192, 5);
+      eval { $conn->close() };
+
+      my $res = {};
+      my $lines = [split(/\r?\n/, $buf)];
+      foreach my $line (@$lines) {
+        $res->{$line} = 1;
+      }
+
+      $self->assert(defined($res->{'visible.txt'}),
+        test_msg("Expected 'visible.txt' in NLST data"));
+
+      foreach my $name ('.hidden', 'upload.tmp') {
+        $self->assert(!defined($res->{$name}),
+          test_msg("Unexpected '$name' in NLST data"));
+      }
+
+      eval { $client->size('.hidden') };
+      unless ($@) {
+        die("SIZE of hidden '.hidden' succeeded unexpectedly");
+      }
+
+      my $resp_code = $client->response_code();
+      my $expected = 550;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $client->quit();
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_options_virtual_dirs {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $src_dir = File::Spec->rel2abs("$tmpdir/shared.d");
+  mkpath($src_dir);
+
+  # The parent directory of the alias is not created beforehand.
+  my $virt_dir = File::Spec->rel2abs("$setup->{home_dir}/virt.d");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.virtdir:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootOptions => 'VirtualDirectories',
+        VRootAlias => "$src_dir ~/virt.d/shared",
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my ($resp_code, $resp_msg) = $client->cwd('virt.d');
+
+      my $expected = 250;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      my $conn = $client->nlst_raw();
+      unless ($conn) {
+        die("Failed to NLST: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      my $buf;
+      $conn->read($buf, 8192, 5);
+      eval { $conn->close() };
+
+      my $res = {};
+      my $lines = [split(/\r?\n/, $buf)];
+      foreach my $line (@$lines) {
+        $res->{$line} = 1;
+      }
+
+      $self->assert(defined($res->{'shared'}),
+        test_msg("Expected 'shared' in NLST data"));
+
+      $self->assert(!-d $virt_dir,
+        test_msg("Directory $virt_dir created unexpectedly"));
+
+      $conn = $client->stor_raw('test.txt');
+      unless ($conn) {
+        die("STOR test.txt failed: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      $buf = "Hello, World!\n";
+      $conn->write($buf, length($buf), 15);
+      eval { $conn->close() };
+
+      $resp_code = $client->response_code();
+      $resp_msg = $client->response_msg();
+      $self->assert_transfer_ok($resp_code, $resp_msg);
+
+      $client->quit();
+
+      $self->assert(-f "$virt_dir/test.txt",
+        test_msg("Expected $virt_dir/test.txt to exist"));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_alias_shard {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $src_dir = File::Spec->rel2abs("$tmpdir/drop.d");
+  mkpath($src_dir);
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.path:20 vroot.shard:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootAlias => "$src_dir ~/drop shard-levels=2",
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my $conn = $client->stor_raw('drop/foo');
+      unless ($conn) {
+        die("STOR drop/foo failed: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      my $buf = "Hello, World!\n";
+      $conn->write($buf, length($buf), 15);
+      eval { $conn->close() };
+
+      my $resp_code = $client->response_code();
+      my $resp_msg = $client->response_msg();
+      $self->assert_transfer_ok($resp_code, $resp_msg);
+
+      $conn = $client->nlst_raw('drop');
+      unless ($conn) {
+        die("Failed to NLST: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      $buf = '';
+      $conn->read($buf, 8192, 5);
+      eval { $conn->close() };
+
+      my $res = {};
+      my $lines = [split(/\r?\n/, $buf)];
+      foreach my $line (@$lines) {
+        $res->{$line} = 1;
+      }
+
+      $self->assert(defined($res->{'drop/foo'}) || defined($res->{'foo'}),
+        test_msg("Expected 'foo' in NLST data"));
+
+      $client->quit();
+
+      # The hash of 'foo' puts it in the d7/7e shard.
+      $self->assert(-f "$src_dir/d7/7e/foo",
+        test_msg("Expected $src_dir/d7/7e/foo to exist"));
+      $self->assert(!-f "$src_dir/foo",
+        test_msg("File $src_dir/foo created unexpectedly"));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_cache_alias {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $src_dir = File::Spec->rel2abs("$tmpdir/archive.d");
+  mkpath($src_dir);
+
+  my $cache_dir = File::Spec->rel2abs("$tmpdir/cache.d");
+  mkpath($cache_dir);
+
+  my $src_file = File::Spec->rel2abs("$src_dir/test.txt");
+  if (open(my $fh, "> $src_file")) {
+    print $fh "Hello, World!\n";
+    unless (close($fh)) {
+      die("Can't write $src_file: $!");
+    }
+
+  } else {
+    die("Can't open $src_file: $!");
+  }
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $cache_dir)) {
+      die("Can't set owner of $cache_dir to $setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.cachetier:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootCacheAlias => "$src_dir ~/archive $cache_dir max-size=1MB",
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      # The first download fills the cache, the second is served from it.
+      for (my $i = 0; $i < 2; $i++) {
+        my $conn = $client->retr_raw('archive/test.txt');
+        unless ($conn) {
+          die("RETR archive/test.txt failed: " . $client->response_code() .
+            " " . $client->response_msg());
+        }
+
+        my $buf;
+        $conn->read($buf, 8192, 5);
+        eval { $conn->close() };
+
+        my $resp_code = $client->response_code();
+        my $resp_msg = $client->response_msg();
+        $self->assert_transfer_ok($resp_code, $resp_msg);
+
+        $self->assert($buf eq "Hello, World!\n",
+          test_msg("Expected 'Hello, World!', got '$buf'"));
+
+        # Allow for the cache to be filled.
+        sleep(1);
+      }
+
+      $client->quit();
+
+      my $cached = [glob("$cache_dir/*.data")];
+      $self->assert(scalar(@$cached) == 1,
+        test_msg("Expected 1 cached copy, found " . scalar(@$cached)));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_staging_alias {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $src_dir = File::Spec->rel2abs("$tmpdir/incoming.d");
+  mkpath($src_dir);
+
+  my $staging_dir = File::Spec->rel2abs("$tmpdir/staging.d");
+  mkpath($staging_dir);
+
+  my $src_file = File::Spec->rel2abs("$src_dir/test.txt");
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $src_dir, $staging_dir)) {
+      die("Can't set owner of $src_dir, $staging_dir to " .
+        "$setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.staging:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootStagingAlias => "$src_dir ~/incoming $staging_dir",
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my $conn = $client->stor_raw('incoming/test.txt');
+      unless ($conn) {
+        die("STOR incoming/test.txt failed: " . $client->response_code() .
+          " " . $client->response_msg());
+      }
+
+      my $buf = "Hello, World!\n";
+      $conn->write($buf, length($buf), 15);
+      eval { $conn->close() };
+
+      my $resp_code = $client->response_code();
+      my $resp_msg = $client->response_msg();
+      $self->assert_transfer_ok($resp_code, $resp_msg);
+
+      # The upload is visible to this session, whether or not it has been
+      # migrated yet.
+      ($resp_code, $resp_msg) = $client->size('incoming/test.txt');
+
+      my $expected = 213;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $expected = 14;
+      $self->assert($expected == $resp_msg,
+        test_msg("Expected response message '$expected', got '$resp_msg'"));
+
+      # Allow for the upload to be migrated.
+      sleep(1);
+
+      $client->quit();
+
+      $self->assert(-f $src_file,
+        test_msg("File $src_file does not exist as expected"));
+
+      my $staged = [glob("$staging_dir/*")];
+      $self->assert(scalar(@$staged) == 0,
+        test_msg("Expected no staged files, found " . scalar(@$staged)));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_spread_alias {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $target1_dir = File::Spec->rel2abs("$tmpdir/disk1.d");
+  mkpath($target1_dir);
+
+  my $target2_dir = File::Spec->rel2abs("$tmpdir/disk2.d");
+  mkpath($target2_dir);
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $target1_dir, $target2_dir)) {
+      die("Can't set owner of $target1_dir, $target2_dir to " .
+        "$setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.spread:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootSpreadAlias => "~/incoming $target1_dir $target2_dir",
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      foreach my $name ('a.txt', 'b.txt') {
+        my $conn = $client->stor_raw("incoming/$name");
+        unless ($conn) {
+          die("STOR incoming/$name failed: " . $client->response_code() .
+            " " . $client->response_msg());
+        }
+
+        my $buf = "Hello, World!\n";
+        $conn->write($buf, length($buf), 15);
+        eval { $conn->close() };
+
+        my $resp_code = $client->response_code();
+        my $resp_msg = $client->response_msg();
+        $self->assert_transfer_ok($resp_code, $resp_msg);
+      }
+
+      my $conn = $client->nlst_raw('incoming');
+      unless ($conn) {
+        die("Failed to NLST: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      my $buf;
+      $conn->read($buf, 8192, 5);
+      eval { $conn->close() };
+
+      my $res = {};
+      my $lines = [split(/\r?\n/, $buf)];
+      foreach my $line (@$lines) {
+        $line =~ s/^.*\///;
+        $res->{$line} = 1;
+      }
+
+      foreach my $name ('a.txt', 'b.txt') {
+        $self->assert(defined($res->{$name}),
+          test_msg("Expected '$name' in NLST data"));
+      }
+
+      $self->assert(!defined($res->{'.vroot-spread'}),
+        test_msg("Unexpected index in NLST data"));
+
+      $client->quit();
+
+      # The two uploads are placed on different targets.
+      $self->assert(-f "$target1_dir/a.txt",
+        test_msg("Expected a.txt on first target"));
+      $self->assert(-f "$target2_dir/b.txt",
+        test_msg("Expected b.txt on second target"));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub vroot_mirror_alias {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'vroot');
+
+  my $primary_dir = File::Spec->rel2abs("$tmpdir/disk1.d");
+  mkpath($primary_dir);
+
+  my $replica_dir = File::Spec->rel2abs("$tmpdir/disk2.d");
+  mkpath($replica_dir);
+
+  foreach my $dir ($primary_dir, $replica_dir) {
+    my $test_file = File::Spec->rel2abs("$dir/test.txt");
+    if (open(my $fh, "> $test_file")) {
+      print $fh "Hello, World!\n";
+      unless (close($fh)) {
+        die("Can't write $test_file: $!");
+      }
+
+    } else {
+      die("Can't open $test_file: $!");
+    }
+  }
+
+  if ($< == 0) {
+    unless (chown($setup->{uid}, $setup->{gid}, $primary_dir, $replica_dir)) {
+      die("Can't set owner of $primary_dir, $replica_dir to " .
+        "$setup->{uid}/$setup->{gid}: $!");
+    }
+  }
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 vroot:20 vroot.mirror:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+    AuthOrder => 'mod_auth_file.c',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_vroot.c' => {
+        VRootEngine => 'on',
+        VRootLog => $setup->{log_file},
+        VRootMirrorAlias => "~/data $primary_dir $replica_dir select=rotate",
+        DefaultRoot => '~',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Allow for server startup
+      sleep(1);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($setup->{user}, $setup->{passwd});
+
+      my ($resp_code, $resp_msg) = $client->size('data/test.txt');
+      $self->assert($resp_code == 213,
+        test_msg("Expected response code 213, got $resp_code"));
+      $self->assert($resp_msg == 14,
+        test_msg("Expected size 14, got $resp_msg"));
+
+      # The downloads are read from each replica in turn; the second pass,
+      # with the copy on the replica gone, fails over to the primary.
+      for (my $i = 0; $i < 4; $i++) {
+        if ($i == 2) {
+          unlink("$replica_dir/test.txt");
+        }
+
+        my $conn = $client->retr_raw('data/test.txt');
+        unless ($conn) {
+          die("RETR data/test.txt failed: " . $client->response_code() .
+            " " . $client->response_msg());
+        }
+
+        my $buf;
+        $conn->read($buf, 8192, 5);
+        eval { $conn->close() };
+
+        $resp_code = $client->response_code();
+        $resp_msg = $client->response_msg();
+        $self->assert_transfer_ok($resp_code, $resp_msg);
+
+        $self->assert($buf eq "Hello, World!\n",
+          test_msg("Expected 'Hello, World!', got '$buf'"));
+      }
+
+      $client->quit();
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 1;
@@ -0,0 +1,305 @@
+/*
+ * ProFTPD - mod_vroot Throttle implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "throttle.h"
+
+/* A token bucket, refilled at `rate` tokens per second, holding at most
+ * `burst` tokens; each operation takes one token.
+ */
+struct throttle_bucket {
+  double rate;
+  double burst;
+  double tokens;
+  double last_refill;
+};
+
+struct throttle_alias {
+  const char *src_path;
+  size_t src_pathlen;
+  struct throttle_bucket bucket;
+};
+
+static pool *throttle_pool = NULL;
+static struct throttle_bucket *throttle_session = NULL;
+static array_header *throttle_aliases = NULL;
+
+static unsigned long throttle_nops = 0;
+static unsigned long throttle_nthrottled = 0;
+static unsigned long throttle_delay_ms = 0;
+
+static const char *trace_channel = "vroot.throttle";
+
+static double throttle_now(void) {
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+    return (double) time(NULL);
+  }
+
+  return (double) ts.tv_sec + ((double) ts.tv_nsec / 1000000000.0);
+}
+
+static void throttle_bucket_init(struct throttle_bucket *bucket,
+    unsigned int rate, unsigned int burst) {
+  if (burst == 0) {
+    burst = rate;
+  }
+
+  bucket->rate = (double) rate;
+  bucket->burst = (double) burst;
+  bucket->tokens = bucket->burst;
+  bucket->last_refill = throttle_now();
+}
+
+/* Takes a token from the given bucket, and returns the number of seconds
+ * to wait before the operation may proceed.  The bucket may go into debt,
+ * which that wait repays.
+ */
+static double throttle_bucket_take(struct throttle_bucket *bucket,
+    double now) {
+  double elapsed;
+
+  elapsed = now - bucket->last_refill;
+  if (elapsed > 0.0) {
+    bucket->tokens += (elapsed * bucket->rate);
+    if (bucket->tokens > bucket->burst) {
+      bucket->tokens = bucket->burst;
+    }
+
+    bucket->last_refill = now;
+  }
+
+  bucket->tokens -= 1.0;
+  if (bucket->tokens >= 0.0) {
+    return 0.0;
+  }
+
+  return -(bucket->tokens) / bucket->rate;
+}
+
+static struct throttle_bucket *throttle_find_alias(const char *path) {
+  register unsigned int i;
+  struct throttle_alias *aliases, *best = NULL;
+
+  aliases = throttle_aliases->elts;
+  for (i = 0; i < throttle_aliases->nelts; i++) {
+    size_t len;
+
+    len = aliases[i].src_pathlen;
+    if (strncmp(path, aliases[i].src_path, len) != 0) {
+      continue;
+    }
+
+    if (path[len] != '\0' &&
+        path[len] != '/') {
+      continue;
+    }
+
+    /* Aliases may be nested; use the most specific one. */
+    if (best == NULL ||
+        len > best->src_pathlen) {
+      best = &(aliases[i]);
+    }
+  }
+
+  return (best != NULL ? &(best->bucket) : NULL);
+}
+
+static void throttle_wait(double secs) {
+  struct timespec ts;
+
+  ts.tv_sec = (time_t) secs;
+  ts.tv_nsec = (long) ((secs - (double) ts.tv_sec) * 1000000000.0);
+
+  while (nanosleep(&ts, &ts) < 0) {
+    if (errno != EINTR) {
+      break;
+    }
+
+    pr_signals_handle();
+  }
+}
+
+static void throttle_init(void) {
+  if (throttle_pool == NULL) {
+    throttle_pool = make_sub_pool(session.pool);
+    pr_pool_tag(throttle_pool, "VRoot Throttle Pool");
+  }
+}
+
+int vroot_throttle_set_limit(unsigned int rate, unsigned int burst) {
+  if (rate > VROOT_THROTTLE_MAX_RATE ||
+      burst > VROOT_THROTTLE_MAX_RATE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (rate == 0) {
+    throttle_session = NULL;
+    return 0;
+  }
+
+  throttle_init();
+
+  if (throttle_session == NULL) {
+    throttle_session = pcalloc(throttle_pool, sizeof(struct throttle_bucket));
+  }
+
+  throttle_bucket_init(throttle_session, rate, burst);
+
+  pr_trace_msg(trace_channel, 9,
+    "limiting metadata operations to %u/sec (burst %u)", rate,
+    burst > 0 ? burst : rate);
+  return 0;
+}
+
+int vroot_throttle_add_alias(const char *src_path, unsigned int rate,
+    unsigned int burst) {
+  struct throttle_alias *alias;
+
+  if (src_path == NULL ||
+      rate == 0 ||
+      rate > VROOT_THROTTLE_MAX_RATE ||
+      burst > VROOT_THROTTLE_MAX_RATE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  throttle_init();
+
+  if (throttle_aliases == NULL) {
+    throttle_aliases = make_array(throttle_pool, 1,
+      sizeof(struct throttle_alias));
+  }
+
+  alias = push_array(throttle_aliases);
+  alias->src_path = pstrdup(throttle_pool, src_path);
+  alias->src_pathlen = strlen(src_path);
+
+  /* Handle a source path of "/". */
+  if (alias->src_pathlen == 1) {
+    alias->src_pathlen = 0;
+  }
+
+  throttle_bucket_init(&(alias->bucket), rate, burst);
+
+  pr_trace_msg(trace_channel, 9,
+    "limiting metadata operations in '%s' to %u/sec (burst %u)", src_path,
+    rate, burst > 0 ? burst : rate);
+  return 0;
+}
+
+int vroot_throttle_acquire(const char *path) {
+  struct throttle_bucket *alias_bucket = NULL;
+  double now, secs = 0.0;
+  unsigned long ms;
+
+  if (throttle_session == NULL &&
+      throttle_aliases == NULL) {
+    return 0;
+  }
+
+  if (path != NULL &&
+      throttle_aliases != NULL) {
+    alias_bucket = throttle_find_alias(path);
+  }
+
+  if (throttle_session == NULL &&
+      alias_bucket == NULL) {
+    return 0;
+  }
+
+  throttle_nops++;
+  now = throttle_now();
+
+  if (throttle_session != NULL) {
+    secs = throttle_bucket_take(throttle_session, now);
+  }
+
+  if (alias_bucket != NULL) {
+    double alias_secs;
+
+    alias_secs = throttle_bucket_take(alias_bucket, now);
+    if (alias_secs > secs) {
+      secs = alias_secs;
+    }
+  }
+
+  if (secs <= 0.0) {
+    return 0;
+  }
+
+  ms = (unsigned long) ((secs * 1000.0) + 0.5);
+
+  if (throttle_nthrottled == 0) {
+    (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+      "metadata operations over limit, throttling session");
+  }
+
+  throttle_nthrottled++;
+  throttle_delay_ms += ms;
+
+  pr_trace_msg(trace_channel, 15, "delaying operation on '%s' by %lu ms",
+    path != NULL ? path : "(none)", ms);
+  throttle_wait(secs);
+
+  return (int) ms;
+}
+
+int vroot_throttle_get_stats(unsigned long *nops, unsigned long *nthrottled,
+    unsigned long *delay_ms) {
+  if (nops == NULL &&
+      nthrottled == NULL &&
+      delay_ms == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (nops != NULL) {
+    *nops = throttle_nops;
+  }
+
+  if (nthrottled != NULL) {
+    *nthrottled = throttle_nthrottled;
+  }
+
+  if (delay_ms != NULL) {
+    *delay_ms = throttle_delay_ms;
+  }
+
+  return 0;
+}
+
+int vroot_throttle_free(void) {
+  if (throttle_pool != NULL) {
+    destroy_pool(throttle_pool);
+    throttle_pool = NULL;
+  }
+
+  throttle_session = NULL;
+  throttle_aliases = NULL;
+  throttle_nops = throttle_nthrottled = throttle_delay_ms = 0;
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * ProFTPD - mod_vroot Throttle API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_THROTTLE_H
+#define MOD_VROOT_THROTTLE_H
+
+#include "mod_vroot.h"
+
+/* Largest configurable rate, in operations per second. */
+#define VROOT_THROTTLE_MAX_RATE		1000000
+
+/* Limits the metadata operations (e.g. stat(2), opendir(3)) of the session
+ * to `rate` per second, allowing bursts of up to `burst` operations; a zero
+ * `burst` allows one second's worth.  A zero `rate` removes the limit.
+ */
+int vroot_throttle_set_limit(unsigned int rate, unsigned int burst);
+
+/* Limits the metadata operations on paths within the given alias source
+ * path, in addition to any limit for the session.
+ */
+int vroot_throttle_add_alias(const char *src_path, unsigned int rate,
+  unsigned int burst);
+
+/* Waits, if needed, until a metadata operation on the given real path is
+ * within the configured limits.  Returns the number of milliseconds waited.
+ */
+int vroot_throttle_acquire(const char *path);
+
+/* Provides the number of metadata operations, how many of them were delayed,
+ * and the total delay in milliseconds, for the session.
+ */
+int vroot_throttle_get_stats(unsigned long *nops, unsigned long *nthrottled,
+  unsigned long *delay_ms);
+
+/* Internal use only. */
+int vroot_throttle_free(void);
+
+#endif /* MOD_VROOT_THROTTLE_H */
@@ -0,0 +1,934 @@
+/*
+ * ProFTPD - mod_vroot Union Alias implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "union.h"
+
+/* Bounds the memory used for remembering missing paths. */
+#define VROOT_UNION_MAX_MISSES		4096
+
+struct vroot_union {
+  const char *dst_path;
+
+  /* The real paths of the layers, top layer first. */
+  const char **layers;
+  size_t *layer_lens;
+  unsigned int nlayers;
+};
+
+struct vroot_union_dir {
+  pool *pool;
+  const struct vroot_union *u;
+  const char *rel_path;
+
+  /* The names already listed, or hidden by whiteouts. */
+  pr_table_t *seen;
+
+  /* Whether the lower layers are hidden. */
+  int opaque;
+
+  /* The layer of the directory read by the caller, if any, the layer
+   * being read, and the next layer to read.
+   */
+  unsigned int first_layer;
+  unsigned int curr_layer;
+  unsigned int next_layer;
+  DIR *dirh;
+};
+
+static pool *union_pool = NULL;
+static array_header *unions = NULL;
+
+/* The paths found missing in a layer, and when. */
+static pool *union_miss_pool = NULL;
+static pr_table_t *union_misses = NULL;
+
+static const char *trace_channel = "vroot.union";
+
+int vroot_union_add(const char *dst_path, const array_header *layers) {
+  register unsigned int i;
+  struct vroot_union *u;
+  char **elts;
+
+  if (dst_path == NULL ||
+      layers == NULL ||
+      layers->nelts < 2) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (union_pool == NULL) {
+    union_pool = make_sub_pool(session.pool);
+    pr_pool_tag(union_pool, "VRoot Union Pool");
+
+    unions = make_array(union_pool, 1, sizeof(struct vroot_union *));
+  }
+
+  u = pcalloc(union_pool, sizeof(struct vroot_union));
+  u->dst_path = pstrdup(union_pool, dst_path);
+  u->nlayers = layers->nelts;
+  u->layers = pcalloc(union_pool, u->nlayers * sizeof(char *));
+  u->layer_lens = pcalloc(union_pool, u->nlayers * sizeof(size_t));
+
+  elts = layers->elts;
+  for (i = 0; i < u->nlayers; i++) {
+    char *layer;
+    size_t layer_len;
+
+    layer = pstrdup(union_pool, elts[i]);
+    layer_len = strlen(layer);
+    if (layer_len > 1 &&
+        layer[layer_len-1] == '/') {
+      layer[--layer_len] = '\0';
+    }
+
+    u->layers[i] = layer;
+    u->layer_lens[i] = layer_len;
+
+    pr_trace_msg(trace_channel, 9, "union '%s': layer %u = '%s'", dst_path,
+      i, layer);
+  }
+
+  *((struct vroot_union **) push_array(unions)) = u;
+  return 0;
+}
+
+unsigned int vroot_union_count(void) {
+  if (unions == NULL) {
+    return 0;
+  }
+
+  return unions->nelts;
+}
+
+/* Finds the union with a layer containing the given real path, setting the
+ * layer, and the path relative to that layer ("" for the layer itself).
+ */
+static struct vroot_union *union_get(const char *path, int top_only,
+    unsigned int *layer_idx, const char **rel_path) {
+  register unsigned int i;
+  struct vroot_union **elts;
+
+  if (unions == NULL) {
+    return NULL;
+  }
+
+  elts = unions->elts;
+  for (i = 0; i < unions->nelts; i++) {
+    register unsigned int j;
+    struct vroot_union *u;
+
+    u = elts[i];
+    for (j = 0; j < u->nlayers; j++) {
+      size_t len;
+
+      len = u->layer_lens[j];
+      if (strncmp(path, u->layers[j], len) == 0 &&
+          (path[len] == '\0' ||
+           path[len] == '/')) {
+        const char *rel;
+
+        rel = path + len;
+        if (*rel == '/') {
+          rel++;
+        }
+
+        *layer_idx = j;
+        *rel_path = rel;
+        return u;
+      }
+
+      if (top_only == TRUE) {
+        break;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static int layer_path(char *buf, size_t bufsz, const struct vroot_union *u,
+    unsigned int layer_idx, const char *rel_path) {
+  int len;
+
+  if (*rel_path == '\0') {
+    len = snprintf(buf, bufsz, "%s", u->layers[layer_idx]);
+
+  } else {
+    len = snprintf(buf, bufsz, "%s/%s", u->layers[layer_idx], rel_path);
+  }
+
+  if (len < 0 ||
+      (size_t) len >= bufsz) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Builds the path of the whiteout, in the top layer, for the given path. */
+static int whiteout_path(char *buf, size_t bufsz, const struct vroot_union *u,
+    const char *rel_path) {
+  const char *name;
+  int len;
+
+  name = strrchr(rel_path, '/');
+  if (name != NULL) {
+    name++;
+
+  } else {
+    name = rel_path;
+  }
+
+  len = snprintf(buf, bufsz, "%s/%.*s%s%s", u->layers[0],
+    (int) (name - rel_path), rel_path, VROOT_UNION_WHITEOUT_PREFIX, name);
+  if (len < 0 ||
+      (size_t) len >= bufsz) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void misses_clear(void) {
+  if (union_miss_pool != NULL) {
+    destroy_pool(union_miss_pool);
+    union_miss_pool = NULL;
+    union_misses = NULL;
+  }
+}
+
+static int miss_cached(const char *path) {
+  const time_t *missed;
+
+  if (union_misses == NULL) {
+    return FALSE;
+  }
+
+  missed = pr_table_get(union_misses, path, NULL);
+  if (missed == NULL) {
+    return FALSE;
+  }
+
+  if (time(NULL) - *missed >= VROOT_UNION_MISS_TTL) {
+    (void) pr_table_remove(union_misses, path, NULL);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void miss_add(const char *path) {
+  time_t *missed;
+
+  if (union_misses != NULL &&
+      pr_table_count(union_misses) >= VROOT_UNION_MAX_MISSES) {
+    misses_clear();
+  }
+
+  if (union_misses == NULL) {
+    union_miss_pool = make_sub_pool(union_pool);
+    pr_pool_tag(union_miss_pool, "VRoot Union Misses Pool");
+
+    union_misses = pr_table_alloc(union_miss_pool, 0);
+  }
+
+  missed = palloc(union_miss_pool, sizeof(time_t));
+  *missed = time(NULL);
+
+  (void) pr_table_add(union_misses, pstrdup(union_miss_pool, path), missed,
+    sizeof(time_t));
+}
+
+/* As lstat(2), remembering the paths found missing for a while, as the lower
+ * layers are probed for every path missing from the top layer.
+ */
+static int layer_lstat(const char *path, struct stat *st) {
+  int xerrno;
+
+  if (miss_cached(path) == TRUE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (lstat(path, st) == 0) {
+    return 0;
+  }
+
+  xerrno = errno;
+  if (xerrno == ENOENT ||
+      xerrno == ENOTDIR) {
+    miss_add(path);
+  }
+
+  errno = xerrno;
+  return -1;
+}
+
+/* Returns TRUE if the lower layers are hidden for the given path, by a
+ * whiteout for it, or for one of its parents, or by an opaque parent.
+ */
+static int union_hidden(const struct vroot_union *u, const char *rel_path) {
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+  const char *comp;
+  struct stat st;
+  int len;
+
+  comp = rel_path;
+  while (*comp != '\0') {
+    const char *next;
+    size_t comp_len;
+
+    pr_signals_handle();
+
+    next = strchr(comp, '/');
+    comp_len = (next != NULL ? (size_t) (next - comp) : strlen(comp));
+
+    len = snprintf(buf, sizeof(buf), "%s/%.*s%s%.*s", u->layers[0],
+      (int) (comp - rel_path), rel_path, VROOT_UNION_WHITEOUT_PREFIX,
+      (int) comp_len, comp);
+    if (len > 0 &&
+        (size_t) len < sizeof(buf) &&
+        layer_lstat(buf, &st) == 0) {
+      return TRUE;
+    }
+
+    if (next == NULL) {
+      break;
+    }
+
+    len = snprintf(buf, sizeof(buf), "%s/%.*s/%s", u->layers[0],
+      (int) (next - rel_path), rel_path, VROOT_UNION_OPAQUE_NAME);
+    if (len > 0 &&
+        (size_t) len < sizeof(buf) &&
+        layer_lstat(buf, &st) == 0) {
+      return TRUE;
+    }
+
+    comp = next + 1;
+  }
+
+  return FALSE;
+}
+
+/* Finds the first lower layer providing the given path. */
+static int lower_find(const struct vroot_union *u, const char *rel_path,
+    unsigned int *layer_idx, struct stat *st) {
+  register unsigned int i;
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+
+  if (*rel_path != '\0' &&
+      union_hidden(u, rel_path) == TRUE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  for (i = 1; i < u->nlayers; i++) {
+    if (layer_path(buf, sizeof(buf), u, i, rel_path) < 0) {
+      return -1;
+    }
+
+    if (layer_lstat(buf, st) == 0) {
+      *layer_idx = i;
+      return 0;
+    }
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+/* Finds the first layer providing the given path. */
+static int union_find(const struct vroot_union *u, const char *rel_path,
+    unsigned int *layer_idx, struct stat *st) {
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+
+  if (layer_path(buf, sizeof(buf), u, 0, rel_path) < 0) {
+    return -1;
+  }
+
+  /* Any change is made to the top layer, thus it is always checked. */
+  if (lstat(buf, st) == 0) {
+    *layer_idx = 0;
+    return 0;
+  }
+
+  if (errno == ENOTDIR) {
+    /* A file in the top layer hides the lower layer directories. */
+    errno = ENOENT;
+    return -1;
+  }
+
+  return lower_find(u, rel_path, layer_idx, st);
+}
+
+/* Creates the parent directories of the given path in the top layer, as
+ * found in the lower layers.
+ */
+static int copy_up_parents(const struct vroot_union *u, const char *rel_path) {
+  char rel[PR_TUNABLE_PATH_MAX + 1], buf[PR_TUNABLE_PATH_MAX + 1], *ptr;
+
+  sstrncpy(rel, rel_path, sizeof(rel));
+
+  ptr = rel;
+  while ((ptr = strchr(ptr, '/')) != NULL) {
+    struct stat st;
+
+    pr_signals_handle();
+
+    *ptr = '\0';
+
+    if (layer_path(buf, sizeof(buf), u, 0, rel) < 0) {
+      return -1;
+    }
+
+    if (lstat(buf, &st) < 0) {
+      unsigned int layer_idx;
+
+      if (errno != ENOENT ||
+          lower_find(u, rel, &layer_idx, &st) < 0) {
+        return -1;
+      }
+
+      if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return -1;
+      }
+
+      if (mkdir(buf, st.st_mode & 07777) < 0 &&
+          errno != EEXIST) {
+        return -1;
+      }
+
+      pr_trace_msg(trace_channel, 15, "copied up directory '%s' from '%s'",
+        buf, u->layers[layer_idx]);
+    }
+
+    *ptr++ = '/';
+  }
+
+  return 0;
+}
+
+/* Prepares the top layer for creating the given path; returns 1 if a
+ * whiteout was removed for it.
+ */
+static int union_prepare(const struct vroot_union *u, const char *rel_path) {
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+
+  if (*rel_path == '\0') {
+    return 0;
+  }
+
+  if (copy_up_parents(u, rel_path) < 0) {
+    return -1;
+  }
+
+  misses_clear();
+
+  if (whiteout_path(buf, sizeof(buf), u, rel_path) == 0 &&
+      unlink(buf) == 0) {
+    pr_trace_msg(trace_channel, 15, "removed whiteout '%s'", buf);
+    return 1;
+  }
+
+  return 0;
+}
+
+int vroot_union_lookup(char *path, size_t pathsz, int op) {
+  struct vroot_union *u;
+  unsigned int layer_idx = 0;
+  const char *rel_path = NULL;
+  char rel[PR_TUNABLE_PATH_MAX + 1];
+  struct stat st;
+  int found;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  u = union_get(path, TRUE, &layer_idx, &rel_path);
+  if (u == NULL ||
+      op == VROOT_UNION_OP_TOP) {
+    return 0;
+  }
+
+  sstrncpy(rel, rel_path, sizeof(rel));
+  found = (union_find(u, rel, &layer_idx, &st) == 0);
+
+  switch (op) {
+    case VROOT_UNION_OP_READ:
+      if (found == TRUE &&
+          layer_idx > 0) {
+        if (layer_path(path, pathsz, u, layer_idx, rel) < 0) {
+          return -1;
+        }
+
+        pr_trace_msg(trace_channel, 19, "using layer %u path '%s'",
+          layer_idx, path);
+      }
+      break;
+
+    case VROOT_UNION_OP_CREATE_EXCL:
+      if (found == TRUE) {
+        errno = EEXIST;
+        return -1;
+      }
+
+      if (union_prepare(u, rel) < 0) {
+        return -1;
+      }
+      break;
+
+    case VROOT_UNION_OP_MODIFY:
+      if (found == TRUE &&
+          layer_idx > 0) {
+        pr_trace_msg(trace_channel, 9,
+          "refusing to modify '%s', provided by read-only layer '%s'", rel,
+          u->layers[layer_idx]);
+        errno = EROFS;
+        return -1;
+      }
+
+      /* Fallthrough */
+
+    case VROOT_UNION_OP_CREATE:
+      if (found == FALSE ||
+          layer_idx > 0) {
+        if (union_prepare(u, rel) < 0) {
+          return -1;
+        }
+      }
+      break;
+
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  return 0;
+}
+
+int vroot_union_whiteout(const char *path) {
+  struct vroot_union *u;
+  unsigned int layer_idx = 0;
+  const char *rel_path = NULL;
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+  struct stat st;
+  int fd;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  u = union_get(path, TRUE, &layer_idx, &rel_path);
+  if (u == NULL ||
+      *rel_path == '\0') {
+    return 0;
+  }
+
+  /* Only needed while a lower layer still provides the path. */
+  if (lower_find(u, rel_path, &layer_idx, &st) < 0) {
+    return 0;
+  }
+
+  if (copy_up_parents(u, rel_path) < 0 ||
+      whiteout_path(buf, sizeof(buf), u, rel_path) < 0) {
+    return -1;
+  }
+
+  fd = open(buf, O_CREAT|O_WRONLY|O_TRUNC, 0600);
+  if (fd < 0) {
+    return -1;
+  }
+
+  (void) close(fd);
+  misses_clear();
+
+  pr_trace_msg(trace_channel, 15, "created whiteout '%s'", buf);
+  return 1;
+}
+
+int vroot_union_unlink(const char *path) {
+  struct vroot_union *u;
+  unsigned int layer_idx = 0;
+  const char *rel_path = NULL;
+  struct stat st;
+  int res, xerrno;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  u = union_get(path, TRUE, &layer_idx, &rel_path);
+  if (u == NULL) {
+    return unlink(path);
+  }
+
+  res = unlink(path);
+  xerrno = errno;
+
+  if (res == 0 ||
+      xerrno == ENOENT) {
+    misses_clear();
+
+    if (*rel_path != '\0' &&
+        lower_find(u, rel_path, &layer_idx, &st) == 0) {
+      if (res < 0 &&
+          S_ISDIR(st.st_mode)) {
+        errno = EISDIR;
+        return -1;
+      }
+
+      if (vroot_union_whiteout(path) < 0) {
+        return -1;
+      }
+
+      return 0;
+    }
+  }
+
+  errno = xerrno;
+  return res;
+}
+
+static struct vroot_union_dir *union_dir_open(const struct vroot_union *u,
+    const char *rel_path, unsigned int layer_idx) {
+  pool *dir_pool;
+  struct vroot_union_dir *ud;
+
+  dir_pool = make_sub_pool(session.pool);
+  pr_pool_tag(dir_pool, "VRoot Union Directory Pool");
+
+  ud = pcalloc(dir_pool, sizeof(struct vroot_union_dir));
+  ud->pool = dir_pool;
+  ud->u = u;
+  ud->rel_path = pstrdup(dir_pool, rel_path);
+  ud->seen = pr_table_alloc(dir_pool, 0);
+  ud->first_layer = ud->curr_layer = ud->next_layer = layer_idx;
+
+  if (*rel_path != '\0' &&
+      union_hidden(u, rel_path) == TRUE) {
+    ud->opaque = TRUE;
+  }
+
+  return ud;
+}
+
+static int union_dir_filter(struct vroot_union_dir *ud, const char *name,
+    unsigned int layer_idx) {
+  if (strcmp(name, ".") == 0 ||
+      strcmp(name, "..") == 0) {
+    return (layer_idx == ud->first_layer);
+  }
+
+  if (layer_idx == 0) {
+    size_t prefix_len;
+
+    if (strcmp(name, VROOT_UNION_OPAQUE_NAME) == 0) {
+      ud->opaque = TRUE;
+      return FALSE;
+    }
+
+    prefix_len = strlen(VROOT_UNION_WHITEOUT_PREFIX);
+    if (strncmp(name, VROOT_UNION_WHITEOUT_PREFIX, prefix_len) == 0) {
+      const char *hidden;
+
+      hidden = pstrdup(ud->pool, name + prefix_len);
+      (void) pr_table_add(ud->seen, hidden, hidden, 0);
+      return FALSE;
+    }
+  }
+
+  if (pr_table_get(ud->seen, name, NULL) != NULL) {
+    return FALSE;
+  }
+
+  /* The names of the last layer read need not be remembered. */
+  if (layer_idx + 1 < ud->u->nlayers &&
+      ud->opaque == FALSE) {
+    const char *seen;
+
+    seen = pstrdup(ud->pool, name);
+    (void) pr_table_add(ud->seen, seen, seen, 0);
+  }
+
+  return TRUE;
+}
+
+struct vroot_union_dir *vroot_union_opendir(const char *path) {
+  struct vroot_union *u;
+  struct vroot_union_dir *ud;
+  unsigned int layer_idx = 0;
+  const char *rel_path = NULL;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  u = union_get(path, FALSE, &layer_idx, &rel_path);
+  if (u == NULL ||
+      (layer_idx > 0 && layer_idx + 1 == u->nlayers)) {
+    /* Nothing to merge into the listing of the last layer. */
+    errno = ENOENT;
+    return NULL;
+  }
+
+  ud = union_dir_open(u, rel_path, layer_idx);
+  ud->next_layer = layer_idx + 1;
+
+  return ud;
+}
+
+int vroot_union_filter(struct vroot_union_dir *ud, const char *name) {
+  if (ud == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return union_dir_filter(ud, name, ud->first_layer);
+}
+
+struct dirent *vroot_union_readdir(struct vroot_union_dir *ud) {
+  if (ud == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  while (TRUE) {
+    struct dirent *dent;
+
+    pr_signals_handle();
+
+    if (ud->dirh == NULL) {
+      char buf[PR_TUNABLE_PATH_MAX + 1];
+
+      if (ud->next_layer >= ud->u->nlayers ||
+          (ud->next_layer > 0 && ud->opaque == TRUE)) {
+        errno = 0;
+        return NULL;
+      }
+
+      ud->curr_layer = ud->next_layer++;
+      if (layer_path(buf, sizeof(buf), ud->u, ud->curr_layer,
+          ud->rel_path) < 0) {
+        continue;
+      }
+
+      ud->dirh = opendir(buf);
+      if (ud->dirh == NULL) {
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 19, "merging listing of '%s'", buf);
+    }
+
+    dent = readdir(ud->dirh);
+    if (dent == NULL) {
+      (void) closedir(ud->dirh);
+      ud->dirh = NULL;
+      continue;
+    }
+
+    if (union_dir_filter(ud, dent->d_name, ud->curr_layer) == TRUE) {
+      return dent;
+    }
+  }
+}
+
+int vroot_union_closedir(struct vroot_union_dir *ud) {
+  if (ud == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (ud->dirh != NULL) {
+    (void) closedir(ud->dirh);
+    ud->dirh = NULL;
+  }
+
+  destroy_pool(ud->pool);
+  return 0;
+}
+
+/* Removes the whiteouts, and opaque marker, from the given top layer
+ * directory, so that it can be removed.
+ */
+static void whiteouts_remove(const char *path) {
+  DIR *dirh;
+  struct dirent *dent;
+  size_t prefix_len;
+
+  dirh = opendir(path);
+  if (dirh == NULL) {
+    return;
+  }
+
+  prefix_len = strlen(VROOT_UNION_WHITEOUT_PREFIX);
+  while ((dent = readdir(dirh)) != NULL) {
+    char buf[PR_TUNABLE_PATH_MAX + 1];
+
+    pr_signals_handle();
+
+    if (strncmp(dent->d_name, VROOT_UNION_WHITEOUT_PREFIX, prefix_len) != 0) {
+      continue;
+    }
+
+    if (snprintf(buf, sizeof(buf), "%s/%s", path, dent->d_name) <
+        (int) sizeof(buf)) {
+      (void) unlink(buf);
+    }
+  }
+
+  (void) closedir(dirh);
+}
+
+int vroot_union_rmdir(const char *path) {
+  struct vroot_union *u;
+  struct vroot_union_dir *ud;
+  struct dirent *dent;
+  unsigned int layer_idx = 0;
+  const char *rel_path = NULL;
+  struct stat st;
+  int res, xerrno, empty = TRUE;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  u = union_get(path, TRUE, &layer_idx, &rel_path);
+  if (u == NULL ||
+      *rel_path == '\0') {
+    return rmdir(path);
+  }
+
+  /* The merged directory must be empty. */
+  ud = union_dir_open(u, rel_path, 0);
+  while ((dent = vroot_union_readdir(ud)) != NULL) {
+    if (strcmp(dent->d_name, ".") != 0 &&
+        strcmp(dent->d_name, "..") != 0) {
+      empty = FALSE;
+      break;
+    }
+  }
+  (void) vroot_union_closedir(ud);
+
+  if (empty == FALSE) {
+    errno = ENOTEMPTY;
+    return -1;
+  }
+
+  whiteouts_remove(path);
+
+  res = rmdir(path);
+  xerrno = errno;
+
+  if (res == 0 ||
+      xerrno == ENOENT) {
+    misses_clear();
+
+    if (lower_find(u, rel_path, &layer_idx, &st) == 0) {
+      if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return -1;
+      }
+
+      if (vroot_union_whiteout(path) < 0) {
+        return -1;
+      }
+
+      return 0;
+    }
+  }
+
+  errno = xerrno;
+  return res;
+}
+
+int vroot_union_mkdir(const char *path, mode_t mode) {
+  struct vroot_union *u;
+  unsigned int layer_idx = 0;
+  const char *rel_path = NULL;
+  struct stat st;
+  int res, removed;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  u = union_get(path, TRUE, &layer_idx, &rel_path);
+  if (u == NULL) {
+    return mkdir(path, mode);
+  }
+
+  if (union_find(u, rel_path, &layer_idx, &st) == 0) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  removed = union_prepare(u, rel_path);
+  if (removed < 0) {
+    return -1;
+  }
+
+  res = mkdir(path, mode);
+  if (res == 0 &&
+      removed == 1) {
+    char buf[PR_TUNABLE_PATH_MAX + 1];
+    int fd;
+
+    /* The directory replaces one which was removed; the contents of the
+     * removed directory, in the lower layers, must stay hidden.
+     */
+    if (snprintf(buf, sizeof(buf), "%s/%s", path, VROOT_UNION_OPAQUE_NAME) <
+        (int) sizeof(buf)) {
+      fd = open(buf, O_CREAT|O_WRONLY|O_TRUNC, 0600);
+      if (fd >= 0) {
+        (void) close(fd);
+      }
+    }
+  }
+
+  return res;
+}
+
+int vroot_union_free(void) {
+  if (union_pool != NULL) {
+    destroy_pool(union_pool);
+    union_pool = NULL;
+    unions = NULL;
+    union_miss_pool = NULL;
+    union_misses = NULL;
+  }
+
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * ProFTPD - mod_vroot Union Alias API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_UNION_H
+#define MOD_VROOT_UNION_H
+
+#include "mod_vroot.h"
+
+/* Whiteouts, in the top layer, hide the entries of the lower layers. */
+#define VROOT_UNION_WHITEOUT_PREFIX	".wh."
+#define VROOT_UNION_OPAQUE_NAME		".wh..wh..opq"
+
+/* How long, in seconds, a path found missing in a layer is remembered. */
+#define VROOT_UNION_MISS_TTL		5
+
+struct vroot_union_dir;
+
+/* Registers a union of the given layers, given as real paths, for the
+ * given alias destination path.  The first layer, which is also the source
+ * of the alias, is the top layer; it receives all changes.  The other layers
+ * are only read.
+ */
+int vroot_union_add(const char *dst_path, const array_header *layers);
+unsigned int vroot_union_count(void);
+
+/* Resolves the given real path, within the top layer of a union, for the
+ * given operation, rewriting it in place as needed.
+ */
+int vroot_union_lookup(char *path, size_t pathsz, int op);
+
+/* Reads use the first layer containing the path. */
+#define VROOT_UNION_OP_READ		1
+
+/* Creating a path uses the top layer, creating its parent directories there
+ * as needed, and removes any whiteout for it.  The path then hides any
+ * lower layer entries.
+ */
+#define VROOT_UNION_OP_CREATE		2
+
+/* As for creating, but fails with EEXIST if any layer contains the path. */
+#define VROOT_UNION_OP_CREATE_EXCL	3
+
+/* Modifying a path uses the top layer, failing with EROFS if only a lower
+ * layer contains the path.
+ */
+#define VROOT_UNION_OP_MODIFY		4
+
+/* The top layer path is used as is, e.g. for vroot_union_unlink(). */
+#define VROOT_UNION_OP_TOP		5
+
+/* Removes the given path, within the top layer of a union, adding whiteouts
+ * for any entries of the lower layers.
+ */
+int vroot_union_unlink(const char *path);
+int vroot_union_rmdir(const char *path);
+int vroot_union_mkdir(const char *path, mode_t mode);
+
+/* Hides any lower layer entries for the given path, once removed from the
+ * top layer, e.g. as the source of a rename.  Returns 1 if a whiteout was
+ * created.
+ */
+int vroot_union_whiteout(const char *path);
+
+/* Merges the listings of the lower layers into the listing of the given
+ * directory, which is read by the caller.  Returns NULL, with errno set to
+ * ENOENT, if the directory is not within a union.
+ */
+struct vroot_union_dir *vroot_union_opendir(const char *path);
+
+/* Returns TRUE if the given entry, read by the caller, is to be listed. */
+int vroot_union_filter(struct vroot_union_dir *ud, const char *name);
+
+/* Returns the next entry of the lower layers not yet listed, or NULL at the
+ * end of the listing.
+ */
+struct dirent *vroot_union_readdir(struct vroot_union_dir *ud);
+
+int vroot_union_closedir(struct vroot_union_dir *ud);
+
+/* Internal use only. */
+int vroot_union_free(void);
+
+#endif /* MOD_VROOT_UNION_H */
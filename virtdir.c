@@ -0,0 +1,348 @@
+/*
+ * ProFTPD - mod_vroot Virtual Directory implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "virtdir.h"
+
+#define VIRTDIR_STATE_UNKNOWN		0
+#define VIRTDIR_STATE_ABSENT		1
+#define VIRTDIR_STATE_PRESENT		2
+
+struct virtdir {
+  const char *path;
+  int state;
+
+  /* Synthesized, but stable, inode number. */
+  ino_t ino;
+};
+
+static pool *virtdir_pool = NULL;
+static pr_table_t *virtdirs = NULL;
+static unsigned int virtdir_count = 0;
+
+/* The virtual directories are as old as the session which registered them. */
+static time_t virtdir_mtime = 0;
+
+static const char *trace_channel = "vroot.virtdir";
+
+static struct virtdir *virtdir_get(const char *path) {
+  if (virtdirs == NULL) {
+    return NULL;
+  }
+
+  return (struct virtdir *) pr_table_get(virtdirs, path, NULL);
+}
+
+static ino_t virtdir_ino(const char *path) {
+  unsigned long h = 5381;
+
+  while (*path != '\0') {
+    h = ((h << 5) + h) + (unsigned char) *path++;
+  }
+
+  return (ino_t) h;
+}
+
+/* Returns the length of the parent directory of the first len bytes of the
+ * given path; the parent of a top-level directory is "/".
+ */
+static size_t parent_len(const char *path, size_t len) {
+  while (len > 0 &&
+         path[len-1] != '/') {
+    len--;
+  }
+
+  if (len > 1) {
+    len--;
+  }
+
+  return len;
+}
+
+int vroot_virtdir_add(const char *path, const char *top_path) {
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+  size_t len, top_len;
+
+  if (path == NULL ||
+      top_path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  top_len = strlen(top_path);
+  if (top_len <= 1 ||
+      strncmp(path, top_path, top_len) != 0 ||
+      (path[top_len] != '\0' && path[top_len] != '/')) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  len = strlen(path);
+  if (len >= sizeof(buf)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  if (virtdir_pool == NULL) {
+    virtdir_pool = make_sub_pool(session.pool);
+    pr_pool_tag(virtdir_pool, "VRoot Virtual Directory Pool");
+
+    virtdirs = pr_table_alloc(virtdir_pool, 0);
+    virtdir_mtime = time(NULL);
+  }
+
+  memcpy(buf, path, len + 1);
+
+  for (;;) {
+    buf[len] = '\0';
+
+    if (virtdir_get(buf) == NULL) {
+      struct virtdir *vd;
+
+      vd = pcalloc(virtdir_pool, sizeof(struct virtdir));
+      vd->path = pstrdup(virtdir_pool, buf);
+      vd->state = VIRTDIR_STATE_UNKNOWN;
+      vd->ino = virtdir_ino(buf);
+
+      if (pr_table_add(virtdirs, vd->path, vd, sizeof(struct virtdir *)) < 0) {
+        return -1;
+      }
+
+      virtdir_count++;
+      pr_trace_msg(trace_channel, 17, "added virtual directory '%s'", buf);
+    }
+
+    if (len <= top_len) {
+      break;
+    }
+
+    len = parent_len(buf, len);
+  }
+
+  return 0;
+}
+
+unsigned int vroot_virtdir_count(void) {
+  return virtdir_count;
+}
+
+int vroot_virtdir_stat(const char *path, struct stat *st) {
+  struct virtdir *vd;
+
+  if (path == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  vd = virtdir_get(path);
+  if (vd == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (vd->state == VIRTDIR_STATE_UNKNOWN) {
+    struct stat real_st;
+
+    if (lstat(path, &real_st) == 0) {
+      vd->state = VIRTDIR_STATE_PRESENT;
+
+    } else if (errno == ENOENT) {
+      pr_trace_msg(trace_channel, 15,
+        "virtual directory '%s' does not exist, using synthesized attributes",
+        path);
+      vd->state = VIRTDIR_STATE_ABSENT;
+    }
+  }
+
+  if (vd->state != VIRTDIR_STATE_ABSENT) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  memset(st, 0, sizeof(struct stat));
+  st->st_mode = S_IFDIR|0755;
+  st->st_nlink = 2;
+  st->st_ino = vd->ino;
+  st->st_uid = session.uid;
+  st->st_gid = session.gid;
+  st->st_atime = st->st_mtime = st->st_ctime = virtdir_mtime;
+
+  return 0;
+}
+
+int vroot_virtdir_materialize(const char *path) {
+  char dir_path[PR_TUNABLE_PATH_MAX + 1], name[PR_TUNABLE_PATH_MAX + 1];
+  char *ptr;
+  size_t dir_len, start_len;
+  struct virtdir *vd;
+  int fd, flags, xerrno;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (virtdirs == NULL) {
+    return 0;
+  }
+
+  /* Only an entry created directly within a virtual directory, which is
+   * (or may be) missing, requires any work.
+   */
+  sstrncpy(dir_path, path, sizeof(dir_path));
+  ptr = strrchr(dir_path, '/');
+  if (ptr == NULL ||
+      ptr == dir_path) {
+    return 0;
+  }
+
+  *ptr = '\0';
+  dir_len = ptr - dir_path;
+
+  vd = virtdir_get(dir_path);
+  if (vd == NULL ||
+      vd->state == VIRTDIR_STATE_PRESENT) {
+    return 0;
+  }
+
+  /* Find the nearest parent which is not a missing virtual directory. */
+  start_len = dir_len;
+  while (start_len > 1) {
+    start_len = parent_len(dir_path, start_len);
+
+    memcpy(name, dir_path, start_len);
+    name[start_len] = '\0';
+
+    vd = virtdir_get(name);
+    if (vd == NULL ||
+        vd->state == VIRTDIR_STATE_PRESENT) {
+      break;
+    }
+  }
+
+  memcpy(name, dir_path, start_len);
+  name[start_len] = '\0';
+
+  flags = O_RDONLY;
+#if defined(O_DIRECTORY)
+  flags |= O_DIRECTORY;
+#endif /* O_DIRECTORY */
+
+  fd = open(name, flags);
+  if (fd < 0) {
+    return -1;
+  }
+
+  /* Existing names are not followed if they are symlinks; the virtual
+   * directories are only ever created as real directories.
+   */
+#if defined(O_NOFOLLOW)
+  flags |= O_NOFOLLOW;
+#endif /* O_NOFOLLOW */
+
+  ptr = dir_path + start_len;
+  while (*ptr != '\0') {
+    char *end;
+    int next_fd;
+
+    while (*ptr == '/') {
+      ptr++;
+    }
+
+    end = strchr(ptr, '/');
+    if (end == NULL) {
+      end = dir_path + dir_len;
+    }
+
+    memcpy(name, ptr, end - ptr);
+    name[end - ptr] = '\0';
+
+    if (mkdirat(fd, name, 0777) == 0) {
+      pr_trace_msg(trace_channel, 9, "created virtual directory '%.*s'",
+        (int) (end - dir_path), dir_path);
+
+    } else if (errno != EEXIST) {
+      xerrno = errno;
+
+      (void) close(fd);
+      errno = xerrno;
+      return -1;
+    }
+
+    next_fd = openat(fd, name, flags);
+    xerrno = errno;
+    (void) close(fd);
+
+    if (next_fd < 0) {
+      errno = xerrno;
+      return -1;
+    }
+
+    fd = next_fd;
+
+    memcpy(name, dir_path, end - dir_path);
+    name[end - dir_path] = '\0';
+
+    vd = virtdir_get(name);
+    if (vd != NULL) {
+      vd->state = VIRTDIR_STATE_PRESENT;
+    }
+
+    ptr = end;
+  }
+
+  (void) close(fd);
+  return 0;
+}
+
+int vroot_virtdir_forget(const char *path) {
+  struct virtdir *vd;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  vd = virtdir_get(path);
+  if (vd == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  vd->state = VIRTDIR_STATE_UNKNOWN;
+  return 0;
+}
+
+int vroot_virtdir_free(void) {
+  if (virtdir_pool != NULL) {
+    destroy_pool(virtdir_pool);
+    virtdir_pool = NULL;
+  }
+
+  virtdirs = NULL;
+  virtdir_count = 0;
+  virtdir_mtime = 0;
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * ProFTPD - mod_vroot Virtual Directory API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_VIRTDIR_H
+#define MOD_VROOT_VIRTDIR_H
+
+#include "mod_vroot.h"
+
+/* Registers the given real path, and each of its parent directories up to
+ * and including the given top directory, as virtual directories: should
+ * they not exist, they are listed as empty directories, with synthesized
+ * attributes, rather than failing.
+ */
+int vroot_virtdir_add(const char *path, const char *top_path);
+
+/* Returns the number of registered virtual directories. */
+unsigned int vroot_virtdir_count(void);
+
+/* Provides the synthesized attributes for the given real path, if it is a
+ * virtual directory which does not exist.  Otherwise, fails with ENOENT.
+ * Each virtual directory is only looked for on disk once.
+ */
+int vroot_virtdir_stat(const char *path, struct stat *st);
+
+/* Creates the virtual directories, if any, in which the given real path is
+ * about to be created, using mkdirat(2) from the nearest existing directory.
+ */
+int vroot_virtdir_materialize(const char *path);
+
+/* Notes that the given real path has been created, or removed, by this
+ * session, so that it is looked for on disk again.
+ */
+int vroot_virtdir_forget(const char *path);
+
+/* Internal use only. */
+int vroot_virtdir_free(void);
+
+#endif /* MOD_VROOT_VIRTDIR_H */
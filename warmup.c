@@ -0,0 +1,454 @@
+/*
+ * ProFTPD - mod_vroot Warm-up implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "warmup.h"
+
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+/* Number of recently used directories kept in the history. */
+#define VROOT_WARMUP_MAX_HISTORY	16
+
+static pool *warmup_pool = NULL;
+static array_header *warmup_history = NULL;
+
+static const char *trace_channel = "vroot.warmup";
+
+#ifdef HAVE_PTHREAD_H
+
+/* As with the prefetch helpers, the warm-up thread only ever issues system
+ * calls, and uses memory obtained from malloc(3).
+ */
+struct warmup_state {
+  char **paths;
+  unsigned int npaths;
+
+  unsigned int max_millis;
+  unsigned int max_entries;
+  unsigned int nentries;
+
+  pthread_mutex_t mutex;
+  int shutdown;
+};
+
+static struct warmup_state *warmup_state = NULL;
+static pthread_t warmup_thread;
+
+static unsigned long warmup_elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec - start->tv_sec) * 1000UL) +
+    ((now.tv_nsec - start->tv_nsec) / 1000000L);
+}
+
+static int warmup_done(struct warmup_state *ws, const struct timespec *start) {
+  int shutdown;
+
+  pthread_mutex_lock(&(ws->mutex));
+  shutdown = ws->shutdown;
+  pthread_mutex_unlock(&(ws->mutex));
+
+  if (shutdown == TRUE ||
+      ws->nentries >= ws->max_entries ||
+      warmup_elapsed(start) >= ws->max_millis) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void warmup_path(struct warmup_state *ws, const char *path,
+    const struct timespec *start) {
+  int fd;
+  DIR *dirh;
+  struct dirent *dent;
+  struct stat st;
+
+  ws->nentries++;
+  if (lstat(path, &st) < 0 ||
+      !S_ISDIR(st.st_mode)) {
+    return;
+  }
+
+  fd = open(path, O_RDONLY|O_DIRECTORY);
+  if (fd < 0) {
+    return;
+  }
+
+  dirh = fdopendir(fd);
+  if (dirh == NULL) {
+    (void) close(fd);
+    return;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    if (warmup_done(ws, start) == TRUE) {
+      break;
+    }
+
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+    ws->nentries++;
+    (void) fstatat(fd, dent->d_name, &st, AT_SYMLINK_NOFOLLOW);
+  }
+
+  (void) closedir(dirh);
+}
+
+static void *warmup_run(void *arg) {
+  register unsigned int i;
+  struct warmup_state *ws;
+  struct timespec start;
+
+  ws = arg;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (i = 0; i < ws->npaths; i++) {
+    if (warmup_done(ws, &start) == TRUE) {
+      break;
+    }
+
+    warmup_path(ws, ws->paths[i], &start);
+  }
+
+  return NULL;
+}
+
+static void warmup_destroy(struct warmup_state *ws) {
+  register unsigned int i;
+
+  for (i = 0; i < ws->npaths; i++) {
+    free(ws->paths[i]);
+  }
+
+  free(ws->paths);
+  pthread_mutex_destroy(&(ws->mutex));
+  free(ws);
+}
+
+int vroot_warmup_start(const array_header *paths, unsigned int max_millis,
+    unsigned int max_entries) {
+  register unsigned int i;
+  struct warmup_state *ws;
+  sigset_t all_sigs, orig_sigs;
+  int xerrno;
+
+  if (paths == NULL ||
+      max_millis == 0 ||
+      max_entries == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (warmup_state != NULL) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  ws = calloc(1, sizeof(struct warmup_state));
+  if (ws == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  ws->paths = calloc(paths->nelts + 1, sizeof(char *));
+  if (ws->paths == NULL) {
+    free(ws);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  pthread_mutex_init(&(ws->mutex), NULL);
+  ws->max_millis = max_millis;
+  ws->max_entries = max_entries;
+
+  for (i = 0; i < paths->nelts; i++) {
+    char *path;
+
+    path = strdup(((char **) paths->elts)[i]);
+    if (path == NULL) {
+      warmup_destroy(ws);
+      errno = ENOMEM;
+      return -1;
+    }
+
+    ws->paths[ws->npaths++] = path;
+  }
+
+  /* Make sure that signals are only ever delivered to the session thread. */
+  sigfillset(&all_sigs);
+  pthread_sigmask(SIG_SETMASK, &all_sigs, &orig_sigs);
+  xerrno = pthread_create(&warmup_thread, NULL, warmup_run, ws);
+  pthread_sigmask(SIG_SETMASK, &orig_sigs, NULL);
+
+  if (xerrno != 0) {
+    pr_trace_msg(trace_channel, 3, "error creating warm-up thread: %s",
+      strerror(xerrno));
+    warmup_destroy(ws);
+    errno = xerrno;
+    return -1;
+  }
+
+  warmup_state = ws;
+
+  pr_trace_msg(trace_channel, 15,
+    "warming up %u %s (max %u ms, %u entries)", ws->npaths,
+    ws->npaths != 1 ? "paths" : "path", max_millis, max_entries);
+  return 0;
+}
+
+int vroot_warmup_wait(void) {
+  int nentries;
+
+  if (warmup_state == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pthread_join(warmup_thread, NULL);
+  nentries = (int) warmup_state->nentries;
+
+  pr_trace_msg(trace_channel, 15, "warm-up looked up %d %s", nentries,
+    nentries != 1 ? "entries" : "entry");
+
+  warmup_destroy(warmup_state);
+  warmup_state = NULL;
+
+  return nentries;
+}
+
+static void warmup_stop(void) {
+  if (warmup_state == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&(warmup_state->mutex));
+  warmup_state->shutdown = TRUE;
+  pthread_mutex_unlock(&(warmup_state->mutex));
+
+  (void) vroot_warmup_wait();
+}
+
+#else
+
+int vroot_warmup_start(const array_header *paths, unsigned int max_millis,
+    unsigned int max_entries) {
+  pr_trace_msg(trace_channel, 9, "unable to warm up: threads not supported");
+  errno = ENOSYS;
+  return -1;
+}
+
+int vroot_warmup_wait(void) {
+  errno = ENOENT;
+  return -1;
+}
+
+static void warmup_stop(void) {
+}
+#endif /* HAVE_PTHREAD_H */
+
+int vroot_warmup_history_add(const char *path) {
+  register unsigned int i;
+  char **elts;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (warmup_pool == NULL) {
+    warmup_pool = make_sub_pool(session.pool);
+    pr_pool_tag(warmup_pool, "VRoot Warm-up Pool");
+
+    warmup_history = make_array(warmup_pool, VROOT_WARMUP_MAX_HISTORY,
+      sizeof(char *));
+  }
+
+  /* Keep the most recently used directory first. */
+  elts = warmup_history->elts;
+  for (i = 0; i < warmup_history->nelts; i++) {
+    if (strcmp(elts[i], path) == 0) {
+      break;
+    }
+  }
+
+  if (i == warmup_history->nelts) {
+    if (warmup_history->nelts < VROOT_WARMUP_MAX_HISTORY) {
+      (void) push_array(warmup_history);
+      elts = warmup_history->elts;
+
+    } else {
+      i--;
+    }
+
+    elts[i] = pstrdup(warmup_pool, path);
+  }
+
+  if (i > 0) {
+    char *elt;
+
+    elt = elts[i];
+    memmove(&(elts[1]), &(elts[0]), i * sizeof(char *));
+    elts[0] = elt;
+  }
+
+  return 0;
+}
+
+array_header *vroot_warmup_history_read(pool *p, const char *path) {
+  FILE *fh;
+  char buf[PR_TUNABLE_PATH_MAX + 2];
+  array_header *paths;
+  int xerrno;
+
+  if (p == NULL ||
+      path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  fh = fopen(path, "r");
+  if (fh == NULL) {
+    xerrno = errno;
+    pr_trace_msg(trace_channel, 9, "unable to read history '%s': %s", path,
+      strerror(xerrno));
+    errno = xerrno;
+    return NULL;
+  }
+
+  paths = make_array(p, VROOT_WARMUP_MAX_HISTORY, sizeof(char *));
+
+  while (paths->nelts < VROOT_WARMUP_MAX_HISTORY &&
+         fgets(buf, sizeof(buf), fh) != NULL) {
+    size_t buflen;
+
+    buflen = strlen(buf);
+    if (buflen > 0 &&
+        buf[buflen-1] == '\n') {
+      buf[--buflen] = '\0';
+    }
+
+    /* Ignore anything but absolute (virtual) paths. */
+    if (buflen == 0 ||
+        buf[0] != '/') {
+      continue;
+    }
+
+    *((char **) push_array(paths)) = pstrdup(p, buf);
+  }
+
+  (void) fclose(fh);
+
+  /* Note the directories in reverse, so that the history keeps its order. */
+  if (paths->nelts > 0) {
+    register int i;
+
+    for (i = paths->nelts - 1; i >= 0; i--) {
+      (void) vroot_warmup_history_add(((char **) paths->elts)[i]);
+    }
+  }
+
+  return paths;
+}
+
+int vroot_warmup_history_write(const char *path) {
+  register unsigned int i;
+  char tmp_path[PR_TUNABLE_PATH_MAX + 1];
+  int fd, res = 0, xerrno = 0;
+  FILE *fh;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (warmup_history == NULL ||
+      warmup_history->nelts == 0) {
+    return 0;
+  }
+
+  /* Write the new history alongside the old, then rename it into place, so
+   * that concurrent sessions of the same user never see a partial history.
+   */
+  snprintf(tmp_path, sizeof(tmp_path)-1, "%s.%lu", path,
+    (unsigned long) getpid());
+
+  fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW, 0600);
+  if (fd < 0) {
+    return -1;
+  }
+
+  fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    xerrno = errno;
+    (void) close(fd);
+    (void) unlink(tmp_path);
+    errno = xerrno;
+    return -1;
+  }
+
+  for (i = 0; i < warmup_history->nelts; i++) {
+    if (fprintf(fh, "%s\n", ((char **) warmup_history->elts)[i]) < 0) {
+      res = -1;
+      xerrno = errno;
+      break;
+    }
+  }
+
+  if (fclose(fh) != 0 &&
+      res == 0) {
+    res = -1;
+    xerrno = errno;
+  }
+
+  if (res == 0) {
+    res = rename(tmp_path, path);
+    xerrno = errno;
+  }
+
+  if (res < 0) {
+    (void) unlink(tmp_path);
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+int vroot_warmup_free(void) {
+  warmup_stop();
+
+  if (warmup_pool != NULL) {
+    destroy_pool(warmup_pool);
+    warmup_pool = NULL;
+    warmup_history = NULL;
+  }
+
+  return 0;
+}
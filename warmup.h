@@ -0,0 +1,65 @@
+/*
+ * ProFTPD - mod_vroot Warm-up API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_WARMUP_H
+#define MOD_VROOT_WARMUP_H
+
+#include "mod_vroot.h"
+
+#define VROOT_WARMUP_DEFAULT_MAX_MILLIS		2000
+#define VROOT_WARMUP_DEFAULT_MAX_ENTRIES	10000
+#define VROOT_WARMUP_MAX_PARAM			1000000
+
+/* Starts warming up the kernel caches for the given real paths (and, for
+ * directories, their entries) in a helper thread, without waiting for it.
+ * The helper stops after `max_millis` milliseconds, or after looking up
+ * `max_entries` entries, whichever comes first.
+ */
+int vroot_warmup_start(const array_header *paths, unsigned int max_millis,
+  unsigned int max_entries);
+
+/* Waits for the helper thread to finish, returning the number of entries
+ * looked up, or -1 with errno set to ENOENT if no warm-up was started.
+ */
+int vroot_warmup_wait(void);
+
+/* Notes that the given (virtual) directory was used, for the history of
+ * recently used directories.
+ */
+int vroot_warmup_history_add(const char *path);
+
+/* Reads the history of recently used directories from the given file,
+ * returning its (virtual) directories, most recently used first.  These are
+ * also noted as used, so that the next vroot_warmup_history_write() keeps
+ * them.
+ */
+array_header *vroot_warmup_history_read(pool *p, const char *path);
+
+/* Writes the history of recently used directories to the given file. */
+int vroot_warmup_history_write(const char *path);
+
+/* Internal use only. */
+int vroot_warmup_free(void);
+
+#endif /* MOD_VROOT_WARMUP_H */
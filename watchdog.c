@@ -0,0 +1,683 @@
+/*
+ * ProFTPD - mod_vroot Watchdog implementation
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "watchdog.h"
+
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+static const char *trace_channel = "vroot.watchdog";
+
+#ifdef HAVE_PTHREAD_H
+
+/* Robust mutexes let sessions recover the lock of the shared table from a
+ * session killed while holding it.
+ */
+#if defined(__linux__) && defined(EOWNERDEAD)
+# define VROOT_WATCHDOG_ROBUST	1
+#endif
+
+#define VROOT_WATCHDOG_MAX_SLOTS	64
+
+#define WATCHDOG_STATE_UP		0
+#define WATCHDOG_STATE_DOWN		1
+
+/* How long, in seconds, a slot must have gone unused by any session before
+ * it is reclaimed for another alias source.
+ */
+#define VROOT_WATCHDOG_SLOT_IDLE_SECS	300
+
+/* The state of an alias source, shared by all sessions using it.  Slots
+ * are only reused once no session has used them for a while, and no probe
+ * thread may still update them.
+ */
+struct watchdog_slot {
+  char path[PR_TUNABLE_PATH_MAX + 1];
+  int state;
+  int xerrno;
+
+  /* When the probe in flight (if any) started, and by which session; when
+   * the last probe completed; and until when an unavailable source is not
+   * probed again.
+   */
+  time_t probe_start;
+  pid_t probe_pid;
+  time_t probed_at;
+  time_t down_until;
+
+  /* When a session last used the slot. */
+  time_t used_at;
+
+  /* The last known attributes of the source. */
+  int have_st;
+  struct stat st;
+};
+
+struct watchdog_table {
+  pthread_mutex_t mutex;
+  unsigned int nslots;
+  struct watchdog_slot slots[VROOT_WATCHDOG_MAX_SLOTS];
+};
+
+/* The alias sources probed by this session. */
+struct watchdog_alias {
+  struct watchdog_slot *slot;
+  const char *path;
+  size_t pathlen;
+  int logged_state;
+};
+
+/* As with the other helper threads, the watchdog and probe threads only
+ * ever issue system calls, and use memory obtained from malloc(3).
+ */
+struct watchdog_probe {
+  struct watchdog_slot *slot;
+  char *path;
+  time_t start;
+  unsigned int cooldown;
+};
+
+static struct watchdog_table *watchdog_table = NULL;
+static struct watchdog_alias *watchdog_aliases = NULL;
+static unsigned int watchdog_naliases = 0;
+
+static unsigned int watchdog_interval = 0;
+static unsigned int watchdog_timeout = 0;
+static unsigned int watchdog_cooldown = 0;
+
+static pthread_t watchdog_thread;
+static pthread_mutex_t watchdog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_cond = PTHREAD_COND_INITIALIZER;
+static int watchdog_running = FALSE;
+static int watchdog_shutdown = FALSE;
+
+static time_t watchdog_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static void table_lock(void) {
+  int res;
+
+  res = pthread_mutex_lock(&(watchdog_table->mutex));
+#if defined(VROOT_WATCHDOG_ROBUST)
+  if (res == EOWNERDEAD) {
+    /* The table is only ever updated field by field; it is still usable. */
+    pthread_mutex_consistent(&(watchdog_table->mutex));
+  }
+#else
+  (void) res;
+#endif /* VROOT_WATCHDOG_ROBUST */
+}
+
+static void table_unlock(void) {
+  pthread_mutex_unlock(&(watchdog_table->mutex));
+}
+
+int vroot_watchdog_init(void) {
+  struct watchdog_table *table;
+  pthread_mutexattr_t attr;
+  void *ptr;
+  int xerrno;
+
+  if (watchdog_table != NULL) {
+    return 0;
+  }
+
+  ptr = mmap(NULL, sizeof(struct watchdog_table), PROT_READ|PROT_WRITE,
+    MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return -1;
+  }
+
+  table = ptr;
+
+  pthread_mutexattr_init(&attr);
+  xerrno = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  if (xerrno != 0) {
+    pthread_mutexattr_destroy(&attr);
+    (void) munmap(ptr, sizeof(struct watchdog_table));
+    errno = xerrno;
+    return -1;
+  }
+
+#if defined(VROOT_WATCHDOG_ROBUST)
+  (void) pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif /* VROOT_WATCHDOG_ROBUST */
+
+  pthread_mutex_init(&(table->mutex), &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  watchdog_table = table;
+  return 0;
+}
+
+static void *watchdog_probe_run(void *arg) {
+  struct watchdog_probe *probe;
+  struct watchdog_slot *slot;
+  struct statvfs fs;
+  struct stat st;
+  int res, xerrno = 0;
+  time_t now;
+
+  probe = arg;
+
+  /* statvfs(2) is not answered from the attribute caches of network
+   * filesystems, making it a better probe of the server than stat(2).
+   */
+  res = statvfs(probe->path, &fs);
+  if (res == 0) {
+    res = stat(probe->path, &st);
+  }
+
+  if (res < 0) {
+    xerrno = errno;
+  }
+
+  now = watchdog_now();
+  slot = probe->slot;
+
+  table_lock();
+
+  /* Another session may have taken over from an abandoned probe. */
+  if (slot->probe_start == probe->start) {
+    slot->probe_start = 0;
+  }
+
+  slot->probed_at = now;
+
+  if (res == 0 ||
+      xerrno == ENOENT ||
+      xerrno == ENOTDIR ||
+      xerrno == EACCES) {
+    /* The source answered; any error is reported when it is used. */
+    if (res == 0) {
+      memcpy(&(slot->st), &st, sizeof(struct stat));
+      slot->have_st = TRUE;
+    }
+
+    if (slot->state == WATCHDOG_STATE_DOWN &&
+        now >= slot->down_until) {
+      slot->state = WATCHDOG_STATE_UP;
+      slot->xerrno = 0;
+    }
+
+  } else {
+    slot->state = WATCHDOG_STATE_DOWN;
+    slot->xerrno = xerrno;
+    slot->down_until = now + probe->cooldown;
+  }
+
+  table_unlock();
+
+  free(probe->path);
+  free(probe);
+  return NULL;
+}
+
+static void watchdog_probe(struct watchdog_slot *slot, time_t now) {
+  struct watchdog_probe *probe;
+  pthread_attr_t attr;
+  pthread_t thread;
+
+  probe = calloc(1, sizeof(struct watchdog_probe));
+  if (probe == NULL) {
+    return;
+  }
+
+  probe->path = strdup(slot->path);
+  if (probe->path == NULL) {
+    free(probe);
+    return;
+  }
+
+  probe->slot = slot;
+  probe->start = now;
+  probe->cooldown = watchdog_cooldown;
+
+  /* A probe of a hung source may never return, thus it is never joined. */
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  if (pthread_create(&thread, &attr, watchdog_probe_run, probe) != 0) {
+    free(probe->path);
+    free(probe);
+
+  } else {
+    slot->probe_start = now;
+    slot->probe_pid = getpid();
+  }
+
+  pthread_attr_destroy(&attr);
+}
+
+static void watchdog_tick(void) {
+  register unsigned int i;
+  time_t now;
+
+  now = watchdog_now();
+
+  table_lock();
+
+  for (i = 0; i < watchdog_naliases; i++) {
+    struct watchdog_slot *slot;
+
+    slot = watchdog_aliases[i].slot;
+    slot->used_at = now;
+
+    if (slot->probe_start > 0) {
+      if (now - slot->probe_start >= (time_t) watchdog_timeout &&
+          slot->state == WATCHDOG_STATE_UP) {
+        slot->state = WATCHDOG_STATE_DOWN;
+        slot->xerrno = ETIMEDOUT;
+        slot->down_until = now + watchdog_cooldown;
+      }
+
+      /* Wait for the probe in flight, however long it takes, unless the
+       * session which started it has gone away; this keeps at most one
+       * probe thread stuck on a hung source.
+       */
+      if (slot->probe_pid == getpid() ||
+          kill(slot->probe_pid, 0) == 0 ||
+          errno != ESRCH) {
+        continue;
+      }
+    }
+
+    if (slot->state == WATCHDOG_STATE_DOWN) {
+      if (now < slot->down_until) {
+        continue;
+      }
+
+    } else if (slot->probed_at > 0 &&
+               now - slot->probed_at < (time_t) watchdog_interval) {
+      /* Recently probed, possibly by another session. */
+      continue;
+    }
+
+    watchdog_probe(slot, now);
+  }
+
+  table_unlock();
+}
+
+static void *watchdog_run(void *arg) {
+  pthread_mutex_lock(&watchdog_mutex);
+
+  while (watchdog_shutdown == FALSE) {
+    struct timespec ts;
+
+    pthread_mutex_unlock(&watchdog_mutex);
+    watchdog_tick();
+    pthread_mutex_lock(&watchdog_mutex);
+
+    if (watchdog_shutdown == TRUE) {
+      break;
+    }
+
+    /* Timeouts are detected with a granularity of one second. */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 1;
+    (void) pthread_cond_timedwait(&watchdog_cond, &watchdog_mutex, &ts);
+  }
+
+  pthread_mutex_unlock(&watchdog_mutex);
+  return NULL;
+}
+
+/* A slot can be reclaimed once no session has used it for a while, and any
+ * probe in flight belongs to a session which has gone away (taking the probe
+ * thread with it).
+ */
+static int slot_is_idle(struct watchdog_slot *slot, time_t now) {
+  if (now - slot->used_at < VROOT_WATCHDOG_SLOT_IDLE_SECS) {
+    return FALSE;
+  }
+
+  if (slot->probe_start > 0 &&
+      (slot->probe_pid == getpid() ||
+       kill(slot->probe_pid, 0) == 0 ||
+       errno != ESRCH)) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static struct watchdog_slot *table_get_slot(const char *path) {
+  register unsigned int i;
+  struct watchdog_slot *slot = NULL;
+  time_t now;
+
+  now = watchdog_now();
+
+  for (i = 0; i < watchdog_table->nslots; i++) {
+    if (strcmp(watchdog_table->slots[i].path, path) == 0) {
+      slot = &(watchdog_table->slots[i]);
+      slot->used_at = now;
+      return slot;
+    }
+  }
+
+  if (watchdog_table->nslots < VROOT_WATCHDOG_MAX_SLOTS) {
+    slot = &(watchdog_table->slots[watchdog_table->nslots++]);
+
+  } else {
+    for (i = 0; i < watchdog_table->nslots; i++) {
+      if (slot_is_idle(&(watchdog_table->slots[i]), now) == TRUE) {
+        slot = &(watchdog_table->slots[i]);
+        pr_trace_msg(trace_channel, 9,
+          "reclaiming idle slot of alias source '%s' for '%s'", slot->path,
+          path);
+        break;
+      }
+    }
+
+    if (slot == NULL) {
+      return NULL;
+    }
+  }
+
+  memset(slot, 0, sizeof(struct watchdog_slot));
+  sstrncpy(slot->path, path, sizeof(slot->path));
+  slot->state = WATCHDOG_STATE_UP;
+  slot->used_at = now;
+
+  return slot;
+}
+
+int vroot_watchdog_start(const array_header *paths, unsigned int interval,
+    unsigned int timeout, unsigned int cooldown) {
+  register unsigned int i;
+  sigset_t all_sigs, orig_sigs;
+  int xerrno;
+
+  if (paths == NULL ||
+      interval == 0 ||
+      timeout == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (watchdog_running == TRUE) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  if (watchdog_table == NULL) {
+    pr_trace_msg(trace_channel, 9,
+      "no shared watchdog table, using one for this session only");
+
+    if (vroot_watchdog_init() < 0) {
+      return -1;
+    }
+  }
+
+  watchdog_aliases = calloc(paths->nelts + 1, sizeof(struct watchdog_alias));
+  if (watchdog_aliases == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  table_lock();
+
+  for (i = 0; i < paths->nelts; i++) {
+    const char *path;
+    struct watchdog_slot *slot;
+    struct watchdog_alias *alias;
+
+    path = ((char **) paths->elts)[i];
+
+    slot = table_get_slot(path);
+    if (slot == NULL) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "too many alias sources in use (max %u), not probing '%s'",
+        (unsigned int) VROOT_WATCHDOG_MAX_SLOTS, path);
+      continue;
+    }
+
+    alias = &(watchdog_aliases[watchdog_naliases++]);
+    alias->slot = slot;
+    alias->path = slot->path;
+    alias->pathlen = strlen(slot->path);
+
+    /* Report sources already known to be unavailable. */
+    alias->logged_state = WATCHDOG_STATE_UP;
+  }
+
+  table_unlock();
+
+  if (watchdog_naliases == 0) {
+    free(watchdog_aliases);
+    watchdog_aliases = NULL;
+    return 0;
+  }
+
+  watchdog_interval = interval;
+  watchdog_timeout = timeout;
+  watchdog_cooldown = cooldown;
+  watchdog_shutdown = FALSE;
+
+  /* Make sure that signals are only ever delivered to the session thread;
+   * the probe threads inherit this mask.
+   */
+  sigfillset(&all_sigs);
+  pthread_sigmask(SIG_SETMASK, &all_sigs, &orig_sigs);
+  xerrno = pthread_create(&watchdog_thread, NULL, watchdog_run, NULL);
+  pthread_sigmask(SIG_SETMASK, &orig_sigs, NULL);
+
+  if (xerrno != 0) {
+    pr_trace_msg(trace_channel, 3, "error creating watchdog thread: %s",
+      strerror(xerrno));
+    free(watchdog_aliases);
+    watchdog_aliases = NULL;
+    watchdog_naliases = 0;
+
+    errno = xerrno;
+    return -1;
+  }
+
+  watchdog_running = TRUE;
+
+  pr_trace_msg(trace_channel, 15,
+    "probing %u alias %s every %u secs (timeout %u secs, cooldown %u secs)",
+    watchdog_naliases, watchdog_naliases != 1 ? "sources" : "source",
+    interval, timeout, cooldown);
+
+  vroot_watchdog_poll();
+  return 0;
+}
+
+int vroot_watchdog_check(const char *path) {
+  register unsigned int i;
+  int down = FALSE;
+
+  if (watchdog_naliases == 0 ||
+      path == NULL) {
+    return 0;
+  }
+
+  for (i = 0; i < watchdog_naliases; i++) {
+    struct watchdog_alias *alias;
+
+    alias = &(watchdog_aliases[i]);
+
+    if (strncmp(path, alias->path, alias->pathlen) != 0 ||
+        (path[alias->pathlen] != '\0' &&
+         path[alias->pathlen] != '/')) {
+      continue;
+    }
+
+    table_lock();
+    if (alias->slot->state == WATCHDOG_STATE_DOWN) {
+      down = TRUE;
+    }
+    table_unlock();
+
+    if (down == TRUE) {
+      break;
+    }
+  }
+
+  if (down == TRUE) {
+    vroot_watchdog_poll();
+
+    pr_trace_msg(trace_channel, 17,
+      "failing fast for '%s': alias source '%s' unavailable", path,
+      watchdog_aliases[i].path);
+    errno = ETIMEDOUT;
+    return -1;
+  }
+
+  return 0;
+}
+
+int vroot_watchdog_get_stat(const char *path, struct stat *st) {
+  register unsigned int i;
+  int res = -1;
+
+  if (path == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (i = 0; i < watchdog_naliases; i++) {
+    struct watchdog_alias *alias;
+
+    alias = &(watchdog_aliases[i]);
+    if (strcmp(path, alias->path) != 0) {
+      continue;
+    }
+
+    table_lock();
+    if (alias->slot->have_st == TRUE) {
+      memcpy(st, &(alias->slot->st), sizeof(struct stat));
+      res = 0;
+    }
+    table_unlock();
+
+    break;
+  }
+
+  if (res < 0) {
+    errno = ENOENT;
+  }
+
+  return res;
+}
+
+void vroot_watchdog_poll(void) {
+  register unsigned int i;
+
+  for (i = 0; i < watchdog_naliases; i++) {
+    struct watchdog_alias *alias;
+    int state, xerrno;
+
+    alias = &(watchdog_aliases[i]);
+
+    table_lock();
+    state = alias->slot->state;
+    xerrno = alias->slot->xerrno;
+    table_unlock();
+
+    if (state == alias->logged_state) {
+      continue;
+    }
+
+    if (state == WATCHDOG_STATE_DOWN) {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "alias source '%s' is unavailable (%s), failing fast for at least "
+        "%u secs", alias->path, strerror(xerrno), watchdog_cooldown);
+
+    } else {
+      (void) pr_log_writefile(vroot_logfd, MOD_VROOT_VERSION,
+        "alias source '%s' is available again", alias->path);
+    }
+
+    alias->logged_state = state;
+  }
+}
+
+int vroot_watchdog_free(void) {
+  if (watchdog_running == TRUE) {
+    pthread_mutex_lock(&watchdog_mutex);
+    watchdog_shutdown = TRUE;
+    pthread_cond_signal(&watchdog_cond);
+    pthread_mutex_unlock(&watchdog_mutex);
+
+    pthread_join(watchdog_thread, NULL);
+    watchdog_running = FALSE;
+  }
+
+  /* The table itself is kept, as probe threads stuck on a hung source may
+   * still update it.
+   */
+  free(watchdog_aliases);
+  watchdog_aliases = NULL;
+  watchdog_naliases = 0;
+
+  return 0;
+}
+
+#else
+
+int vroot_watchdog_init(void) {
+  return 0;
+}
+
+int vroot_watchdog_start(const array_header *paths, unsigned int interval,
+    unsigned int timeout, unsigned int cooldown) {
+  pr_trace_msg(trace_channel, 9,
+    "unable to probe alias sources: threads not supported");
+  errno = ENOSYS;
+  return -1;
+}
+
+int vroot_watchdog_check(const char *path) {
+  return 0;
+}
+
+int vroot_watchdog_get_stat(const char *path, struct stat *st) {
+  errno = ENOENT;
+  return -1;
+}
+
+void vroot_watchdog_poll(void) {
+}
+
+int vroot_watchdog_free(void) {
+  return 0;
+}
+#endif /* HAVE_PTHREAD_H */
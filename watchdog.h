@@ -0,0 +1,64 @@
+/*
+ * ProFTPD - mod_vroot Watchdog API
+ * Copyright (c) 2025 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#ifndef MOD_VROOT_WATCHDOG_H
+#define MOD_VROOT_WATCHDOG_H
+
+#include "mod_vroot.h"
+
+#define VROOT_WATCHDOG_DEFAULT_INTERVAL		10
+#define VROOT_WATCHDOG_DEFAULT_TIMEOUT		5
+#define VROOT_WATCHDOG_DEFAULT_COOLDOWN		60
+
+/* Creates the table of alias source states, shared by all sessions.  This
+ * is done by the daemon, before sessions are forked; sessions started
+ * without it use a table of their own.
+ */
+int vroot_watchdog_init(void);
+
+/* Starts probing the given alias source paths, every `interval` seconds, in
+ * a helper thread.  A source whose probe does not complete within `timeout`
+ * seconds, or fails, is considered unavailable for `cooldown` seconds.
+ */
+int vroot_watchdog_start(const array_header *paths, unsigned int interval,
+  unsigned int timeout, unsigned int cooldown);
+
+/* Checks whether the given real path, if within a probed alias source, is
+ * available.  Returns -1, with errno set to ETIMEDOUT, if not.
+ */
+int vroot_watchdog_check(const char *path);
+
+/* Provides the last known attributes of the given alias source path, for
+ * listing an unavailable alias.  Returns -1, with errno set to ENOENT, if
+ * there are none.
+ */
+int vroot_watchdog_get_stat(const char *path, struct stat *st);
+
+/* Logs any changes in the availability of the probed alias sources. */
+void vroot_watchdog_poll(void);
+
+/* Internal use only. */
+int vroot_watchdog_free(void);
+
+#endif /* MOD_VROOT_WATCHDOG_H */